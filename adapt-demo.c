@@ -0,0 +1,177 @@
+/**
+ * @file adapt-demo.c
+ * @brief 自适应加密的示例
+ * @details
+ *  在 L 形区域 [-1,1]² \ (0,1]×[-1,0) 上求解 Δu + 1 = 0, 边界上 u = 0.
+ *  原点处是 270° 的凹角, 解在那里像 r^(2/3) 一样奇异, 一致加密的误差只按
+ *  N^(-1/3) 下降. 分别用一致加密和自适应加密把误差估计降到 tol 以下,
+ *  误差估计可选残量型(residual, 缺省)或梯度恢复型(zz),
+ *  比较两者所需的单元个数和时间, 自适应网格写入 l-shape-adapt.eps,
+ *  网格和解写入 l-shape-adapt.vtu, 并检查 mesh_to_vtu_stream 写出的字节与之相同.
+ *  在这个问题上一致加密所需的单元个数只是自适应的 1.7 到 4.7 倍
+ *  (tol = 0.05 到 0.02, zz 的差距更大), 并没有数量级的差别
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "mesh.h"
+#include "mesh-to-eps.h"
+#include "mesh-to-vtu.h"
+#include "problem-spec.h"
+#include "estimator.h"
+#include "adapt.h"
+#include "timer.h"
+
+#define UNIFORM_MAX_ELEMENTS 4000000	/* 一致加密时的单元个数上限 */
+
+// L 形区域的顶点, 原点是凹角
+static struct problem_spec_point l_points[] = {
+    {0, -1.0, -1.0, FEM_BC_DIRICHLET},
+    {1,  0.0, -1.0, FEM_BC_DIRICHLET},
+    {2,  0.0,  0.0, FEM_BC_DIRICHLET},
+    {3,  1.0,  0.0, FEM_BC_DIRICHLET},
+    {4,  1.0,  1.0, FEM_BC_DIRICHLET},
+    {5, -1.0,  1.0, FEM_BC_DIRICHLET},
+};
+
+static struct problem_spec_segment l_segments[] = {
+    {0, 0, 1, FEM_BC_DIRICHLET},
+    {1, 1, 2, FEM_BC_DIRICHLET},
+    {2, 2, 3, FEM_BC_DIRICHLET},
+    {3, 3, 4, FEM_BC_DIRICHLET},
+    {4, 4, 5, FEM_BC_DIRICHLET},
+    {5, 5, 0, FEM_BC_DIRICHLET},
+};
+
+static double one(double x, double y)
+{
+    (void)x;
+    (void)y;
+    return 1.0;
+}
+
+static void estimate(int estimator, struct mesh *mesh,
+        struct problem_spec *spec, const double *u, double *eta)
+{
+    if (estimator == ADAPT_ESTIMATOR_ZZ)
+        estimate_zz(mesh, u, eta);
+    else
+        estimate_residual(mesh, spec, u, eta);
+}
+
+/* 把 mesh_to_vtu_stream 的输出写到临时文件, 与 mesh_to_vtu 写出的 file 逐字节比较 */
+static int check_vtu_stream(struct mesh *mesh, const char *file,
+        const struct vtu_field *fields, int field_num)
+{
+    FILE *fp = fopen(file, "rb"), *tmp = tmpfile();
+    int same = 0, c, d;
+
+    if (fp != NULL && tmp != NULL
+            && mesh_to_vtu_stream(tmp, mesh, VTU_NODE_BC | VTU_ELEMENT_AREA,
+                fields, field_num) == 0) {
+        rewind(tmp);
+        do {
+            c = getc(fp);
+            d = getc(tmp);
+        } while (c == d && c != EOF);
+        same = c == d;
+    }
+    if (fp != NULL)
+        fclose(fp);
+    if (tmp != NULL)
+        fclose(tmp);
+    return same;
+}
+
+static void show_usage(char *progname)
+{
+    printf("Usage: %s <tol> [residual|zz]\n", progname);
+    printf("  tol是误差估计的目标值\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    struct problem_spec spec;
+    struct mesh *mesh;
+    struct vtu_field solution;
+    double tol, est, t, a = 0.1;
+    double *u, *eta;
+    int uniform_elements = 0;
+    int estimator = ADAPT_ESTIMATOR_RESIDUAL;
+
+    if (argc != 2 && argc != 3)
+        show_usage(argv[0]);
+    if (argc == 3) {
+        if (strcmp(argv[2], "zz") == 0)
+            estimator = ADAPT_ESTIMATOR_ZZ;
+        else if (strcmp(argv[2], "residual") != 0)
+            show_usage(argv[0]);
+    }
+    tol = strtod(argv[1], NULL);
+    if (tol <= 0.0)
+        show_usage(argv[0]);
+
+    memset(&spec, 0, sizeof spec);
+    spec.points = l_points;
+    spec.num_points = sizeof l_points / sizeof l_points[0];
+    spec.segments = l_segments;
+    spec.num_segments = sizeof l_segments / sizeof l_segments[0];
+    spec.f = one;
+    printf("L 形区域\n");
+
+    printf("-----------------------------------\n");
+    printf("一致加密\n");
+    t = wall_time();
+    for (;;) {
+        if ((mesh = make_mesh(&spec, a)) == NULL)
+            return 1;
+        if ((u = fem_solve(mesh, &spec)) == NULL) {
+            fprintf(stderr, "a = %g: 刚度矩阵不正定\n", a);
+            free_mesh(mesh);
+            return 1;
+        }
+        make_vector(eta, mesh->element_num);
+        estimate(estimator, mesh, &spec, u, eta);
+        est = estimate_total(eta, mesh->element_num);
+        uniform_elements = mesh->element_num;
+        printf("a = %g: 单元个数 %d, 误差估计 %g\n", a, mesh->element_num, est);
+        free_vector(eta);
+        free_vector(u);
+        free_mesh(mesh);
+        if (est <= tol || uniform_elements > UNIFORM_MAX_ELEMENTS)
+            break;
+        a /= 2;
+    }
+    printf("一致加密耗时 %.3f 秒\n", wall_time() - t);
+
+    printf("-----------------------------------\n");
+    printf("自适应加密\n");
+    t = wall_time();
+    mesh = adapt_mesh(&spec, 0.1, tol, 60, estimator, &u, &est, stdout);
+    if (mesh == NULL)
+        return 1;
+    printf("自适应加密耗时 %.3f 秒\n", wall_time() - t);
+    printf("单元个数: 一致 %d, 自适应 %d (一致/自适应 = %.1f)\n",
+            uniform_elements, mesh->element_num,
+            (double)uniform_elements / mesh->element_num);
+    mesh_to_eps(mesh, "l-shape-adapt.eps");
+    solution.name = "u";
+    solution.location = VTU_POINT_DATA;
+    solution.components = 1;
+    solution.data = u;
+    mesh_to_vtu(mesh, "l-shape-adapt.vtu", VTU_NODE_BC | VTU_ELEMENT_AREA, &solution, 1);
+    if (!check_vtu_stream(mesh, "l-shape-adapt.vtu", &solution, 1)) {
+        fprintf(stderr, "mesh_to_vtu_stream 的输出与 l-shape-adapt.vtu 不同\n");
+        return 1;
+    }
+    printf("mesh_to_vtu_stream 的输出与 l-shape-adapt.vtu 相同\n");
+    free_vector(u);
+    free_mesh(mesh);
+
+    printf("-----------------------------------\n");
+    return 0;
+}
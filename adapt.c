@@ -0,0 +1,134 @@
+/**
+ * @file adapt.c
+ * @brief 误差估计驱动的自适应加密
+ * @details
+ *  用 Dörfler(bulk)标记: 每次只加密误差最大的一批单元, 它们的 η_K² 之和占
+ *  总和的 ADAPT_BULK, 面积上限缩小到 ADAPT_REFINE_FACTOR 倍, 其余单元不加限制.
+ *  每次加密的幅度有上限, 不会像按 tol 一步到位地分配面积那样在奇异点以外
+ *  过度加密; 凹角附近的单元误差最大, 会被反复选中.
+ *  新网格由 refine_mesh() 在上一次的网格上加密得到.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "fem.h"
+#include "cholesky.h"
+#include "estimator.h"
+#include "adapt.h"
+
+/**
+ * @name fem_solve - 组装并用稀疏 Cholesky 求解
+ * @return 有限元解(下标为 node_id), 由调用者释放; 矩阵非正定时返回 NULL
+*/
+double *fem_solve(struct mesh *mesh, struct problem_spec *spec)
+{
+	struct csr_matrix *A = fem_assemble_matrix(mesh, spec);
+	struct cholesky_symbolic *S = cholesky_analyze(A, mesh->nodes);
+	struct cholesky_factor *F = cholesky_factorize(S, A);
+	double *u;
+
+	make_vector(u, mesh->node_num);
+	fem_assemble_load(mesh, spec, u);
+	if (F != NULL)
+		cholesky_solve(F, u, 1);
+	else
+		free_vector(u);
+
+	free_cholesky_factor(F);
+	free_cholesky_symbolic(S);
+	free_csr_matrix(A);
+	return u;
+}
+
+struct marked{
+	double eta2;	/* η_K² */
+	int r;
+};
+
+static int cmp_marked(const void *p, const void *q)
+{
+	double a = ((const struct marked *)p)->eta2;
+	double b = ((const struct marked *)q)->eta2;
+	return (a < b) - (a > b);
+}
+
+/*
+ * Dörfler 标记: 按 η_K 从大到小取单元, 直到取到的 Σ η_K² 不小于
+ * ADAPT_BULK·Σ η_K², 这些单元的面积上限是原面积的 ADAPT_REFINE_FACTOR 倍,
+ * 其余单元写 -1(不限制)
+ */
+static void mark_bulk(struct mesh *mesh, const double *eta, double *area)
+{
+	struct marked *order;
+	double total = 0.0, sum = 0.0;
+	int n = mesh->element_num;
+
+	make_vector(order, n);
+	for (int r = 0; r < n; r++) {
+		order[r].eta2 = eta[r] * eta[r];
+		order[r].r = r;
+		total += order[r].eta2;
+		area[r] = -1.0;
+	}
+	qsort(order, n, sizeof *order, cmp_marked);
+	for (int k = 0; k < n && sum < ADAPT_BULK * total; k++) {
+		int r = order[k].r;
+		sum += order[k].eta2;
+		area[r] = ADAPT_REFINE_FACTOR * mesh->elements[r].area;
+	}
+	free_vector(order);
+}
+
+/**
+ * @name adapt_mesh - 自适应加密
+ * @param 1.spec 问题规格 2.a0 初始网格的面积约束 3.tol 整体误差估计的目标
+ * 	4.max_iter 最多加密次数 5.estimator ADAPT_ESTIMATOR_RESIDUAL 或 ADAPT_ESTIMATOR_ZZ
+ * 	6.u 输出最终网格上的解(可为 NULL) 7.estimate 输出最终的误差估计(可为 NULL)
+ * 	8.log 每次迭代打印一行, NULL 表示不打印
+ * @return 最终网格, 剖分出错时返回 NULL
+*/
+struct mesh *adapt_mesh(struct problem_spec *spec, double a0, double tol,
+		int max_iter, int estimator, double **u, double *estimate, FILE *log)
+{
+	struct mesh *mesh = make_mesh(spec, a0);
+	double *sol, *eta, *area, total;
+
+	if (mesh == NULL)
+		return NULL;
+	for (int it = 0; ; it++) {
+		sol = fem_solve(mesh, spec);
+		make_vector(eta, mesh->element_num);
+		if (sol != NULL && estimator == ADAPT_ESTIMATOR_ZZ)
+			estimate_zz(mesh, sol, eta);
+		else if (sol != NULL)
+			estimate_residual(mesh, spec, sol, eta);
+		total = sol != NULL ? estimate_total(eta, mesh->element_num) : NAN;
+		if (log != NULL)
+			fprintf(log, "自适应第 %d 次: 单元个数 %d, 误差估计 %g\n",
+					it, mesh->element_num, total);
+		if (!(total > tol) || it == max_iter)
+			break;
+
+		make_vector(area, mesh->element_num);
+		mark_bulk(mesh, eta, area);
+		struct mesh *refined = refine_mesh(mesh, area);
+		free_vector(area);
+		free_vector(eta);
+		free_vector(sol);
+		free_mesh(mesh);
+		if (refined == NULL)
+			return NULL;
+		mesh = refined;
+	}
+
+	free_vector(eta);
+	if (u != NULL)
+		*u = sol;
+	else
+		free_vector(sol);
+	if (estimate != NULL)
+		*estimate = total;
+	return mesh;
+}
@@ -0,0 +1,26 @@
+/*
+ * adapt.h
+ *  误差估计驱动的自适应加密
+ *
+ *  求解 → 计算单元误差指示子 → 标记误差最大的单元并写出面积上限 → refine_mesh() 加密,
+ *  直到整体误差估计不超过 tol 或达到 max_iter 次
+ */
+#ifndef ADAPT_H
+#define ADAPT_H
+
+#include <stdio.h>
+#include "mesh.h"
+#include "problem-spec.h"
+
+#define ADAPT_BULK          0.3 // Dörfler 标记: 加密的单元占 Σ η_K² 的比例
+#define ADAPT_REFINE_FACTOR 0.5 // 被标记单元的面积上限是原面积的这个比例
+
+// 误差指示子的种类
+#define ADAPT_ESTIMATOR_RESIDUAL 0  // 残量型, estimate_residual()
+#define ADAPT_ESTIMATOR_ZZ       1  // 梯度恢复型, estimate_zz()
+
+struct mesh *adapt_mesh(struct problem_spec *spec, double a0, double tol,
+        int max_iter, int estimator, double **u, double *estimate, FILE *log);
+double *fem_solve(struct mesh *mesh, struct problem_spec *spec);
+
+#endif
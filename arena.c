@@ -0,0 +1,204 @@
+/**
+ * @file arena.c
+ * @brief 顺序分配的内存池, 见 arena.h
+ * @details
+ *  内存按块向 libc 申请, 当前块放在链表头. 每次分配前面放一个记录大小的
+ *  头部, 供 realloc 复制数据用; 所有分配按 ARENA_ALIGN 对齐.
+ *  大于块大小四分之一的分配单独占一块, 挂在当前块后面, 不打断当前块的使用.
+ *  块本身直接用 malloc 申请, 不经过 xmalloc, 否则会递归到自己.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE	(1 << 20)	/* 缺省的块大小 */
+#define ARENA_ALIGN		16
+
+struct arena_block{
+	struct arena_block *next;
+	size_t size, used;
+	unsigned char *data;
+};
+
+/* 每次分配前面的头部 */
+union arena_header{
+	size_t size;
+	unsigned char pad[ARENA_ALIGN];
+};
+
+struct arena{
+	struct allocator allocator;
+	pthread_mutex_t lock;
+	struct arena_block *blocks;
+	size_t block_size;
+	size_t total;		/* 向 libc 申请的字节数 */
+};
+
+#define ROUND_UP(n)	(((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static struct arena_block *new_block(struct arena *arena, size_t size)
+{
+	struct arena_block *b;
+
+	/* 块头部之后对齐到 ARENA_ALIGN */
+	b = malloc(ROUND_UP(sizeof *b) + size);
+	if (b == NULL)
+		return NULL;
+	b->size = size;
+	b->used = 0;
+	b->data = (unsigned char *)b + ROUND_UP(sizeof *b);
+	arena->total += ROUND_UP(sizeof *b) + size;
+	return b;
+}
+
+/* 调用者持有锁 */
+static void *alloc_locked(struct arena *arena, size_t size)
+{
+	size_t need = sizeof(union arena_header) + ROUND_UP(size);
+	struct arena_block *b = arena->blocks;
+	union arena_header *h;
+
+	if (need < size)
+		return NULL;	/* 溢出 */
+	if (b == NULL || b->size - b->used < need) {
+		if (need > arena->block_size / 4) {
+			if ((b = new_block(arena, need)) == NULL)
+				return NULL;
+			if (arena->blocks == NULL) {
+				b->next = NULL;
+				arena->blocks = b;
+			} else {
+				b->next = arena->blocks->next;
+				arena->blocks->next = b;
+			}
+		} else {
+			if ((b = new_block(arena, arena->block_size)) == NULL)
+				return NULL;
+			b->next = arena->blocks;
+			arena->blocks = b;
+		}
+	}
+	h = (union arena_header *)(b->data + b->used);
+	h->size = size;
+	b->used += need;
+	return h + 1;
+}
+
+static union arena_header *header_of(void *ptr)
+{
+	return (union arena_header *)ptr - 1;
+}
+
+/* ptr 是否是当前块中最后一次分配 */
+static int is_last(struct arena *arena, void *ptr)
+{
+	struct arena_block *b = arena->blocks;
+
+	return b != NULL && (unsigned char *)ptr + ROUND_UP(header_of(ptr)->size)
+			== b->data + b->used;
+}
+
+static void *arena_alloc(void *ctx, size_t size)
+{
+	struct arena *arena = ctx;
+	void *ptr;
+
+	pthread_mutex_lock(&arena->lock);
+	ptr = alloc_locked(arena, size);
+	pthread_mutex_unlock(&arena->lock);
+	return ptr;
+}
+
+static void arena_free(void *ctx, void *ptr)
+{
+	struct arena *arena = ctx;
+
+	pthread_mutex_lock(&arena->lock);
+	if (is_last(arena, ptr))
+		arena->blocks->used -= sizeof(union arena_header)
+				+ ROUND_UP(header_of(ptr)->size);
+	pthread_mutex_unlock(&arena->lock);
+}
+
+static void *arena_realloc(void *ctx, void *ptr, size_t size)
+{
+	struct arena *arena = ctx;
+	struct arena_block *b;
+	size_t old;
+	void *p;
+
+	if (ptr == NULL)
+		return arena_alloc(ctx, size);
+	pthread_mutex_lock(&arena->lock);
+	b = arena->blocks;
+	old = header_of(ptr)->size;
+	/* 最后一次分配, 当前块中放得下时原地扩大或缩小 */
+	if (is_last(arena, ptr) && ROUND_UP(size) >= size
+			&& (unsigned char *)ptr - b->data + ROUND_UP(size) <= b->size) {
+		b->used = (unsigned char *)ptr - b->data + ROUND_UP(size);
+		header_of(ptr)->size = size;
+		p = ptr;
+	} else if ((p = alloc_locked(arena, size)) != NULL)
+		memcpy(p, ptr, old < size ? old : size);
+	pthread_mutex_unlock(&arena->lock);
+	return p;
+}
+
+/**
+ * @name arena_create - 创建内存池
+ * @param 1.block_size 每块的大小(字节), 0 表示缺省的 1MB
+ * @return 内存池, 用 arena_destroy() 释放; 内存不足时返回 NULL
+*/
+struct arena *arena_create(size_t block_size)
+{
+	struct arena *arena = malloc(sizeof *arena);
+
+	if (arena == NULL)
+		return NULL;
+	arena->allocator.alloc = arena_alloc;
+	arena->allocator.realloc = arena_realloc;
+	arena->allocator.free = arena_free;
+	arena->allocator.ctx = arena;
+	pthread_mutex_init(&arena->lock, NULL);
+	arena->blocks = NULL;
+	arena->block_size = block_size > 0 ? ROUND_UP(block_size) : ARENA_BLOCK_SIZE;
+	arena->total = 0;
+	return arena;
+}
+
+/**
+ * @name arena_destroy - 一次性释放内存池和从中分配的所有内存
+ * @param 1.arena 内存池(可为 NULL)
+ * @note 调用前不能再有线程把它作为当前分配器
+*/
+void arena_destroy(struct arena *arena)
+{
+	struct arena_block *b, *next;
+
+	if (arena == NULL)
+		return;
+	for (b = arena->blocks; b != NULL; b = next) {
+		next = b->next;
+		free(b);
+	}
+	pthread_mutex_destroy(&arena->lock);
+	free(arena);
+}
+
+struct allocator *arena_allocator(struct arena *arena)
+{
+	return &arena->allocator;
+}
+
+// 向 libc 申请的总字节数
+size_t arena_size(struct arena *arena)
+{
+	size_t total;
+
+	pthread_mutex_lock(&arena->lock);
+	total = arena->total;
+	pthread_mutex_unlock(&arena->lock);
+	return total;
+}
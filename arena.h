@@ -0,0 +1,28 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include "xmalloc.h"
+
+/*
+ * 顺序分配(bump)的内存池, 实现 xmalloc.h 中的分配器接口
+ *  分配只是移动指针; 释放最近一次的分配时回退指针, 其余的释放什么也不做,
+ *  内存到 arena_destroy 时一次性归还. 可以被多个线程同时使用(内部加锁).
+ *  Triangle 的内存池等中间结果也要到那时才归还, 所以峰值内存比 libc 高.
+ *
+ * 用法:
+ *     struct arena *arena = arena_create(0);
+ *     struct allocator *old = set_allocator(arena_allocator(arena));
+ *     mesh = make_mesh(spec, a);
+ *     set_allocator(old);
+ *     ...
+ *     arena_destroy(arena);    // 代替 free_mesh(mesh)
+ */
+struct arena;
+
+struct arena *arena_create(size_t block_size);
+void arena_destroy(struct arena *arena);
+struct allocator *arena_allocator(struct arena *arena);
+size_t arena_size(struct arena *arena);
+
+#endif
@@ -0,0 +1,549 @@
+/**
+ * @file cholesky.c
+ * @brief 超节点稀疏 Cholesky 分解
+ * @details
+ *  1. 排序: 用节点坐标做递归坐标二分(RCB)的嵌套剖分. 每一层沿包围盒较长的
+ *     方向按中位数把节点分成两半, 右半部分中与左半部分相邻的节点作为分隔集,
+ *     排序为 左半 | 右半 | 分隔集, 然后按消去树做后序重排.
+ *  2. 符号分解: 消去树, 列计数, 基本超节点以及每个超节点的行结构.
+ *     只与稀疏结构有关, 网格不变时可以反复使用.
+ *  3. 数值分解: 右视(right-looking)超节点算法, 每个超节点稠密存放(列主序).
+ *  4. 求解: 各右端项相互独立, 用 parallel_for() 分给多个线程.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "parallel.h"
+#include "cholesky.h"
+
+#define ND_LEAF 64		/* 子区域节点数不超过该值时停止剖分 */
+#define SN_MAX_COLS 128		/* 超节点的最大列数 */
+
+struct nd_key{
+	double key;
+	int idx;
+};
+
+static int cmp_nd_key(const void *a, const void *b)
+{
+	double ka = ((const struct nd_key *)a)->key;
+	double kb = ((const struct nd_key *)b)->key;
+	return (ka > kb) - (ka < kb);
+}
+
+struct nd_ctx{
+	const struct csr_matrix *A;
+	const struct node *nodes;
+	char *side;		/* 0: 不在当前子集, 1: 左, 2: 右, 3: 分隔集 */
+	int *perm;
+	int pos;
+	struct nd_key *keys;
+};
+
+/* 递归坐标二分, 把 idx[0..m) 按嵌套剖分顺序追加到 perm */
+static void nd_order(struct nd_ctx *c, int *idx, int m)
+{
+	double xmin, xmax, ymin, ymax;
+	int i, mid, nl, nr, ns;
+	int *left, *right, *sep;
+
+	if (m <= ND_LEAF) {
+		for (i = 0; i < m; i++)
+			c->perm[c->pos++] = idx[i];
+		return;
+	}
+
+	xmin = xmax = c->nodes[idx[0]].x;
+	ymin = ymax = c->nodes[idx[0]].y;
+	for (i = 1; i < m; i++) {
+		const struct node *np = &c->nodes[idx[i]];
+		if (np->x < xmin) xmin = np->x;
+		if (np->x > xmax) xmax = np->x;
+		if (np->y < ymin) ymin = np->y;
+		if (np->y > ymax) ymax = np->y;
+	}
+	for (i = 0; i < m; i++) {
+		const struct node *np = &c->nodes[idx[i]];
+		c->keys[i].key = (xmax - xmin >= ymax - ymin) ? np->x : np->y;
+		c->keys[i].idx = idx[i];
+	}
+	qsort(c->keys, m, sizeof c->keys[0], cmp_nd_key);
+
+	mid = m / 2;
+	for (i = 0; i < m; i++) {
+		idx[i] = c->keys[i].idx;
+		c->side[idx[i]] = (i < mid) ? 1 : 2;
+	}
+	for (i = mid; i < m; i++) {
+		int v = idx[i];
+		for (int p = c->A->rowptr[v]; p < c->A->rowptr[v+1]; p++)
+			if (c->side[c->A->colind[p]] == 1) {
+				c->side[v] = 3;
+				break;
+			}
+	}
+
+	/* idx 已按坐标排好, 就地拆分成 左 | 右 | 分隔集 */
+	make_vector(sep, m - mid);
+	nl = mid;
+	nr = ns = 0;
+	for (i = mid; i < m; i++) {
+		if (c->side[idx[i]] == 3)
+			sep[ns++] = idx[i];
+		else
+			idx[mid + nr++] = idx[i];
+	}
+	for (i = 0; i < ns; i++)
+		idx[mid + nr + i] = sep[i];
+	free_vector(sep);
+	for (i = 0; i < m; i++)
+		c->side[idx[i]] = 0;
+
+	left = idx;
+	right = idx + nl;
+	nd_order(c, left, nl);
+	nd_order(c, right, nr);
+	for (i = 0; i < ns; i++)
+		c->perm[c->pos++] = idx[nl + nr + i];
+}
+
+/* 按 perm 计算消去树, ancestor 为路径压缩用的工作数组 */
+static void etree(const struct csr_matrix *A, const int *perm, const int *iperm,
+		int *parent, int *ancestor)
+{
+	for (int k = 0; k < A->n; k++) {
+		int v = perm[k];
+		parent[k] = -1;
+		ancestor[k] = -1;
+		for (int p = A->rowptr[v]; p < A->rowptr[v+1]; p++) {
+			int i = iperm[A->colind[p]];
+			while (i != -1 && i < k) {
+				int next = ancestor[i];
+				ancestor[i] = k;
+				if (next == -1)
+					parent[i] = k;
+				i = next;
+			}
+		}
+	}
+}
+
+/* 消去树的后序, post[k] = 后序中第 k 个节点 */
+static void tree_postorder(int n, const int *parent, int *post)
+{
+	int *head, *next, *stack;
+	int k = 0, top;
+
+	make_vector(head, n);
+	make_vector(next, n);
+	make_vector(stack, n);
+	for (int j = 0; j < n; j++)
+		head[j] = -1;
+	for (int j = n - 1; j >= 0; j--)
+		if (parent[j] != -1) {
+			next[j] = head[parent[j]];
+			head[parent[j]] = j;
+		}
+	for (int root = 0; root < n; root++) {
+		if (parent[root] != -1)
+			continue;
+		top = 0;
+		stack[top] = root;
+		while (top >= 0) {
+			int p = stack[top];
+			int child = head[p];
+			if (child == -1) {
+				post[k++] = p;
+				top--;
+			} else {
+				head[p] = next[child];
+				stack[++top] = child;
+			}
+		}
+	}
+	free_vector(head);
+	free_vector(next);
+	free_vector(stack);
+}
+
+/* 列计数: 逐行沿消去树向上走出 L 第 k 行的结构 */
+static void column_counts(const struct csr_matrix *A, const int *perm,
+		const int *iperm, const int *parent, int *count, int *mark)
+{
+	int n = A->n;
+
+	for (int j = 0; j < n; j++) {
+		count[j] = 1;
+		mark[j] = -1;
+	}
+	for (int k = 0; k < n; k++) {
+		int v = perm[k];
+		mark[k] = k;
+		for (int p = A->rowptr[v]; p < A->rowptr[v+1]; p++) {
+			int i = iperm[A->colind[p]];
+			if (i > k)
+				continue;
+			while (mark[i] != k) {
+				count[i]++;
+				mark[i] = k;
+				i = parent[i];
+			}
+		}
+	}
+}
+
+/**
+ * @name cholesky_analyze - 排序与符号分解
+ * @param 1.A 对称矩阵(需要完整的上下三角结构) 2.nodes 第 i 行对应的节点 nodes[i]
+ * @return 符号分解结果
+*/
+struct cholesky_symbolic *cholesky_analyze(const struct csr_matrix *A,
+		const struct node *nodes)
+{
+	struct cholesky_symbolic *S = xmalloc(sizeof *S);
+	int n = A->n;
+	int *idx, *parent, *work, *post, *count, *mark, *sn_parent;
+	struct nd_ctx c;
+
+	S->n = n;
+	make_vector(S->perm, n);
+	make_vector(S->iperm, n);
+	make_vector(S->col_to_sn, n);
+
+	/* 1. 嵌套剖分 */
+	make_vector(idx, n);
+	make_vector(c.side, n);
+	make_vector(c.keys, n);
+	for (int i = 0; i < n; i++) {
+		idx[i] = i;
+		c.side[i] = 0;
+	}
+	c.A = A;
+	c.nodes = nodes;
+	c.perm = S->perm;
+	c.pos = 0;
+	nd_order(&c, idx, n);
+	free_vector(c.side);
+	free_vector(c.keys);
+	for (int k = 0; k < n; k++)
+		S->iperm[S->perm[k]] = k;
+
+	/* 2. 消去树后序, 使每个超节点的列连续 */
+	make_vector(parent, n);
+	make_vector(work, n);
+	make_vector(post, n);
+	etree(A, S->perm, S->iperm, parent, work);
+	tree_postorder(n, parent, post);
+	for (int k = 0; k < n; k++)
+		idx[k] = S->perm[post[k]];
+	for (int k = 0; k < n; k++) {
+		S->perm[k] = idx[k];
+		S->iperm[idx[k]] = k;
+	}
+	etree(A, S->perm, S->iperm, parent, work);
+	free_vector(post);
+	free_vector(idx);
+
+	/* 3. 列计数与基本超节点 */
+	make_vector(count, n);
+	make_vector(mark, n);
+	column_counts(A, S->perm, S->iperm, parent, count, work);
+	for (int j = 0; j < n; j++)
+		mark[j] = 0;		/* 子节点个数 */
+	for (int j = 0; j < n; j++)
+		if (parent[j] != -1)
+			mark[parent[j]]++;
+
+	make_vector(S->sn_start, n + 1);
+	S->sn_num = 0;
+	for (int j = 0; j < n; j++) {
+		int width = (S->sn_num > 0) ? j - S->sn_start[S->sn_num - 1] : 0;
+		if (j == 0 || parent[j-1] != j || count[j-1] != count[j] + 1
+				|| mark[j] != 1 || width >= SN_MAX_COLS)
+			S->sn_start[S->sn_num++] = j;
+		S->col_to_sn[j] = S->sn_num - 1;
+	}
+	S->sn_start[S->sn_num] = n;
+
+	/* 4. 超节点的行结构: 自身的列 ∪ A 中的非零行 ∪ 子超节点的行 */
+	make_vector(S->row_ptr, S->sn_num + 1);
+	make_vector(S->val_ptr, S->sn_num + 1);
+	make_vector(sn_parent, S->sn_num);
+	S->row_ptr[0] = 0;
+	S->val_ptr[0] = 0;
+	for (int s = 0; s < S->sn_num; s++) {
+		int last = S->sn_start[s+1] - 1;
+		int rows = count[S->sn_start[s]];
+		int cols = S->sn_start[s+1] - S->sn_start[s];
+		S->row_ptr[s+1] = S->row_ptr[s] + rows;
+		S->val_ptr[s+1] = S->val_ptr[s] + (long)rows * cols;
+		sn_parent[s] = parent[last] == -1 ? -1 : S->col_to_sn[parent[last]];
+	}
+	S->nnz_L = S->val_ptr[S->sn_num];
+	make_vector(S->rowind, S->row_ptr[S->sn_num]);
+
+	for (int j = 0; j < n; j++)
+		mark[j] = -1;
+	/* work[s]: 已写入超节点 s 的行数 */
+	for (int s = 0; s < S->sn_num; s++)
+		work[s] = 0;
+	for (int s = 0; s < S->sn_num; s++) {
+		int first = S->sn_start[s], last = S->sn_start[s+1] - 1;
+		int *rows = &S->rowind[S->row_ptr[s]];
+		int nrows = work[s];
+
+		/* 子超节点的行已在处理子节点时追加到 rows[0..work[s]) */
+		for (int i = 0; i < nrows; i++)
+			mark[rows[i]] = s;
+		for (int j = first; j <= last; j++) {
+			if (mark[j] != s) {
+				mark[j] = s;
+				rows[nrows++] = j;
+			}
+			int v = S->perm[j];
+			for (int p = A->rowptr[v]; p < A->rowptr[v+1]; p++) {
+				int i = S->iperm[A->colind[p]];
+				if (i > last && mark[i] != s) {
+					mark[i] = s;
+					rows[nrows++] = i;
+				}
+			}
+		}
+		/* insertion sort; rows of a supernode are few */
+		for (int a = 1; a < nrows; a++) {
+			int r = rows[a], b = a - 1;
+			while (b >= 0 && rows[b] > r) {
+				rows[b+1] = rows[b];
+				b--;
+			}
+			rows[b+1] = r;
+		}
+
+		/* 把 last 之后的行合并到父超节点(去重) */
+		int ps = sn_parent[s];
+		if (ps != -1) {
+			int *prow = &S->rowind[S->row_ptr[ps]];
+			for (int i = 0; i < work[ps]; i++)
+				mark[prow[i]] = -2;
+			for (int i = last - first + 1; i < nrows; i++) {
+				int r = rows[i];
+				if (mark[r] != -2) {
+					mark[r] = -2;
+					prow[work[ps]++] = r;
+				}
+			}
+			for (int i = 0; i < work[ps]; i++)
+				mark[prow[i]] = -1;
+		}
+	}
+
+	free_vector(parent);
+	free_vector(work);
+	free_vector(count);
+	free_vector(mark);
+	free_vector(sn_parent);
+	return S;
+}
+
+/* 超节点 t 的行结构中找出 rows[i..nrows) 的位置 */
+static void relative_rows(const struct cholesky_symbolic *S, int t,
+		const int *rows, int i, int nrows, int *rel)
+{
+	const int *trows = &S->rowind[S->row_ptr[t]];
+	int pt = 0;
+
+	for (int j = i; j < nrows; j++) {
+		while (trows[pt] != rows[j])
+			pt++;
+		rel[j] = pt;
+	}
+}
+
+/**
+ * @name cholesky_factorize - 数值分解
+ * @param 1.S cholesky_analyze() 的结果 2.A 与分析时稀疏结构相同的对称正定矩阵
+ * @return 分解结果; 若 A 不是正定矩阵则返回 NULL
+*/
+struct cholesky_factor *cholesky_factorize(const struct cholesky_symbolic *S,
+		const struct csr_matrix *A)
+{
+	struct cholesky_factor *F = xmalloc(sizeof *F);
+	int *map, *rel;
+
+	F->S = S;
+	make_vector(F->val, S->nnz_L);
+	for (long p = 0; p < S->nnz_L; p++)
+		F->val[p] = 0.0;
+	make_vector(map, S->n);
+	make_vector(rel, S->n);
+
+	for (int s = 0; s < S->sn_num; s++) {
+		int first = S->sn_start[s];
+		int nc = S->sn_start[s+1] - first;
+		int nrows = S->row_ptr[s+1] - S->row_ptr[s];
+		const int *rows = &S->rowind[S->row_ptr[s]];
+		double *L = F->val + S->val_ptr[s];
+
+		/* 累加 A 的下三角部分; 来自前面超节点的更新已在 L 中 */
+		for (int i = 0; i < nrows; i++)
+			map[rows[i]] = i;
+		for (int k = 0; k < nc; k++) {
+			int v = S->perm[first + k];
+			for (int p = A->rowptr[v]; p < A->rowptr[v+1]; p++) {
+				int i = S->iperm[A->colind[p]];
+				if (i >= first + k)
+					L[map[i] + (long)k*nrows] += A->val[p];
+			}
+		}
+
+		/* 稠密面板分解 */
+		for (int k = 0; k < nc; k++) {
+			double *Lk = L + (long)k*nrows;
+			if (Lk[k] <= 0.0) {
+				fprintf(stderr, "cholesky_factorize: matrix is not "
+						"positive definite (pivot %d)\n", first + k);
+				free_vector(map);
+				free_vector(rel);
+				free_cholesky_factor(F);
+				return NULL;
+			}
+			double d = sqrt(Lk[k]);
+			Lk[k] = d;
+			for (int i = k + 1; i < nrows; i++)
+				Lk[i] /= d;
+			for (int j = k + 1; j < nc; j++) {
+				double *Lj = L + (long)j*nrows;
+				double ljk = Lk[j];
+				for (int i = j; i < nrows; i++)
+					Lj[i] -= Lk[i] * ljk;
+			}
+		}
+
+		/* 把 L_R L_R^T 从祖先超节点中减去, 按目标超节点分组 */
+		for (int i = nc; i < nrows; ) {
+			int t = S->col_to_sn[rows[i]];
+			int tfirst = S->sn_start[t], tend = S->sn_start[t+1];
+			int tnrows = S->row_ptr[t+1] - S->row_ptr[t];
+			double *Lt = F->val + S->val_ptr[t];
+			int g = i;
+
+			while (g < nrows && rows[g] < tend)
+				g++;
+			relative_rows(S, t, rows, i, nrows, rel);
+			for (int ii = i; ii < g; ii++) {
+				double *tcol = Lt + (long)(rows[ii] - tfirst)*tnrows;
+				for (int k = 0; k < nc; k++) {
+					const double *Lk = L + (long)k*nrows;
+					double a = Lk[ii];
+					if (a == 0.0)
+						continue;
+					for (int j = ii; j < nrows; j++)
+						tcol[rel[j]] -= Lk[j] * a;
+				}
+			}
+			i = g;
+		}
+	}
+
+	free_vector(map);
+	free_vector(rel);
+	return F;
+}
+
+/* 求解 L L^T x = x, x 为重排后的向量 */
+static void supernodal_solve(const struct cholesky_factor *F, double *x)
+{
+	const struct cholesky_symbolic *S = F->S;
+
+	for (int s = 0; s < S->sn_num; s++) {
+		int first = S->sn_start[s];
+		int nc = S->sn_start[s+1] - first;
+		int nrows = S->row_ptr[s+1] - S->row_ptr[s];
+		const int *rows = &S->rowind[S->row_ptr[s]];
+		const double *L = F->val + S->val_ptr[s];
+		for (int k = 0; k < nc; k++) {
+			const double *Lk = L + (long)k*nrows;
+			double xk = x[first + k] / Lk[k];
+			x[first + k] = xk;
+			for (int i = k + 1; i < nrows; i++)
+				x[rows[i]] -= Lk[i] * xk;
+		}
+	}
+
+	for (int s = S->sn_num - 1; s >= 0; s--) {
+		int first = S->sn_start[s];
+		int nc = S->sn_start[s+1] - first;
+		int nrows = S->row_ptr[s+1] - S->row_ptr[s];
+		const int *rows = &S->rowind[S->row_ptr[s]];
+		const double *L = F->val + S->val_ptr[s];
+		for (int k = nc - 1; k >= 0; k--) {
+			const double *Lk = L + (long)k*nrows;
+			double sum = x[first + k];
+			for (int i = k + 1; i < nrows; i++)
+				sum -= Lk[i] * x[rows[i]];
+			x[first + k] = sum / Lk[k];
+		}
+	}
+}
+
+struct solve_ctx{
+	const struct cholesky_factor *F;
+	double *b;
+};
+
+static void solve_range(void *arg, int begin, int end)
+{
+	struct solve_ctx *c = arg;
+	const struct cholesky_symbolic *S = c->F->S;
+	int n = S->n;
+	double *x;
+
+	make_vector(x, n);
+	for (int r = begin; r < end; r++) {
+		double *b = c->b + (long)r*n;
+		for (int k = 0; k < n; k++)
+			x[k] = b[S->perm[k]];
+		supernodal_solve(c->F, x);
+		for (int k = 0; k < n; k++)
+			b[S->perm[k]] = x[k];
+	}
+	free_vector(x);
+}
+
+/**
+ * @name cholesky_solve - 求解 A X = B
+ * @param 1.F 数值分解结果 2.b 按列存放的 n×nrhs 右端项, 返回时被解覆盖 3.nrhs 右端项个数
+ * @note 各右端项由不同线程并行求解
+*/
+void cholesky_solve(const struct cholesky_factor *F, double *b, int nrhs)
+{
+	struct solve_ctx c = { F, b };
+
+	parallel_for(nrhs, 1, solve_range, &c);
+}
+
+void free_cholesky_symbolic(struct cholesky_symbolic *S)
+{
+	if (S == NULL)
+		return;
+
+	free_vector(S->perm);
+	free_vector(S->iperm);
+	free_vector(S->sn_start);
+	free_vector(S->col_to_sn);
+	free_vector(S->row_ptr);
+	free_vector(S->rowind);
+	free_vector(S->val_ptr);
+	xfree(S);
+}
+
+void free_cholesky_factor(struct cholesky_factor *F)
+{
+	if (F == NULL)
+		return;
+
+	free_vector(F->val);
+	xfree(F);
+}
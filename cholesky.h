@@ -0,0 +1,50 @@
+/*
+ * cholesky.h
+ *  超节点稀疏 Cholesky 分解 A = P^T L L^T P
+ *
+ *  用法:
+ *      S = cholesky_analyze(A, mesh->nodes);   // 排序 + 符号分解, 网格不变时只需一次
+ *      F = cholesky_factorize(S, A);           // 数值分解, A 的值改变时重做
+ *      cholesky_solve(F, B, nrhs);             // 多个右端项并行求解
+ *      free_cholesky_factor(F);
+ *      free_cholesky_symbolic(S);
+ */
+#ifndef CHOLESKY_H
+#define CHOLESKY_H
+
+#include "mesh.h"
+#include "sparse.h"
+
+/*
+ * 符号分解结果
+ *  第 s 个超节点包含 L 的第 [sn_start[s], sn_start[s+1]) 列(重排后的编号),
+ *  其行结构为 rowind[row_ptr[s] .. row_ptr[s+1]), 按列主序稠密存放在
+ *  L 的 [val_ptr[s], val_ptr[s+1]) 中
+ */
+struct cholesky_symbolic{
+    int n;              // 矩阵阶数
+    int *perm;          // perm[k] = 重排后第 k 个未知量的原始编号
+    int *iperm;         // perm 的逆
+    int sn_num;         // 超节点个数
+    int *sn_start;      // 长度 sn_num+1
+    int *col_to_sn;     // 每一列所属的超节点
+    int *row_ptr;       // 长度 sn_num+1
+    int *rowind;        // 各超节点的行号(重排后的编号)
+    long *val_ptr;      // 长度 sn_num+1
+    long nnz_L;         // L 的存储量(含超节点内的上三角零元)
+};
+
+struct cholesky_factor{
+    const struct cholesky_symbolic *S;
+    double *val;        // 长度 S->nnz_L
+};
+
+struct cholesky_symbolic *cholesky_analyze(const struct csr_matrix *A,
+        const struct node *nodes);
+struct cholesky_factor *cholesky_factorize(const struct cholesky_symbolic *S,
+        const struct csr_matrix *A);
+void cholesky_solve(const struct cholesky_factor *F, double *b, int nrhs);
+void free_cholesky_symbolic(struct cholesky_symbolic *S);
+void free_cholesky_factor(struct cholesky_factor *F);
+
+#endif
@@ -0,0 +1,281 @@
+/**
+ * @file convergence-study.c
+ * @brief 收敛性研究: 对一组面积约束 a 并行地 生成网格→组装→求解→计算误差
+ * @details
+ *  用法:
+ *      convergence-study.bin <domain> <json-file> <a0> <ratio> <count>
+ *  其中 domain 为 triangle-with-hole, annulus 或 square,
+ *  面积约束取等比数列 a0, a0*ratio, ..., a0*ratio^(count-1).
+ *
+ *  区域上的问题用人工构造的精确解
+ *      u = sin(πx)cos(πy) + xy,  η = 1,  f = 2π²sin(πx)cos(πy),  g = u
+ *  各个 a 作为独立的任务交给 parallel_for() 的线程池, 先启动最细的网格.
+ *  每个任务的网格从自己的 arena 分配, 线程之间不争用 malloc, 用完一次性释放.
+ *  结果(误差, 观测收敛阶, 各阶段耗时)写入 JSON 文件, 同时在终端打印一张表.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "mesh.h"
+#include "problem-spec.h"
+#include "fem.h"
+#include "cholesky.h"
+#include "parallel.h"
+#include "timer.h"
+#include "arena.h"
+
+static void manufactured_u(const double *x, const double *y, double *out,
+		int n, void *ctx)
+{
+	double pi = 4*atan(1.0);
+	(void)ctx;
+	for (int i = 0; i < n; i++)
+		out[i] = sin(pi*x[i])*cos(pi*y[i]) + x[i]*y[i];
+}
+
+static void manufactured_f(const double *x, const double *y, double *out,
+		int n, void *ctx)
+{
+	double pi = 4*atan(1.0);
+	(void)ctx;
+	for (int i = 0; i < n; i++)
+		out[i] = 2*pi*pi*sin(pi*x[i])*cos(pi*y[i]);
+}
+
+// 一次 生成网格→组装→求解→误差 的结果
+struct study_run{
+	double a;
+	int node_num, element_num;
+	double l2, h1;
+	double t_mesh, t_assemble, t_solve, t_error;
+	struct mesh_timings mesh_phases;
+	struct mesh_stats mesh_stats;
+};
+
+struct study{
+	struct problem_spec *spec;
+	struct study_run *runs;
+	int count;
+};
+
+static void run_one(struct problem_spec *spec, struct study_run *run)
+{
+	struct mesh *mesh;
+	struct csr_matrix *A;
+	struct cholesky_symbolic *S;
+	struct cholesky_factor *F;
+	struct arena *arena = arena_create(0);
+	struct allocator *old;
+	double *u, t;
+
+	old = set_allocator(arena != NULL ? arena_allocator(arena) : NULL);
+	mesh = make_mesh_profiled(spec, run->a, &run->mesh_phases, &run->mesh_stats);
+	set_allocator(old);
+	if (mesh == NULL) {
+		/* 错误已经打印; 这一行除 a 外清零, 误差留空, 其余的照常计算 */
+		double a = run->a;
+		memset(run, 0, sizeof *run);
+		run->a = a;
+		run->l2 = run->h1 = NAN;
+		arena_destroy(arena);
+		return;
+	}
+	run->t_mesh = run->mesh_phases.total;
+	run->node_num = mesh->node_num;
+	run->element_num = mesh->element_num;
+
+	t = wall_time();
+	A = fem_assemble_matrix(mesh, spec);
+	make_vector(u, mesh->node_num);
+	fem_assemble_load(mesh, spec, u);
+	run->t_assemble = wall_time() - t;
+
+	t = wall_time();
+	S = cholesky_analyze(A, mesh->nodes);
+	F = cholesky_factorize(S, A);
+	if (F != NULL)
+		cholesky_solve(F, u, 1);
+	run->t_solve = wall_time() - t;
+
+	t = wall_time();
+	if (F != NULL)
+		fem_errors(mesh, spec, u, &run->l2, &run->h1);
+	else
+		run->l2 = run->h1 = NAN;
+	run->t_error = wall_time() - t;
+
+	free_cholesky_factor(F);
+	free_cholesky_symbolic(S);
+	free_csr_matrix(A);
+	free_vector(u);
+	if (arena != NULL)
+		arena_destroy(arena);
+	else
+		free_mesh(mesh);
+}
+
+static void run_range(void *arg, int begin, int end)
+{
+	struct study *st = arg;
+
+	/* 任务 k 对应第 count-1-k 个 a, 即最细的网格先算 */
+	for (int k = begin; k < end; k++)
+		run_one(st->spec, &st->runs[st->count - 1 - k]);
+}
+
+/* 观测收敛阶, 以 h ~ N^(-1/2) 计, N 为单元个数 */
+static double rate(double e0, double e1, int n0, int n1)
+{
+	if (!(e0 > 0.0) || !(e1 > 0.0) || n0 == n1)
+		return NAN;
+	return 2.0 * log(e0/e1) / log((double)n1/n0);
+}
+
+/* JSON 没有 NaN, 用 null 代替 */
+static void json_number(FILE *fp, const char *name, double v, const char *sep)
+{
+	if (isfinite(v))
+		fprintf(fp, "\"%s\": %.6e%s", name, v, sep);
+	else
+		fprintf(fp, "\"%s\": null%s", name, sep);
+}
+
+static void write_mesh_phases(FILE *fp, const struct mesh_timings *t)
+{
+	fprintf(fp, "\"mesh_phases\": {\"spec_to_triangle\": %.6f, "
+			"\"delaunay\": %.6f, \"segments\": %.6f, \"holes\": %.6f, "
+			"\"quality\": %.6f, \"write_nodes\": %.6f, "
+			"\"write_elements\": %.6f, \"write_segments\": %.6f, "
+			"\"write_edges\": %.6f, \"triangle_to_mesh\": %.6f, "
+			"\"assign_elem_edges\": %.6f, \"geometry\": %.6f}",
+			t->spec_to_triangle, t->delaunay, t->segments, t->holes,
+			t->quality, t->write_nodes, t->write_elements,
+			t->write_segments, t->write_edges, t->triangle_to_mesh,
+			t->assign_elem_edges, t->geometry);
+}
+
+static void write_mesh_stats(FILE *fp, const struct mesh_stats *s)
+{
+	fprintf(fp, "\"mesh_stats\": {\"incircle\": %ld, \"orient2d\": %ld, "
+			"\"incircle_exact\": %ld, \"orient2d_exact\": %ld, "
+			"\"circumcenters\": %ld, \"locate_calls\": %ld, "
+			"\"locate_steps\": %ld, \"locate_max_steps\": %ld, "
+			"\"steiner_points\": %ld, \"pool_bytes\": %ld}",
+			s->incircle_tests, s->orient2d_tests, s->incircle_exact,
+			s->orient2d_exact, s->circumcenters, s->locate_calls,
+			s->locate_steps, s->locate_max_steps, s->steiner_points,
+			s->vertex_bytes + s->triangle_bytes + s->subseg_bytes
+			+ s->virus_bytes + s->badsubseg_bytes + s->badtriangle_bytes
+			+ s->flipstacker_bytes + s->splaynode_bytes);
+}
+
+static void write_json(FILE *fp, const char *domain, struct study *st,
+		int threads, double wall)
+{
+	fprintf(fp, "{\n  \"domain\": \"%s\",\n  \"threads\": %d,\n", domain, threads);
+	fprintf(fp, "  \"wall_time\": %.6f,\n  \"runs\": [\n", wall);
+	for (int k = 0; k < st->count; k++) {
+		struct study_run *r = &st->runs[k];
+		double rl2 = k > 0 ? rate(st->runs[k-1].l2, r->l2,
+				st->runs[k-1].element_num, r->element_num) : NAN;
+		double rh1 = k > 0 ? rate(st->runs[k-1].h1, r->h1,
+				st->runs[k-1].element_num, r->element_num) : NAN;
+		fprintf(fp, "    {\"a\": %.6e, \"nodes\": %d, \"elements\": %d, ",
+				r->a, r->node_num, r->element_num);
+		json_number(fp, "l2", r->l2, ", ");
+		json_number(fp, "h1", r->h1, ", ");
+		json_number(fp, "rate_l2", rl2, ", ");
+		json_number(fp, "rate_h1", rh1, ",\n     ");
+		fprintf(fp, "\"time\": {\"mesh\": %.6f, \"assemble\": %.6f, "
+				"\"solve\": %.6f, \"error\": %.6f},\n     ",
+				r->t_mesh, r->t_assemble, r->t_solve, r->t_error);
+		write_mesh_phases(fp, &r->mesh_phases);
+		fprintf(fp, ",\n     ");
+		write_mesh_stats(fp, &r->mesh_stats);
+		fprintf(fp, "}%s\n", k + 1 < st->count ? "," : "");
+	}
+	fprintf(fp, "  ]\n}\n");
+}
+
+static void show_usage(char *progname)
+{
+	printf("Usage: %s <domain> <json-file> <a0> <ratio> <count>\n", progname);
+	printf("  domain: triangle-with-hole | annulus | square\n");
+	printf("  面积约束依次取 a0, a0*ratio, ..., a0*ratio^(count-1)\n");
+	printf("  线程数由环境变量 TRI_NUM_THREADS 指定\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct problem_spec spec, *base;
+	struct study st;
+	char *domain;
+	double a0, ratio, wall;
+	FILE *fp;
+
+	if (argc != 6)
+		show_usage(argv[0]);
+	domain = argv[1];
+	a0 = strtod(argv[3], NULL);
+	ratio = strtod(argv[4], NULL);
+	st.count = atoi(argv[5]);
+	if (a0 <= 0.0 || ratio <= 0.0 || st.count <= 0)
+		show_usage(argv[0]);
+
+	if (strcmp(domain, "triangle-with-hole") == 0)
+		base = triangle_with_hole();
+	else if (strcmp(domain, "annulus") == 0)
+		base = annulus(24);
+	else if (strcmp(domain, "square") == 0)
+		base = square();
+	else
+		show_usage(argv[0]);
+
+	/* 在副本上挂接人工解, 不改动内置区域 */
+	spec = *base;
+	spec.f = spec.u_exact = spec.g = spec.h = spec.eta = NULL;
+	spec.f_batch = manufactured_f;
+	spec.u_exact_batch = manufactured_u;
+	spec.g_batch = manufactured_u;
+	spec.h_batch = spec.eta_batch = NULL;
+	spec.ctx = NULL;
+
+	make_vector(st.runs, st.count);
+	for (int k = 0; k < st.count; k++)
+		st.runs[k].a = a0 * pow(ratio, k);
+	st.spec = &spec;
+
+	wall = wall_time();
+	parallel_for(st.count, 1, run_range, &st);
+	wall = wall_time() - wall;
+
+	printf("%12s %10s %12s %12s %8s %8s %9s %9s %9s %9s\n",
+			"a", "elements", "L2", "H1", "rate", "rate",
+			"mesh", "assemble", "solve", "error");
+	for (int k = 0; k < st.count; k++) {
+		struct study_run *r = &st.runs[k];
+		printf("%12.4e %10d %12.4e %12.4e %8.3f %8.3f %9.4f %9.4f %9.4f %9.4f\n",
+				r->a, r->element_num, r->l2, r->h1,
+				k > 0 ? rate(st.runs[k-1].l2, r->l2, st.runs[k-1].element_num, r->element_num) : NAN,
+				k > 0 ? rate(st.runs[k-1].h1, r->h1, st.runs[k-1].element_num, r->element_num) : NAN,
+				r->t_mesh, r->t_assemble, r->t_solve, r->t_error);
+	}
+	printf("总耗时 %.3f 秒, %d 个线程\n", wall, parallel_num_threads());
+
+	if ((fp = fopen(argv[2], "w")) == NULL) {
+		fprintf(stderr, "cannot open file %s for writing\n", argv[2]);
+		return 1;
+	}
+	write_json(fp, domain, &st, parallel_num_threads(), wall);
+	fclose(fp);
+	fprintf(stderr, "结果已经写入到 %s 文件\n", argv[2]);
+
+	if (strcmp(domain, "annulus") == 0)
+		free_annulus(base);
+	free_vector(st.runs);
+	return 0;
+}
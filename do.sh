@@ -1,2 +1,8 @@
 #!/bin/sh
- gcc  mesh-to-eps.c mesh.c problem-spec.c triangle.c xmalloc.c mesh-demo.c -lm -o mesh-demo.bin 
+ gcc  mesh-to-eps.c mesh-to-raster.c mesh-file.c mesh-cache.c mesh.c problem-spec.c triangle.c xmalloc.c sparse.c fem.c parallel.c cholesky.c timer.c trace.c mesh-demo.c -lm -lpthread -o mesh-demo.bin 
+ gcc  mesh.c problem-spec.c triangle.c xmalloc.c sparse.c fem.c parallel.c cholesky.c timer.c trace.c arena.c convergence-study.c -lm -lpthread -o convergence-study.bin 
+ gcc  mesh-to-eps.c mesh.c problem-spec.c triangle.c xmalloc.c sparse.c fem.c parallel.c cholesky.c timer.c trace.c estimator.c adapt.c mesh-to-vtu.c adapt-demo.c -lm -lpthread -o adapt-demo.bin 
+ gcc  mesh.c problem-spec.c triangle.c xmalloc.c parallel.c timer.c trace.c mesh-file.c mesh-archive.c gmsh.c poly.c mesh-pack.c -lm -lpthread -o mesh-pack.bin 
+ gcc  mesh.c problem-spec.c triangle.c xmalloc.c parallel.c timer.c trace.c memstat.c mesh-bench.c -lm -lpthread -o mesh-bench.bin 
+ gcc  mesh.c problem-spec.c triangle.c xmalloc.c parallel.c timer.c trace.c memstat.c mesh-file.c mesh-check.c -lm -lpthread -o mesh-check.bin 
+ gcc  triangle.c xmalloc.c timer.c trace.c predicate-bench.c -lm -lpthread -o predicate-bench.bin 
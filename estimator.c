@@ -0,0 +1,281 @@
+/**
+ * @file estimator.c
+ * @brief 后验误差估计
+*/
+#include <math.h>
+#include <stdlib.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "fem.h"
+#include "parallel.h"
+#include "estimator.h"
+
+/*
+ * 单元 ep 上 P1 解的梯度 (gx, gy)
+ *  ∇φᵢ = (-eyᵢ, exᵢ)/(2A)
+ */
+static void element_gradient(const struct element *ep, const double *u,
+		double *gx, double *gy)
+{
+	*gx = *gy = 0.0;
+	for (int i = 0; i < 3; i++) {
+		double ui = u[ep->node[i]->node_id];
+		*gx -= ui * ep->edge_vector_y[i];
+		*gy += ui * ep->edge_vector_x[i];
+	}
+	*gx /= 2.0 * ep->area;
+	*gy /= 2.0 * ep->area;
+}
+
+/**
+ * @name estimate_residual - 残量型误差指示子
+ * @param 1.mesh 网格 2.spec 问题规格 3.u 有限元解 4.eta 输出, 长度 element_num
+ * @note
+ * 	η_K² = h_K² ‖f‖²_K + ½ Σ h_E ‖[η∂u/∂n]‖²_E + Σ h_E ‖h - η∂u/∂n‖²_{E⊂Γ_N},
+ * 	h_K 取最长边; 第一项用边中点公式, 跳跃在 P1 解下沿边为常数
+*/
+void estimate_residual(struct mesh *mesh, struct problem_spec *spec,
+		const double *u, double *eta)
+{
+	double qx[3*FEM_BLOCK], qy[3*FEM_BLOCK], f[3*FEM_BLOCK], c[3*FEM_BLOCK];
+	double *flux, *hval;
+	int *share;
+
+	make_vector(flux, mesh->edge_num);
+	make_vector(hval, mesh->edge_num);
+	make_vector(share, mesh->edge_num);
+	for (int s = 0; s < mesh->edge_num; s++) {
+		flux[s] = hval[s] = 0.0;
+		share[s] = 0;
+	}
+
+	/* 单元内残量, 同时把各单元的法向通量累加到边上 */
+	for (int first = 0; first < mesh->element_num; first += FEM_BLOCK) {
+		int count = mesh->element_num - first;
+		if (count > FEM_BLOCK)
+			count = FEM_BLOCK;
+		for (int r = 0; r < count; r++) {
+			struct element *ep = &mesh->elements[first + r];
+			for (int q = 0; q < 3; q++) {
+				qx[3*r+q] = (ep->node[(q+1)%3]->x + ep->node[(q+2)%3]->x) / 2.0;
+				qy[3*r+q] = (ep->node[(q+1)%3]->y + ep->node[(q+2)%3]->y) / 2.0;
+			}
+		}
+		problem_spec_eval_f(spec, qx, qy, f, 3*count);
+		problem_spec_eval_eta(spec, qx, qy, c, 3*count);
+
+		for (int r = 0; r < count; r++) {
+			struct element *ep = &mesh->elements[first + r];
+			double gx, gy, hk2 = 0.0, ff = 0.0;
+			element_gradient(ep, u, &gx, &gy);
+			for (int q = 0; q < 3; q++) {
+				double ex = ep->edge_vector_x[q], ey = ep->edge_vector_y[q];
+				double len2 = ex*ex + ey*ey;
+				/* outward normal of a CCW triangle times |E| is (ey, -ex) */
+				int s = ep->edge[q]->edge_id;
+				flux[s] += c[3*r+q] * (gx*ey - gy*ex) / sqrt(len2);
+				share[s]++;
+				if (len2 > hk2)
+					hk2 = len2;
+				ff += f[3*r+q] * f[3*r+q];
+			}
+			eta[first + r] = hk2 * ep->area / 3.0 * ff;
+		}
+	}
+
+	/* 纽曼边上的 h, 在边中点取值 */
+	{
+		int nn = 0, k = 0;
+		double *x, *y, *h;
+		for (int s = 0; s < mesh->edge_num; s++)
+			if (mesh->edges[s].bc == FEM_BC_NEUMANN && share[s] == 1)
+				nn++;
+		make_vector(x, nn + 1);
+		make_vector(y, nn + 1);
+		make_vector(h, nn + 1);
+		for (int s = 0; s < mesh->edge_num; s++)
+			if (mesh->edges[s].bc == FEM_BC_NEUMANN && share[s] == 1) {
+				x[k] = (mesh->edges[s].node[0]->x + mesh->edges[s].node[1]->x) / 2.0;
+				y[k] = (mesh->edges[s].node[0]->y + mesh->edges[s].node[1]->y) / 2.0;
+				k++;
+			}
+		problem_spec_eval_h(spec, x, y, h, nn);
+		for (int s = k = 0; s < mesh->edge_num; s++)
+			if (mesh->edges[s].bc == FEM_BC_NEUMANN && share[s] == 1)
+				hval[s] = h[k++];
+		free_vector(x);
+		free_vector(y);
+		free_vector(h);
+	}
+
+	/* 边上的跳跃 */
+	for (int r = 0; r < mesh->element_num; r++) {
+		struct element *ep = &mesh->elements[r];
+		for (int q = 0; q < 3; q++) {
+			struct edge *e = ep->edge[q];
+			int s = e->edge_id;
+			double ex = ep->edge_vector_x[q], ey = ep->edge_vector_y[q];
+			double len2 = ex*ex + ey*ey, j;
+			if (share[s] == 2)
+				j = 0.5 * flux[s] * flux[s];
+			else if (e->bc == FEM_BC_NEUMANN)
+				j = (hval[s] - flux[s]) * (hval[s] - flux[s]);
+			else
+				continue;
+			/* h_E ∫_E j² = |E|² j² */
+			eta[r] += len2 * j;
+		}
+		eta[r] = sqrt(eta[r]);
+	}
+
+	free_vector(flux);
+	free_vector(hval);
+	free_vector(share);
+}
+
+struct zz_ctx{
+	struct mesh *mesh;
+	const double *u;
+	int *start;		/* 节点→单元关联, CSR 形式 */
+	int *list;
+	double *grad;		/* 单元梯度, 每个单元 2 个分量 */
+	double *recovered;	/* 恢复的节点梯度, 每个节点 2 个分量 */
+	double *eta;
+};
+
+static void zz_element_gradients(void *arg, int begin, int end)
+{
+	struct zz_ctx *c = arg;
+
+	for (int r = begin; r < end; r++)
+		element_gradient(&c->mesh->elements[r], c->u,
+				&c->grad[2*r], &c->grad[2*r+1]);
+}
+
+/*
+ * 在节点 v 的单元片上做超收敛片恢复(SPR):
+ *  用单元重心处的梯度最小二乘拟合线性函数 a + b(x-xv) + c(y-yv), 取 a 作为节点梯度.
+ *  单元少于 3 个或者法方程奇异时(多见于边界节点), 退回到面积加权平均.
+ */
+static void zz_recover_node(struct zz_ctx *c, int v)
+{
+	struct node *np = &c->mesh->nodes[v];
+	double M[3][3] = {{0}}, rx[3] = {0}, ry[3] = {0};
+	double wsum = 0.0, gx = 0.0, gy = 0.0;
+	int m = c->start[v+1] - c->start[v];
+
+	for (int p = c->start[v]; p < c->start[v+1]; p++) {
+		int r = c->list[p];
+		struct element *ep = &c->mesh->elements[r];
+		double px[3];
+		px[0] = 1.0;
+		px[1] = (ep->node[0]->x + ep->node[1]->x + ep->node[2]->x) / 3.0 - np->x;
+		px[2] = (ep->node[0]->y + ep->node[1]->y + ep->node[2]->y) / 3.0 - np->y;
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++)
+				M[i][j] += px[i] * px[j];
+			rx[i] += px[i] * c->grad[2*r];
+			ry[i] += px[i] * c->grad[2*r+1];
+		}
+		wsum += ep->area;
+		gx += ep->area * c->grad[2*r];
+		gy += ep->area * c->grad[2*r+1];
+	}
+
+	if (m >= 3) {
+		/* Cramer's rule; only the constant coefficient is needed */
+		double det = M[0][0]*(M[1][1]*M[2][2] - M[1][2]*M[2][1])
+			- M[0][1]*(M[1][0]*M[2][2] - M[1][2]*M[2][0])
+			+ M[0][2]*(M[1][0]*M[2][1] - M[1][1]*M[2][0]);
+		double scale = M[1][1] + M[2][2];
+		if (fabs(det) > 1e-10 * scale * scale * m) {
+			double c00 = M[1][1]*M[2][2] - M[1][2]*M[2][1];
+			double c01 = M[0][2]*M[2][1] - M[0][1]*M[2][2];
+			double c02 = M[0][1]*M[1][2] - M[0][2]*M[1][1];
+			c->recovered[2*v]   = (c00*rx[0] + c01*rx[1] + c02*rx[2]) / det;
+			c->recovered[2*v+1] = (c00*ry[0] + c01*ry[1] + c02*ry[2]) / det;
+			return;
+		}
+	}
+	c->recovered[2*v]   = gx / wsum;
+	c->recovered[2*v+1] = gy / wsum;
+}
+
+static void zz_recover_range(void *arg, int begin, int end)
+{
+	for (int v = begin; v < end; v++)
+		zz_recover_node(arg, v);
+}
+
+/* η_K² = ∫_K |G - ∇u_h|², G 为恢复梯度的线性插值, 用边中点公式积分 */
+static void zz_indicator_range(void *arg, int begin, int end)
+{
+	struct zz_ctx *c = arg;
+
+	for (int r = begin; r < end; r++) {
+		struct element *ep = &c->mesh->elements[r];
+		double s = 0.0;
+		for (int q = 0; q < 3; q++) {
+			int a = ep->node[(q+1)%3]->node_id;
+			int b = ep->node[(q+2)%3]->node_id;
+			double dx = (c->recovered[2*a] + c->recovered[2*b]) / 2.0 - c->grad[2*r];
+			double dy = (c->recovered[2*a+1] + c->recovered[2*b+1]) / 2.0 - c->grad[2*r+1];
+			s += dx*dx + dy*dy;
+		}
+		c->eta[r] = sqrt(ep->area / 3.0 * s);
+	}
+}
+
+/**
+ * @name estimate_zz - Zienkiewicz–Zhu 梯度恢复型误差指示子
+ * @param 1.mesh 网格 2.u 有限元解 3.eta 输出, 长度 element_num
+ * @note
+ * 	不需要 u_exact. 单元梯度、节点恢复和单元指示子三步都用 parallel_for() 并行,
+ * 	节点恢复通过节点→单元关联表访问每个节点周围的单元片
+*/
+void estimate_zz(struct mesh *mesh, const double *u, double *eta)
+{
+	struct zz_ctx c;
+	int n = mesh->node_num;
+
+	c.mesh = mesh;
+	c.u = u;
+	c.eta = eta;
+	make_vector(c.start, n + 1);
+	make_vector(c.list, 3 * mesh->element_num);
+	make_vector(c.grad, 2 * mesh->element_num);
+	make_vector(c.recovered, 2 * n);
+
+	for (int v = 0; v <= n; v++)
+		c.start[v] = 0;
+	for (int r = 0; r < mesh->element_num; r++)
+		for (int i = 0; i < 3; i++)
+			c.start[mesh->elements[r].node[i]->node_id + 1]++;
+	for (int v = 0; v < n; v++)
+		c.start[v+1] += c.start[v];
+	for (int r = 0; r < mesh->element_num; r++)
+		for (int i = 0; i < 3; i++)
+			c.list[c.start[mesh->elements[r].node[i]->node_id]++] = r;
+	for (int v = n; v > 0; v--)	/* undo the shift from filling */
+		c.start[v] = c.start[v-1];
+	c.start[0] = 0;
+
+	parallel_for(mesh->element_num, 4096, zz_element_gradients, &c);
+	parallel_for(n, 2048, zz_recover_range, &c);
+	parallel_for(mesh->element_num, 4096, zz_indicator_range, &c);
+
+	free_vector(c.start);
+	free_vector(c.list);
+	free_vector(c.grad);
+	free_vector(c.recovered);
+}
+
+/* 整体误差估计 sqrt(Σ eta²) */
+double estimate_total(const double *eta, int element_num)
+{
+	double sum = 0.0;
+
+	for (int r = 0; r < element_num; r++)
+		sum += eta[r] * eta[r];
+	return sqrt(sum);
+}
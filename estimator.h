@@ -0,0 +1,17 @@
+/*
+ * estimator.h
+ *  后验误差估计: 由有限元解 u 计算每个单元上的误差指示子 eta[r],
+ *  整体误差估计为 sqrt(Σ eta[r]²)
+ */
+#ifndef ESTIMATOR_H
+#define ESTIMATOR_H
+
+#include "mesh.h"
+#include "problem-spec.h"
+
+void estimate_residual(struct mesh *mesh, struct problem_spec *spec,
+        const double *u, double *eta);
+void estimate_zz(struct mesh *mesh, const double *u, double *eta);
+double estimate_total(const double *eta, int element_num);
+
+#endif
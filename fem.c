@@ -0,0 +1,323 @@
+/**
+ * @file fem.c
+ * @brief 线性(P1)有限元的组装与误差计算
+ * @details
+ *  求解 ∇·(η∇u) + f = 0, 其中狄利克雷节点(bc == FEM_BC_DIRICHLET)上 u = g,
+ *  纽曼边(bc == FEM_BC_NEUMANN)上 η·∂u/∂n = h.
+ *
+ *  单元上的积分采用三边中点公式(对二次多项式精确),
+ *  纽曼边上的积分采用两点 Gauss 公式.
+ *  每次把 FEM_BLOCK 个单元的积分点坐标收集起来, 一次性调用批量回调.
+ *
+ *  狄利克雷条件通过消元施加: 狄利克雷节点对应的行和列除对角元(=1)外都置零,
+ *  已知值移到右端项, 因此刚度矩阵保持对称正定.
+*/
+#include <math.h>
+#include <stdlib.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "fem.h"
+
+static int is_dirichlet(const struct node *np)
+{
+	return np->bc == FEM_BC_DIRICHLET;
+}
+
+/*
+ * 收集 [first, first+count) 单元的三个边中点
+ *  第 q 个积分点是第 q 个顶点所对的边的中点
+ */
+static void gather_edge_midpoints(struct element *elements, int first, int count,
+		double *qx, double *qy)
+{
+	for (int r = 0; r < count; r++) {
+		struct element *ep = &elements[first + r];
+		for (int q = 0; q < 3; q++) {
+			int j = (q+1)%3;
+			int k = (q+2)%3;
+			qx[3*r+q] = (ep->node[j]->x + ep->node[k]->x) / 2.0;
+			qy[3*r+q] = (ep->node[j]->y + ep->node[k]->y) / 2.0;
+		}
+	}
+}
+
+/*
+ * 单元刚度矩阵
+ *  ∇φᵢ = (-eyᵢ, exᵢ)/(2A), 其中 eᵢ 是第 i 个顶点所对的边向量,
+ *  η 取三个边中点上的平均值(∇φ 为常数, 对二次 η 精确)
+ */
+static void element_stiffness(struct element *ep, const double *eta, double k[3][3])
+{
+	double eta_avg = (eta[0] + eta[1] + eta[2]) / 3.0;
+	double c = eta_avg / (4.0 * ep->area);
+
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			k[i][j] = c * (ep->edge_vector_x[i]*ep->edge_vector_x[j]
+					+ ep->edge_vector_y[i]*ep->edge_vector_y[j]);
+}
+
+/*
+ * CSR 结构: 第 i 行包含 i 本身以及与 i 有边相连的节点
+ */
+static struct csr_matrix *make_mesh_pattern(struct mesh *mesh)
+{
+	int n = mesh->node_num;
+	int *deg, *fill;
+	struct csr_matrix *A;
+
+	make_vector(deg, n);
+	for (int i = 0; i < n; i++)
+		deg[i] = 1;
+	for (int s = 0; s < mesh->edge_num; s++) {
+		deg[mesh->edges[s].node[0]->node_id]++;
+		deg[mesh->edges[s].node[1]->node_id]++;
+	}
+
+	A = make_csr_matrix(n, n + 2*mesh->edge_num);
+	A->rowptr[0] = 0;
+	for (int i = 0; i < n; i++)
+		A->rowptr[i+1] = A->rowptr[i] + deg[i];
+
+	fill = deg;	/* reuse as insertion cursor */
+	for (int i = 0; i < n; i++) {
+		fill[i] = A->rowptr[i];
+		A->colind[fill[i]++] = i;
+	}
+	for (int s = 0; s < mesh->edge_num; s++) {
+		int a = mesh->edges[s].node[0]->node_id;
+		int b = mesh->edges[s].node[1]->node_id;
+		A->colind[fill[a]++] = b;
+		A->colind[fill[b]++] = a;
+	}
+
+	/* rows are short; insertion sort keeps columns ascending */
+	for (int i = 0; i < n; i++) {
+		for (int p = A->rowptr[i] + 1; p < A->rowptr[i+1]; p++) {
+			int c = A->colind[p];
+			int q = p - 1;
+			while (q >= A->rowptr[i] && A->colind[q] > c) {
+				A->colind[q+1] = A->colind[q];
+				q--;
+			}
+			A->colind[q+1] = c;
+		}
+	}
+	for (int p = 0; p < A->nnz; p++)
+		A->val[p] = 0.0;
+
+	free_vector(deg);
+	return A;
+}
+
+/**
+ * @name fem_assemble_matrix - 组装刚度矩阵
+ * @param 1.mesh 网格 2.spec 问题规格(只用到 η)
+ * @return 已施加狄利克雷条件的对称正定 CSR 矩阵, 行号即 node_id
+*/
+struct csr_matrix *fem_assemble_matrix(struct mesh *mesh, struct problem_spec *spec)
+{
+	struct csr_matrix *A = make_mesh_pattern(mesh);
+	double qx[3*FEM_BLOCK], qy[3*FEM_BLOCK], eta[3*FEM_BLOCK];
+
+	for (int first = 0; first < mesh->element_num; first += FEM_BLOCK) {
+		int count = mesh->element_num - first;
+		if (count > FEM_BLOCK)
+			count = FEM_BLOCK;
+		gather_edge_midpoints(mesh->elements, first, count, qx, qy);
+		problem_spec_eval_eta(spec, qx, qy, eta, 3*count);
+
+		for (int r = 0; r < count; r++) {
+			struct element *ep = &mesh->elements[first + r];
+			double k[3][3];
+			element_stiffness(ep, &eta[3*r], k);
+			for (int i = 0; i < 3; i++) {
+				if (is_dirichlet(ep->node[i]))
+					continue;
+				for (int j = 0; j < 3; j++) {
+					if (is_dirichlet(ep->node[j]))
+						continue;
+					int p = csr_find(A, ep->node[i]->node_id,
+							ep->node[j]->node_id);
+					A->val[p] += k[i][j];
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < mesh->node_num; i++)
+		if (is_dirichlet(&mesh->nodes[i]))
+			A->val[csr_find(A, i, i)] = 1.0;
+
+	return A;
+}
+
+/*
+ * 纽曼边上的两点 Gauss 积分: ∫ h φ ds
+ */
+static void assemble_neumann(struct mesh *mesh, struct problem_spec *spec, double *b)
+{
+	double t0 = (1.0 - 1.0/sqrt(3.0)) / 2.0;
+	double t[2] = { t0, 1.0 - t0 };
+	struct edge *list[FEM_BLOCK];
+	double qx[2*FEM_BLOCK], qy[2*FEM_BLOCK], h[2*FEM_BLOCK];
+	int count = 0;
+
+	for (int s = 0; s <= mesh->edge_num; s++) {
+		if (s < mesh->edge_num && mesh->edges[s].bc == FEM_BC_NEUMANN) {
+			struct edge *e = &mesh->edges[s];
+			for (int q = 0; q < 2; q++) {
+				qx[2*count+q] = (1-t[q])*e->node[0]->x + t[q]*e->node[1]->x;
+				qy[2*count+q] = (1-t[q])*e->node[0]->y + t[q]*e->node[1]->y;
+			}
+			list[count++] = e;
+		}
+		if (count == FEM_BLOCK || (s == mesh->edge_num && count > 0)) {
+			problem_spec_eval_h(spec, qx, qy, h, 2*count);
+			for (int r = 0; r < count; r++) {
+				struct edge *e = list[r];
+				double len = hypot(e->node[1]->x - e->node[0]->x,
+						e->node[1]->y - e->node[0]->y);
+				for (int q = 0; q < 2; q++) {
+					double w = len / 2.0 * h[2*r+q];
+					b[e->node[0]->node_id] += w * (1 - t[q]);
+					b[e->node[1]->node_id] += w * t[q];
+				}
+			}
+			count = 0;
+		}
+	}
+}
+
+/**
+ * @name fem_assemble_load - 组装右端项
+ * @param 1.mesh 网格 2.spec 问题规格 3.b 输出, 长度 node_num
+ * @note
+ * 	b 与 fem_assemble_matrix() 得到的矩阵配套使用:
+ * 	狄利克雷节点上 b = g, 其余节点上的 g 已经通过消元移到右端
+*/
+void fem_assemble_load(struct mesh *mesh, struct problem_spec *spec, double *b)
+{
+	int n = mesh->node_num;
+	double *gx, *gy, *g;
+	double qx[3*FEM_BLOCK], qy[3*FEM_BLOCK], f[3*FEM_BLOCK], eta[3*FEM_BLOCK];
+
+	/* 狄利克雷值: 所有节点一次性计算, 非狄利克雷节点上置零 */
+	make_vector(gx, n);
+	make_vector(gy, n);
+	make_vector(g, n);
+	for (int i = 0; i < n; i++) {
+		gx[i] = mesh->nodes[i].x;
+		gy[i] = mesh->nodes[i].y;
+	}
+	problem_spec_eval_g(spec, gx, gy, g, n);
+	for (int i = 0; i < n; i++) {
+		if (!is_dirichlet(&mesh->nodes[i]))
+			g[i] = 0.0;
+		b[i] = 0.0;
+	}
+
+	for (int first = 0; first < mesh->element_num; first += FEM_BLOCK) {
+		int count = mesh->element_num - first;
+		if (count > FEM_BLOCK)
+			count = FEM_BLOCK;
+		gather_edge_midpoints(mesh->elements, first, count, qx, qy);
+		problem_spec_eval_f(spec, qx, qy, f, 3*count);
+		problem_spec_eval_eta(spec, qx, qy, eta, 3*count);
+
+		for (int r = 0; r < count; r++) {
+			struct element *ep = &mesh->elements[first + r];
+			double *fr = &f[3*r];
+			double k[3][3];
+			/* φᵢ 在所对边中点为 0, 在另两个边中点为 1/2 */
+			for (int i = 0; i < 3; i++)
+				b[ep->node[i]->node_id] += ep->area / 6.0
+					* (fr[0] + fr[1] + fr[2] - fr[i]);
+
+			element_stiffness(ep, &eta[3*r], k);
+			for (int i = 0; i < 3; i++)
+				for (int j = 0; j < 3; j++)
+					b[ep->node[i]->node_id] -= k[i][j]
+						* g[ep->node[j]->node_id];
+		}
+	}
+
+	assemble_neumann(mesh, spec, b);
+
+	for (int i = 0; i < n; i++)
+		if (is_dirichlet(&mesh->nodes[i]))
+			b[i] = g[i];
+
+	free_vector(gx);
+	free_vector(gy);
+	free_vector(g);
+}
+
+/**
+ * @name fem_errors - 计算有限元解与精确解之间的误差
+ * @param 1.mesh 网格 2.spec 问题规格(需要 u_exact) 3.u 有限元解, 下标为 node_id
+ * 	4.l2 输出 ‖u - u_h‖_L2 5.h1 输出 |I_h u - u_h|_H1
+ * @note
+ * 	spec 中只有 u_exact 而没有其梯度, 所以 H1 误差用节点插值 I_h u 代替 u 计算;
+ * 	l2 或 h1 为 NULL 时不计算相应的量
+*/
+void fem_errors(struct mesh *mesh, struct problem_spec *spec, const double *u,
+		double *l2, double *h1)
+{
+	double qx[3*FEM_BLOCK], qy[3*FEM_BLOCK], ue[3*FEM_BLOCK];
+	double sum = 0.0;
+
+	if (l2 != NULL) {
+		for (int first = 0; first < mesh->element_num; first += FEM_BLOCK) {
+			int count = mesh->element_num - first;
+			if (count > FEM_BLOCK)
+				count = FEM_BLOCK;
+			gather_edge_midpoints(mesh->elements, first, count, qx, qy);
+			problem_spec_eval_u_exact(spec, qx, qy, ue, 3*count);
+			for (int r = 0; r < count; r++) {
+				struct element *ep = &mesh->elements[first + r];
+				double s = 0.0;
+				for (int q = 0; q < 3; q++) {
+					double uh = (u[ep->node[(q+1)%3]->node_id]
+						+ u[ep->node[(q+2)%3]->node_id]) / 2.0;
+					double d = uh - ue[3*r+q];
+					s += d*d;
+				}
+				sum += ep->area / 3.0 * s;
+			}
+		}
+		*l2 = sqrt(sum);
+	}
+
+	if (h1 != NULL) {
+		int n = mesh->node_num;
+		double *x, *y, *d;
+		make_vector(x, n);
+		make_vector(y, n);
+		make_vector(d, n);
+		for (int i = 0; i < n; i++) {
+			x[i] = mesh->nodes[i].x;
+			y[i] = mesh->nodes[i].y;
+		}
+		problem_spec_eval_u_exact(spec, x, y, d, n);
+		for (int i = 0; i < n; i++)
+			d[i] = u[i] - d[i];
+
+		sum = 0.0;
+		for (int r = 0; r < mesh->element_num; r++) {
+			struct element *ep = &mesh->elements[r];
+			double gx = 0.0, gy = 0.0;
+			for (int i = 0; i < 3; i++) {
+				double di = d[ep->node[i]->node_id];
+				gx -= di * ep->edge_vector_y[i];
+				gy += di * ep->edge_vector_x[i];
+			}
+			/* ∇ = (gx, gy)/(2A), ∫|∇|² = (gx² + gy²)/(4A) */
+			sum += (gx*gx + gy*gy) / (4.0 * ep->area);
+		}
+		*h1 = sqrt(sum);
+		free_vector(x);
+		free_vector(y);
+		free_vector(d);
+	}
+}
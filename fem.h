@@ -0,0 +1,22 @@
+/*
+ * fem.h
+ *  线性(P1)有限元: 组装刚度矩阵、右端项以及计算误差
+ *
+ *  系数函数 f, g, h, η, u_exact 都通过 problem_spec_eval_*() 批量计算,
+ *  每次处理 FEM_BLOCK 个单元的全部积分点, 而不是逐点调用函数指针
+ */
+#ifndef FEM_H
+#define FEM_H
+
+#include "mesh.h"
+#include "problem-spec.h"
+#include "sparse.h"
+
+#define FEM_BLOCK 256   // 每批处理的单元(或边)个数
+
+struct csr_matrix *fem_assemble_matrix(struct mesh *mesh, struct problem_spec *spec);
+void fem_assemble_load(struct mesh *mesh, struct problem_spec *spec, double *b);
+void fem_errors(struct mesh *mesh, struct problem_spec *spec, const double *u,
+        double *l2, double *h1);
+
+#endif
@@ -0,0 +1,1088 @@
+/*
+Gmsh MSH 4.1 files in the binary flavour ("4.1 1 8").
+
+Writing.  mesh_to_msh() puts all triangles on one surface entity and
+gives every distinct nonzero bc value a curve entity whose physical tag
+is that bc value.  Nodes are classified on the curve of their bc (or on
+the surface if the bc is 0) and edges with a nonzero bc become 2-node
+line elements on the curve of their bc, so both node and edge markers
+survive a round trip.  Node tags are node_id + 1.
+
+Reading.  The file is mapped with mmap().  The $Nodes and $Elements
+sections are parsed in two steps: a sequential walk over the block
+headers, which can skip every block in O(1) because its size follows
+from its header, and then a parallel_for() over chunks of at most
+MSH_JOB_ITEMS nodes or elements, which converts them into index arrays.
+Nodes are numbered in the order of their tags.  Only the first physical
+tag of an entity is used:
+
+	node bc		the physical tag of its point or curve entity, otherwise
+			the bc of a line element through it (Dirichlet wins)
+	line bc		the physical tag of its curve entity, MSH_DEFAULT_BC
+			if it has none
+	triangles	3-node and 6-node triangles, the latter by their corners,
+			turned counterclockwise if necessary
+
+Lines (2- and 3-node) and triangles are kept, all other element types
+are skipped.  msh_to_mesh() needs triangles and keeps the bc of the
+lines that are edges of the triangulation.  msh_to_problem_spec() turns
+the lines into the segments of a PSLG; if the file also has triangles,
+each loop of lines gets a hole point just outside a line that has
+triangles on one side only (the point of the outer loop falls outside
+the domain, where Triangle ignores it).
+
+Byte-swapped files, ASCII files and data sizes other than 8 are refused.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "parallel.h"
+#include "gmsh.h"
+
+#define MSH_BUF_SIZE	(1 << 20)
+#define MSH_JOB_ITEMS	(1 << 16)
+#define MSH_MAX_CURVES	64		/* distinct bc values the writer handles */
+#define MSH_HOLE_OFFSET	0.01		/* hole point: mid + offset * (mid - opposite node) */
+
+#define MSH_LINE	1
+#define MSH_TRIANGLE	2
+#define MSH_LINE3	8
+#define MSH_TRIANGLE6	9
+
+/* ---------------- writer ---------------- */
+
+struct msh_out {
+	FILE *fp;
+	unsigned char *buf;
+	size_t len;
+	int err;
+};
+
+static void out_flush(struct msh_out *o)
+{
+	if (fwrite(o->buf, 1, o->len, o->fp) != o->len)
+		o->err = 1;
+	o->len = 0;
+}
+
+static void out_bytes(struct msh_out *o, const void *p, size_t n)
+{
+	if (o->len + n > MSH_BUF_SIZE)
+		out_flush(o);
+	memcpy(o->buf + o->len, p, n);
+	o->len += n;
+}
+
+static void out_int(struct msh_out *o, int v)
+{
+	out_bytes(o, &v, sizeof v);
+}
+
+static void out_size(struct msh_out *o, size_t v)
+{
+	out_bytes(o, &v, sizeof v);
+}
+
+static void out_double(struct msh_out *o, double v)
+{
+	out_bytes(o, &v, sizeof v);
+}
+
+static void out_text(struct msh_out *o, const char *s)
+{
+	out_bytes(o, s, strlen(s));
+}
+
+/* minx miny minz maxx maxy maxz */
+static void out_box(struct msh_out *o, const double *box)
+{
+	out_double(o, box[0]);
+	out_double(o, box[1]);
+	out_double(o, 0.0);
+	out_double(o, box[2]);
+	out_double(o, box[3]);
+	out_double(o, 0.0);
+}
+
+static void box_add(double *box, const struct node *np)
+{
+	if (np->x < box[0]) box[0] = np->x;
+	if (np->y < box[1]) box[1] = np->y;
+	if (np->x > box[2]) box[2] = np->x;
+	if (np->y > box[3]) box[3] = np->y;
+}
+
+static int find_curve(const int *bcs, int curve_num, int bc)
+{
+	for (int c = 0; c < curve_num; c++)
+		if (bcs[c] == bc)
+			return c;
+	return -1;
+}
+
+static int add_curve(int *bcs, int *curve_num, int bc)
+{
+	int c;
+
+	if (bc == 0 || find_curve(bcs, *curve_num, bc) >= 0)
+		return 0;
+	if (*curve_num == MSH_MAX_CURVES)
+		return -1;
+	/* keep bcs sorted */
+	for (c = *curve_num; c > 0 && bcs[c-1] > bc; c--)
+		bcs[c] = bcs[c-1];
+	bcs[c] = bc;
+	(*curve_num)++;
+	return 0;
+}
+
+/**
+ * @name mesh_to_msh - 把网格写成 Gmsh MSH 4.1 二进制文件
+ * @param 1.mesh 网格 2.outfile 文件名
+ * @return 成功返回 0, 失败返回 -1
+ * @note 每个非零的 bc 值对应一条曲线实体, 其物理标记就是 bc 值
+*/
+int mesh_to_msh(struct mesh *mesh, char *outfile)
+{
+	int bcs[MSH_MAX_CURVES], curve_num = 0;
+	long node_count[MSH_MAX_CURVES + 1], edge_count[MSH_MAX_CURVES];
+	double box[MSH_MAX_CURVES + 1][4];
+	struct msh_out o;
+	size_t tag, element_total;
+	int block_num;
+	char line[128];
+
+	for (int i = 0; i < mesh->node_num; i++)
+		if (add_curve(bcs, &curve_num, mesh->nodes[i].bc) != 0)
+			goto too_many;
+	for (int i = 0; i < mesh->edge_num; i++)
+		if (add_curve(bcs, &curve_num, mesh->edges[i].bc) != 0)
+			goto too_many;
+
+	/* per curve (and last, for the surface): node counts and bounding boxes */
+	for (int c = 0; c <= curve_num; c++) {
+		node_count[c] = 0;
+		box[c][0] = box[c][1] = 1e300;
+		box[c][2] = box[c][3] = -1e300;
+	}
+	for (int c = 0; c < curve_num; c++)
+		edge_count[c] = 0;
+	for (int i = 0; i < mesh->node_num; i++) {
+		struct node *np = &mesh->nodes[i];
+		int c = np->bc == 0 ? curve_num : find_curve(bcs, curve_num, np->bc);
+		node_count[c]++;
+		box_add(box[c], np);
+		box_add(box[curve_num], np);
+	}
+	for (int i = 0; i < mesh->edge_num; i++) {
+		struct edge *ep = &mesh->edges[i];
+		int c;
+		if (ep->bc == 0)
+			continue;
+		c = find_curve(bcs, curve_num, ep->bc);
+		edge_count[c]++;
+		box_add(box[c], ep->node[0]);
+		box_add(box[c], ep->node[1]);
+	}
+
+	if ((o.fp = fopen(outfile, "wb")) == NULL) {
+		fprintf(stderr, "cannot open file %s for writing\n", outfile);
+		return -1;
+	}
+	o.buf = xmalloc(MSH_BUF_SIZE);
+	o.len = 0;
+	o.err = 0;
+
+	out_text(&o, "$MeshFormat\n4.1 1 8\n");
+	out_int(&o, 1);
+	out_text(&o, "\n$EndMeshFormat\n");
+
+	sprintf(line, "$PhysicalNames\n%d\n", curve_num + 1);
+	out_text(&o, line);
+	for (int c = 0; c < curve_num; c++) {
+		sprintf(line, "1 %d \"bc%d\"\n", bcs[c], bcs[c]);
+		out_text(&o, line);
+	}
+	out_text(&o, "2 1 \"domain\"\n$EndPhysicalNames\n");
+
+	out_text(&o, "$Entities\n");
+	out_size(&o, 0);
+	out_size(&o, curve_num);
+	out_size(&o, 1);
+	out_size(&o, 0);
+	for (int c = 0; c < curve_num; c++) {
+		out_int(&o, c + 1);
+		out_box(&o, box[c]);
+		out_size(&o, 1);
+		out_int(&o, bcs[c]);
+		out_size(&o, 0);
+	}
+	out_int(&o, 1);
+	out_box(&o, box[curve_num]);
+	out_size(&o, 1);
+	out_int(&o, 1);
+	out_size(&o, curve_num);
+	for (int c = 0; c < curve_num; c++)
+		out_int(&o, c + 1);
+	out_text(&o, "\n$EndEntities\n");
+
+	/* nodes: a block per curve, then the surface */
+	block_num = 0;
+	for (int c = 0; c <= curve_num; c++)
+		block_num += node_count[c] > 0;
+	out_text(&o, "$Nodes\n");
+	out_size(&o, block_num);
+	out_size(&o, mesh->node_num);
+	out_size(&o, 1);
+	out_size(&o, mesh->node_num);
+	for (int c = 0; c <= curve_num; c++) {
+		int bc = c < curve_num ? bcs[c] : 0;
+		if (node_count[c] == 0)
+			continue;
+		out_int(&o, c < curve_num ? 1 : 2);
+		out_int(&o, c < curve_num ? c + 1 : 1);
+		out_int(&o, 0);
+		out_size(&o, node_count[c]);
+		for (int i = 0; i < mesh->node_num; i++)
+			if (mesh->nodes[i].bc == bc)
+				out_size(&o, i + 1);
+		for (int i = 0; i < mesh->node_num; i++) {
+			if (mesh->nodes[i].bc == bc) {
+				out_double(&o, mesh->nodes[i].x);
+				out_double(&o, mesh->nodes[i].y);
+				out_double(&o, mesh->nodes[i].z);
+			}
+		}
+	}
+	out_text(&o, "\n$EndNodes\n");
+
+	/* elements: boundary lines per curve, then the triangles */
+	block_num = 1;
+	element_total = mesh->element_num;
+	for (int c = 0; c < curve_num; c++) {
+		block_num += edge_count[c] > 0;
+		element_total += edge_count[c];
+	}
+	out_text(&o, "$Elements\n");
+	out_size(&o, block_num);
+	out_size(&o, element_total);
+	out_size(&o, 1);
+	out_size(&o, element_total);
+	tag = 1;
+	for (int c = 0; c < curve_num; c++) {
+		if (edge_count[c] == 0)
+			continue;
+		out_int(&o, 1);
+		out_int(&o, c + 1);
+		out_int(&o, MSH_LINE);
+		out_size(&o, edge_count[c]);
+		for (int i = 0; i < mesh->edge_num; i++) {
+			struct edge *ep = &mesh->edges[i];
+			if (ep->bc != bcs[c])
+				continue;
+			out_size(&o, tag++);
+			out_size(&o, ep->node[0]->node_id + 1);
+			out_size(&o, ep->node[1]->node_id + 1);
+		}
+	}
+	out_int(&o, 2);
+	out_int(&o, 1);
+	out_int(&o, MSH_TRIANGLE);
+	out_size(&o, mesh->element_num);
+	for (int i = 0; i < mesh->element_num; i++) {
+		out_size(&o, tag++);
+		for (int k = 0; k < 3; k++)
+			out_size(&o, mesh->elements[i].node[k]->node_id + 1);
+	}
+	out_text(&o, "\n$EndElements\n");
+
+	out_flush(&o);
+	xfree(o.buf);
+	if (fclose(o.fp) != 0 || o.err) {
+		fprintf(stderr, "error writing file %s\n", outfile);
+		return -1;
+	}
+	fprintf(stderr, "MSH 已经写入到 %s 文件\n", outfile);
+	return 0;
+
+too_many:
+	fprintf(stderr, "more than %d distinct bc values\n", MSH_MAX_CURVES);
+	return -1;
+}
+
+/* ---------------- reader ---------------- */
+
+struct msh_cursor {
+	const unsigned char *p, *end;
+	int err;
+};
+
+static const unsigned char *take(struct msh_cursor *c, size_t n)
+{
+	const unsigned char *p = c->p;
+
+	if (c->err || (size_t)(c->end - c->p) < n) {
+		c->err = 1;
+		return NULL;
+	}
+	c->p += n;
+	return p;
+}
+
+static int get_int(struct msh_cursor *c)
+{
+	const unsigned char *p = take(c, sizeof(int));
+	int v = 0;
+
+	if (p != NULL)
+		memcpy(&v, p, sizeof v);
+	return v;
+}
+
+static size_t get_size(struct msh_cursor *c)
+{
+	const unsigned char *p = take(c, sizeof(size_t));
+	size_t v = 0;
+
+	if (p != NULL)
+		memcpy(&v, p, sizeof v);
+	return v;
+}
+
+static void skip_space(struct msh_cursor *c)
+{
+	while (c->p < c->end && (*c->p == ' ' || *c->p == '\n' || *c->p == '\r' || *c->p == '\t'))
+		c->p++;
+}
+
+/* the rest of the current line, without the newline */
+static int get_line(struct msh_cursor *c, char *buf, size_t size)
+{
+	size_t n = 0;
+
+	while (c->p < c->end && *c->p != '\n') {
+		if (n + 1 < size)
+			buf[n++] = *c->p;
+		c->p++;
+	}
+	buf[n] = '\0';
+	if (c->p == c->end)
+		return -1;
+	c->p++;
+	return 0;
+}
+
+/* skip to just after the line "$End<name>" */
+static int skip_section(struct msh_cursor *c, const char *name)
+{
+	char tag[80];
+	size_t n;
+
+	snprintf(tag, sizeof tag, "$End%s", name);
+	n = strlen(tag);
+	while (c->p + n <= c->end) {
+		const unsigned char *q = memchr(c->p, '$', c->end - c->p);
+		if (q == NULL || q + n > c->end)
+			break;
+		if (memcmp(q, tag, n) == 0) {
+			char rest[8];
+			c->p = q;
+			return get_line(c, rest, sizeof rest);
+		}
+		c->p = q + 1;
+	}
+	return -1;
+}
+
+struct msh_entity {
+	int tag;
+	int phys;	/* first physical tag, 0 if none */
+};
+
+struct msh_block {
+	const unsigned char *data;
+	int dim, tag, type;
+	int nodes;		/* node blocks: doubles per node; element blocks: nodes per element */
+	long count;
+	long first;		/* position of the first node, line or triangle */
+	int bc;
+};
+
+struct msh_job {
+	int block;
+	long begin, end;
+};
+
+struct msh_data {
+	struct msh_entity *ent[4];
+	int ent_num[4];
+
+	int node_num;
+	size_t min_tag, tag_span;
+	int *tag2idx;
+	double *xy;
+	int *node_bc;
+
+	int line_num, tri_num;
+	int *line_node, *line_bc;
+	int *tri_node;
+
+	/* the section being converted in parallel */
+	struct msh_block *blocks;
+	struct msh_job *jobs;
+	int pass;
+	atomic_int err;
+};
+
+static int cmp_entity(const void *a, const void *b)
+{
+	const struct msh_entity *x = a, *y = b;
+	return (x->tag > y->tag) - (x->tag < y->tag);
+}
+
+static int entity_phys(const struct msh_data *d, int dim, int tag)
+{
+	struct msh_entity key, *e;
+
+	if (dim < 0 || dim > 3 || d->ent[dim] == NULL)
+		return 0;
+	key.tag = tag;
+	e = bsearch(&key, d->ent[dim], d->ent_num[dim], sizeof key, cmp_entity);
+	return e != NULL ? e->phys : 0;
+}
+
+static int parse_entities(struct msh_cursor *c, struct msh_data *d)
+{
+	size_t num[4];
+
+	for (int dim = 0; dim < 4; dim++) {
+		num[dim] = get_size(c);
+		if (num[dim] > (size_t)(c->end - c->p))
+			return -1;
+	}
+	for (int dim = 0; dim < 4; dim++) {
+		make_vector(d->ent[dim], num[dim] > 0 ? num[dim] : 1);
+		d->ent_num[dim] = num[dim];
+		for (size_t i = 0; i < num[dim] && !c->err; i++) {
+			size_t nphys, nbound;
+			d->ent[dim][i].tag = get_int(c);
+			take(c, (dim == 0 ? 3 : 6) * sizeof(double));
+			nphys = get_size(c);
+			d->ent[dim][i].phys = nphys > 0 ? get_int(c) : 0;
+			if (nphys > 1 && take(c, (nphys - 1) * sizeof(int)) == NULL)
+				break;
+			if (dim > 0) {
+				nbound = get_size(c);
+				if (nbound > (size_t)(c->end - c->p) / sizeof(int))
+					c->err = 1;
+				else
+					take(c, nbound * sizeof(int));
+			}
+		}
+		qsort(d->ent[dim], d->ent_num[dim], sizeof *d->ent[dim], cmp_entity);
+	}
+	return c->err ? -1 : 0;
+}
+
+/* split the blocks into jobs of at most MSH_JOB_ITEMS items */
+static int make_jobs(struct msh_data *d, int block_num)
+{
+	int n = 0;
+
+	for (int pass = 0; pass < 2; pass++) {
+		n = 0;
+		for (int b = 0; b < block_num; b++) {
+			for (long i = 0; i < d->blocks[b].count; i += MSH_JOB_ITEMS) {
+				if (pass == 1) {
+					d->jobs[n].block = b;
+					d->jobs[n].begin = i;
+					d->jobs[n].end = i + MSH_JOB_ITEMS < d->blocks[b].count
+						? i + MSH_JOB_ITEMS : d->blocks[b].count;
+				}
+				n++;
+			}
+		}
+		if (pass == 0)
+			make_vector(d->jobs, n > 0 ? n : 1);
+	}
+	return n;
+}
+
+/*
+ * Pass 0 marks the tags that occur, pass 1 stores each node at the rank
+ * of its tag, so that the node numbers follow the tags and not the order
+ * of the blocks.
+ */
+static void convert_nodes(void *arg, int begin, int end)
+{
+	struct msh_data *d = arg;
+
+	for (int j = begin; j < end; j++) {
+		const struct msh_job *job = &d->jobs[j];
+		const struct msh_block *b = &d->blocks[job->block];
+		const unsigned char *coords = b->data + b->count * sizeof(size_t);
+		for (long k = job->begin; k < job->end; k++) {
+			size_t tag;
+			int idx;
+			memcpy(&tag, b->data + k * sizeof(size_t), sizeof tag);
+			if (tag < d->min_tag || tag - d->min_tag >= d->tag_span) {
+				atomic_store(&d->err, 1);
+				return;
+			}
+			if (d->pass == 0) {
+				d->tag2idx[tag - d->min_tag] = 0;
+				continue;
+			}
+			idx = d->tag2idx[tag - d->min_tag];
+			memcpy(&d->xy[2*idx], coords + k * b->nodes * sizeof(double),
+					2 * sizeof(double));
+			d->node_bc[idx] = b->bc;
+		}
+	}
+}
+
+static int parse_nodes(struct msh_cursor *c, struct msh_data *d)
+{
+	size_t block_num = get_size(c);
+	size_t node_num = get_size(c);
+	size_t max_tag;
+	long first = 0;
+	int job_num, n = 0;
+
+	d->min_tag = get_size(c);
+	max_tag = get_size(c);
+	if (c->err || node_num > INT_MAX || block_num > (size_t)(c->end - c->p) / 20
+			|| (node_num > 0 && max_tag < d->min_tag))
+		return -1;
+	d->tag_span = node_num > 0 ? max_tag - d->min_tag + 1 : 0;
+	if (d->tag_span > 4 * node_num + (1 << 20)) {
+		fprintf(stderr, "node tags are too sparse\n");
+		return -1;
+	}
+
+	make_vector(d->blocks, block_num > 0 ? block_num : 1);
+	for (size_t i = 0; i < block_num; i++) {
+		struct msh_block *b = &d->blocks[i];
+		int parametric;
+		size_t count;
+		b->dim = get_int(c);
+		b->tag = get_int(c);
+		parametric = get_int(c);
+		count = get_size(c);
+		if (c->err || b->dim < 0 || b->dim > 3 || count > node_num - first)
+			return -1;
+		b->count = count;
+		b->nodes = 3 + (parametric ? b->dim : 0);
+		b->first = first;
+		b->bc = b->dim <= 1 ? entity_phys(d, b->dim, b->tag) : 0;
+		b->data = take(c, count * (sizeof(size_t) + b->nodes * sizeof(double)));
+		if (b->data == NULL)
+			return -1;
+		first += count;
+	}
+	if ((size_t)first != node_num)
+		return -1;
+
+	d->node_num = node_num;
+	make_vector(d->tag2idx, d->tag_span > 0 ? d->tag_span : 1);
+	memset(d->tag2idx, 0xff, d->tag_span * sizeof *d->tag2idx);	/* all -1 */
+	make_vector(d->xy, 2 * (node_num > 0 ? node_num : 1));
+	make_vector(d->node_bc, node_num > 0 ? node_num : 1);
+
+	job_num = make_jobs(d, block_num);
+	atomic_init(&d->err, 0);
+	d->pass = 0;
+	parallel_for(job_num, 1, convert_nodes, d);
+	for (size_t t = 0; t < d->tag_span; t++)
+		if (d->tag2idx[t] == 0)
+			d->tag2idx[t] = n++;
+	if (n != (int)node_num)		/* repeated tags */
+		atomic_store(&d->err, 1);
+	d->pass = 1;
+	if (!atomic_load(&d->err))
+		parallel_for(job_num, 1, convert_nodes, d);
+	free_vector(d->jobs);
+	free_vector(d->blocks);
+	return atomic_load(&d->err) ? -1 : 0;
+}
+
+static int type_nodes(int type)
+{
+	switch (type) {
+	case 1: return 2;	case 2: return 3;	case 3: return 4;
+	case 4: return 4;	case 5: return 8;	case 6: return 6;
+	case 7: return 5;	case 8: return 3;	case 9: return 6;
+	case 10: return 9;	case 11: return 10;	case 12: return 27;
+	case 13: return 18;	case 14: return 14;	case 15: return 1;
+	case 16: return 8;	case 17: return 20;	case 18: return 15;
+	case 19: return 13;	case 20: return 9;	case 21: return 10;
+	case 22: return 12;	case 23: return 15;	case 24: return 15;
+	case 25: return 21;	case 26: return 4;	case 27: return 5;
+	case 28: return 6;	case 29: return 20;	case 30: return 35;
+	case 31: return 56;
+	default: return -1;
+	}
+}
+
+static int node_index(struct msh_data *d, const unsigned char *p)
+{
+	size_t tag;
+	int idx;
+
+	memcpy(&tag, p, sizeof tag);
+	if (tag < d->min_tag || tag - d->min_tag >= d->tag_span
+			|| (idx = d->tag2idx[tag - d->min_tag]) < 0) {
+		atomic_store(&d->err, 1);
+		return 0;
+	}
+	return idx;
+}
+
+static void convert_elements(void *arg, int begin, int end)
+{
+	struct msh_data *d = arg;
+
+	for (int j = begin; j < end; j++) {
+		const struct msh_job *job = &d->jobs[j];
+		const struct msh_block *b = &d->blocks[job->block];
+		size_t stride = (1 + b->nodes) * sizeof(size_t);
+		for (long k = job->begin; k < job->end; k++) {
+			const unsigned char *p = b->data + k * stride + sizeof(size_t);
+			long i = b->first + k;
+			if (b->type == MSH_LINE || b->type == MSH_LINE3) {
+				d->line_node[2*i] = node_index(d, p);
+				d->line_node[2*i+1] = node_index(d, p + sizeof(size_t));
+				d->line_bc[i] = b->bc;
+			} else {
+				int *t = &d->tri_node[3*i];
+				const double *xy = d->xy;
+				double area;
+				t[0] = node_index(d, p);
+				t[1] = node_index(d, p + sizeof(size_t));
+				t[2] = node_index(d, p + 2 * sizeof(size_t));
+				area = (xy[2*t[1]] - xy[2*t[0]]) * (xy[2*t[2]+1] - xy[2*t[0]+1])
+					- (xy[2*t[1]+1] - xy[2*t[0]+1]) * (xy[2*t[2]] - xy[2*t[0]]);
+				if (area < 0) {
+					int tmp = t[1];
+					t[1] = t[2];
+					t[2] = tmp;
+				}
+			}
+		}
+	}
+}
+
+static int parse_elements(struct msh_cursor *c, struct msh_data *d)
+{
+	size_t block_num = get_size(c);
+	size_t element_num = get_size(c);
+	long lines = 0, tris = 0, seen = 0;
+	int kept = 0, job_num;
+
+	get_size(c);
+	get_size(c);
+	if (c->err || d->tag2idx == NULL || block_num > (size_t)(c->end - c->p) / 20)
+		return -1;
+
+	make_vector(d->blocks, block_num > 0 ? block_num : 1);
+	for (size_t i = 0; i < block_num; i++) {
+		struct msh_block b;
+		size_t count;
+		b.dim = get_int(c);
+		b.tag = get_int(c);
+		b.type = get_int(c);
+		count = get_size(c);
+		b.nodes = type_nodes(b.type);
+		if (c->err || b.nodes < 0 || count > element_num - seen)
+			return -1;
+		b.count = count;
+		b.data = take(c, count * (1 + b.nodes) * sizeof(size_t));
+		if (b.data == NULL)
+			return -1;
+		seen += count;
+		if (b.type == MSH_LINE || b.type == MSH_LINE3) {
+			b.bc = entity_phys(d, b.dim, b.tag);
+			if (b.bc == 0)
+				b.bc = MSH_DEFAULT_BC;
+			b.first = lines;
+			lines += count;
+		} else if (b.type == MSH_TRIANGLE || b.type == MSH_TRIANGLE6) {
+			b.bc = 0;
+			b.first = tris;
+			tris += count;
+		} else
+			continue;
+		d->blocks[kept++] = b;
+	}
+	if (lines > INT_MAX / 2 || tris > INT_MAX / 3)
+		return -1;
+
+	d->line_num = lines;
+	d->tri_num = tris;
+	make_vector(d->line_node, 2 * (lines > 0 ? lines : 1));
+	make_vector(d->line_bc, lines > 0 ? lines : 1);
+	make_vector(d->tri_node, 3 * (tris > 0 ? tris : 1));
+
+	job_num = make_jobs(d, kept);
+	atomic_init(&d->err, 0);
+	parallel_for(job_num, 1, convert_elements, d);
+	free_vector(d->jobs);
+	free_vector(d->blocks);
+	return atomic_load(&d->err) ? -1 : 0;
+}
+
+static void free_msh_data(struct msh_data *d)
+{
+	for (int dim = 0; dim < 4; dim++)
+		free_vector(d->ent[dim]);
+	free_vector(d->tag2idx);
+	free_vector(d->xy);
+	free_vector(d->node_bc);
+	free_vector(d->line_node);
+	free_vector(d->line_bc);
+	free_vector(d->tri_node);
+	free_vector(d->blocks);
+	free_vector(d->jobs);
+}
+
+/* node bc not given by an entity: take it from the lines, Dirichlet first */
+static void node_bc_from_lines(struct msh_data *d)
+{
+	char *fixed;
+
+	make_vector(fixed, d->node_num > 0 ? d->node_num : 1);
+	for (int i = 0; i < d->node_num; i++)
+		fixed[i] = d->node_bc[i] != 0;
+	for (int i = 0; i < 2 * d->line_num; i++) {
+		int v = d->line_node[i], bc = d->line_bc[i/2];
+		if (fixed[v])
+			continue;
+		if (d->node_bc[v] == 0 || bc == FEM_BC_DIRICHLET)
+			d->node_bc[v] = bc;
+	}
+	free_vector(fixed);
+}
+
+static int msh_read(char *infile, struct msh_data *d)
+{
+	struct msh_cursor c;
+	struct stat st;
+	void *base;
+	char line[128];
+	double version;
+	int file_type, data_size, one, fd, status = -1;
+
+	memset(d, 0, sizeof *d);
+	if ((fd = open(infile, O_RDONLY)) < 0) {
+		fprintf(stderr, "cannot open file %s for reading\n", infile);
+		return -1;
+	}
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		fprintf(stderr, "%s: not a MSH file\n", infile);
+		close(fd);
+		return -1;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, "cannot map file %s\n", infile);
+		return -1;
+	}
+	c.p = base;
+	c.end = c.p + st.st_size;
+	c.err = 0;
+
+	if (get_line(&c, line, sizeof line) != 0 || strcmp(line, "$MeshFormat") != 0
+			|| get_line(&c, line, sizeof line) != 0
+			|| sscanf(line, "%lf %d %d", &version, &file_type, &data_size) != 3) {
+		fprintf(stderr, "%s: not a MSH file\n", infile);
+		goto out;
+	}
+	if (version < 4.1 || version >= 5 || file_type != 1 || data_size != sizeof(size_t)) {
+		fprintf(stderr, "%s: only binary MSH 4.1 files are supported\n", infile);
+		goto out;
+	}
+	one = get_int(&c);
+	if (one != 1) {
+		fprintf(stderr, "%s: byte-swapped MSH files are not supported\n", infile);
+		goto out;
+	}
+	if (skip_section(&c, "MeshFormat") != 0)
+		goto corrupt;
+
+	for (;;) {
+		int r = 0;
+		skip_space(&c);
+		if (c.p == c.end)
+			break;
+		if (*c.p != '$' || get_line(&c, line, sizeof line) != 0)
+			goto corrupt;
+		if (strcmp(line, "$Entities") == 0)
+			r = parse_entities(&c, d);
+		else if (strcmp(line, "$Nodes") == 0)
+			r = parse_nodes(&c, d);
+		else if (strcmp(line, "$Elements") == 0)
+			r = parse_elements(&c, d);
+		if (r != 0 || skip_section(&c, line + 1) != 0)
+			goto corrupt;
+	}
+	if (d->tag2idx == NULL || d->line_node == NULL) {
+		fprintf(stderr, "%s: no nodes or elements\n", infile);
+		goto out;
+	}
+	node_bc_from_lines(d);
+	status = 0;
+	goto out;
+
+corrupt:
+	fprintf(stderr, "%s: corrupt or truncated MSH file\n", infile);
+out:
+	munmap(base, st.st_size);
+	if (status != 0)
+		free_msh_data(d);
+	return status;
+}
+
+/*
+ * Edges of the triangles, bucketed by their smaller node.  Edge k of
+ * triangle t is opposite its node k.  The edges with smaller node v are
+ * edge_start[v] .. edge_start[v+1]-1, so that they can be looked up.
+ */
+struct msh_edges {
+	int edge_num;
+	int *edge_node, *element_edge;
+	int *edge_start;
+	int *tri_count, *first_tri;	/* triangles on each edge */
+};
+
+static void build_edges(const struct msh_data *d, struct msh_edges *E)
+{
+	int n = d->node_num, m = 3 * d->tri_num;
+	int *start, *slot;
+
+	make_vector(start, n + 1);
+	make_vector(slot, m > 0 ? m : 1);
+	for (int v = 0; v <= n; v++)
+		start[v] = 0;
+	for (int s = 0; s < m; s++) {
+		int a = d->tri_node[3*(s/3) + (s%3+1)%3], b = d->tri_node[3*(s/3) + (s%3+2)%3];
+		start[(a < b ? a : b) + 1]++;
+	}
+	for (int v = 0; v < n; v++)
+		start[v+1] += start[v];
+	for (int s = 0; s < m; s++) {
+		int a = d->tri_node[3*(s/3) + (s%3+1)%3], b = d->tri_node[3*(s/3) + (s%3+2)%3];
+		slot[start[a < b ? a : b]++] = s;
+	}
+	for (int v = n; v > 0; v--)
+		start[v] = start[v-1];
+	start[0] = 0;
+
+	make_vector(E->edge_node, 2 * (m > 0 ? m : 1));
+	make_vector(E->element_edge, m > 0 ? m : 1);
+	make_vector(E->edge_start, n + 1);
+	make_vector(E->tri_count, m > 0 ? m : 1);
+	make_vector(E->first_tri, m > 0 ? m : 1);
+	E->edge_num = 0;
+	for (int v = 0; v < n; v++) {
+		int first = E->edge_num;
+		E->edge_start[v] = first;
+		for (int p = start[v]; p < start[v+1]; p++) {
+			int s = slot[p], t = s / 3;
+			int a = d->tri_node[3*t + (s%3+1)%3], b = d->tri_node[3*t + (s%3+2)%3];
+			int hi = a < b ? b : a, e;
+			for (e = first; e < E->edge_num; e++)
+				if (E->edge_node[2*e+1] == hi)
+					break;
+			if (e == E->edge_num) {
+				E->edge_node[2*e] = v;
+				E->edge_node[2*e+1] = hi;
+				E->tri_count[e] = 0;
+				E->first_tri[e] = t;
+				E->edge_num++;
+			}
+			E->tri_count[e]++;
+			E->element_edge[s] = e;
+		}
+	}
+	E->edge_start[n] = E->edge_num;
+	free_vector(start);
+	free_vector(slot);
+}
+
+static int find_edge(const struct msh_edges *E, int a, int b)
+{
+	int lo = a < b ? a : b, hi = a < b ? b : a;
+
+	for (int e = E->edge_start[lo]; e < E->edge_start[lo+1]; e++)
+		if (E->edge_node[2*e+1] == hi)
+			return e;
+	return -1;
+}
+
+static void free_edges(struct msh_edges *E)
+{
+	free_vector(E->edge_node);
+	free_vector(E->element_edge);
+	free_vector(E->edge_start);
+	free_vector(E->tri_count);
+	free_vector(E->first_tri);
+}
+
+/**
+ * @name msh_to_mesh - 读入 Gmsh MSH 4.1 二进制文件中的三角形网格
+ * @param 1.infile 文件名
+ * @return 网格, 失败返回 NULL
+ * @note 边由三角形生成, 与线单元重合的边取线单元的 bc
+*/
+struct mesh *msh_to_mesh(char *infile)
+{
+	struct msh_data d;
+	struct msh_edges E;
+	struct mesh *mesh;
+	int *edge_bc;
+
+	if (msh_read(infile, &d) != 0)
+		return NULL;
+	if (d.tri_num == 0) {
+		fprintf(stderr, "%s: no triangles\n", infile);
+		free_msh_data(&d);
+		return NULL;
+	}
+	build_edges(&d, &E);
+	make_vector(edge_bc, E.edge_num);
+	for (int e = 0; e < E.edge_num; e++)
+		edge_bc[e] = 0;
+	for (int i = 0; i < d.line_num; i++) {
+		int e = find_edge(&E, d.line_node[2*i], d.line_node[2*i+1]);
+		if (e >= 0)
+			edge_bc[e] = d.line_bc[i];
+	}
+	mesh = mesh_from_arrays(d.node_num, d.xy, d.node_bc,
+			E.edge_num, E.edge_node, edge_bc,
+			d.tri_num, d.tri_node, E.element_edge);
+	free_vector(edge_bc);
+	free_edges(&E);
+	free_msh_data(&d);
+	return mesh;
+}
+
+static int find_root(int *parent, int v)
+{
+	while (parent[v] != v) {
+		parent[v] = parent[parent[v]];
+		v = parent[v];
+	}
+	return v;
+}
+
+/* a point just outside each loop of lines, where the triangles stop */
+static int find_holes(const struct msh_data *d, struct problem_spec_hole **holes)
+{
+	struct msh_edges E;
+	int *parent;
+	char *done;
+	int hole_num = 0;
+
+	build_edges(d, &E);
+	make_vector(parent, d->node_num);
+	make_vector(done, d->node_num);
+	for (int v = 0; v < d->node_num; v++) {
+		parent[v] = v;
+		done[v] = 0;
+	}
+	for (int i = 0; i < d->line_num; i++) {
+		int a = find_root(parent, d->line_node[2*i]);
+		int b = find_root(parent, d->line_node[2*i+1]);
+		parent[a] = b;
+	}
+
+	make_vector(*holes, d->line_num > 0 ? d->line_num : 1);
+	for (int i = 0; i < d->line_num; i++) {
+		int a = d->line_node[2*i], b = d->line_node[2*i+1];
+		int r = find_root(parent, a), e, t, c;
+		double mx, my;
+		if (done[r] || (e = find_edge(&E, a, b)) < 0 || E.tri_count[e] != 1)
+			continue;
+		t = E.first_tri[e];
+		c = d->tri_node[3*t] != a && d->tri_node[3*t] != b ? d->tri_node[3*t]
+			: d->tri_node[3*t+1] != a && d->tri_node[3*t+1] != b ? d->tri_node[3*t+1]
+			: d->tri_node[3*t+2];
+		mx = (d->xy[2*a] + d->xy[2*b]) / 2;
+		my = (d->xy[2*a+1] + d->xy[2*b+1]) / 2;
+		(*holes)[hole_num].x = mx + MSH_HOLE_OFFSET * (mx - d->xy[2*c]);
+		(*holes)[hole_num].y = my + MSH_HOLE_OFFSET * (my - d->xy[2*c+1]);
+		hole_num++;
+		done[r] = 1;
+	}
+	free_vector(parent);
+	free_vector(done);
+	free_edges(&E);
+	return hole_num;
+}
+
+/**
+ * @name msh_to_problem_spec - 由 Gmsh MSH 4.1 二进制文件中的线单元构造问题规格
+ * @param 1.infile 文件名
+ * @return 问题规格(用 free_problem_spec 释放), 失败返回 NULL
+ * @note 线单元成为线段, 其端点成为点; 文件中有三角形时, 由它们确定洞的位置
+*/
+struct problem_spec *msh_to_problem_spec(char *infile)
+{
+	struct msh_data d;
+	struct problem_spec *spec;
+	int *point_of, n = 0;
+
+	if (msh_read(infile, &d) != 0)
+		return NULL;
+	if (d.line_num == 0) {
+		fprintf(stderr, "%s: no boundary lines\n", infile);
+		free_msh_data(&d);
+		return NULL;
+	}
+
+	spec = xmalloc(sizeof *spec);
+	memset(spec, 0, sizeof *spec);
+	make_vector(point_of, d.node_num);
+	for (int v = 0; v < d.node_num; v++)
+		point_of[v] = -1;
+	for (int i = 0; i < 2 * d.line_num; i++)
+		if (point_of[d.line_node[i]] < 0)
+			point_of[d.line_node[i]] = n++;
+
+	make_vector(spec->points, n);
+	for (int v = 0; v < d.node_num; v++) {
+		int p = point_of[v];
+		if (p < 0)
+			continue;
+		spec->points[p].point_id = p;
+		spec->points[p].x = d.xy[2*v];
+		spec->points[p].y = d.xy[2*v+1];
+		spec->points[p].bc = d.node_bc[v];
+	}
+	make_vector(spec->segments, d.line_num);
+	for (int i = 0; i < d.line_num; i++) {
+		spec->segments[i].segment_id = i;
+		spec->segments[i].point_id1 = point_of[d.line_node[2*i]];
+		spec->segments[i].point_id2 = point_of[d.line_node[2*i+1]];
+		spec->segments[i].bc = d.line_bc[i];
+	}
+	spec->num_points = n;
+	spec->num_segments = d.line_num;
+	if (d.tri_num > 0)
+		spec->num_holes = find_holes(&d, &spec->holes);
+
+	free_vector(point_of);
+	free_msh_data(&d);
+	return spec;
+}
@@ -0,0 +1,13 @@
+#ifndef H_GMSH_H
+#define H_GMSH_H
+
+#include "mesh.h"
+#include "problem-spec.h"
+
+#define MSH_DEFAULT_BC	1	/* bc of boundary lines without a physical tag */
+
+int mesh_to_msh(struct mesh *mesh, char *outfile);
+struct mesh *msh_to_mesh(char *infile);
+struct problem_spec *msh_to_problem_spec(char *infile);
+
+#endif /* H_GMSH_H */
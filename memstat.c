@@ -0,0 +1,263 @@
+/**
+ * @file memstat.c
+ * @brief 按调用点统计内存分配, 见 memstat.h
+ * @details
+ *  调用点保存在以 (file, line) 为键的开放寻址哈希表里; file 是 __FILE__
+ *  字符串常量, 直接比较指针, 同一个源文件在不同编译单元里的指针不同时
+ *  会分成两项, 输出时也不合并. 表满后新的调用点只计入总数.
+ *  每块内存前面的头部记下大小和调用点, 释放时据此扣减.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "memstat.h"
+
+#define MEMSTAT_SITES	1024	/* 哈希表大小, 必须是 2 的幂 */
+
+union memstat_header{
+	struct{
+		size_t size;
+		int site;	/* 在 sites 中的下标, -1 表示没有记下调用点 */
+	} h;
+	unsigned char pad[16];
+};
+
+struct memstat{
+	struct allocator allocator;
+	struct allocator *under;
+	pthread_mutex_t lock;
+	size_t current, peak;
+	long allocs;
+	int site_num;
+	struct memstat_site sites[MEMSTAT_SITES];
+};
+
+static int find_site(struct memstat *ms, const char *file, int line)
+{
+	unsigned k = (unsigned)(((uintptr_t)file >> 3) * 31 + (unsigned)line);
+
+	for (int i = 0; i < MEMSTAT_SITES; i++, k++) {
+		struct memstat_site *s = &ms->sites[k & (MEMSTAT_SITES - 1)];
+		if (s->file == file && s->line == line)
+			return k & (MEMSTAT_SITES - 1);
+		if (s->file == NULL) {
+			if (ms->site_num >= MEMSTAT_SITES / 2)
+				return -1;	/* 保持表足够稀疏 */
+			s->file = file;
+			s->line = line;
+			ms->site_num++;
+			return k & (MEMSTAT_SITES - 1);
+		}
+	}
+	return -1;
+}
+
+/* 调用者持有锁 */
+static void account_alloc(struct memstat *ms, union memstat_header *h,
+		size_t size, int site)
+{
+	h->h.size = size;
+	h->h.site = site;
+	ms->allocs++;
+	ms->current += size;
+	if (ms->current > ms->peak)
+		ms->peak = ms->current;
+	if (site >= 0) {
+		struct memstat_site *s = &ms->sites[site];
+		s->allocs++;
+		s->bytes += size;
+		s->current += size;
+		if (s->current > s->peak)
+			s->peak = s->current;
+	}
+}
+
+static void account_free(struct memstat *ms, union memstat_header *h)
+{
+	ms->current -= h->h.size;
+	if (h->h.site >= 0) {
+		ms->sites[h->h.site].frees++;
+		ms->sites[h->h.site].current -= h->h.size;
+	}
+}
+
+static int current_site(struct memstat *ms)
+{
+	const char *file;
+	int line;
+
+	alloc_site(&file, &line);
+	return file != NULL ? find_site(ms, file, line) : -1;
+}
+
+static void *memstat_alloc(void *ctx, size_t size)
+{
+	struct memstat *ms = ctx;
+	union memstat_header *h;
+
+	if (size > SIZE_MAX - sizeof *h)
+		return NULL;
+	h = ms->under->alloc(ms->under->ctx, sizeof *h + size);
+	if (h == NULL)
+		return NULL;
+	pthread_mutex_lock(&ms->lock);
+	account_alloc(ms, h, size, current_site(ms));
+	pthread_mutex_unlock(&ms->lock);
+	return h + 1;
+}
+
+static void memstat_free(void *ctx, void *ptr)
+{
+	struct memstat *ms = ctx;
+	union memstat_header *h = (union memstat_header *)ptr - 1;
+
+	pthread_mutex_lock(&ms->lock);
+	account_free(ms, h);
+	pthread_mutex_unlock(&ms->lock);
+	ms->under->free(ms->under->ctx, h);
+}
+
+static void *memstat_realloc(void *ctx, void *ptr, size_t size)
+{
+	struct memstat *ms = ctx;
+	union memstat_header *h, old;
+
+	if (ptr == NULL)
+		return memstat_alloc(ctx, size);
+	if (size > SIZE_MAX - sizeof *h)
+		return NULL;
+	h = (union memstat_header *)ptr - 1;
+	old = *h;
+	h = ms->under->realloc(ms->under->ctx, h, sizeof *h + size);
+	if (h == NULL)
+		return NULL;
+	pthread_mutex_lock(&ms->lock);
+	account_free(ms, &old);
+	account_alloc(ms, h, size, current_site(ms));
+	pthread_mutex_unlock(&ms->lock);
+	return h + 1;
+}
+
+/**
+ * @name memstat_create - 创建统计用的分配器
+ * @param 1.under 实际分配内存的分配器, NULL 表示当前线程的分配器
+ * @return 统计分配器, 用 memstat_destroy() 释放
+*/
+struct memstat *memstat_create(struct allocator *under)
+{
+	/* 统计本身不经过被统计的分配器 */
+	struct memstat *ms = calloc(1, sizeof *ms);
+
+	if (ms == NULL) {
+		fprintf(stderr, "%s:%d: calloc(%zu) failed\n", __FILE__, __LINE__,
+				sizeof *ms);
+		exit(EXIT_FAILURE);
+	}
+	ms->allocator.alloc = memstat_alloc;
+	ms->allocator.realloc = memstat_realloc;
+	ms->allocator.free = memstat_free;
+	ms->allocator.ctx = ms;
+	ms->under = under != NULL ? under : get_allocator();
+	pthread_mutex_init(&ms->lock, NULL);
+	return ms;
+}
+
+void memstat_destroy(struct memstat *ms)
+{
+	if (ms == NULL)
+		return;
+	pthread_mutex_destroy(&ms->lock);
+	free(ms);
+}
+
+struct allocator *memstat_allocator(struct memstat *ms)
+{
+	return &ms->allocator;
+}
+
+size_t memstat_current(struct memstat *ms)
+{
+	size_t n;
+
+	pthread_mutex_lock(&ms->lock);
+	n = ms->current;
+	pthread_mutex_unlock(&ms->lock);
+	return n;
+}
+
+size_t memstat_peak(struct memstat *ms)
+{
+	size_t n;
+
+	pthread_mutex_lock(&ms->lock);
+	n = ms->peak;
+	pthread_mutex_unlock(&ms->lock);
+	return n;
+}
+
+long memstat_allocs(struct memstat *ms)
+{
+	long n;
+
+	pthread_mutex_lock(&ms->lock);
+	n = ms->allocs;
+	pthread_mutex_unlock(&ms->lock);
+	return n;
+}
+
+static int compare_peak(const void *p, const void *q)
+{
+	const struct memstat_site *a = p, *b = q;
+	return (a->peak < b->peak) - (a->peak > b->peak);
+}
+
+/**
+ * @name memstat_sites - 取出各调用点的统计
+ * @param 1.ms 统计分配器 2.sites 输出数组 3.max 数组长度
+ * @return 调用点的总数; 只写入峰值最大的 min(总数, max) 个, 按峰值从大到小
+*/
+int memstat_sites(struct memstat *ms, struct memstat_site *sites, int max)
+{
+	struct memstat_site *all = malloc(MEMSTAT_SITES * sizeof *all);
+	int n = 0;
+
+	if (all == NULL)
+		return 0;
+	pthread_mutex_lock(&ms->lock);
+	for (int i = 0; i < MEMSTAT_SITES; i++)
+		if (ms->sites[i].file != NULL)
+			all[n++] = ms->sites[i];
+	pthread_mutex_unlock(&ms->lock);
+	qsort(all, n, sizeof *all, compare_peak);
+	memcpy(sites, all, (n < max ? n : max) * sizeof *all);
+	free(all);
+	return n;
+}
+
+/**
+ * @name memstat_dump - 打印总数和各调用点的统计
+ * @param 1.ms 统计分配器 2.fp 输出文件
+*/
+void memstat_dump(struct memstat *ms, FILE *fp)
+{
+	struct memstat_site *sites = malloc(MEMSTAT_SITES * sizeof *sites);
+	int n;
+
+	if (sites == NULL)
+		return;
+	n = memstat_sites(ms, sites, MEMSTAT_SITES);
+	fprintf(fp, "peak %zu bytes, current %zu bytes, %ld allocations\n",
+			memstat_peak(ms), memstat_current(ms), memstat_allocs(ms));
+	fprintf(fp, "%-28s %10s %10s %14s %14s %14s\n", "site", "allocs", "frees",
+			"bytes", "current", "peak");
+	for (int i = 0; i < n; i++) {
+		char name[64];
+		snprintf(name, sizeof name, "%s:%d", sites[i].file, sites[i].line);
+		fprintf(fp, "%-28s %10ld %10ld %14zu %14zu %14zu\n", name,
+				sites[i].allocs, sites[i].frees, sites[i].bytes,
+				sites[i].current, sites[i].peak);
+	}
+	free(sites);
+}
@@ -0,0 +1,44 @@
+#ifndef MEMSTAT_H
+#define MEMSTAT_H
+
+#include <stdio.h>
+#include "xmalloc.h"
+
+/*
+ * 按调用点统计内存分配
+ *  memstat 是包在另一个分配器外面的分配器(见 xmalloc.h), 安装后经过
+ *  xmalloc, xrealloc, xfree 和 trimalloc, trifree 的分配都会按调用点
+ *  (__FILE__, __LINE__) 记下次数, 当前字节数和峰值字节数.
+ *  每块内存前面多一个 16 字节的头部, 所以统计期间分配的内存必须在统计期间释放,
+ *  反之亦然. 可以被多个线程同时使用(内部加锁).
+ *
+ * 用法:
+ *     struct memstat *ms = memstat_create(NULL);
+ *     struct allocator *old = set_allocator(memstat_allocator(ms));
+ *     mesh = make_mesh(spec, a);
+ *     free_mesh(mesh);
+ *     set_allocator(old);
+ *     printf("%zu\n", memstat_peak(ms));
+ *     memstat_dump(ms, stderr);
+ *     memstat_destroy(ms);
+ */
+struct memstat_site{
+	const char *file;
+	int line;
+	long allocs, frees;	/* 次数, realloc 记为一次分配 */
+	size_t bytes;		/* 累计分配的字节数 */
+	size_t current, peak;	/* 此调用点当前占用和最多占用的字节数 */
+};
+
+struct memstat;
+
+struct memstat *memstat_create(struct allocator *under);
+void memstat_destroy(struct memstat *ms);
+struct allocator *memstat_allocator(struct memstat *ms);
+size_t memstat_current(struct memstat *ms);
+size_t memstat_peak(struct memstat *ms);
+long memstat_allocs(struct memstat *ms);
+int memstat_sites(struct memstat *ms, struct memstat_site *sites, int max);
+void memstat_dump(struct memstat *ms, FILE *fp);
+
+#endif
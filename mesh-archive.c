@@ -0,0 +1,624 @@
+/*
+Compressed mesh archives.
+
+An archive holds one mesh as a single sequential stream, so it can be
+written to and read from pipes as well as files.  After the 8-byte magic
+come the version, the coordinate mode and the counts as varints, then
+
+	connectivity	per element three node codes and three edge codes
+	loose edges	the two nodes of every edge no element refers to
+	coordinates	per node x and y
+	node bc		run-length coded
+	edge bc		run-length coded
+
+All integers are LEB128 varints; signed ones are zigzag coded first.
+
+Before encoding, the elements are put in the order of the Hilbert curve
+through their centroids, and nodes and edges are renumbered in the order
+in which that element walk first meets them.  A reference to a node is
+then coded as (next new node number - node number): 0 for a node seen for
+the first time, and a small number for a node seen recently, which is
+the common case since neighboring elements are close on the curve.
+Edges are coded the same way; a new edge of an element is the one
+opposite node i, so its two nodes need not be stored.  Nodes that belong
+to no element get the numbers after the rest.  The decoded mesh is the
+same mesh up to this renumbering, with edges oriented as in the first
+element that uses them.
+
+Coordinates are coded in node order, each one against the previous
+node's.  With quant_bits = MESH_ARCHIVE_LOSSLESS they are the varint of
+the XOR of the IEEE bit patterns, whose high bits cancel for nearby
+values; otherwise they are quantized to quant_bits bits over the
+bounding box and stored as zigzag deltas.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "mesh-archive.h"
+
+#define ARC_BUF_SIZE	(1 << 20)
+#define ARC_MAX_VARINT	10		/* bytes in the longest 64-bit varint */
+
+#define MIN_QUANT_BITS	8
+#define MAX_QUANT_BITS	32
+
+/* ---------------- byte streams ---------------- */
+
+struct arc_out {
+	FILE *fp;
+	unsigned char *buf;
+	size_t len;
+	int err;
+};
+
+static void out_flush(struct arc_out *o)
+{
+	if (fwrite(o->buf, 1, o->len, o->fp) != o->len)
+		o->err = 1;
+	o->len = 0;
+}
+
+static void put_uvarint(struct arc_out *o, uint64_t v)
+{
+	unsigned char *p;
+
+	if (o->len > ARC_BUF_SIZE - ARC_MAX_VARINT)
+		out_flush(o);
+	p = o->buf + o->len;
+	while (v >= 0x80) {
+		*p++ = (unsigned char)v | 0x80;
+		v >>= 7;
+	}
+	*p++ = (unsigned char)v;
+	o->len = p - o->buf;
+}
+
+static uint64_t zigzag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t u)
+{
+	return (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+}
+
+static void put_raw(struct arc_out *o, const void *p, size_t n)
+{
+	if (o->len > ARC_BUF_SIZE - n)
+		out_flush(o);
+	memcpy(o->buf + o->len, p, n);
+	o->len += n;
+}
+
+struct arc_in {
+	FILE *fp;
+	unsigned char *buf;
+	size_t pos, len;
+	int eof;
+	int err;	/* set on a truncated or malformed stream */
+};
+
+/* keep at least ARC_MAX_VARINT bytes buffered unless the stream ends */
+static void in_refill(struct arc_in *in)
+{
+	size_t n = in->len - in->pos;
+
+	memmove(in->buf, in->buf + in->pos, n);
+	in->pos = 0;
+	in->len = n;
+	while (!in->eof && in->len < ARC_BUF_SIZE) {
+		size_t got = fread(in->buf + in->len, 1, ARC_BUF_SIZE - in->len, in->fp);
+		in->len += got;
+		if (got == 0)
+			in->eof = 1;
+		else
+			break;
+	}
+}
+
+static uint64_t get_uvarint(struct arc_in *in)
+{
+	const unsigned char *p, *end;
+	uint64_t v = 0;
+	int shift = 0;
+
+	if (in->len - in->pos < ARC_MAX_VARINT && !in->eof)
+		in_refill(in);
+	p = in->buf + in->pos;
+	end = in->buf + in->len;
+	if (end - p > ARC_MAX_VARINT)
+		end = p + ARC_MAX_VARINT;
+	while (p < end) {
+		unsigned char c = *p++;
+		v |= (uint64_t)(c & 0x7f) << shift;
+		if (c < 0x80) {
+			in->pos = p - in->buf;
+			return v;
+		}
+		shift += 7;
+	}
+	in->err = 1;
+	in->pos = in->len;
+	return 0;
+}
+
+static void get_raw(struct arc_in *in, void *p, size_t n)
+{
+	if (in->len - in->pos < n && !in->eof)
+		in_refill(in);
+	if (in->len - in->pos < n) {
+		in->err = 1;
+		memset(p, 0, n);
+		return;
+	}
+	memcpy(p, in->buf + in->pos, n);
+	in->pos += n;
+}
+
+/* ---------------- element ordering ---------------- */
+
+/* position of (x, y) on the Hilbert curve through a 65536 x 65536 grid */
+static uint32_t hilbert_key(uint32_t x, uint32_t y)
+{
+	uint32_t d = 0;
+
+	for (uint32_t s = 1u << 15; s > 0; s >>= 1) {
+		uint32_t rx = (x & s) != 0;
+		uint32_t ry = (y & s) != 0;
+		d += s * s * ((3 * rx) ^ ry);
+		if (ry == 0) {
+			uint32_t t;
+			if (rx == 1) {
+				x = 0xffff - x;
+				y = 0xffff - y;
+			}
+			t = x; x = y; y = t;
+		}
+	}
+	return d;
+}
+
+static void bounding_box(struct mesh *mesh, double *box)
+{
+	box[0] = box[2] = mesh->node_num > 0 ? mesh->nodes[0].x : 0.0;
+	box[1] = box[3] = mesh->node_num > 0 ? mesh->nodes[0].y : 0.0;
+	for (int i = 1; i < mesh->node_num; i++) {
+		double x = mesh->nodes[i].x, y = mesh->nodes[i].y;
+		if (x < box[0]) box[0] = x;
+		if (x > box[2]) box[2] = x;
+		if (y < box[1]) box[1] = y;
+		if (y > box[3]) box[3] = y;
+	}
+}
+
+/* element numbers sorted along the Hilbert curve, by a two-pass radix sort */
+static int *hilbert_order(struct mesh *mesh, const double *box)
+{
+	int n = mesh->element_num;
+	double sx = box[2] > box[0] ? 65535.0 / (box[2] - box[0]) : 0.0;
+	double sy = box[3] > box[1] ? 65535.0 / (box[3] - box[1]) : 0.0;
+	uint32_t *key, *key2;
+	int *order, *order2, *count;
+
+	make_vector(key, n);
+	make_vector(key2, n);
+	make_vector(order, n);
+	make_vector(order2, n);
+	make_vector(count, 65536);
+	for (int r = 0; r < n; r++) {
+		struct element *ep = &mesh->elements[r];
+		double cx = (ep->node[0]->x + ep->node[1]->x + ep->node[2]->x) / 3.0;
+		double cy = (ep->node[0]->y + ep->node[1]->y + ep->node[2]->y) / 3.0;
+		key[r] = hilbert_key((uint32_t)((cx - box[0]) * sx),
+				(uint32_t)((cy - box[1]) * sy));
+		order[r] = r;
+	}
+	for (int shift = 0; shift < 32; shift += 16) {
+		int sum = 0;
+		memset(count, 0, 65536 * sizeof *count);
+		for (int r = 0; r < n; r++)
+			count[(key[r] >> shift) & 0xffff]++;
+		for (int b = 0; b < 65536; b++) {
+			int c = count[b];
+			count[b] = sum;
+			sum += c;
+		}
+		for (int r = 0; r < n; r++) {
+			int slot = count[(key[r] >> shift) & 0xffff]++;
+			key2[slot] = key[r];
+			order2[slot] = order[r];
+		}
+		{ uint32_t *t = key; key = key2; key2 = t; }
+		{ int *t = order; order = order2; order2 = t; }
+	}
+	free_vector(key);
+	free_vector(key2);
+	free_vector(order2);
+	free_vector(count);
+	return order;
+}
+
+/* ---------------- encoder ---------------- */
+
+static void put_bc_runs(struct arc_out *o, const int *bc, int n)
+{
+	for (int i = 0; i < n; ) {
+		int j = i + 1;
+		while (j < n && bc[j] == bc[i])
+			j++;
+		put_uvarint(o, zigzag(bc[i]));
+		put_uvarint(o, j - i);
+		i = j;
+	}
+}
+
+static uint64_t double_bits(double x)
+{
+	uint64_t u;
+	memcpy(&u, &x, sizeof u);
+	return u;
+}
+
+static double bits_double(uint64_t u)
+{
+	double x;
+	memcpy(&x, &u, sizeof x);
+	return x;
+}
+
+static uint32_t quantize(double v, double lo, double hi, double qmax)
+{
+	double t = hi > lo ? (v - lo) / (hi - lo) * qmax : 0.0;
+	return (uint32_t)floor(t + 0.5);
+}
+
+static double dequantize(uint32_t q, double lo, double hi, double qmax)
+{
+	return lo + (hi - lo) * (q / qmax);
+}
+
+/**
+ * @name mesh_archive_encode - 把网格压缩写入流
+ * @param 1.fp 输出流 2.mesh 网格 3.quant_bits 坐标量化位数(8 到 32), MESH_ARCHIVE_LOSSLESS 表示无损
+ * @return 成功返回 0, 失败返回 -1
+ * @note 网格中的节点, 边和单元在压缩时会重新编号
+*/
+int mesh_archive_encode(FILE *fp, struct mesh *mesh, int quant_bits)
+{
+	struct arc_out o;
+	double box[4], qmax = 0.0;
+	int *order, *node_new, *edge_new, *node_old, *edge_old, *bc;
+	int next_node = 0, next_edge = 0, status = 0;
+
+	if (quant_bits != MESH_ARCHIVE_LOSSLESS
+			&& (quant_bits < MIN_QUANT_BITS || quant_bits > MAX_QUANT_BITS)) {
+		fprintf(stderr, "quantization must use %d to %d bits\n",
+				MIN_QUANT_BITS, MAX_QUANT_BITS);
+		return -1;
+	}
+
+	o.fp = fp;
+	o.buf = xmalloc(ARC_BUF_SIZE);
+	o.len = 0;
+	o.err = 0;
+
+	bounding_box(mesh, box);
+	put_raw(&o, MESH_ARCHIVE_MAGIC, sizeof MESH_ARCHIVE_MAGIC);
+	put_uvarint(&o, MESH_ARCHIVE_VERSION);
+	put_uvarint(&o, quant_bits);
+	put_uvarint(&o, mesh->node_num);
+	put_uvarint(&o, mesh->edge_num);
+	put_uvarint(&o, mesh->element_num);
+	if (quant_bits != MESH_ARCHIVE_LOSSLESS) {
+		put_raw(&o, box, sizeof box);
+		qmax = ldexp(1.0, quant_bits) - 1.0;
+	}
+
+	order = hilbert_order(mesh, box);
+	make_vector(node_new, mesh->node_num);
+	make_vector(edge_new, mesh->edge_num);
+	make_vector(node_old, mesh->node_num);
+	make_vector(edge_old, mesh->edge_num);
+	for (int i = 0; i < mesh->node_num; i++)
+		node_new[i] = -1;
+	for (int i = 0; i < mesh->edge_num; i++)
+		edge_new[i] = -1;
+
+	/* connectivity; 0 codes a node or edge met for the first time */
+	for (int t = 0; t < mesh->element_num; t++) {
+		struct element *ep = &mesh->elements[order[t]];
+		for (int k = 0; k < 3; k++) {
+			int v = ep->node[k]->node_id;
+			if (node_new[v] < 0) {
+				node_old[next_node] = v;
+				node_new[v] = next_node++;
+				put_uvarint(&o, 0);
+			} else
+				put_uvarint(&o, next_node - node_new[v]);
+		}
+		for (int k = 0; k < 3; k++) {
+			struct edge *e = ep->edge[k];
+			int id = e->edge_id;
+			if (edge_new[id] < 0) {
+				struct node *a = ep->node[(k+1)%3], *b = ep->node[(k+2)%3];
+				if (!((e->node[0] == a && e->node[1] == b)
+						|| (e->node[0] == b && e->node[1] == a))) {
+					fprintf(stderr, "element %d: edge %d is not opposite node %d\n",
+							ep->element_id, id, k);
+					status = -1;
+					goto out;
+				}
+				edge_old[next_edge] = id;
+				edge_new[id] = next_edge++;
+				put_uvarint(&o, 0);
+			} else
+				put_uvarint(&o, next_edge - edge_new[id]);
+		}
+	}
+
+	/* nodes and edges outside every element go last */
+	for (int i = 0; i < mesh->node_num; i++) {
+		if (node_new[i] < 0) {
+			node_old[next_node] = i;
+			node_new[i] = next_node++;
+		}
+	}
+	for (int i = 0; i < mesh->edge_num; i++) {
+		if (edge_new[i] < 0) {
+			edge_old[next_edge] = i;
+			edge_new[i] = next_edge++;
+			put_uvarint(&o, node_new[mesh->edges[i].node[0]->node_id]);
+			put_uvarint(&o, node_new[mesh->edges[i].node[1]->node_id]);
+		}
+	}
+
+	/* coordinates */
+	if (quant_bits == MESH_ARCHIVE_LOSSLESS) {
+		uint64_t px = 0, py = 0;
+		for (int i = 0; i < mesh->node_num; i++) {
+			uint64_t x = double_bits(mesh->nodes[node_old[i]].x);
+			uint64_t y = double_bits(mesh->nodes[node_old[i]].y);
+			put_uvarint(&o, x ^ px);
+			put_uvarint(&o, y ^ py);
+			px = x;
+			py = y;
+		}
+	} else {
+		int64_t px = 0, py = 0;
+		for (int i = 0; i < mesh->node_num; i++) {
+			int64_t x = quantize(mesh->nodes[node_old[i]].x, box[0], box[2], qmax);
+			int64_t y = quantize(mesh->nodes[node_old[i]].y, box[1], box[3], qmax);
+			put_uvarint(&o, zigzag(x - px));
+			put_uvarint(&o, zigzag(y - py));
+			px = x;
+			py = y;
+		}
+	}
+
+	/* boundary markers */
+	make_vector(bc, mesh->node_num > mesh->edge_num ? mesh->node_num : mesh->edge_num);
+	for (int i = 0; i < mesh->node_num; i++)
+		bc[i] = mesh->nodes[node_old[i]].bc;
+	put_bc_runs(&o, bc, mesh->node_num);
+	for (int i = 0; i < mesh->edge_num; i++)
+		bc[i] = mesh->edges[edge_old[i]].bc;
+	put_bc_runs(&o, bc, mesh->edge_num);
+	free_vector(bc);
+
+	out_flush(&o);
+	if (o.err) {
+		fprintf(stderr, "error writing mesh archive\n");
+		status = -1;
+	}
+out:
+	free_vector(order);
+	free_vector(node_new);
+	free_vector(edge_new);
+	free_vector(node_old);
+	free_vector(edge_old);
+	xfree(o.buf);
+	return status;
+}
+
+/* ---------------- decoder ---------------- */
+
+static void get_bc_runs(struct arc_in *in, int *bc, int n)
+{
+	for (int i = 0; i < n && !in->err; ) {
+		int v = (int)unzigzag(get_uvarint(in));
+		uint64_t run = get_uvarint(in);
+		if (run == 0 || run > (uint64_t)(n - i)) {
+			in->err = 1;
+			break;
+		}
+		for (int j = 0; j < (int)run; j++)
+			bc[i+j] = v;
+		i += run;
+	}
+}
+
+/**
+ * @name mesh_archive_decode - 从流中读出一个压缩网格
+ * @param 1.fp 输入流
+ * @return 网格, 流格式错误或被截断时返回 NULL
+*/
+struct mesh *mesh_archive_decode(FILE *fp)
+{
+	struct arc_in in;
+	char magic[sizeof MESH_ARCHIVE_MAGIC];
+	double box[4], qmax = 0.0;
+	double *xy;
+	int *node_bc, *edge_node, *edge_bc, *element_node, *element_edge;
+	int quant_bits, node_num, edge_num, element_num;
+	int next_node = 0, next_edge = 0;
+	struct mesh *mesh = NULL;
+
+	in.fp = fp;
+	in.buf = xmalloc(ARC_BUF_SIZE);
+	in.pos = in.len = 0;
+	in.eof = 0;
+	in.err = 0;
+
+	get_raw(&in, magic, sizeof magic);
+	if (in.err || memcmp(magic, MESH_ARCHIVE_MAGIC, sizeof magic) != 0
+			|| get_uvarint(&in) != MESH_ARCHIVE_VERSION) {
+		fprintf(stderr, "not a mesh archive or unsupported version\n");
+		xfree(in.buf);
+		return NULL;
+	}
+	{
+		uint64_t q = get_uvarint(&in);
+		uint64_t nn = get_uvarint(&in);
+		uint64_t ne = get_uvarint(&in);
+		uint64_t nt = get_uvarint(&in);
+		if (in.err || (q != MESH_ARCHIVE_LOSSLESS && (q < MIN_QUANT_BITS || q > MAX_QUANT_BITS))
+				|| nn > INT32_MAX / 2 || ne > INT32_MAX / 2 || nt > INT32_MAX / 3) {
+			fprintf(stderr, "corrupt mesh archive header\n");
+			xfree(in.buf);
+			return NULL;
+		}
+		quant_bits = q;
+		node_num = nn;
+		edge_num = ne;
+		element_num = nt;
+	}
+	if (quant_bits != MESH_ARCHIVE_LOSSLESS) {
+		get_raw(&in, box, sizeof box);
+		qmax = ldexp(1.0, quant_bits) - 1.0;
+	}
+
+	make_vector(xy, 2 * node_num);
+	make_vector(node_bc, node_num);
+	make_vector(edge_node, 2 * edge_num);
+	make_vector(edge_bc, edge_num);
+	make_vector(element_node, 3 * element_num);
+	make_vector(element_edge, 3 * element_num);
+
+	/* connectivity */
+	for (int t = 0; t < element_num && !in.err; t++) {
+		int *en = &element_node[3*t];
+		for (int k = 0; k < 3; k++) {
+			uint64_t d = get_uvarint(&in);
+			if (d == 0) {
+				if (next_node == node_num)
+					in.err = 1;
+				en[k] = next_node++;
+			} else if (d > (uint64_t)next_node) {
+				in.err = 1;
+				en[k] = 0;
+			} else
+				en[k] = next_node - (int)d;
+		}
+		for (int k = 0; k < 3; k++) {
+			uint64_t d = get_uvarint(&in);
+			if (d == 0) {
+				if (next_edge == edge_num) {
+					in.err = 1;
+					break;
+				}
+				edge_node[2*next_edge] = en[(k+1)%3];
+				edge_node[2*next_edge+1] = en[(k+2)%3];
+				element_edge[3*t+k] = next_edge++;
+			} else if (d > (uint64_t)next_edge) {
+				in.err = 1;
+				break;
+			} else
+				element_edge[3*t+k] = next_edge - (int)d;
+		}
+	}
+	for (int i = next_edge; i < edge_num && !in.err; i++) {
+		uint64_t a = get_uvarint(&in);
+		uint64_t b = get_uvarint(&in);
+		if (a >= (uint64_t)node_num || b >= (uint64_t)node_num)
+			in.err = 1;
+		edge_node[2*i] = a;
+		edge_node[2*i+1] = b;
+	}
+
+	/* coordinates */
+	if (quant_bits == MESH_ARCHIVE_LOSSLESS) {
+		uint64_t px = 0, py = 0;
+		for (int i = 0; i < node_num && !in.err; i++) {
+			px ^= get_uvarint(&in);
+			py ^= get_uvarint(&in);
+			xy[2*i] = bits_double(px);
+			xy[2*i+1] = bits_double(py);
+		}
+	} else {
+		int64_t px = 0, py = 0;
+		for (int i = 0; i < node_num && !in.err; i++) {
+			px += unzigzag(get_uvarint(&in));
+			py += unzigzag(get_uvarint(&in));
+			xy[2*i] = dequantize(px, box[0], box[2], qmax);
+			xy[2*i+1] = dequantize(py, box[1], box[3], qmax);
+		}
+	}
+
+	get_bc_runs(&in, node_bc, node_num);
+	get_bc_runs(&in, edge_bc, edge_num);
+
+	if (in.err)
+		fprintf(stderr, "corrupt or truncated mesh archive\n");
+	else
+		mesh = mesh_from_arrays(node_num, xy, node_bc, edge_num, edge_node, edge_bc,
+				element_num, element_node, element_edge);
+
+	free_vector(xy);
+	free_vector(node_bc);
+	free_vector(edge_node);
+	free_vector(edge_bc);
+	free_vector(element_node);
+	free_vector(element_edge);
+	xfree(in.buf);
+	return mesh;
+}
+
+/**
+ * @name mesh_archive_write - 把网格压缩写入文件
+ * @param 1.mesh 网格 2.outfile 文件名 3.quant_bits 同 mesh_archive_encode
+ * @return 成功返回 0, 失败返回 -1
+*/
+int mesh_archive_write(struct mesh *mesh, char *outfile, int quant_bits)
+{
+	FILE *fp;
+	int status;
+
+	if ((fp = fopen(outfile, "wb")) == NULL) {
+		fprintf(stderr, "cannot open file %s for writing\n", outfile);
+		return -1;
+	}
+	status = mesh_archive_encode(fp, mesh, quant_bits);
+	if (fclose(fp) != 0)
+		status = -1;
+	if (status != 0) {
+		fprintf(stderr, "error writing file %s\n", outfile);
+		return -1;
+	}
+	fprintf(stderr, "压缩网格已经写入到 %s 文件\n", outfile);
+	return 0;
+}
+
+/**
+ * @name mesh_archive_read - 从文件读出压缩网格
+ * @param 1.infile 文件名
+ * @return 网格, 失败返回 NULL
+*/
+struct mesh *mesh_archive_read(char *infile)
+{
+	FILE *fp;
+	struct mesh *mesh;
+
+	if ((fp = fopen(infile, "rb")) == NULL) {
+		fprintf(stderr, "cannot open file %s for reading\n", infile);
+		return NULL;
+	}
+	mesh = mesh_archive_decode(fp);
+	fclose(fp);
+	return mesh;
+}
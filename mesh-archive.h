@@ -0,0 +1,16 @@
+#ifndef H_MESH_ARCHIVE_H
+#define H_MESH_ARCHIVE_H
+
+#include <stdio.h>
+#include "mesh.h"
+
+#define MESH_ARCHIVE_MAGIC	"TRIMARC"	/* 8 bytes including the NUL */
+#define MESH_ARCHIVE_VERSION	1
+#define MESH_ARCHIVE_LOSSLESS	0		/* quant_bits: keep coordinates exactly */
+
+int mesh_archive_encode(FILE *fp, struct mesh *mesh, int quant_bits);
+struct mesh *mesh_archive_decode(FILE *fp);
+int mesh_archive_write(struct mesh *mesh, char *outfile, int quant_bits);
+struct mesh *mesh_archive_read(char *infile);
+
+#endif /* H_MESH_ARCHIVE_H */
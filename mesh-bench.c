@@ -0,0 +1,430 @@
+/**
+ * @file mesh-bench.c
+ * @brief 网格生成的基准测试: 各阶段耗时, 吞吐量和内存峰值
+ * @details
+ *  用法:
+ *      mesh-bench.bin <csv-file> <json-file> [reps] [warmup] [levels] [max-n]
+ *  测试用例(由小到大):
+ *      triangle-with-hole, square          内置区域
+ *      annulus(n)                          n = 24, 24*16, ... 直到 max-n
+ *      random-points(n)                    单位正方形中的 n 个随机点
+ *      random-pslg(n)                      n 个顶点的随机星形多边形(边界有锯齿)
+ *  每个用例的面积约束取 BENCH_A0, BENCH_A0/4, ... 共 levels 个.
+ *  每组先运行 warmup 次不计时, 再运行 reps 次, 对 make_mesh_profiled 给出的
+ *  每个阶段统计最小值, 中位数, p90 和最大值, 并给出每秒三角形数(按总耗时
+ *  中位数)和这一组的进程内存峰值: 每组在单独的子进程中运行, 取 wait4 给出的
+ *  ru_maxrss(含 fork 时继承的父进程常驻内存, 很小).
+ *  计时之后再用 memstat 统计一次, 给出经过 xmalloc 的内存峰值, 并与
+ *  mesh_predict_peak 的估计对照. 设置了环境变量 TRI_MEMSTAT=<文件名> 时,
+ *  把每组的按调用点统计追加到该文件.
+ *  这里只做测量, 正确性检查在 mesh-check.c 中.
+ *  随机输入用固定的种子生成, 多次运行的输入完全相同.
+ *  缺省 reps = 5, warmup = 1, levels = 3, max-n = 100000.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "mesh.h"
+#include "problem-spec.h"
+#include "parallel.h"
+#include "memstat.h"
+
+#define BENCH_A0	0.01	/* 面积约束的起点 */
+#define BENCH_SCALE	16	/* 相邻规模之比 */
+#define BENCH_SEED	20240601ULL
+
+struct bench_phase{
+	const char *name;
+	size_t offset;		/* 在 struct mesh_timings 中的位置 */
+};
+
+static const struct bench_phase phases[] = {
+	{ "spec_to_triangle",  offsetof(struct mesh_timings, spec_to_triangle) },
+	{ "delaunay",          offsetof(struct mesh_timings, delaunay) },
+	{ "segments",          offsetof(struct mesh_timings, segments) },
+	{ "holes",             offsetof(struct mesh_timings, holes) },
+	{ "quality",           offsetof(struct mesh_timings, quality) },
+	{ "write_nodes",       offsetof(struct mesh_timings, write_nodes) },
+	{ "write_elements",    offsetof(struct mesh_timings, write_elements) },
+	{ "write_segments",    offsetof(struct mesh_timings, write_segments) },
+	{ "write_edges",       offsetof(struct mesh_timings, write_edges) },
+	{ "triangle_to_mesh",  offsetof(struct mesh_timings, triangle_to_mesh) },
+	{ "assign_elem_edges", offsetof(struct mesh_timings, assign_elem_edges) },
+	{ "geometry",          offsetof(struct mesh_timings, geometry) },
+	{ "total",             offsetof(struct mesh_timings, total) },
+};
+#define PHASE_NUM	((int)(sizeof phases / sizeof phases[0]))
+
+struct phase_summary{
+	double min, median, p90, max;
+};
+
+// 一个用例在一个面积约束下的结果
+struct bench_result{
+	const char *name;
+	int size;		/* 规模参数, 内置区域为 0 */
+	double a;
+	int node_num, element_num;
+	struct phase_summary phase[PHASE_NUM];
+	double triangles_per_sec;
+	long peak_rss_kb;
+	size_t peak_bytes;		/* memstat 统计的峰值 */
+	size_t predicted_bytes;		/* mesh_predict_peak 的估计 */
+};
+
+/* xorshift64*, 各平台结果一致 */
+static double next_random(unsigned long long *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return ((*state * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static struct problem_spec *new_spec(int num_points, int num_segments)
+{
+	struct problem_spec *spec = xmalloc(sizeof *spec);
+
+	memset(spec, 0, sizeof *spec);
+	make_vector(spec->points, num_points);
+	spec->num_points = num_points;
+	if (num_segments > 0)
+		make_vector(spec->segments, num_segments);
+	spec->num_segments = num_segments;
+	return spec;
+}
+
+/*
+ * 单位正方形中的 n 个随机点, 加上正方形的 4 个角点和 4 条边
+ *  (make_mesh 用 -p, 没有线段包围时整个凸包都会被当作外部挖掉)
+ */
+static struct problem_spec *random_points(int n)
+{
+	static const double corner[4][2] = { {0, 0}, {1, 0}, {1, 1}, {0, 1} };
+	struct problem_spec *spec = new_spec(n + 4, 4);
+	unsigned long long state = BENCH_SEED;
+
+	for (int i = 0; i < 4; i++) {
+		spec->points[i].point_id = i;
+		spec->points[i].x = corner[i][0];
+		spec->points[i].y = corner[i][1];
+		spec->points[i].bc = FEM_BC_DIRICHLET;
+		spec->segments[i].segment_id = i;
+		spec->segments[i].point_id1 = i;
+		spec->segments[i].point_id2 = (i + 1) % 4;
+		spec->segments[i].bc = FEM_BC_DIRICHLET;
+	}
+	for (int i = 4; i < n + 4; i++) {
+		spec->points[i].point_id = i;
+		spec->points[i].x = next_random(&state);
+		spec->points[i].y = next_random(&state);
+		spec->points[i].bc = 0;
+	}
+	return spec;
+}
+
+/*
+ * n 个顶点的星形多边形, 总是简单多边形: 角度等分, 半径在 0.4 附近随机扰动,
+ *  扰动不超过边长的一半, 以免出现 -q 无法处理的细长尖角
+ */
+static struct problem_spec *random_pslg(int n)
+{
+	struct problem_spec *spec = new_spec(n, n);
+	unsigned long long state = BENCH_SEED + n;
+	double pi = 4*atan(1.0);
+
+	for (int i = 0; i < n; i++) {
+		double r = 0.4 * (1.0 + (2*pi/n) * (next_random(&state) - 0.5));
+		double t = 2*pi*i / n;
+		spec->points[i].point_id = i;
+		spec->points[i].x = 0.5 + r*cos(t);
+		spec->points[i].y = 0.5 + r*sin(t);
+		spec->points[i].bc = FEM_BC_DIRICHLET;
+		spec->segments[i].segment_id = i;
+		spec->segments[i].point_id1 = i;
+		spec->segments[i].point_id2 = (i + 1) % n;
+		spec->segments[i].bc = FEM_BC_DIRICHLET;
+	}
+	return spec;
+}
+
+// 测试用例; first 为最小规模, 0 表示没有规模参数
+struct bench_case{
+	const char *name;
+	int first;
+};
+
+static const struct bench_case cases[] = {
+	{ "triangle-with-hole", 0 },
+	{ "square", 0 },
+	{ "annulus", 24 },
+	{ "random-points", 1000 },
+	{ "random-pslg", 64 },
+};
+#define CASE_NUM	((int)(sizeof cases / sizeof cases[0]))
+
+static struct problem_spec *make_case(int c, int n)
+{
+	switch (c) {
+	case 0: return triangle_with_hole();
+	case 1: return square();
+	case 2: return annulus(n);
+	case 3: return random_points(n);
+	default: return random_pslg(n);
+	}
+}
+
+static void free_case(int c, struct problem_spec *spec)
+{
+	if (c == 2)
+		free_annulus(spec);
+	else if (c > 2)
+		free_problem_spec(spec);
+	/* 内置的 triangle-with-hole 和 square 是静态的 */
+}
+
+/* 规模序列 first, first*BENCH_SCALE, ..., 最后一个取 max_n; 返回 0 表示结束 */
+static int next_size(int n, int max_n)
+{
+	if (n == 0 || n >= max_n)
+		return 0;
+	return n * BENCH_SCALE < max_n ? n * BENCH_SCALE : max_n;
+}
+
+static int compare_double(const void *p, const void *q)
+{
+	double x = *(const double *)p, y = *(const double *)q;
+	return (x > y) - (x < y);
+}
+
+/* 已排序样本的 p 分位数(最近秩) */
+static double percentile(const double *sorted, int n, double p)
+{
+	int k = (int)ceil(p * n) - 1;
+	return sorted[k < 0 ? 0 : (k >= n ? n - 1 : k)];
+}
+
+static void run_case(struct bench_result *res, struct problem_spec *spec,
+		int reps, int warmup)
+{
+	struct mesh_timings t;
+	struct mesh *mesh;
+	double *samples;
+
+	make_vector(samples, (size_t)PHASE_NUM * reps);
+	for (int r = -warmup; r < reps; r++) {
+		mesh = make_mesh_profiled(spec, res->a, &t, NULL);
+		if (mesh == NULL) {
+			fprintf(stderr, "%s %d: 网格生成失败\n", res->name, res->size);
+			exit(EXIT_FAILURE);
+		}
+		res->node_num = mesh->node_num;
+		res->element_num = mesh->element_num;
+		free_mesh(mesh);
+		if (r < 0)
+			continue;
+		for (int p = 0; p < PHASE_NUM; p++)
+			samples[p*reps + r] = *(double *)((char *)&t + phases[p].offset);
+	}
+	for (int p = 0; p < PHASE_NUM; p++) {
+		double *s = &samples[p*reps];
+		qsort(s, reps, sizeof *s, compare_double);
+		res->phase[p].min = s[0];
+		res->phase[p].median = reps % 2 ? s[reps/2] : 0.5 * (s[reps/2-1] + s[reps/2]);
+		res->phase[p].p90 = percentile(s, reps, 0.9);
+		res->phase[p].max = s[reps-1];
+	}
+	res->triangles_per_sec = res->phase[PHASE_NUM-1].median > 0.0 ?
+		res->element_num / res->phase[PHASE_NUM-1].median : 0.0;
+	free_vector(samples);
+}
+
+/* 不计时地再运行一次, 统计内存峰值 */
+static void measure_memory(struct bench_result *res, struct problem_spec *spec)
+{
+	struct memstat *ms = memstat_create(NULL);
+	struct allocator *old = set_allocator(memstat_allocator(ms));
+	char *dump = getenv("TRI_MEMSTAT");
+	FILE *fp;
+
+	free_mesh(make_mesh(spec, res->a));
+	set_allocator(old);
+	res->peak_bytes = memstat_peak(ms);
+	res->predicted_bytes = mesh_predict_peak(spec, res->a, NULL);
+	if (dump != NULL && *dump != '\0') {
+		if ((fp = fopen(dump, "a")) == NULL)
+			fprintf(stderr, "cannot open file %s for writing\n", dump);
+		else {
+			fprintf(fp, "# %s %d %.6e\n", res->name, res->size, res->a);
+			memstat_dump(ms, fp);
+			fclose(fp);
+		}
+	}
+	memstat_destroy(ms);
+}
+
+/*
+ * 在子进程中运行 run_case 和 measure_memory, 结果经管道传回,
+ *  这样 wait4 给出的 ru_maxrss 不包括前面各组的峰值
+ */
+static void run_isolated(struct bench_result *res, struct problem_spec *spec,
+		int reps, int warmup)
+{
+	struct rusage ru;
+	int fd[2], status;
+	ssize_t n;
+	pid_t pid;
+
+	fflush(NULL);		/* 子进程不要重复输出缓冲区中的内容 */
+	if (pipe(fd) != 0 || (pid = fork()) < 0) {
+		perror("mesh-bench");
+		exit(EXIT_FAILURE);
+	}
+	if (pid == 0) {
+		close(fd[0]);
+		run_case(res, spec, reps, warmup);
+		measure_memory(res, spec);
+		n = write(fd[1], res, sizeof *res);
+		_exit(n == (ssize_t)sizeof *res ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	close(fd[1]);
+	n = read(fd[0], res, sizeof *res);
+	close(fd[0]);
+	if (wait4(pid, &status, 0, &ru) != pid || !WIFEXITED(status)
+			|| WEXITSTATUS(status) != EXIT_SUCCESS || n != (ssize_t)sizeof *res) {
+		fprintf(stderr, "%s %d: 子进程失败\n", res->name, res->size);
+		exit(EXIT_FAILURE);
+	}
+	res->peak_rss_kb = ru.ru_maxrss;	/* Linux 上单位是 KB */
+}
+
+static void write_csv(FILE *fp, const struct bench_result *res, int count)
+{
+	fprintf(fp, "case,size,a,nodes,elements,phase,min,median,p90,max,"
+			"triangles_per_sec,peak_rss_kb,peak_bytes,predicted_bytes\n");
+	for (int k = 0; k < count; k++)
+		for (int p = 0; p < PHASE_NUM; p++)
+			fprintf(fp, "%s,%d,%.6e,%d,%d,%s,%.6e,%.6e,%.6e,%.6e,%.1f,%ld,%zu,%zu\n",
+					res[k].name, res[k].size, res[k].a,
+					res[k].node_num, res[k].element_num, phases[p].name,
+					res[k].phase[p].min, res[k].phase[p].median,
+					res[k].phase[p].p90, res[k].phase[p].max,
+					res[k].triangles_per_sec, res[k].peak_rss_kb,
+					res[k].peak_bytes, res[k].predicted_bytes);
+}
+
+static void write_json(FILE *fp, const struct bench_result *res, int count,
+		int reps, int warmup)
+{
+	fprintf(fp, "{\n  \"reps\": %d,\n  \"warmup\": %d,\n  \"threads\": %d,\n",
+			reps, warmup, parallel_num_threads());
+	fprintf(fp, "  \"cases\": [\n");
+	for (int k = 0; k < count; k++) {
+		fprintf(fp, "    {\"case\": \"%s\", \"size\": %d, \"a\": %.6e, "
+				"\"nodes\": %d, \"elements\": %d, "
+				"\"triangles_per_sec\": %.1f, \"peak_rss_kb\": %ld,\n"
+				"     \"peak_bytes\": %zu, \"predicted_bytes\": %zu,\n"
+				"     \"phases\": {",
+				res[k].name, res[k].size, res[k].a, res[k].node_num,
+				res[k].element_num, res[k].triangles_per_sec,
+				res[k].peak_rss_kb, res[k].peak_bytes,
+				res[k].predicted_bytes);
+		for (int p = 0; p < PHASE_NUM; p++)
+			fprintf(fp, "%s\"%s\": {\"min\": %.6e, \"median\": %.6e, "
+					"\"p90\": %.6e, \"max\": %.6e}",
+					p ? ",\n       " : "\n       ", phases[p].name,
+					res[k].phase[p].min, res[k].phase[p].median,
+					res[k].phase[p].p90, res[k].phase[p].max);
+		fprintf(fp, "}}%s\n", k + 1 < count ? "," : "");
+	}
+	fprintf(fp, "  ]\n}\n");
+}
+
+static void show_usage(char *progname)
+{
+	printf("Usage: %s <csv-file> <json-file> [reps] [warmup] [levels] [max-n]\n", progname);
+	printf("  reps: 计时的重复次数(缺省 5), warmup: 不计时的预热次数(缺省 1)\n");
+	printf("  levels: 面积约束的个数(缺省 3), max-n: 合成用例的最大规模(缺省 100000)\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct problem_spec *spec;
+	struct bench_result *res;
+	int reps = 5, warmup = 1, levels = 3, max_n = 100000;
+	int count = 0, capacity;
+	FILE *fp;
+
+	if (argc < 3 || argc > 7)
+		show_usage(argv[0]);
+	if (argc > 3)
+		reps = atoi(argv[3]);
+	if (argc > 4)
+		warmup = atoi(argv[4]);
+	if (argc > 5)
+		levels = atoi(argv[5]);
+	if (argc > 6)
+		max_n = atoi(argv[6]);
+	if (reps <= 0 || warmup < 0 || levels <= 0 || max_n < 24)
+		show_usage(argv[0]);
+
+	capacity = 16 * levels;
+	make_vector(res, capacity);
+	printf("%-18s %7s %11s %9s %10s %10s %12s %9s %11s %6s\n", "case", "size",
+			"a", "elements", "median(s)", "p90(s)", "triangles/s", "rss(KB)",
+			"peak(KB)", "pred");
+
+	/* 每个用例 * 每个规模 * 每个面积约束 */
+	for (int c = 0; c < CASE_NUM; c++) {
+		for (int n = cases[c].first; ; n = next_size(n, max_n)) {
+			if (count + levels > capacity) {
+				capacity *= 2;
+				res = xrealloc(res, capacity * sizeof *res);
+			}
+			spec = make_case(c, n);
+			for (int l = 0; l < levels; l++) {
+				struct bench_result *r = &res[count++];
+				r->name = cases[c].name;
+				r->size = n;
+				r->a = BENCH_A0 * pow(0.25, l);
+				run_isolated(r, spec, reps, warmup);
+				printf("%-18s %7d %11.4e %9d %10.4f %10.4f %12.0f %9ld %11zu %6.3f\n",
+						r->name, r->size, r->a, r->element_num,
+						r->phase[PHASE_NUM-1].median, r->phase[PHASE_NUM-1].p90,
+						r->triangles_per_sec, r->peak_rss_kb,
+						r->peak_bytes / 1024,
+						(double)r->predicted_bytes / r->peak_bytes);
+				fflush(stdout);
+			}
+			free_case(c, spec);
+			if (next_size(n, max_n) == 0)
+				break;
+		}
+	}
+
+	if ((fp = fopen(argv[1], "w")) == NULL) {
+		fprintf(stderr, "cannot open file %s for writing\n", argv[1]);
+		return 1;
+	}
+	write_csv(fp, res, count);
+	fclose(fp);
+	fprintf(stderr, "结果已经写入到 %s 文件\n", argv[1]);
+
+	if ((fp = fopen(argv[2], "w")) == NULL) {
+		fprintf(stderr, "cannot open file %s for writing\n", argv[2]);
+		return 1;
+	}
+	write_json(fp, res, count, reps, warmup);
+	fclose(fp);
+	fprintf(stderr, "结果已经写入到 %s 文件\n", argv[2]);
+	free_vector(res);
+	return 0;
+}
@@ -0,0 +1,394 @@
+/**
+ * @file mesh-cache.c
+ * @brief make_mesh 结果的缓存, 见 mesh-cache.h
+ * @details
+ *  键是 128 位哈希: 把版本号, 开关字符串和问题规格的各个字段依次作为 64 位字
+ *  送进两个种子不同的乘法-旋转哈希. 内存中的网格挂在按最近使用排序的双向链表上,
+ *  查找时顺序比较键; 网格个数受字节数限制, 通常只有几十个, 顺序查找只要几微秒.
+ *  淘汰时还借出(引用计数不为 0)的网格先从链表摘下放进 retired, 最后一次归还时释放.
+ *  目录中的文件先写到临时文件再改名, 其它进程不会读到写了一半的文件.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "xmalloc.h"
+#include "mesh-file.h"
+#include "mesh-cache.h"
+
+#define MESH_CACHE_BYTES	(256u << 20)	/* 缺省的内存上限 */
+#define MESH_CACHE_VERSION	1		/* 剖分方式改变时加一, 使旧的文件失效 */
+
+#define P1 0x9E3779B97F4A7C15ULL
+#define P2 0xC2B2AE3D27D4EB4FULL
+
+struct cache_entry{
+	struct cache_entry *prev, *next;	/* 表头是最近使用的 */
+	uint64_t key[2];
+	struct mesh *mesh;
+	size_t bytes;
+	int refs;		/* 借出的次数 */
+};
+
+struct mesh_cache{
+	pthread_mutex_t lock;
+	struct cache_entry *head, *tail;
+	struct cache_entry *retired;	/* 已淘汰但还借出的, 用 next 串起来 */
+	size_t max_bytes;
+	char *dir;			/* NULL 表示只在内存中缓存 */
+	struct mesh_cache_stats stats;
+};
+
+static atomic_int temp_serial;
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t fmix64(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= P2;
+	h ^= h >> 29;
+	h *= P1;
+	h ^= h >> 32;
+	return h;
+}
+
+static void put_word(uint64_t key[2], uint64_t v)
+{
+	key[0] = rotl64(key[0] ^ v * P1, 31) * P2;
+	key[1] = rotl64(key[1] ^ v * P2, 27) * P1 + 0x52DCE729;
+}
+
+static void put_double(uint64_t key[2], double x)
+{
+	uint64_t v;
+
+	memcpy(&v, &x, sizeof v);
+	put_word(key, v);
+}
+
+static void put_string(uint64_t key[2], const char *s)
+{
+	size_t n = strlen(s);
+
+	put_word(key, n);
+	for (size_t i = 0; i < n; i += 8) {
+		uint64_t v = 0;
+		memcpy(&v, s + i, n - i < 8 ? n - i : 8);
+		put_word(key, v);
+	}
+}
+
+/* 只用 problem_spec_to_triangle 交给 Triangle 的字段, 与编号和函数指针无关 */
+static void spec_key(struct problem_spec *spec, const char *opts, uint64_t key[2])
+{
+	key[0] = 0x243F6A8885A308D3ULL;
+	key[1] = 0x13198A2E03707344ULL;
+	put_word(key, MESH_CACHE_VERSION);
+	put_string(key, opts);
+	put_word(key, spec->num_points);
+	for (int i = 0; i < spec->num_points; i++) {
+		put_double(key, spec->points[i].x);
+		put_double(key, spec->points[i].y);
+		put_word(key, (uint64_t)spec->points[i].bc);
+	}
+	put_word(key, spec->num_segments);
+	for (int i = 0; i < spec->num_segments; i++) {
+		put_word(key, (uint64_t)spec->segments[i].point_id1);
+		put_word(key, (uint64_t)spec->segments[i].point_id2);
+		put_word(key, (uint64_t)spec->segments[i].bc);
+	}
+	put_word(key, spec->num_holes);
+	for (int i = 0; i < spec->num_holes; i++) {
+		put_double(key, spec->holes[i].x);
+		put_double(key, spec->holes[i].y);
+	}
+	put_word(key, spec->num_regions);
+	for (int i = 0; i < spec->num_regions; i++) {
+		put_double(key, spec->regions[i].x);
+		put_double(key, spec->regions[i].y);
+		put_double(key, spec->regions[i].attribute);
+		put_double(key, spec->regions[i].max_area);
+	}
+	key[0] = fmix64(key[0]);
+	key[1] = fmix64(key[1] ^ key[0]);
+}
+
+static size_t mesh_bytes(struct mesh *mesh)
+{
+	return sizeof *mesh + mesh->node_num * sizeof(struct node)
+		+ mesh->edge_num * sizeof(struct edge)
+		+ mesh->element_num * sizeof(struct element);
+}
+
+/* 缓存的网格不属于调用者的恢复点(见 xmalloc.h) */
+static void detach_mesh(struct mesh *mesh)
+{
+	recovery_detach(mesh->nodes);
+	recovery_detach(mesh->edges);
+	recovery_detach(mesh->elements);
+	recovery_detach(mesh);
+}
+
+static void free_cached_mesh(struct mesh *mesh)
+{
+	struct allocator *old = set_allocator(NULL);
+
+	free_mesh(mesh);
+	set_allocator(old);
+}
+
+/* ---------------- LRU 链表, 调用者持有锁 ---------------- */
+
+static void unlink_entry(struct mesh_cache *cache, struct cache_entry *e)
+{
+	if (e->prev != NULL)
+		e->prev->next = e->next;
+	else
+		cache->head = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+	else
+		cache->tail = e->prev;
+}
+
+static void push_front(struct mesh_cache *cache, struct cache_entry *e)
+{
+	e->prev = NULL;
+	e->next = cache->head;
+	if (cache->head != NULL)
+		cache->head->prev = e;
+	else
+		cache->tail = e;
+	cache->head = e;
+}
+
+static struct cache_entry *find_entry(struct mesh_cache *cache, const uint64_t key[2])
+{
+	for (struct cache_entry *e = cache->head; e != NULL; e = e->next)
+		if (e->key[0] == key[0] && e->key[1] == key[1])
+			return e;
+	return NULL;
+}
+
+/* 超过上限时从最久没用的开始淘汰, 至少留下表头 */
+static void evict(struct mesh_cache *cache)
+{
+	struct cache_entry *e;
+
+	while (cache->stats.bytes > cache->max_bytes && cache->tail != cache->head) {
+		e = cache->tail;
+		unlink_entry(cache, e);
+		cache->stats.entries--;
+		cache->stats.bytes -= e->bytes;
+		if (e->refs > 0) {
+			e->next = cache->retired;
+			cache->retired = e;
+		} else {
+			free_cached_mesh(e->mesh);
+			free(e);
+		}
+	}
+}
+
+/* ---------------- 目录 ---------------- */
+
+static void entry_path(struct mesh_cache *cache, const uint64_t key[2],
+		char *path, size_t size)
+{
+	snprintf(path, size, "%s/%016llx%016llx.mesh", cache->dir,
+			(unsigned long long)key[0], (unsigned long long)key[1]);
+}
+
+static struct mesh *read_stored(struct mesh_cache *cache, const uint64_t key[2])
+{
+	struct mesh_file *mf;
+	struct mesh *mesh;
+	char path[1024];
+
+	entry_path(cache, key, path, sizeof path);
+	if (access(path, R_OK) != 0)
+		return NULL;
+	if ((mf = mesh_file_open(path, 1)) == NULL)
+		return NULL;
+	mesh = mesh_file_to_mesh(mf);
+	mesh_file_close(mf);
+	return mesh;
+}
+
+static void store(struct mesh_cache *cache, const uint64_t key[2], struct mesh *mesh)
+{
+	char path[1024], temp[1024 + 64];
+
+	entry_path(cache, key, path, sizeof path);
+	snprintf(temp, sizeof temp, "%s.%ld.%d.tmp", path, (long)getpid(),
+			atomic_fetch_add(&temp_serial, 1));
+	if (mesh_file_write(mesh, temp, 0) != 0 || rename(temp, path) != 0) {
+		fprintf(stderr, "cannot store mesh in %s\n", cache->dir);
+		remove(temp);
+	}
+}
+
+/* ---------------- 接口 ---------------- */
+
+/**
+ * @name mesh_cache_create - 创建网格缓存
+ * @param 1.max_bytes 内存中网格的字节数上限, 0 表示缺省的 256MB
+ * 	2.dir 存放网格文件的目录(须已存在), NULL 表示只在内存中缓存
+ * @return 缓存, 用 mesh_cache_destroy() 释放
+*/
+struct mesh_cache *mesh_cache_create(size_t max_bytes, const char *dir)
+{
+	/* 缓存本身不经过 xmalloc: 它的寿命比调用者安装的分配器长 */
+	struct mesh_cache *cache = calloc(1, sizeof *cache);
+
+	if (cache == NULL) {
+		fprintf(stderr, "%s:%d: calloc(%zu) failed\n", __FILE__, __LINE__,
+				sizeof *cache);
+		exit(EXIT_FAILURE);
+	}
+	if (dir != NULL && (cache->dir = strdup(dir)) == NULL) {
+		fprintf(stderr, "%s:%d: strdup failed\n", __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	cache->max_bytes = max_bytes > 0 ? max_bytes : MESH_CACHE_BYTES;
+	pthread_mutex_init(&cache->lock, NULL);
+	return cache;
+}
+
+/**
+ * @name mesh_cache_destroy - 释放缓存和其中的网格
+ * @param 1.cache 缓存(可为 NULL)
+ * @note 调用前所有借出的网格都要已经归还
+*/
+void mesh_cache_destroy(struct mesh_cache *cache)
+{
+	struct cache_entry *e, *next;
+
+	if (cache == NULL)
+		return;
+	for (e = cache->head; e != NULL; e = next) {
+		next = e->next;
+		free_cached_mesh(e->mesh);
+		free(e);
+	}
+	for (e = cache->retired; e != NULL; e = next) {
+		next = e->next;
+		free_cached_mesh(e->mesh);
+		free(e);
+	}
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->dir);
+	free(cache);
+}
+
+/**
+ * @name mesh_cache_get - 取得 make_mesh(spec, a) 的网格
+ * @param 1.cache 缓存 2.spec 问题规格 3.a 最大面积
+ * @return 只读的网格, 用 mesh_cache_release() 归还; make_mesh 出错时返回 NULL
+ * @note 没有命中时不持锁生成网格, 几个线程同时生成同一个网格时只留下一个
+*/
+struct mesh *mesh_cache_get(struct mesh_cache *cache, struct problem_spec *spec,
+		double a)
+{
+	struct cache_entry *e;
+	struct allocator *old;
+	struct mesh *mesh = NULL;
+	uint64_t key[2];
+	char opts[96];
+	int from_disk = 0;
+
+	mesh_switches(spec, a, opts, sizeof opts);
+	spec_key(spec, opts, key);
+	pthread_mutex_lock(&cache->lock);
+	if ((e = find_entry(cache, key)) != NULL) {
+		unlink_entry(cache, e);
+		push_front(cache, e);
+		e->refs++;
+		cache->stats.hits++;
+		pthread_mutex_unlock(&cache->lock);
+		return e->mesh;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	old = set_allocator(NULL);
+	if (cache->dir != NULL)
+		from_disk = (mesh = read_stored(cache, key)) != NULL;
+	if (mesh == NULL && (mesh = make_mesh(spec, a)) != NULL && cache->dir != NULL)
+		store(cache, key, mesh);
+	set_allocator(old);
+	if (mesh == NULL)
+		return NULL;
+	detach_mesh(mesh);
+
+	pthread_mutex_lock(&cache->lock);
+	if (from_disk)
+		cache->stats.disk_hits++;
+	else
+		cache->stats.misses++;
+	if ((e = find_entry(cache, key)) != NULL) {
+		/* 别的线程先放进去了 */
+		free_cached_mesh(mesh);
+		unlink_entry(cache, e);
+	} else {
+		if ((e = malloc(sizeof *e)) == NULL) {
+			fprintf(stderr, "%s:%d: malloc(%zu) failed\n", __FILE__, __LINE__,
+					sizeof *e);
+			exit(EXIT_FAILURE);
+		}
+		memcpy(e->key, key, sizeof e->key);
+		e->mesh = mesh;
+		e->bytes = mesh_bytes(mesh);
+		e->refs = 0;
+		cache->stats.entries++;
+		cache->stats.bytes += e->bytes;
+	}
+	push_front(cache, e);
+	e->refs++;
+	mesh = e->mesh;
+	evict(cache);
+	pthread_mutex_unlock(&cache->lock);
+	return mesh;
+}
+
+/**
+ * @name mesh_cache_release - 归还 mesh_cache_get 借出的网格
+ * @param 1.cache 缓存 2.mesh 网格(可为 NULL)
+*/
+void mesh_cache_release(struct mesh_cache *cache, struct mesh *mesh)
+{
+	struct cache_entry *e, **p;
+
+	if (mesh == NULL)
+		return;
+	pthread_mutex_lock(&cache->lock);
+	for (e = cache->head; e != NULL; e = e->next)
+		if (e->mesh == mesh) {
+			e->refs--;
+			pthread_mutex_unlock(&cache->lock);
+			return;
+		}
+	for (p = &cache->retired; (e = *p) != NULL; p = &e->next)
+		if (e->mesh == mesh) {
+			if (--e->refs == 0) {
+				*p = e->next;
+				free_cached_mesh(e->mesh);
+				free(e);
+			}
+			break;
+		}
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void mesh_cache_stats(struct mesh_cache *cache, struct mesh_cache_stats *stats)
+{
+	pthread_mutex_lock(&cache->lock);
+	*stats = cache->stats;
+	pthread_mutex_unlock(&cache->lock);
+}
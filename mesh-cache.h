@@ -0,0 +1,40 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <stddef.h>
+#include "mesh.h"
+
+/*
+ * make_mesh 结果的缓存
+ *  键是问题规格中影响剖分的点, 线段, 洞, 区域和 Triangle 开关(见 mesh_switches,
+ *  其中含面积约束)的内容哈希. 内存中按最近使用(LRU)保留至多 max_bytes 字节的网格;
+ *  给了目录时, 内存中没有的网格再到目录下找 <哈希>.mesh 文件(mesh-file.h 的格式,
+ *  映射读入), 新生成的网格也写到那里, 供以后的进程使用.
+ *  返回的网格属于缓存, 调用者只能读, 用完调用 mesh_cache_release 归还, 不能 free_mesh.
+ *  缓存的网格总是用 libc 分配, 与当前线程的分配器无关. 可以被多个线程同时使用.
+ *
+ * 用法:
+ *     struct mesh_cache *cache = mesh_cache_create(0, "mesh-cache");
+ *     mesh = mesh_cache_get(cache, spec, a);
+ *     ...
+ *     mesh_cache_release(cache, mesh);
+ *     mesh_cache_destroy(cache);
+ */
+struct mesh_cache_stats{
+	long hits;		/* 内存中命中 */
+	long disk_hits;		/* 从目录中读入 */
+	long misses;		/* 调用 make_mesh 生成 */
+	int entries;		/* 内存中的网格个数 */
+	size_t bytes;		/* 内存中的网格字节数 */
+};
+
+struct mesh_cache;
+
+struct mesh_cache *mesh_cache_create(size_t max_bytes, const char *dir);
+void mesh_cache_destroy(struct mesh_cache *cache);
+struct mesh *mesh_cache_get(struct mesh_cache *cache, struct problem_spec *spec,
+		double a);
+void mesh_cache_release(struct mesh_cache *cache, struct mesh *mesh);
+void mesh_cache_stats(struct mesh_cache *cache, struct mesh_cache_stats *stats);
+
+#endif
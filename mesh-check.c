@@ -0,0 +1,314 @@
+/**
+ * @file mesh-check.c
+ * @brief 网格生成的正确性检查, 与 mesh-bench 的测量分开
+ * @details
+ *  用法:
+ *      mesh-check.bin
+ *  对内置区域(triangle-with-hole, square, annulus(24))检查 make_mesh_budgeted:
+ *  Steiner 点上限, 时间预算和 progress 返回非零都要截断加密并给出通过
+ *  mesh_check 的网格, progress 一直返回 0 时与 make_mesh 相同;
+ *  make_mesh_streamed 分块交出的节点, 单元和边(含不足一块和最后一块不满的
+ *  情形)与 make_mesh 相同, mesh_file_write_spec 写出的文件与 mesh_file_write
+ *  的相同(临时文件写在当前目录, 检查后删除).
+ *  每项打印 ok 或 FAILED, 有一项不通过时返回 1.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "xmalloc.h"
+#include "mesh.h"
+#include "mesh-file.h"
+#include "problem-spec.h"
+#include "memstat.h"
+#include "timer.h"
+
+#define CHECK_A0	0.01	/* 面积约束, 与 mesh-bench 的起点相同 */
+#define BUDGET_A	1e-6	/* 预算检查用的面积约束(%f 能表示的最小值), 不截断时要几百万个单元 */
+#define BUDGET_STEINER	500	/* 预算检查的 Steiner 点上限 */
+#define BUDGET_SECONDS	0.01	/* 预算检查的时间预算 */
+
+// 检查用的内置区域
+static const char *const case_names[] = {
+	"triangle-with-hole", "square", "annulus",
+};
+#define CASE_NUM	((int)(sizeof case_names / sizeof case_names[0]))
+
+static struct problem_spec *make_case(int c)
+{
+	switch (c) {
+	case 0: return triangle_with_hole();
+	case 1: return square();
+	default: return annulus(24);
+	}
+}
+
+static void free_case(int c, struct problem_spec *spec)
+{
+	if (c == 2)
+		free_annulus(spec);
+	/* 内置的 triangle-with-hole 和 square 是静态的 */
+}
+
+// 预算检查用的 progress: 第 stop 次调用时返回非零, stop 为 0 时一直返回 0
+struct budget_probe{
+	int calls;
+	int stop;
+};
+
+static int budget_progress(void *ctx, long steiner_points, long bad_triangles)
+{
+	struct budget_probe *probe = ctx;
+
+	(void)steiner_points;
+	(void)bad_triangles;
+	return ++probe->calls == probe->stop;
+}
+
+/* 打印一项预算检查的结果, 返回不通过的项数 */
+static int budget_result(const char *name, const char *what, int ok,
+		struct mesh *mesh, struct mesh_budget *b, double seconds)
+{
+	printf("%-18s %-8s %s: truncated %d, 节点 %d, 单元 %d, %.3f 秒\n",
+			name, what, ok ? "ok" : "FAILED", b->truncated,
+			mesh != NULL ? mesh->node_num : 0,
+			mesh != NULL ? mesh->element_num : 0, seconds);
+	free_mesh(mesh);
+	return !ok;
+}
+
+/*
+ * 检查 make_mesh_budgeted
+ *  面积约束为 BUDGET_A 时 Steiner 点上限和时间预算都必须截断加密;
+ *  progress 第一次调用就返回非零时也停止加密, 比完整的网格少节点;
+ *  progress 一直返回 0 时结果与 make_mesh 相同. 各网格都要通过 mesh_check.
+ *  返回不通过的项数
+ */
+static int check_budget(const char *name, struct problem_spec *spec)
+{
+	struct mesh_budget b;
+	struct budget_probe probe;
+	struct mesh *mesh, *full;
+	double a = CHECK_A0 / 64, t;
+	int failed = 0;
+
+	memset(&b, 0, sizeof b);
+	b.steiner_points = BUDGET_STEINER;
+	t = wall_time();
+	mesh = make_mesh_budgeted(spec, BUDGET_A, &b);
+	t = wall_time() - t;
+	failed += budget_result(name, "steiner", mesh != NULL && b.truncated
+			&& mesh->node_num <= spec->num_points + BUDGET_STEINER
+			&& mesh_check(mesh, spec->num_holes) == 0, mesh, &b, t);
+
+	memset(&b, 0, sizeof b);
+	b.seconds = BUDGET_SECONDS;
+	t = wall_time();
+	mesh = make_mesh_budgeted(spec, BUDGET_A, &b);
+	t = wall_time() - t;
+	failed += budget_result(name, "seconds", mesh != NULL && b.truncated
+			&& mesh_check(mesh, spec->num_holes) == 0, mesh, &b, t);
+
+	if ((full = make_mesh(spec, a)) == NULL)
+		return failed + 1;
+	memset(&b, 0, sizeof b);
+	b.progress = budget_progress;
+	b.ctx = &probe;
+	probe.calls = 0;
+	probe.stop = 1;
+	t = wall_time();
+	mesh = make_mesh_budgeted(spec, a, &b);
+	t = wall_time() - t;
+	failed += budget_result(name, "stop", mesh != NULL && b.truncated
+			&& probe.calls == 1 && mesh->node_num < full->node_num
+			&& mesh_check(mesh, spec->num_holes) == 0, mesh, &b, t);
+
+	memset(&b, 0, sizeof b);
+	b.progress = budget_progress;
+	b.ctx = &probe;
+	probe.calls = 0;
+	probe.stop = 0;
+	t = wall_time();
+	mesh = make_mesh_budgeted(spec, a, &b);
+	t = wall_time() - t;
+	failed += budget_result(name, "no-stop", mesh != NULL && !b.truncated
+			&& probe.calls > 0 && mesh->element_num == full->element_num
+			&& mesh->node_num == full->node_num
+			&& mesh_check(mesh, spec->num_holes) == 0, mesh, &b, t);
+	free_mesh(full);
+	return failed;
+}
+
+/*
+ * 检查 make_mesh_streamed 用的回调: 每一块都与 make_mesh 的网格比较.
+ *  kind 0, 1, 2 是节点, 单元, 边. 块要按下标连续, 只有最后一块可以不满
+ *  MESH_STREAM_CHUNK 个, 拼起来与网格完全相同
+ */
+struct stream_probe{
+	struct mesh *mesh;
+	int begun;
+	int next[3];		/* 下一块的 first 应该是多少 */
+	int chunks[3];
+	int last[3];		/* 最后一块的个数 */
+	int bad;
+};
+
+static void probe_chunk(struct stream_probe *p, int kind, int first, int count)
+{
+	if (!p->begun || first != p->next[kind] || count <= 0
+			|| count > MESH_STREAM_CHUNK
+			|| (p->chunks[kind] > 0 && p->last[kind] != MESH_STREAM_CHUNK))
+		p->bad = 1;
+	p->next[kind] = first + count;
+	p->chunks[kind]++;
+	p->last[kind] = count;
+}
+
+static void probe_begin(void *ctx, int node_num, int element_num, int edge_num)
+{
+	struct stream_probe *p = ctx;
+
+	if (p->begun || node_num != p->mesh->node_num
+			|| element_num != p->mesh->element_num
+			|| edge_num != p->mesh->edge_num)
+		p->bad = 1;
+	p->begun = 1;
+}
+
+static void probe_nodes(void *ctx, int first, int count, const double *xy,
+		const int *bc)
+{
+	struct stream_probe *p = ctx;
+
+	probe_chunk(p, 0, first, count);
+	for (int i = 0; i < count && !p->bad; i++) {
+		const struct node *np = &p->mesh->nodes[first + i];
+		if (xy[2*i] != np->x || xy[2*i+1] != np->y || bc[i] != np->bc)
+			p->bad = 1;
+	}
+}
+
+static void probe_elements(void *ctx, int first, int count, const int *node)
+{
+	struct stream_probe *p = ctx;
+
+	probe_chunk(p, 1, first, count);
+	for (int i = 0; i < count && !p->bad; i++)
+		for (int k = 0; k < 3; k++)
+			if (node[3*i+k] != p->mesh->elements[first + i].node[k]->node_id)
+				p->bad = 1;
+}
+
+static void probe_edges(void *ctx, int first, int count, const int *node,
+		const int *bc)
+{
+	struct stream_probe *p = ctx;
+
+	probe_chunk(p, 2, first, count);
+	for (int i = 0; i < count && !p->bad; i++) {
+		const struct edge *e = &p->mesh->edges[first + i];
+		if (node[2*i] != e->node[0]->node_id
+				|| node[2*i+1] != e->node[1]->node_id || bc[i] != e->bc)
+			p->bad = 1;
+	}
+}
+
+static int files_equal(const char *p, const char *q)
+{
+	FILE *fp = fopen(p, "rb"), *fq = fopen(q, "rb");
+	int same = 0, c, d;
+
+	if (fp != NULL && fq != NULL) {
+		do {
+			c = getc(fp);
+			d = getc(fq);
+		} while (c == d && c != EOF);
+		same = c == d;
+	}
+	if (fp != NULL)
+		fclose(fp);
+	if (fq != NULL)
+		fclose(fq);
+	return same;
+}
+
+/*
+ * 检查 make_mesh_streamed 和 mesh_file_write_spec
+ *  面积约束取 CHECK_A0(节点, 单元和边都不到一块)和 CHECK_A0/64(多块, 最后一块不满).
+ *  回调收到的块拼起来要与 make_mesh 的网格相同, mesh_file_write_spec 写出的文件要与
+ *  mesh_file_write 写出的逐字节相同; 同时给出两种写法经过 xmalloc 的内存峰值.
+ *  临时文件是 <prefix>.stream.mesh 和 <prefix>.ref.mesh, 检查后删除. 返回不通过的项数
+ */
+static int check_stream(const char *name, struct problem_spec *spec,
+		const char *prefix)
+{
+	struct stream_probe p;
+	struct mesh_stream stream = { probe_begin, probe_nodes, probe_elements,
+		probe_edges, &p };
+	struct mesh *mesh;
+	struct memstat *ms;
+	struct allocator *old;
+	size_t peak_stream, peak_mesh;
+	char file[2][512];
+	int failed = 0, ok;
+
+	snprintf(file[0], sizeof file[0], "%s.stream.mesh", prefix);
+	snprintf(file[1], sizeof file[1], "%s.ref.mesh", prefix);
+	for (int l = 0; l < 2; l++) {
+		double a = l == 0 ? CHECK_A0 : CHECK_A0 / 64;
+
+		if ((mesh = make_mesh(spec, a)) == NULL)
+			return failed + 1;
+		memset(&p, 0, sizeof p);
+		p.mesh = mesh;
+		ok = make_mesh_streamed(spec, a, &stream) == 0 && !p.bad
+			&& p.next[0] == mesh->node_num && p.next[1] == mesh->element_num
+			&& p.next[2] == mesh->edge_num;
+		free_mesh(mesh);
+
+		ms = memstat_create(NULL);
+		old = set_allocator(memstat_allocator(ms));
+		ok = mesh_file_write_spec(spec, a, file[0], 1) == 0 && ok;
+		set_allocator(old);
+		peak_stream = memstat_peak(ms);
+		memstat_destroy(ms);
+
+		ms = memstat_create(NULL);
+		old = set_allocator(memstat_allocator(ms));
+		mesh = make_mesh(spec, a);
+		ok = mesh != NULL && mesh_file_write(mesh, file[1], 1) == 0 && ok;
+		free_mesh(mesh);
+		set_allocator(old);
+		peak_mesh = memstat_peak(ms);
+		memstat_destroy(ms);
+
+		ok = ok && files_equal(file[0], file[1]);
+		remove(file[0]);
+		remove(file[1]);
+		printf("%-18s %-8s %s: 节点 %d 块(末块 %d), 单元 %d 块(末块 %d), "
+				"边 %d 块(末块 %d), 峰值 %zu KB, 建网格再写 %zu KB\n",
+				name, l == 0 ? "stream" : "stream64", ok ? "ok" : "FAILED",
+				p.chunks[0], p.last[0], p.chunks[1], p.last[1],
+				p.chunks[2], p.last[2], peak_stream / 1024, peak_mesh / 1024);
+		failed += !ok;
+	}
+	return failed;
+}
+
+int main(int argc, char *argv[])
+{
+	struct problem_spec *spec;
+	int failed = 0;
+
+	if (argc != 1) {
+		printf("Usage: %s\n", argv[0]);
+		return 1;
+	}
+	for (int c = 0; c < CASE_NUM; c++) {
+		spec = make_case(c);
+		failed += check_budget(case_names[c], spec);
+		failed += check_stream(case_names[c], spec, "mesh-check");
+		free_case(c, spec);
+	}
+	printf("%d 项不通过\n", failed);
+	return failed > 0;
+}
@@ -3,20 +3,162 @@
  * @brief 该文件包含了生成网格的示例
  * @details 该文件包含了生成网格的示例，包括三角形网格、圆环网格、正方形网格、三洞圆环网格等
  * 返回结果生成一个EPS图像格式
+ * 网格生成和文件输出是流水线: 主线程生成下一个网格的同时, 输出线程写出上一个网格,
+ * 两者之间是容量为 QUEUE_DEPTH 的有界队列, 总时间取决于较慢的一级而不是两级之和
+ * 设置了环境变量 TRI_MESH_CACHE=<目录> 时, 网格经过 mesh-cache.h 的缓存取得,
+ * 以后再用同样的 a 运行时直接从该目录读入, 不再调用 Triangle
+ * 设置了环境变量 TRI_DEMO_PNG 时还写出 PNG 图像; 它们会覆盖仓库里的 annulus.png 等图片
+ * 设置了环境变量 TRI_EPS_LOD=<格子边长> 时用 mesh_to_eps_lod 写出 EPS 预览(格子边长单位为点,
+ * 不大于 0 时取 EPS_LOD_CELL), 细网格的输出大小只与格子数有关
+ * 设置了环境变量 TRI_DEMO_MESH 时还写出 mesh-file.h 格式的二进制网格文件 name.mesh
 */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include "mesh.h"
 #include "problem-spec.h"
 #include "triangle.h"
+#include "mesh-to-eps.h"
+#include "mesh-to-raster.h"
+#include "mesh-file.h"
+#include "mesh-cache.h"
+#include "trace.h"
 
-static void do_demo(struct problem_spec *spec, double a, char *eps_filename){
-    struct mesh *mesh = make_mesh(spec, a);
+#define PNG_SIZE 800    // PNG 图像宽高中较大者(像素)
+
+#define QUEUE_DEPTH 2   // 等待输出的网格最多个数
+
+static struct mesh_cache *cache;    // NULL 表示不使用缓存
+static int write_png;               // 是否写出 name.png
+static int write_mesh;              // 是否写出 name.mesh
+static double eps_lod_cell;         // > 0 时 EPS 用 LOD 预览
+
+struct demo_job{
+    struct mesh *mesh;
+    char name[64];
+};
+
+// 生成和输出之间的有界队列
+struct demo_queue{
+    struct demo_job jobs[QUEUE_DEPTH];
+    int head;               // 队首下标
+    int count;              // 队中网格个数
+    int closed;             // 不会再有新的网格
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+    pthread_t thread;
+    int threaded;           // 输出线程是否启动成功
+};
+
+/*
+ * @name: write_demo
+ * @msg: 写出 name.eps 以及可选的 name.png 和二进制网格文件 name.mesh, 然后释放或归还网格
+ */
+static void write_demo(struct mesh *mesh, char *name){
+    char filename[256];
+    TRACE_SCOPE("write_demo");
+    snprintf(filename, sizeof filename, "%s.eps", name);
+    if (eps_lod_cell > 0)
+        mesh_to_eps_lod(mesh, filename, eps_lod_cell, EPS_LOD_MIN_EDGE);
+    else
+        mesh_to_eps(mesh, filename);
+    if (write_png){
+        struct raster *image = mesh_to_raster(mesh, PNG_SIZE, NULL, NULL, 1);
+        snprintf(filename, sizeof filename, "%s.png", name);
+        raster_write_png(image, filename);
+        free_raster(image);
+    }
+    if (write_mesh){
+        snprintf(filename, sizeof filename, "%s.mesh", name);
+        mesh_file_write(mesh, filename, 1);
+    }
+    if (cache != NULL)
+        mesh_cache_release(cache, mesh);
+    else
+        free_mesh(mesh);
+}
+
+/*
+ * @name: output_thread
+ * @msg: 输出线程, 依次从队列取出网格并写出, 队列关闭且为空时退出
+ */
+static void *output_thread(void *arg){
+    struct demo_queue *q = arg;
+    struct demo_job job;
+    for (;;){
+        pthread_mutex_lock(&q->lock);
+        while (q->count == 0 && !q->closed)
+            pthread_cond_wait(&q->not_empty, &q->lock);
+        if (q->count == 0){
+            pthread_mutex_unlock(&q->lock);
+            return NULL;
+        }
+        job = q->jobs[q->head];
+        q->head = (q->head + 1) % QUEUE_DEPTH;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+        pthread_mutex_unlock(&q->lock);
+        write_demo(job.mesh, job.name);
+    }
+}
+
+/*
+ * @name: start_output
+ * @msg: 初始化队列并启动输出线程, 线程启动失败时 do_demo 直接写出
+ */
+static void start_output(struct demo_queue *q){
+    q->head = q->count = q->closed = 0;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    q->threaded = pthread_create(&q->thread, NULL, output_thread, q) == 0;
+}
+
+/*
+ * @name: finish_output
+ * @msg: 关闭队列, 等待输出线程写完所有网格
+ */
+static void finish_output(struct demo_queue *q){
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+    if (q->threaded)
+        pthread_join(q->thread, NULL);
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+}
+
+/*
+ * @name: do_demo
+ * @msg: 生成网格并交给输出线程写出, 队列满时等待
+ */
+static void do_demo(struct demo_queue *q, struct problem_spec *spec, double a, char *name){
+    struct mesh *mesh = cache != NULL ? mesh_cache_get(cache, spec, a) : make_mesh(spec, a);
+    struct demo_job *job;
+    if (mesh == NULL){
+        /* 错误已经打印, 跳过这一个, 继续下一个 */
+        fprintf(stderr, "%s: 网格生成失败\n", name);
+        return;
+    }
     printf("网格生成完毕\n");
     printf("节点个数: %d, 边个数: %d, 面个数: %d\n", mesh->node_num, mesh->edge_num, mesh->element_num);
-    mesh_to_eps(mesh, eps_filename);
-    free_mesh(mesh);
+    if (!q->threaded){
+        write_demo(mesh, name);
+        return;
+    }
+    pthread_mutex_lock(&q->lock);
+    while (q->count == QUEUE_DEPTH)
+        pthread_cond_wait(&q->not_full, &q->lock);
+    job = &q->jobs[(q->head + q->count) % QUEUE_DEPTH];
+    job->mesh = mesh;
+    snprintf(job->name, sizeof job->name, "%s", name);
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
 }
 
 /*
@@ -41,30 +183,44 @@ int main(int argc, char *argv[])
     struct problem_spec *three_holes(int n);
     void free_three_holes(struct problem_spec *spec);
     struct problem_spec *spec;
+    struct demo_queue queue;
     
     char *endptr; // 用于strtod函数
+    char *cache_dir = getenv("TRI_MESH_CACHE");
     double a;
 
     if (argc != 2){
         show_usage(argv[0]);
     }
     a = strtod(argv[1], &endptr); // strtod将字符串转换为double类型
+    write_png = getenv("TRI_DEMO_PNG") != NULL;
+    write_mesh = getenv("TRI_DEMO_MESH") != NULL;
+    if (getenv("TRI_EPS_LOD") != NULL){
+        eps_lod_cell = strtod(getenv("TRI_EPS_LOD"), NULL);
+        if (eps_lod_cell <= 0)
+            eps_lod_cell = EPS_LOD_CELL;
+    }
+    if (cache_dir != NULL && *cache_dir != '\0')
+        cache = mesh_cache_create(0, cache_dir);
+    start_output(&queue);
 
     printf("-----------------------------------\n");
     printf("三角形带孔区域\n");
-    do_demo(triangle_with_hole(), a, "triangle-with-hole.eps");
+    do_demo(&queue, triangle_with_hole(), a, "triangle-with-hole");
 
     printf("-----------------------------------\n");
     printf("圆环区域\n");
     spec = annulus(24);
-    do_demo(spec, a, "annulus.eps");
+    do_demo(&queue, spec, a, "annulus");
     free_annulus(spec);
 
     printf("-----------------------------------\n");
     printf("方形区域\n");
-    do_demo(square(), a, "square.eps");
+    do_demo(&queue, square(), a, "square");
 
     printf("-----------------------------------\n");
+    finish_output(&queue);
+    mesh_cache_destroy(cache);
 
     return 1;
 }
\ No newline at end of file
@@ -0,0 +1,646 @@
+/*
+Binary mesh files.
+
+A mesh file is a 128-byte header followed by the mesh arrays, each array
+in its own section starting on a MESH_FILE_ALIGN boundary and padded with
+zeros up to the next one:
+
+	header		struct mesh_file_header
+	xy		node coordinates, x0 y0 x1 y1 ...	double
+	node_bc		node boundary markers			int32
+	edge_node	two node indices per edge		int32
+	edge_bc		edge boundary markers			int32
+	element_node	three node indices per element		int32
+	element_edge	three edge indices per element, edge i	int32
+			opposite node i
+	neighbor	three element indices per element, the	int32
+			element across edge i or -1 (optional)
+
+Everything is little-endian; the file is refused on big-endian hosts
+rather than byte-swapped, since that would defeat mapping it.  Indices
+are 0-based, so the sections are exactly the index arrays that
+mesh_from_arrays() takes.
+
+The checksum is computed over the whole file, with the checksum field
+itself read as zero, 32 bytes at a time by four independent
+multiply-rotate lanes, which runs at memory speed.  The writer fills it
+in last; the reader only recomputes it when asked to, so that opening a
+file stays O(1) no matter how large the mesh is.
+
+mesh_file_open() maps the file read-only and points the members of
+struct mesh_file straight into the mapping.  Code that works on index
+arrays can use those directly; mesh_file_to_mesh() builds an ordinary
+struct mesh (after checking every index) for code that needs pointers.
+
+mesh_file_write_spec() writes the file for make_mesh() without building
+the mesh: each chunk from make_mesh_streamed() goes straight to its place
+in its section, and the element edges, the neighbors, the header and the
+checksum are filled in through a mapping of the file at the end.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "mesh-file.h"
+
+_Static_assert(sizeof(struct mesh_file_header) == 128, "mesh file header must be 128 bytes");
+_Static_assert(sizeof(int) == sizeof(int32_t), "mesh indices are stored as int32");
+
+#define WBUF_SIZE (1 << 20)
+
+#define P1 0x9E3779B97F4A7C15ULL
+#define P2 0xC2B2AE3D27D4EB4FULL
+
+static const uint64_t hash_seed[4] = {
+	0x243F6A8885A308D3ULL, 0x13198A2E03707344ULL,
+	0xA4093822299F31D0ULL, 0x082EFA98EC4E6C89ULL
+};
+
+static int host_is_little_endian(void)
+{
+	unsigned int one = 1;
+	return *(unsigned char *)&one == 1;
+}
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+/* n is a multiple of 32 */
+static void hash_blocks(uint64_t lane[4], const unsigned char *p, size_t n)
+{
+	uint64_t l0 = lane[0], l1 = lane[1], l2 = lane[2], l3 = lane[3];
+
+	for (size_t i = 0; i < n; i += 32) {
+		uint64_t w[4];
+		memcpy(w, p + i, 32);
+		l0 = rotl64((l0 ^ w[0]) * P1, 29);
+		l1 = rotl64((l1 ^ w[1]) * P1, 29);
+		l2 = rotl64((l2 ^ w[2]) * P1, 29);
+		l3 = rotl64((l3 ^ w[3]) * P1, 29);
+	}
+	lane[0] = l0; lane[1] = l1; lane[2] = l2; lane[3] = l3;
+}
+
+static uint64_t hash_final(const uint64_t lane[4], uint64_t size)
+{
+	uint64_t h = lane[0] ^ rotl64(lane[1], 16) ^ rotl64(lane[2], 32)
+		^ rotl64(lane[3], 48) ^ size;
+
+	h ^= h >> 33;
+	h *= P1;
+	h ^= h >> 29;
+	h *= P2;
+	h ^= h >> 32;
+	return h;
+}
+
+static uint64_t align_up(uint64_t n)
+{
+	return (n + MESH_FILE_ALIGN - 1) / MESH_FILE_ALIGN * MESH_FILE_ALIGN;
+}
+
+static uint64_t section_bytes(const struct mesh_file_header *h, int s)
+{
+	switch (s) {
+	case MESH_FILE_XY:		return 16ULL * h->node_num;
+	case MESH_FILE_NODE_BC:		return 4ULL * h->node_num;
+	case MESH_FILE_EDGE_NODE:	return 8ULL * h->edge_num;
+	case MESH_FILE_EDGE_BC:		return 4ULL * h->edge_num;
+	default:			return 12ULL * h->element_num;
+	}
+}
+
+/* fill in the section offsets and the file size from the counts and flags */
+static void layout(struct mesh_file_header *h)
+{
+	uint64_t pos = sizeof *h;
+
+	for (int s = 0; s < MESH_FILE_NSECTIONS; s++) {
+		if (s == MESH_FILE_NEIGHBOR && !(h->flags & MESH_FILE_ADJACENCY)) {
+			h->offset[s] = 0;
+			continue;
+		}
+		h->offset[s] = pos;
+		pos = align_up(pos + section_bytes(h, s));
+	}
+	h->file_size = pos;
+}
+
+/* ---------------- writer ---------------- */
+
+struct mf_writer {
+	FILE *fp;
+	unsigned char *buf;
+	size_t len;
+	uint64_t pos;		/* bytes written so far, including buf */
+	uint64_t lane[4];
+	int err;
+};
+
+static void writer_flush(struct mf_writer *w)
+{
+	hash_blocks(w->lane, w->buf, w->len);
+	if (fwrite(w->buf, 1, w->len, w->fp) != w->len)
+		w->err = 1;
+	w->len = 0;
+}
+
+static void put_bytes(struct mf_writer *w, const void *p, size_t n)
+{
+	memcpy(w->buf + w->len, p, n);
+	w->len += n;
+	w->pos += n;
+	if (w->len == WBUF_SIZE)
+		writer_flush(w);
+}
+
+static void put_i32(struct mf_writer *w, int32_t v)
+{
+	put_bytes(w, &v, 4);
+}
+
+static void put_f64(struct mf_writer *w, double v)
+{
+	put_bytes(w, &v, 8);
+}
+
+/* zero padding up to the next section */
+static void put_pad(struct mf_writer *w)
+{
+	static const unsigned char zero[4];
+
+	while (w->pos % MESH_FILE_ALIGN != 0)
+		put_bytes(w, zero, 4);
+}
+
+/* element across each edge, -1 on the boundary */
+static int32_t *element_neighbors(struct mesh *mesh)
+{
+	int *owner;
+	int32_t *nb;
+
+	make_vector(owner, 2 * mesh->edge_num);
+	make_vector(nb, 3 * mesh->element_num);
+	for (int e = 0; e < 2 * mesh->edge_num; e++)
+		owner[e] = -1;
+	for (int r = 0; r < mesh->element_num; r++) {
+		for (int i = 0; i < 3; i++) {
+			int e = mesh->elements[r].edge[i]->edge_id;
+			owner[2*e + (owner[2*e] >= 0)] = r;
+		}
+	}
+	for (int r = 0; r < mesh->element_num; r++) {
+		for (int i = 0; i < 3; i++) {
+			int e = mesh->elements[r].edge[i]->edge_id;
+			nb[3*r+i] = owner[2*e] == r ? owner[2*e+1] : owner[2*e];
+		}
+	}
+	free_vector(owner);
+	return nb;
+}
+
+/**
+ * @name mesh_file_write - 把网格写入二进制网格文件
+ * @param 1.mesh 网格 2.outfile 文件名 3.with_adjacency 非零时同时写入单元相邻关系
+ * @return 成功返回 0, 失败返回 -1
+*/
+int mesh_file_write(struct mesh *mesh, char *outfile, int with_adjacency)
+{
+	struct mesh_file_header h;
+	struct mesh_file_header zero_h;
+	struct mf_writer w;
+	int32_t *nb = NULL;
+	uint64_t checksum;
+
+	if (!host_is_little_endian()) {
+		fprintf(stderr, "mesh files can only be written on little-endian hosts\n");
+		return -1;
+	}
+
+	memset(&h, 0, sizeof h);
+	memcpy(h.magic, MESH_FILE_MAGIC, sizeof MESH_FILE_MAGIC);
+	h.version = MESH_FILE_VERSION;
+	h.flags = with_adjacency ? MESH_FILE_ADJACENCY : 0;
+	h.node_num = mesh->node_num;
+	h.edge_num = mesh->edge_num;
+	h.element_num = mesh->element_num;
+	h.header_size = sizeof h;
+	layout(&h);
+
+	if ((w.fp = fopen(outfile, "wb")) == NULL) {
+		fprintf(stderr, "cannot open file %s for writing\n", outfile);
+		return -1;
+	}
+	w.buf = xmalloc(WBUF_SIZE);
+	w.len = 0;
+	w.pos = 0;
+	w.err = 0;
+	memcpy(w.lane, hash_seed, sizeof w.lane);
+
+	zero_h = h;	/* the checksum field hashes as zero */
+	put_bytes(&w, &zero_h, sizeof zero_h);
+
+	for (int i = 0; i < mesh->node_num; i++) {
+		put_f64(&w, mesh->nodes[i].x);
+		put_f64(&w, mesh->nodes[i].y);
+	}
+	put_pad(&w);
+	for (int i = 0; i < mesh->node_num; i++)
+		put_i32(&w, mesh->nodes[i].bc);
+	put_pad(&w);
+	for (int i = 0; i < mesh->edge_num; i++) {
+		put_i32(&w, mesh->edges[i].node[0]->node_id);
+		put_i32(&w, mesh->edges[i].node[1]->node_id);
+	}
+	put_pad(&w);
+	for (int i = 0; i < mesh->edge_num; i++)
+		put_i32(&w, mesh->edges[i].bc);
+	put_pad(&w);
+	for (int i = 0; i < mesh->element_num; i++)
+		for (int k = 0; k < 3; k++)
+			put_i32(&w, mesh->elements[i].node[k]->node_id);
+	put_pad(&w);
+	for (int i = 0; i < mesh->element_num; i++)
+		for (int k = 0; k < 3; k++)
+			put_i32(&w, mesh->elements[i].edge[k]->edge_id);
+	put_pad(&w);
+	if (with_adjacency) {
+		nb = element_neighbors(mesh);
+		for (int i = 0; i < 3 * mesh->element_num; i++)
+			put_i32(&w, nb[i]);
+		put_pad(&w);
+		free_vector(nb);
+	}
+	writer_flush(&w);
+	xfree(w.buf);
+
+	checksum = hash_final(w.lane, h.file_size);
+	if (fseek(w.fp, offsetof(struct mesh_file_header, checksum), SEEK_SET) != 0
+			|| fwrite(&checksum, sizeof checksum, 1, w.fp) != 1)
+		w.err = 1;
+	if (fclose(w.fp) != 0 || w.err || w.pos != h.file_size) {
+		fprintf(stderr, "error writing file %s\n", outfile);
+		return -1;
+	}
+	fprintf(stderr, "网格已经写入到 %s 文件\n", outfile);
+	return 0;
+}
+
+/* ---------------- reader ---------------- */
+
+static uint64_t file_checksum(const unsigned char *base, uint64_t size)
+{
+	struct mesh_file_header h;
+	uint64_t lane[4];
+
+	memcpy(lane, hash_seed, sizeof lane);
+	memcpy(&h, base, sizeof h);
+	h.checksum = 0;
+	hash_blocks(lane, (const unsigned char *)&h, sizeof h);
+	hash_blocks(lane, base + sizeof h, size - sizeof h);
+	return hash_final(lane, size);
+}
+
+static const char *check_header(const struct mesh_file_header *h, uint64_t size)
+{
+	if (memcmp(h->magic, MESH_FILE_MAGIC, sizeof MESH_FILE_MAGIC) != 0)
+		return "not a mesh file";
+	if (h->version != MESH_FILE_VERSION)
+		return "unsupported version";
+	if (h->header_size != sizeof *h)
+		return "bad header size";
+	if (h->file_size != size || size % 32 != 0)
+		return "truncated or bad file size";
+	if (h->node_num > INT_MAX || h->edge_num > INT_MAX || h->element_num > INT_MAX)
+		return "counts out of range";
+	for (int s = 0; s < MESH_FILE_NSECTIONS; s++) {
+		uint64_t off = h->offset[s];
+		if (off == 0) {
+			if (s == MESH_FILE_NEIGHBOR && !(h->flags & MESH_FILE_ADJACENCY))
+				continue;
+			return "missing section";
+		}
+		if (off % MESH_FILE_ALIGN != 0 || off < sizeof *h
+				|| off > size || section_bytes(h, s) > size - off)
+			return "bad section offset";
+	}
+	return NULL;
+}
+
+/**
+ * @name mesh_file_open - 映射二进制网格文件
+ * @param 1.infile 文件名 2.verify 非零时校验整个文件的校验和
+ * @return 映射后的网格文件, 失败返回 NULL
+ * @note 不校验时打开的代价与网格大小无关; 返回的数组在 mesh_file_close 之前有效
+*/
+struct mesh_file *mesh_file_open(char *infile, int verify)
+{
+	struct mesh_file *mf;
+	struct mesh_file_header h;
+	struct stat st;
+	const char *why;
+	unsigned char *base;
+	int fd;
+
+	if (!host_is_little_endian()) {
+		fprintf(stderr, "mesh files can only be read on little-endian hosts\n");
+		return NULL;
+	}
+	if ((fd = open(infile, O_RDONLY)) < 0) {
+		fprintf(stderr, "cannot open file %s for reading\n", infile);
+		return NULL;
+	}
+	if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof h) {
+		fprintf(stderr, "%s: not a mesh file\n", infile);
+		close(fd);
+		return NULL;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, "cannot map file %s\n", infile);
+		return NULL;
+	}
+
+	memcpy(&h, base, sizeof h);
+	why = check_header(&h, st.st_size);
+	if (why == NULL && verify && file_checksum(base, st.st_size) != h.checksum)
+		why = "checksum mismatch";
+	if (why != NULL) {
+		fprintf(stderr, "%s: %s\n", infile, why);
+		munmap(base, st.st_size);
+		return NULL;
+	}
+
+	mf = xmalloc(sizeof *mf);
+	mf->base = base;
+	mf->size = st.st_size;
+	mf->node_num = h.node_num;
+	mf->edge_num = h.edge_num;
+	mf->element_num = h.element_num;
+	mf->xy = (const double *)(base + h.offset[MESH_FILE_XY]);
+	mf->node_bc = (const int32_t *)(base + h.offset[MESH_FILE_NODE_BC]);
+	mf->edge_node = (const int32_t *)(base + h.offset[MESH_FILE_EDGE_NODE]);
+	mf->edge_bc = (const int32_t *)(base + h.offset[MESH_FILE_EDGE_BC]);
+	mf->element_node = (const int32_t *)(base + h.offset[MESH_FILE_ELEMENT_NODE]);
+	mf->element_edge = (const int32_t *)(base + h.offset[MESH_FILE_ELEMENT_EDGE]);
+	mf->neighbor = h.offset[MESH_FILE_NEIGHBOR] != 0
+		? (const int32_t *)(base + h.offset[MESH_FILE_NEIGHBOR]) : NULL;
+	return mf;
+}
+
+static int indices_in_range(const int32_t *p, long n, int limit)
+{
+	for (long i = 0; i < n; i++)
+		if (p[i] < 0 || p[i] >= limit)
+			return 0;
+	return 1;
+}
+
+/**
+ * @name mesh_file_to_mesh - 由映射的网格文件构造网格结构
+ * @param 1.mf 映射的网格文件
+ * @return 网格, 文件中的下标越界时返回 NULL
+ * @note 网格与 mf 互不依赖, 可以先关闭 mf
+*/
+struct mesh *mesh_file_to_mesh(const struct mesh_file *mf)
+{
+	if (!indices_in_range(mf->edge_node, 2L * mf->edge_num, mf->node_num)
+			|| !indices_in_range(mf->element_node, 3L * mf->element_num, mf->node_num)
+			|| !indices_in_range(mf->element_edge, 3L * mf->element_num, mf->edge_num)) {
+		fprintf(stderr, "mesh file has indices out of range\n");
+		return NULL;
+	}
+	return mesh_from_arrays(mf->node_num, mf->xy, mf->node_bc,
+			mf->edge_num, mf->edge_node, mf->edge_bc,
+			mf->element_num, mf->element_node, mf->element_edge);
+}
+
+void mesh_file_close(struct mesh_file *mf)
+{
+	if (mf == NULL)
+		return;
+	munmap(mf->base, mf->size);
+	xfree(mf);
+}
+
+/* ---------------- streaming writer ---------------- */
+
+/* state of mesh_file_write_spec(); the callbacks of make_mesh_streamed() */
+struct mf_stream {
+	FILE *fp;
+	struct mesh_file_header h;
+	int begun;
+	int err;
+};
+
+/* write count items of size bytes at item first of section s */
+static void stream_put(struct mf_stream *st, int s, int first, size_t size,
+		const void *p, int count)
+{
+	long pos = (long)(st->h.offset[s] + (uint64_t)first * size);
+
+	if (fseek(st->fp, pos, SEEK_SET) != 0
+			|| fwrite(p, size, count, st->fp) != (size_t)count)
+		st->err = 1;
+}
+
+static void stream_begin(void *ctx, int node_num, int element_num, int edge_num)
+{
+	struct mf_stream *st = ctx;
+
+	st->h.node_num = node_num;
+	st->h.edge_num = edge_num;
+	st->h.element_num = element_num;
+	layout(&st->h);
+	/* the holes between the chunks and the padding read back as zeros */
+	if (fflush(st->fp) != 0 || ftruncate(fileno(st->fp), st->h.file_size) != 0)
+		st->err = 1;
+	st->begun = 1;
+}
+
+static void stream_nodes(void *ctx, int first, int count, const double *xy,
+		const int *bc)
+{
+	stream_put(ctx, MESH_FILE_XY, first, 16, xy, count);
+	stream_put(ctx, MESH_FILE_NODE_BC, first, 4, bc, count);
+}
+
+static void stream_elements(void *ctx, int first, int count, const int *node)
+{
+	stream_put(ctx, MESH_FILE_ELEMENT_NODE, first, 12, node, count);
+}
+
+static void stream_edges(void *ctx, int first, int count, const int *node,
+		const int *bc)
+{
+	stream_put(ctx, MESH_FILE_EDGE_NODE, first, 8, node, count);
+	stream_put(ctx, MESH_FILE_EDGE_BC, first, 4, bc, count);
+}
+
+/*
+ * edge i of each element, opposite node i, found among the edges bucketed
+ * by their smaller endpoint (the same search as assign_elem_edges in mesh.c)
+ */
+static void fill_element_edges(const struct mesh_file_header *h,
+		const int32_t *edge_node, const int32_t *element_node,
+		int32_t *element_edge)
+{
+	int n = h->node_num;
+	int *start, *list;
+
+	make_vector(start, n + 1);
+	make_vector(list, h->edge_num);
+	for (int i = 0; i <= n; i++)
+		start[i] = 0;
+	for (uint32_t e = 0; e < h->edge_num; e++) {
+		int a = edge_node[2*e], b = edge_node[2*e+1];
+		start[(a < b ? a : b) + 1]++;
+	}
+	for (int i = 0; i < n; i++)
+		start[i+1] += start[i];
+	for (uint32_t e = 0; e < h->edge_num; e++) {
+		int a = edge_node[2*e], b = edge_node[2*e+1];
+		list[start[a < b ? a : b]++] = e;
+	}
+	for (int i = n; i > 0; i--)	/* undo the shift from filling */
+		start[i] = start[i-1];
+	start[0] = 0;
+
+	for (uint32_t r = 0; r < h->element_num; r++) {
+		for (int i = 0; i < 3; i++) {
+			int a = element_node[3*r + (i+1)%3];
+			int b = element_node[3*r + (i+2)%3];
+			int lo = a < b ? a : b, hi = a < b ? b : a;
+			element_edge[3*r+i] = -1;
+			for (int p = start[lo]; p < start[lo+1]; p++) {
+				if (edge_node[2*list[p]] == hi || edge_node[2*list[p]+1] == hi) {
+					element_edge[3*r+i] = list[p];
+					break;
+				}
+			}
+		}
+	}
+	free_vector(start);
+	free_vector(list);
+}
+
+/* the element across each edge, as element_neighbors() but from element_edge */
+static void fill_neighbors(const struct mesh_file_header *h,
+		const int32_t *element_edge, int32_t *nb)
+{
+	int *owner;
+
+	make_vector(owner, 2 * h->edge_num);
+	for (uint32_t e = 0; e < 2 * h->edge_num; e++)
+		owner[e] = -1;
+	for (uint32_t r = 0; r < h->element_num; r++) {
+		for (int i = 0; i < 3; i++) {
+			int e = element_edge[3*r+i];
+			owner[2*e + (owner[2*e] >= 0)] = r;
+		}
+	}
+	for (uint32_t r = 0; r < h->element_num; r++) {
+		for (int i = 0; i < 3; i++) {
+			int e = element_edge[3*r+i];
+			nb[3*r+i] = owner[2*e] == (int)r ? owner[2*e+1] : owner[2*e];
+		}
+	}
+	free_vector(owner);
+}
+
+/* fill in the derived sections, the header and the checksum in place */
+static int stream_finish(struct mf_stream *st)
+{
+	struct mesh_file_header *h = &st->h;
+	unsigned char *base;
+	int32_t *element_edge;
+
+	if (fflush(st->fp) != 0)
+		return -1;
+	base = mmap(NULL, h->file_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			fileno(st->fp), 0);
+	if (base == MAP_FAILED)
+		return -1;
+	element_edge = (int32_t *)(base + h->offset[MESH_FILE_ELEMENT_EDGE]);
+	fill_element_edges(h,
+			(const int32_t *)(base + h->offset[MESH_FILE_EDGE_NODE]),
+			(const int32_t *)(base + h->offset[MESH_FILE_ELEMENT_NODE]),
+			element_edge);
+	if (!indices_in_range(element_edge, 3L * h->element_num, h->edge_num)) {
+		munmap(base, h->file_size);
+		return -1;
+	}
+	if (h->flags & MESH_FILE_ADJACENCY)
+		fill_neighbors(h, element_edge,
+				(int32_t *)(base + h->offset[MESH_FILE_NEIGHBOR]));
+	memcpy(base, h, sizeof *h);
+	h->checksum = file_checksum(base, h->file_size);
+	memcpy(base + offsetof(struct mesh_file_header, checksum), &h->checksum,
+			sizeof h->checksum);
+	return munmap(base, h->file_size);
+}
+
+/**
+ * @name mesh_file_write_spec - 剖分并把结果直接写入二进制网格文件, 不建立网格
+ * @param 1.spec 问题规格 2.a 最大面积 3.outfile 文件名
+ * 	4.with_adjacency 非零时同时写入单元相邻关系
+ * @return 成功返回 0, 失败返回 -1
+ * @note 文件与 mesh_file_write(make_mesh(spec, a), ...) 写出的逐字节相同.
+ * 	make_mesh_streamed 交出的每一块直接写到它在文件中的位置, 写完后映射文件,
+ * 	补上单元的边, 相邻关系, 文件头和校验和. 除 Triangle 自己的内存外只用
+ * 	4*(节点数+边数) 字节的临时数组(写相邻关系时再用 8*边数 字节)
+*/
+int mesh_file_write_spec(struct problem_spec *spec, double a, char *outfile,
+		int with_adjacency)
+{
+	struct mf_stream st;
+	struct mesh_stream stream = {
+		.begin = stream_begin,
+		.nodes = stream_nodes,
+		.elements = stream_elements,
+		.edges = stream_edges,
+		.ctx = &st,
+	};
+	int status;
+
+	if (!host_is_little_endian()) {
+		fprintf(stderr, "mesh files can only be written on little-endian hosts\n");
+		return -1;
+	}
+
+	memset(&st, 0, sizeof st);
+	memcpy(st.h.magic, MESH_FILE_MAGIC, sizeof MESH_FILE_MAGIC);
+	st.h.version = MESH_FILE_VERSION;
+	st.h.flags = with_adjacency ? MESH_FILE_ADJACENCY : 0;
+	st.h.header_size = sizeof st.h;
+	if ((st.fp = fopen(outfile, "w+b")) == NULL) {
+		fprintf(stderr, "cannot open file %s for writing\n", outfile);
+		return -1;
+	}
+
+	status = make_mesh_streamed(spec, a, &stream);
+	if (status == 0 && (!st.begun || st.err || stream_finish(&st) != 0)) {
+		fprintf(stderr, "error writing file %s\n", outfile);
+		status = -1;
+	}
+	if (fclose(st.fp) != 0 && status == 0) {
+		fprintf(stderr, "error writing file %s\n", outfile);
+		status = -1;
+	}
+	if (status != 0) {
+		remove(outfile);
+		return -1;
+	}
+	fprintf(stderr, "网格已经写入到 %s 文件\n", outfile);
+	return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef H_MESH_FILE_H
+#define H_MESH_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "mesh.h"
+
+#define MESH_FILE_MAGIC		"TRIMESH"	/* 8 bytes including the NUL */
+#define MESH_FILE_VERSION	1
+#define MESH_FILE_ALIGN		64		/* sections start on this boundary */
+
+#define MESH_FILE_ADJACENCY	0x1		/* flags: neighbor section present */
+
+enum {
+	MESH_FILE_XY,		/* double[2*node_num] */
+	MESH_FILE_NODE_BC,	/* int32[node_num] */
+	MESH_FILE_EDGE_NODE,	/* int32[2*edge_num] */
+	MESH_FILE_EDGE_BC,	/* int32[edge_num] */
+	MESH_FILE_ELEMENT_NODE,	/* int32[3*element_num] */
+	MESH_FILE_ELEMENT_EDGE,	/* int32[3*element_num] */
+	MESH_FILE_NEIGHBOR,	/* int32[3*element_num], optional */
+	MESH_FILE_NSECTIONS
+};
+
+/* on-disk header, little-endian, 128 bytes */
+struct mesh_file_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint32_t node_num;
+	uint32_t edge_num;
+	uint32_t element_num;
+	uint32_t header_size;
+	uint64_t file_size;
+	uint64_t checksum;
+	uint64_t offset[MESH_FILE_NSECTIONS];	/* 0 for an absent section */
+	uint64_t reserved[3];
+};
+
+/* a mapped mesh file; the arrays point into the mapping */
+struct mesh_file {
+	void *base;
+	size_t size;
+	int node_num, edge_num, element_num;
+	const double *xy;
+	const int32_t *node_bc;
+	const int32_t *edge_node;
+	const int32_t *edge_bc;
+	const int32_t *element_node;
+	const int32_t *element_edge;
+	const int32_t *neighbor;	/* NULL if the file has no adjacency */
+};
+
+int mesh_file_write(struct mesh *mesh, char *outfile, int with_adjacency);
+int mesh_file_write_spec(struct problem_spec *spec, double a, char *outfile,
+		int with_adjacency);
+struct mesh_file *mesh_file_open(char *infile, int verify);
+struct mesh *mesh_file_to_mesh(const struct mesh_file *mf);
+void mesh_file_close(struct mesh_file *mf);
+
+#endif /* H_MESH_FILE_H */
@@ -0,0 +1,250 @@
+/**
+ * @file mesh-pack.c
+ * @brief 网格文件格式之间的转换
+ * @details
+ *  用法:
+ *      mesh-pack.bin <in> <out> [bits]
+ *      mesh-pack.bin <in.poly> <out> <area>
+ *      mesh-pack.bin -r <in.msh> <out> <area>
+ *  输入和输出的格式由扩展名决定:
+ *      .mesh   二进制网格文件(可以 mmap)
+ *      .marc   压缩网格, 写出时 bits 为坐标量化位数, 缺省无损
+ *      .msh    Gmsh MSH 4.1 二进制文件
+ *  输入还可以是 Triangle 的 .poly 或 .node 文件, 按最大面积 area 剖分后写出;
+ *  写 .mesh 时不建立网格, 剖分结果分块直接写进文件(mesh_file_write_spec)
+ *  -r 重新剖分 .msh: 由其中的边界线(msh_to_problem_spec)按最大面积 area 剖分后写出,
+ *  并检查新网格的边界边恰好是原来的边界线(可能被 Steiner 点分开, bc 不变),
+ *  总面积与文件中原有的三角形相同, 不一致时返回 1
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "mesh.h"
+#include "mesh-file.h"
+#include "mesh-archive.h"
+#include "gmsh.h"
+#include "problem-spec.h"
+
+static void show_usage(char *progname)
+{
+    printf("Usage: %s <in> <out> [bits]\n", progname);
+    printf("       %s <in.poly> <out> <area>\n", progname);
+    printf("       %s -r <in.msh> <out> <area>\n", progname);
+    printf("  in和out的扩展名为 .mesh, .marc 或 .msh\n");
+    printf("  bits是写出 .marc 时坐标量化的位数(8到32), 缺省为无损压缩\n");
+    printf("  in为 .poly 或 .node 时先按最大面积area剖分, .marc 为无损压缩\n");
+    printf("  -r 按 in.msh 的边界线重新剖分, 并检查边界没有改变\n");
+    exit(1);
+}
+
+static int has_suffix(const char *s, const char *suffix)
+{
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+// 节点 r 是否在线段 pq 内部(不含端点)
+static int on_segment(const struct node *r, const struct node *p, const struct node *q)
+{
+    double dx = q->x - p->x, dy = q->y - p->y, len2 = dx*dx + dy*dy;
+    double cross = dx * (r->y - p->y) - dy * (r->x - p->x);
+    double dot = dx * (r->x - p->x) + dy * (r->y - p->y);
+    return fabs(cross) <= 1e-9 * len2 && dot > 0 && dot < len2;
+}
+
+/*
+ * 检查 mesh 的边界边(bc 非零的边)恰好由 spec 的线段剖分而来
+ *  make_mesh 保留输入点的编号, 之后的节点都是 Steiner 点. Triangle 可能在线段上
+ *  插入 Steiner 点, 所以线段 (p, q) 对应新网格中从 p 出发, 经过线段上的 Steiner 点
+ *  到 q 的一串边界边, 它们的 bc 都等于线段的 bc. 所有线段的边界边合起来
+ *  要恰好是新网格的全部边界边
+ */
+static int check_boundary(struct problem_spec *spec, struct mesh *mesh)
+{
+    struct node *nodes = mesh->nodes;
+    int *start, *fill, *adj, *used, boundary = 0, matched = 0, ok = 1;
+
+    make_vector(start, mesh->node_num + 1);
+    make_vector(fill, mesh->node_num + 1);
+    make_vector(adj, 2 * mesh->edge_num + 1);
+    make_vector(used, mesh->edge_num + 1);
+    for (int v = 0; v <= mesh->node_num; v++)
+        start[v] = fill[v] = 0;
+    for (int i = 0; i <= mesh->edge_num; i++)
+        used[i] = 0;
+    // 每个节点的边界边, 压缩存储
+    for (int i = 0; i < mesh->edge_num; i++)
+        if (mesh->edges[i].bc != 0) {
+            start[mesh->edges[i].node[0]->node_id + 1]++;
+            start[mesh->edges[i].node[1]->node_id + 1]++;
+            boundary++;
+        }
+    for (int v = 0; v < mesh->node_num; v++)
+        start[v + 1] += start[v];
+    for (int i = 0; i < mesh->edge_num; i++)
+        if (mesh->edges[i].bc != 0)
+            for (int k = 0; k < 2; k++) {
+                int v = mesh->edges[i].node[k]->node_id;
+                adj[start[v] + fill[v]++] = i;
+            }
+
+    for (int i = 0; i < spec->num_segments && ok; i++) {
+        struct node *p = &nodes[spec->segments[i].point_id1];
+        struct node *q = &nodes[spec->segments[i].point_id2];
+        int cur = p->node_id;
+        while (ok && cur != q->node_id) {
+            int next = -1;
+            for (int j = start[cur]; j < start[cur + 1] && next < 0; j++) {
+                struct edge *e = &mesh->edges[adj[j]];
+                struct node *r = e->node[0]->node_id == cur ? e->node[1] : e->node[0];
+                if (used[adj[j]] || e->bc != spec->segments[i].bc)
+                    continue;
+                if (r == q || (r->node_id >= spec->num_points && on_segment(r, p, q))) {
+                    used[adj[j]] = 1;
+                    matched++;
+                    next = r->node_id;
+                }
+            }
+            if (next < 0)
+                ok = 0;
+            cur = next;
+        }
+        if (!ok)
+            fprintf(stderr, "边界不一致: 线段 %d (%d, %d) 在新网格中断开\n", i,
+                    spec->segments[i].point_id1, spec->segments[i].point_id2);
+    }
+    if (ok && matched != boundary) {
+        fprintf(stderr, "边界不一致: 新网格有 %d 条边界边不在线段上\n", boundary - matched);
+        ok = 0;
+    }
+    if (ok)
+        printf("边界一致: %d 条线段, %d 条边界边\n", spec->num_segments, boundary);
+    free_vector(start);
+    free_vector(fill);
+    free_vector(adj);
+    free_vector(used);
+    return ok ? 0 : -1;
+}
+
+static double total_area(struct mesh *mesh)
+{
+    double sum = 0.0;
+    for (int i = 0; i < mesh->element_num; i++)
+        sum += mesh->elements[i].area;
+    return sum;
+}
+
+/*
+ * -r: 按 .msh 的边界线重新剖分
+ *  检查新网格的边界, 以及新网格与文件中原有三角形的总面积相同(洞的位置正确)
+ */
+static struct mesh *remesh(char *infile, double area)
+{
+    struct problem_spec *spec;
+    struct mesh *mesh, *old;
+    double a0, a1;
+
+    if ((spec = msh_to_problem_spec(infile)) == NULL)
+        return NULL;
+    mesh = make_mesh(spec, area);
+    if (mesh != NULL && check_boundary(spec, mesh) != 0) {
+        free_mesh(mesh);
+        mesh = NULL;
+    }
+    free_problem_spec(spec);
+    if (mesh != NULL && (old = msh_to_mesh(infile)) != NULL) {
+        a0 = total_area(old);
+        a1 = total_area(mesh);
+        if (old->element_num > 0 && fabs(a1 - a0) > 1e-9 * a0) {
+            fprintf(stderr, "面积不一致: 原网格 %.15g, 新网格 %.15g\n", a0, a1);
+            free_mesh(mesh);
+            mesh = NULL;
+        }
+        free_mesh(old);
+    }
+    return mesh;
+}
+
+/* .poly/.node 剖分后直接写 .mesh, 不经过 struct mesh */
+static int poly_to_mesh_file(char *infile, char *outfile, double area)
+{
+    struct problem_spec *spec;
+    int status;
+
+    if ((spec = problem_spec_from_poly(infile)) == NULL)
+        return 1;
+    status = mesh_file_write_spec(spec, area, outfile, 1);
+    free_problem_spec(spec);
+    return status == 0 ? 0 : 1;
+}
+
+static struct mesh *read_mesh(char *infile, double area)
+{
+    struct problem_spec *spec;
+    struct mesh_file *mf;
+    struct mesh *mesh;
+
+    if (has_suffix(infile, ".poly") || has_suffix(infile, ".node")) {
+        if ((spec = problem_spec_from_poly(infile)) == NULL)
+            return NULL;
+        mesh = make_mesh(spec, area);
+        free_problem_spec(spec);
+        return mesh;
+    }
+    if (has_suffix(infile, ".marc"))
+        return mesh_archive_read(infile);
+    if (has_suffix(infile, ".msh"))
+        return msh_to_mesh(infile);
+    if ((mf = mesh_file_open(infile, 1)) == NULL)
+        return NULL;
+    mesh = mesh_file_to_mesh(mf);
+    mesh_file_close(mf);
+    return mesh;
+}
+
+int main(int argc, char *argv[])
+{
+    struct mesh *mesh;
+    char *out;
+    int status = 1, poly, bits = MESH_ARCHIVE_LOSSLESS;
+
+    if (argc == 5 && strcmp(argv[1], "-r") == 0) {
+        if (!has_suffix(argv[2], ".msh"))
+            show_usage(argv[0]);
+        if ((mesh = remesh(argv[2], atof(argv[4]))) == NULL)
+            return 1;
+        out = argv[3];
+    } else {
+        if (argc != 3 && argc != 4)
+            show_usage(argv[0]);
+        poly = has_suffix(argv[1], ".poly") || has_suffix(argv[1], ".node");
+        if (!has_suffix(argv[1], ".mesh") && !has_suffix(argv[1], ".marc")
+                && !has_suffix(argv[1], ".msh") && !poly)
+            show_usage(argv[0]);
+        if (poly && argc != 4)
+            show_usage(argv[0]);
+        if (poly && has_suffix(argv[2], ".mesh"))
+            return poly_to_mesh_file(argv[1], argv[2], atof(argv[3]));
+        if ((mesh = read_mesh(argv[1], poly ? atof(argv[3]) : 0.0)) == NULL)
+            return 1;
+        out = argv[2];
+        if (argc == 4 && !poly)
+            bits = atoi(argv[3]);
+    }
+
+    if (has_suffix(out, ".marc"))
+        status = mesh_archive_write(mesh, out, bits);
+    else if (has_suffix(out, ".msh"))
+        status = mesh_to_msh(mesh, out);
+    else if (has_suffix(out, ".mesh"))
+        status = mesh_file_write(mesh, out, 1);
+    else
+        show_usage(argv[0]);
+
+    free_mesh(mesh);
+    return status == 0 ? 0 : 1;
+}
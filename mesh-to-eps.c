@@ -18,32 +18,116 @@ therefore X = p*s*w + s*(x - xmin).  Similarly Y = p*s*h + s*(y - ymin).
 
 These are all incorporated into the function mesh_to_eps().
 
+The output is written through a large user-space buffer with write(2).
+Coordinates are formatted by hand as fixed-point numbers with 2 decimals,
+which is far below a device pixel since the bounding box is only D
+points wide, and each element/edge uses a one-letter procedure (f, l)
+defined in the prolog instead of spelling out moveto/lineto/... .
+
 2012-12-29
 */
 
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "xmalloc.h"
 #include "mesh-to-eps.h"
 #include "mesh.h"
 
 #define MAX(a,b)  ((a) > (b) ? (a) : (b))
 #define D 400	/* the larger of the W & H of the bounding box */
+#define EPS_BUFSIZE (1 << 20)	/* size of the output buffer */
 
-void mesh_to_eps(struct mesh *mesh, char *outfile)
+struct eps_buf {
+	int fd;
+	char *buf;
+	size_t len;
+	int failed;
+};
+
+static void eps_flush(struct eps_buf *b)
 {
-	FILE *fp;
-	struct node *nodes = mesh->nodes;
-	struct edge *edges = mesh->edges;
-	struct element *elements = mesh->elements;
-	time_t now;
-	double xmin, xmax, ymin, ymax, w, h, W, H, d, s;
-	double p = 0.01;
-	int i, k;
+	size_t done = 0;
 
-	if ((fp = fopen(outfile, "w")) == NULL) {
-		fprintf(stderr, "cannot open file %s for writing\n", outfile);
-		return;
+	while (done < b->len && !b->failed) {
+		ssize_t k = write(b->fd, b->buf + done, b->len - done);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k <= 0)
+			b->failed = 1;
+		else
+			done += k;
+	}
+	b->len = 0;
+}
+
+/* make room for at least n more bytes */
+static char *eps_reserve(struct eps_buf *b, size_t n)
+{
+	if (b->len + n > EPS_BUFSIZE)
+		eps_flush(b);
+	return b->buf + b->len;
+}
+
+static void eps_puts(struct eps_buf *b, const char *s)
+{
+	size_t n = strlen(s);
+
+	memcpy(eps_reserve(b, n), s, n);
+	b->len += n;
+}
+
+/*
+ * Append v with at most two decimals and a trailing space,
+ * e.g. 12.5 -> "12.5 ", 3.0 -> "3 ", 0.25 -> ".25 ".
+ */
+static void eps_coord(struct eps_buf *b, double v)
+{
+	char tmp[32];
+	char *p = tmp + sizeof tmp;
+	char *out = eps_reserve(b, sizeof tmp);
+	long q = lround(v * 100.0);
+	int neg = q < 0;
+	long ip, fp;
+
+	if (neg)
+		q = -q;
+	ip = q / 100;
+	fp = q % 100;
+
+	*--p = ' ';
+	if (fp != 0) {
+		if (fp % 10 != 0)
+			*--p = '0' + fp % 10;
+		*--p = '0' + fp / 10;
+		*--p = '.';
 	}
+	if (ip != 0 || fp == 0)
+		do {
+			*--p = '0' + ip % 10;
+			ip /= 10;
+		} while (ip != 0);
+	if (neg)
+		*--p = '-';
+
+	memcpy(out, p, tmp + sizeof tmp - p);
+	b->len += tmp + sizeof tmp - p;
+}
+
+/* the mapping from the physical domain to the postscript domain */
+struct eps_frame {
+	double xmin, ymin, w, h, W, H, s, p;
+};
+
+static void eps_frame_init(struct eps_frame *f, struct mesh *mesh)
+{
+	struct node *nodes = mesh->nodes;
+	double xmin, xmax, ymin, ymax, d;
+	int i;
 
 	xmin = xmax = nodes[0].x;
 	ymin = ymax = nodes[0].y;
@@ -57,52 +141,217 @@ void mesh_to_eps(struct mesh *mesh, char *outfile)
 		else if(nodes[i].y > ymax)
 			ymax = nodes[i].y;
 	}
-	w = xmax - xmin;
-	h = ymax - ymin;
-	d = MAX(w, h);
-	W = D/d*w;		/* bounding box width */
-	H = D/d*h;		/* bounding box height */
-	s = D/((1+2*p)*d);	/* scale */
-
-	fputs("%!PS-Adobe-3.0 EPSF-3.0\n", fp);
-	fprintf(fp, "%%%%BoundingBox: 0 0 %g %g\n", W, H);
-	fprintf(fp, "%%%%Title: (%s)\n", outfile);
-	fprintf(fp, "%%%%Creator: C Projects, %s\n", __FILE__);
+	f->p = 0.01;
+	f->xmin = xmin;
+	f->ymin = ymin;
+	f->w = xmax - xmin;
+	f->h = ymax - ymin;
+	d = MAX(f->w, f->h);
+	f->W = D/d*f->w;		/* bounding box width */
+	f->H = D/d*f->h;		/* bounding box height */
+	f->s = D/((1+2*f->p)*d);	/* scale */
+}
+
+static double eps_X(const struct eps_frame *f, double x)
+{
+	return f->p*f->s*f->w + f->s*(x - f->xmin);
+}
+
+static double eps_Y(const struct eps_frame *f, double y)
+{
+	return f->p*f->s*f->h + f->s*(y - f->ymin);
+}
+
+/* open outfile and write the header and the prolog */
+static int eps_begin(struct eps_buf *b, const struct eps_frame *f, char *outfile)
+{
+	char line[FILENAME_MAX + 64];
+	time_t now;
+
+	if ((b->fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+		fprintf(stderr, "cannot open file %s for writing\n", outfile);
+		return -1;
+	}
+	b->buf = xmalloc(EPS_BUFSIZE);
+	b->len = 0;
+	b->failed = 0;
+
+	eps_puts(b, "%!PS-Adobe-3.0 EPSF-3.0\n");
+	snprintf(line, sizeof line, "%%%%BoundingBox: 0 0 %g %g\n", f->W, f->H);
+	eps_puts(b, line);
+	snprintf(line, sizeof line, "%%%%Title: (%s)\n", outfile);
+	eps_puts(b, line);
+	snprintf(line, sizeof line, "%%%%Creator: C Projects, %s\n", __FILE__);
+	eps_puts(b, line);
 	now = time(NULL);
-	fprintf(fp, "%%%%CreationDate: %s", ctime(&now));
-	fputs("%%EndComments\n", fp);
+	snprintf(line, sizeof line, "%%%%CreationDate: %s", ctime(&now));
+	eps_puts(b, line);
+	eps_puts(b, "%%EndComments\n");
+	eps_puts(b, "/f {moveto lineto lineto closepath fill} bind def\n");
+	eps_puts(b, "/l {moveto lineto stroke} bind def\n");
+	eps_puts(b, "/r {rectfill} bind def\n");
+	eps_puts(b, "gsave\n");
+	return 0;
+}
 
-	fputs("gsave\n", fp);
-	fputs("1 1 0 setrgbcolor\n", fp);
+static void eps_end(struct eps_buf *b, char *outfile)
+{
+	eps_puts(b, "grestore\n");
+	eps_puts(b, "showpage\n");
+	eps_puts(b, "%%EOF\n");
+	eps_flush(b);
+	xfree(b->buf);
+	if (close(b->fd) != 0 || b->failed) {
+		fprintf(stderr, "error writing file %s\n", outfile);
+		return;
+	}
+	fprintf(stderr, "postscript 已经写入到 %s 文件\n", outfile);
+}
+
+static void eps_triangle(struct eps_buf *b, const struct eps_frame *f,
+		struct element *ep)
+{
+	/* f takes the vertices in reverse: the moveto point is on top */
+	for (int k = 2; k >= 0; k--) {
+		eps_coord(b, eps_X(f, ep->node[k]->x));
+		eps_coord(b, eps_Y(f, ep->node[k]->y));
+	}
+	eps_puts(b, "f\n");
+}
+
+static void eps_line(struct eps_buf *b, const struct eps_frame *f,
+		struct edge *e)
+{
+	for (int k = 1; k >= 0; k--) {
+		eps_coord(b, eps_X(f, e->node[k]->x));
+		eps_coord(b, eps_Y(f, e->node[k]->y));
+	}
+	eps_puts(b, "l\n");
+}
+
+void mesh_to_eps(struct mesh *mesh, char *outfile)
+{
+	struct eps_buf b;
+	struct eps_frame f;
+	int i;
+
+	eps_frame_init(&f, mesh);
+	if (eps_begin(&b, &f, outfile) != 0)
+		return;
+
+	eps_puts(&b, "1 1 0 setrgbcolor\n");
+	for (i = 0; i < mesh->element_num; i++)
+		eps_triangle(&b, &f, &mesh->elements[i]);
+
+	eps_puts(&b, "0 setgray\n");
+	for (i = 0; i < mesh->edge_num; i++)
+		eps_line(&b, &f, &mesh->edges[i]);
+
+	eps_end(&b, outfile);
+}
+
+/*
+ * Fill the runs of marked cells of one grid row by row; each maximal
+ * horizontal run becomes one rectangle.
+ */
+static void eps_cell_runs(struct eps_buf *b, const unsigned char *mark,
+		int nx, int ny, double cell)
+{
+	for (int j = 0; j < ny; j++) {
+		const unsigned char *row = mark + (long)j*nx;
+		int i = 0;
+		while (i < nx) {
+			int k;
+			if (!row[i]) {
+				i++;
+				continue;
+			}
+			for (k = i; k < nx && row[k]; k++)
+				;
+			eps_coord(b, i*cell);
+			eps_coord(b, j*cell);
+			eps_coord(b, (k - i)*cell);
+			eps_coord(b, cell);
+			eps_puts(b, "r\n");
+			i = k;
+		}
+	}
+}
+
+/* Grid cell of coordinate v, clamped so points on the far edge stay inside */
+static int eps_cell(double v, double cell, int n)
+{
+	int c = (int)(v / cell);
+
+	return c < 0 ? 0 : c >= n ? n - 1 : c;
+}
+
+/**
+ * @name mesh_to_eps_lod - 按细节层次(LOD)输出 EPS 预览
+ * @param 1.mesh 网格 2.outfile 输出文件 3.cell 网格单元(像素)边长, 单位为点
+ * 	4.min_edge 短于该长度(单位为点)的边不画
+ * @note
+ * 	把边界框划分为边长为 cell 的格子. 包围盒小于一个格子的单元不单独画,
+ * 	只把其重心所在的格子标记为填充; 被略去的短边把其中点所在格子标记为黑色.
+ * 	每行中连续的标记格子合并成一个矩形. 因此输出大小只与格子数和大单元数有关,
+ * 	而与网格的单元总数无关
+*/
+void mesh_to_eps_lod(struct mesh *mesh, char *outfile, double cell, double min_edge)
+{
+	struct eps_buf b;
+	struct eps_frame f;
+	unsigned char *fill, *ink;
+	int nx, ny, i, k;
+
+	if (cell <= 0.0)
+		cell = EPS_LOD_CELL;
+	eps_frame_init(&f, mesh);
+	if (eps_begin(&b, &f, outfile) != 0)
+		return;
+
+	nx = (int)ceil(f.W / cell) + 1;
+	ny = (int)ceil(f.H / cell) + 1;
+	fill = xmalloc((size_t)nx * ny);
+	ink = xmalloc((size_t)nx * ny);
+	memset(fill, 0, (size_t)nx * ny);
+	memset(ink, 0, (size_t)nx * ny);
+
+	eps_puts(&b, "1 1 0 setrgbcolor\n");
 	for (i = 0; i < mesh->element_num; i++) {
-		double x[3], y[3];
+		struct element *ep = &mesh->elements[i];
+		double X[3], Y[3], xlo, xhi, ylo, yhi;
 		for (k = 0; k < 3; k++) {
-			x[k] = p*s*w + s*(elements[i].node[k]->x - xmin);
-			y[k] = p*s*h + s*(elements[i].node[k]->y - ymin);
+			X[k] = eps_X(&f, ep->node[k]->x);
+			Y[k] = eps_Y(&f, ep->node[k]->y);
 		}
-		fprintf(fp, "%g %g moveto %g %g lineto %g %g lineto "
-				"closepath fill\n",
-				x[0], y[0],
-				x[1], y[1],
-				x[2], y[2]);
+		xlo = fmin(X[0], fmin(X[1], X[2]));
+		xhi = fmax(X[0], fmax(X[1], X[2]));
+		ylo = fmin(Y[0], fmin(Y[1], Y[2]));
+		yhi = fmax(Y[0], fmax(Y[1], Y[2]));
+		if (xhi - xlo < cell && yhi - ylo < cell) {
+			int cx = eps_cell((X[0] + X[1] + X[2]) / 3, cell, nx);
+			int cy = eps_cell((Y[0] + Y[1] + Y[2]) / 3, cell, ny);
+			fill[(long)cy*nx + cx] = 1;
+		} else
+			eps_triangle(&b, &f, ep);
 	}
+	eps_cell_runs(&b, fill, nx, ny, cell);
 
-	fputs("0 setgray\n", fp);
+	eps_puts(&b, "0 setgray\n");
 	for (i = 0; i < mesh->edge_num; i++) {
-		double x1 = edges[i].node[0]->x;
-		double y1 = edges[i].node[0]->y;
-		double x2 = edges[i].node[1]->x;
-		double y2 = edges[i].node[1]->y;
-		double X1 = p*s*w + s*(x1 - xmin);
-		double Y1 = p*s*h + s*(y1 - ymin);
-		double X2 = p*s*w + s*(x2 - xmin);
-		double Y2 = p*s*h + s*(y2 - ymin);
-		fprintf(fp, "%g %g moveto %g %g lineto stroke\n",
-			X1, Y1, X2, Y2);
+		struct edge *e = &mesh->edges[i];
+		double X0 = eps_X(&f, e->node[0]->x), Y0 = eps_Y(&f, e->node[0]->y);
+		double X1 = eps_X(&f, e->node[1]->x), Y1 = eps_Y(&f, e->node[1]->y);
+		if (hypot(X1 - X0, Y1 - Y0) < min_edge) {
+			int cx = eps_cell((X0 + X1) / 2, cell, nx);
+			int cy = eps_cell((Y0 + Y1) / 2, cell, ny);
+			ink[(long)cy*nx + cx] = 1;
+		} else
+			eps_line(&b, &f, e);
 	}
-	fputs("grestore\n", fp);
-	fputs("showpage\n", fp);
-	fputs("%%EOF\n", fp);
-	fclose(fp);
-	fprintf(stderr, "postscript 已经写入到 %s 文件\n", outfile);
+	eps_cell_runs(&b, ink, nx, ny, cell);
+
+	xfree(fill);
+	xfree(ink);
+	eps_end(&b, outfile);
 }
@@ -3,6 +3,10 @@
 
 #include "mesh.h"
 
+#define EPS_LOD_CELL     1.0   /* default grid cell of mesh_to_eps_lod(), in points */
+#define EPS_LOD_MIN_EDGE 0.5   /* default shortest edge drawn, in points */
+
 void mesh_to_eps(struct mesh *mesh, char *outfile);
+void mesh_to_eps_lod(struct mesh *mesh, char *outfile, double cell, double min_edge);
 
 #endif /* H_MESH_TO_EPS_H */
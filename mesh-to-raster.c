@@ -0,0 +1,554 @@
+/*
+Render a mesh into an RGB framebuffer and write it as PPM or PNG.
+
+The physical domain is mapped onto the image the same way mesh_to_eps()
+maps it onto the bounding box: the larger of the image width and height
+is `size' pixels and there is a margin of p = 1% on each side.
+
+The image is cut into RASTER_TILE x RASTER_TILE tiles.  Elements (and
+edges) are first binned into the tiles that their bounding boxes touch,
+then the tiles are rendered independently by parallel_for(), each thread
+writing only the pixels of its own tile.  A triangle is filled at the
+pixel centers it covers; a triangle too small to cover any pixel center
+paints the pixel containing its centroid, so that very fine meshes show
+up as solid areas instead of vanishing.
+
+Elements are colored yellow, or by a per-node field (interpolated
+linearly over each element) or a per-element field (constant on each
+element) through a blue-cyan-green-yellow-red color map.  Edges are
+drawn in black.
+
+The PNG writer has no external dependencies: the scanlines are
+compressed by a small deflate encoder that uses the fixed Huffman codes
+and only looks for matches with the previous pixel and the pixel above,
+which is what flat-shaded mesh pictures mostly consist of.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "parallel.h"
+#include "mesh-to-raster.h"
+
+#define MAX(a,b)  ((a) > (b) ? (a) : (b))
+#define MIN(a,b)  ((a) < (b) ? (a) : (b))
+
+struct raster_ctx {
+	struct raster *r;
+	struct mesh *mesh;
+	double xmin, ymin, w, h, s, p;
+	const double *node_field;
+	const double *element_field;
+	double fmin, fmax;
+	double *X, *Y;		/* image coordinates of the nodes */
+	int nx, ny;		/* number of tiles */
+	int *elem_start, *elem_list;
+	int *edge_start, *edge_list;
+};
+
+/* image coordinates, y pointing down */
+static double raster_X(const struct raster_ctx *c, double x)
+{
+	return c->p*c->s*c->w + c->s*(x - c->xmin);
+}
+
+static double raster_Y(const struct raster_ctx *c, double y)
+{
+	return c->r->height - (c->p*c->s*c->h + c->s*(y - c->ymin));
+}
+
+static void node_coords(void *arg, int begin, int end)
+{
+	struct raster_ctx *c = arg;
+
+	for (int i = begin; i < end; i++) {
+		c->X[i] = raster_X(c, c->mesh->nodes[i].x);
+		c->Y[i] = raster_Y(c, c->mesh->nodes[i].y);
+	}
+}
+
+static void colormap(const struct raster_ctx *c, double v, unsigned char *rgb)
+{
+	static const double stops[5][3] = {
+		{0, 0, 1}, {0, 1, 1}, {0, 1, 0}, {1, 1, 0}, {1, 0, 0},
+	};
+	double t = c->fmax > c->fmin ? (v - c->fmin) / (c->fmax - c->fmin) : 0.5;
+	int k;
+
+	t = 4 * (t < 0 ? 0 : t > 1 ? 1 : t);
+	k = t >= 4 ? 3 : (int)t;
+	t -= k;
+	for (int i = 0; i < 3; i++)
+		rgb[i] = (unsigned char)(255 * ((1-t)*stops[k][i] + t*stops[k+1][i]) + 0.5);
+}
+
+/*
+ * Bin items into the tiles overlapped by their bounding boxes.
+ * bbox(i, box) returns xlo, xhi, ylo, yhi in image coordinates.
+ */
+static void bin_items(struct raster_ctx *c, int n,
+		void (*bbox)(const struct raster_ctx *, int, double *),
+		int **start_out, int **list_out)
+{
+	int ntiles = c->nx * c->ny;
+	int *start, *list;
+	long total = 0;
+	double box[4];
+
+	make_vector(start, ntiles + 1);
+	for (int t = 0; t <= ntiles; t++)
+		start[t] = 0;
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < n; i++) {
+			bbox(c, i, box);
+			int tx0 = MAX((int)floor(box[0]) / RASTER_TILE, 0);
+			int tx1 = MIN((int)floor(box[1]) / RASTER_TILE, c->nx - 1);
+			int ty0 = MAX((int)floor(box[2]) / RASTER_TILE, 0);
+			int ty1 = MIN((int)floor(box[3]) / RASTER_TILE, c->ny - 1);
+			for (int ty = ty0; ty <= ty1; ty++)
+				for (int tx = tx0; tx <= tx1; tx++) {
+					if (pass == 0)
+						start[ty*c->nx + tx + 1]++;
+					else
+						list[start[ty*c->nx + tx]++] = i;
+				}
+		}
+		if (pass == 0) {
+			for (int t = 0; t < ntiles; t++)
+				start[t+1] += start[t];
+			total = start[ntiles];
+			make_vector(list, total + 1);
+		} else {
+			for (int t = ntiles; t > 0; t--)	/* undo the shift */
+				start[t] = start[t-1];
+			start[0] = 0;
+		}
+	}
+	*start_out = start;
+	*list_out = list;
+}
+
+static void element_bbox(const struct raster_ctx *c, int i, double *box)
+{
+	struct element *ep = &c->mesh->elements[i];
+	int a = ep->node[0]->node_id, b = ep->node[1]->node_id, d = ep->node[2]->node_id;
+
+	box[0] = fmin(c->X[a], fmin(c->X[b], c->X[d]));
+	box[1] = fmax(c->X[a], fmax(c->X[b], c->X[d]));
+	box[2] = fmin(c->Y[a], fmin(c->Y[b], c->Y[d]));
+	box[3] = fmax(c->Y[a], fmax(c->Y[b], c->Y[d]));
+}
+
+static void edge_bbox(const struct raster_ctx *c, int i, double *box)
+{
+	struct edge *e = &c->mesh->edges[i];
+	double X0 = c->X[e->node[0]->node_id], Y0 = c->Y[e->node[0]->node_id];
+	double X1 = c->X[e->node[1]->node_id], Y1 = c->Y[e->node[1]->node_id];
+	box[0] = fmin(X0, X1);
+	box[1] = fmax(X0, X1);
+	box[2] = fmin(Y0, Y1);
+	box[3] = fmax(Y0, Y1);
+}
+
+static void fill_element(struct raster_ctx *c, int i,
+		int x0, int x1, int y0, int y1)
+{
+	struct element *ep = &c->mesh->elements[i];
+	struct raster *r = c->r;
+	double X[3], Y[3], f[3], area;
+	unsigned char rgb[3] = {255, 255, 0};
+	int covered = 0;
+
+	for (int k = 0; k < 3; k++) {
+		X[k] = c->X[ep->node[k]->node_id];
+		Y[k] = c->Y[ep->node[k]->node_id];
+		f[k] = c->node_field ? c->node_field[ep->node[k]->node_id] : 0.0;
+	}
+	if (c->element_field)
+		colormap(c, c->element_field[i], rgb);
+	area = (X[1]-X[0])*(Y[2]-Y[0]) - (X[2]-X[0])*(Y[1]-Y[0]);
+	if (area == 0.0)
+		return;
+
+	int px0 = MAX(x0, (int)floor(fmin(X[0], fmin(X[1], X[2]))));
+	int px1 = MIN(x1 - 1, (int)ceil(fmax(X[0], fmax(X[1], X[2]))));
+	int py0 = MAX(y0, (int)floor(fmin(Y[0], fmin(Y[1], Y[2]))));
+	int py1 = MIN(y1 - 1, (int)ceil(fmax(Y[0], fmax(Y[1], Y[2]))));
+	for (int py = py0; py <= py1; py++) {
+		double yc = py + 0.5;
+		for (int px = px0; px <= px1; px++) {
+			double xc = px + 0.5;
+			/* barycentric coordinates, positive inside either orientation */
+			double l0 = ((X[1]-xc)*(Y[2]-yc) - (X[2]-xc)*(Y[1]-yc)) / area;
+			double l1 = ((X[2]-xc)*(Y[0]-yc) - (X[0]-xc)*(Y[2]-yc)) / area;
+			double l2 = 1.0 - l0 - l1;
+			if (l0 < 0 || l1 < 0 || l2 < 0)
+				continue;
+			if (c->node_field)
+				colormap(c, l0*f[0] + l1*f[1] + l2*f[2], rgb);
+			memcpy(&r->rgb[3*((long)py*r->width + px)], rgb, 3);
+			covered = 1;
+		}
+	}
+
+	if (!covered) {
+		int px = (int)((X[0] + X[1] + X[2]) / 3);
+		int py = (int)((Y[0] + Y[1] + Y[2]) / 3);
+		if (px >= x0 && px < x1 && py >= y0 && py < y1) {
+			if (c->node_field)
+				colormap(c, (f[0] + f[1] + f[2]) / 3, rgb);
+			memcpy(&r->rgb[3*((long)py*r->width + px)], rgb, 3);
+		}
+	}
+}
+
+static void draw_edge(struct raster_ctx *c, int i, int x0, int x1, int y0, int y1)
+{
+	struct edge *e = &c->mesh->edges[i];
+	struct raster *r = c->r;
+	double X0 = c->X[e->node[0]->node_id], Y0 = c->Y[e->node[0]->node_id];
+	double X1 = c->X[e->node[1]->node_id], Y1 = c->Y[e->node[1]->node_id];
+	int steps = (int)ceil(fmax(fabs(X1 - X0), fabs(Y1 - Y0)));
+
+	for (int k = 0; k <= steps; k++) {
+		double t = steps ? (double)k / steps : 0.0;
+		int px = (int)(X0 + t*(X1 - X0));
+		int py = (int)(Y0 + t*(Y1 - Y0));
+		if (px >= x0 && px < x1 && py >= y0 && py < y1)
+			memset(&r->rgb[3*((long)py*r->width + px)], 0, 3);
+	}
+}
+
+static void render_tiles(void *arg, int begin, int end)
+{
+	struct raster_ctx *c = arg;
+
+	for (int t = begin; t < end; t++) {
+		int x0 = (t % c->nx) * RASTER_TILE, y0 = (t / c->nx) * RASTER_TILE;
+		int x1 = MIN(x0 + RASTER_TILE, c->r->width);
+		int y1 = MIN(y0 + RASTER_TILE, c->r->height);
+		for (int p = c->elem_start[t]; p < c->elem_start[t+1]; p++)
+			fill_element(c, c->elem_list[p], x0, x1, y0, y1);
+		if (c->edge_start != NULL)
+			for (int p = c->edge_start[t]; p < c->edge_start[t+1]; p++)
+				draw_edge(c, c->edge_list[p], x0, x1, y0, y1);
+	}
+}
+
+/**
+ * @name mesh_to_raster - 把网格渲染成 RGB 图像
+ * @param 1.mesh 网格 2.size 图像宽高中较大者(像素)
+ * 	3.node_field 每个节点上的值(可为 NULL) 4.element_field 每个单元上的值(可为 NULL)
+ * 	5.draw_edges 非零时画出所有的边
+ * @return 图像, 用 free_raster() 释放
+ * @note 两个场都为 NULL 时单元涂成黄色, 与 mesh_to_eps() 一致
+*/
+struct raster *mesh_to_raster(struct mesh *mesh, int size,
+		const double *node_field, const double *element_field,
+		int draw_edges)
+{
+	struct raster *r = xmalloc(sizeof *r);
+	struct raster_ctx c;
+	double xmax, ymax, d;
+	const double *field = node_field ? node_field : element_field;
+	int nfield = node_field ? mesh->node_num : mesh->element_num;
+
+	c.mesh = mesh;
+	c.r = r;
+	c.p = 0.01;
+	c.xmin = xmax = mesh->nodes[0].x;
+	c.ymin = ymax = mesh->nodes[0].y;
+	for (int i = 1; i < mesh->node_num; i++) {
+		c.xmin = fmin(c.xmin, mesh->nodes[i].x);
+		xmax = fmax(xmax, mesh->nodes[i].x);
+		c.ymin = fmin(c.ymin, mesh->nodes[i].y);
+		ymax = fmax(ymax, mesh->nodes[i].y);
+	}
+	c.w = xmax - c.xmin;
+	c.h = ymax - c.ymin;
+	d = MAX(c.w, c.h);
+	r->width = MAX((int)ceil(size/d*c.w), 1);
+	r->height = MAX((int)ceil(size/d*c.h), 1);
+	c.s = size/((1+2*c.p)*d);
+
+	c.node_field = node_field;
+	c.element_field = node_field ? NULL : element_field;
+	c.fmin = c.fmax = 0.0;
+	if (field != NULL) {
+		c.fmin = c.fmax = field[0];
+		for (int i = 1; i < nfield; i++) {
+			c.fmin = fmin(c.fmin, field[i]);
+			c.fmax = fmax(c.fmax, field[i]);
+		}
+	}
+
+	make_vector(r->rgb, 3L * r->width * r->height);
+	memset(r->rgb, 255, 3L * r->width * r->height);
+
+	make_vector(c.X, mesh->node_num);
+	make_vector(c.Y, mesh->node_num);
+	parallel_for(mesh->node_num, 65536, node_coords, &c);
+
+	c.nx = (r->width + RASTER_TILE - 1) / RASTER_TILE;
+	c.ny = (r->height + RASTER_TILE - 1) / RASTER_TILE;
+	bin_items(&c, mesh->element_num, element_bbox, &c.elem_start, &c.elem_list);
+	c.edge_start = c.edge_list = NULL;
+	if (draw_edges)
+		bin_items(&c, mesh->edge_num, edge_bbox, &c.edge_start, &c.edge_list);
+
+	parallel_for(c.nx * c.ny, 1, render_tiles, &c);
+
+	free_vector(c.X);
+	free_vector(c.Y);
+	free_vector(c.elem_start);
+	free_vector(c.elem_list);
+	xfree(c.edge_start);
+	xfree(c.edge_list);
+	return r;
+}
+
+void free_raster(struct raster *r)
+{
+	if (r == NULL)
+		return;
+
+	free_vector(r->rgb);
+	xfree(r);
+}
+
+int raster_write_ppm(const struct raster *r, char *outfile)
+{
+	FILE *fp;
+	int ok;
+
+	if ((fp = fopen(outfile, "wb")) == NULL) {
+		fprintf(stderr, "cannot open file %s for writing\n", outfile);
+		return -1;
+	}
+	fprintf(fp, "P6\n%d %d\n255\n", r->width, r->height);
+	ok = fwrite(r->rgb, 3, (size_t)r->width * r->height, fp)
+		== (size_t)r->width * r->height;
+	if (fclose(fp) != 0 || !ok) {
+		fprintf(stderr, "error writing file %s\n", outfile);
+		return -1;
+	}
+	fprintf(stderr, "PPM 已经写入到 %s 文件\n", outfile);
+	return 0;
+}
+
+/* ---------------- PNG ---------------- */
+
+struct bitbuf {
+	unsigned char *buf;
+	size_t len, cap;
+	unsigned long acc;	/* pending bits, LSB first */
+	int nbits;
+};
+
+static void bits_put(struct bitbuf *b, unsigned long v, int n)
+{
+	b->acc |= v << b->nbits;
+	b->nbits += n;
+	while (b->nbits >= 8) {
+		if (b->len == b->cap) {
+			b->cap *= 2;
+			b->buf = xrealloc(b->buf, b->cap);
+		}
+		b->buf[b->len++] = b->acc & 0xff;
+		b->acc >>= 8;
+		b->nbits -= 8;
+	}
+}
+
+/* Huffman codes are sent most significant bit first */
+static void bits_put_code(struct bitbuf *b, unsigned code, int n)
+{
+	unsigned rev = 0;
+	for (int i = 0; i < n; i++)
+		rev |= ((code >> i) & 1) << (n - 1 - i);
+	bits_put(b, rev, n);
+}
+
+static void put_literal(struct bitbuf *b, int v)
+{
+	if (v < 144)
+		bits_put_code(b, 0x30 + v, 8);
+	else if (v < 256)
+		bits_put_code(b, 0x190 + (v - 144), 9);
+	else if (v < 280)
+		bits_put_code(b, v - 256, 7);
+	else
+		bits_put_code(b, 0xc0 + (v - 280), 8);
+}
+
+static void put_match(struct bitbuf *b, int len, int dist)
+{
+	static const int lbase[29] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,
+		35,43,51,59,67,83,99,115,131,163,195,227,258};
+	static const int lextra[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,
+		3,3,3,3,4,4,4,4,5,5,5,5,0};
+	static const int dbase[30] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,
+		257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+	static const int dextra[30] = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,
+		7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+	int k;
+
+	for (k = 28; lbase[k] > len; k--)
+		;
+	put_literal(b, 257 + k);
+	bits_put(b, len - lbase[k], lextra[k]);
+	for (k = 29; dbase[k] > dist; k--)
+		;
+	bits_put_code(b, k, 5);
+	bits_put(b, dist - dbase[k], dextra[k]);
+}
+
+static int match_length(const unsigned char *data, size_t i, size_t n, size_t dist)
+{
+	int len = 0;
+
+	if (dist > i)
+		return 0;
+	while (len < 258 && i + len < n && data[i + len] == data[i + len - dist])
+		len++;
+	return len;
+}
+
+/* zlib stream of data[0..n) as one fixed-Huffman deflate block */
+static unsigned char *zlib_compress(const unsigned char *data, size_t n,
+		size_t rowbytes, size_t *out_len)
+{
+	struct bitbuf b;
+	unsigned long s1 = 1, s2 = 0;
+	size_t i = 0;
+
+	b.cap = n / 4 + 64;
+	b.buf = xmalloc(b.cap);
+	b.len = 0;
+	b.acc = 0;
+	b.nbits = 0;
+
+	bits_put(&b, 0x78, 8);		/* CMF: deflate, 32K window */
+	bits_put(&b, 0x01, 8);		/* FLG: fastest, check bits */
+	bits_put(&b, 1, 1);		/* BFINAL */
+	bits_put(&b, 1, 2);		/* BTYPE = fixed Huffman */
+	while (i < n) {
+		int len = match_length(data, i, n, 3), dist = 3;
+		if (rowbytes <= 32768) {
+			int up = match_length(data, i, n, rowbytes);
+			if (up > len) {
+				len = up;
+				dist = (int)rowbytes;
+			}
+		}
+		if (len >= 3) {
+			put_match(&b, len, dist);
+			i += len;
+		} else
+			put_literal(&b, data[i++]);
+	}
+	put_literal(&b, 256);		/* end of block */
+	if (b.nbits > 0)		/* flush to a byte boundary */
+		bits_put(&b, 0, 8 - b.nbits);
+
+	/* Adler-32; 5552 bytes is the most that cannot overflow s2 */
+	for (i = 0; i < n; ) {
+		size_t end = MIN(n, i + 5552);
+		for (; i < end; i++) {
+			s1 += data[i];
+			s2 += s1;
+		}
+		s1 %= 65521;
+		s2 %= 65521;
+	}
+	bits_put(&b, (s2 >> 8) & 0xff, 8);
+	bits_put(&b, s2 & 0xff, 8);
+	bits_put(&b, (s1 >> 8) & 0xff, 8);
+	bits_put(&b, s1 & 0xff, 8);
+
+	*out_len = b.len;
+	return b.buf;
+}
+
+static unsigned long crc32_update(unsigned long crc, const unsigned char *p, size_t n)
+{
+	unsigned long table[256];
+
+	/* cheap enough to rebuild per call, and keeps the writer reentrant */
+	for (unsigned long k = 0; k < 256; k++) {
+		unsigned long c = k;
+		for (int j = 0; j < 8; j++)
+			c = (c & 1) ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+		table[k] = c;
+	}
+	crc ^= 0xffffffffUL;
+	while (n--)
+		crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc ^ 0xffffffffUL;
+}
+
+static void put_be32(unsigned char *p, unsigned long v)
+{
+	p[0] = (v >> 24) & 0xff;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+
+static int write_chunk(FILE *fp, const char *type, const unsigned char *data, size_t n)
+{
+	unsigned char hdr[8], crc[4];
+	unsigned long c;
+
+	put_be32(hdr, n);
+	memcpy(hdr + 4, type, 4);
+	c = crc32_update(0, hdr + 4, 4);
+	c = crc32_update(c, data, n);
+	put_be32(crc, c);
+	return fwrite(hdr, 1, 8, fp) == 8 && fwrite(data, 1, n, fp) == n
+		&& fwrite(crc, 1, 4, fp) == 4;
+}
+
+int raster_write_png(const struct raster *r, char *outfile)
+{
+	static const unsigned char signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+	size_t rowbytes = 3 * (size_t)r->width + 1;
+	size_t n = rowbytes * r->height, zlen, off;
+	unsigned char ihdr[13], *raw, *z;
+	FILE *fp;
+	int ok;
+
+	/* filter type 0 (none) before each scanline */
+	raw = xmalloc(n);
+	for (int y = 0; y < r->height; y++) {
+		raw[y*rowbytes] = 0;
+		memcpy(&raw[y*rowbytes + 1], &r->rgb[3L*y*r->width], 3L*r->width);
+	}
+	z = zlib_compress(raw, n, rowbytes, &zlen);
+	xfree(raw);
+
+	if ((fp = fopen(outfile, "wb")) == NULL) {
+		fprintf(stderr, "cannot open file %s for writing\n", outfile);
+		xfree(z);
+		return -1;
+	}
+	put_be32(ihdr, r->width);
+	put_be32(ihdr + 4, r->height);
+	ihdr[8] = 8;		/* bit depth */
+	ihdr[9] = 2;		/* color type: RGB */
+	ihdr[10] = ihdr[11] = ihdr[12] = 0;
+	ok = fwrite(signature, 1, 8, fp) == 8 && write_chunk(fp, "IHDR", ihdr, 13);
+	for (off = 0; ok && off < zlen; off += 1 << 20)
+		ok = write_chunk(fp, "IDAT", z + off, MIN(zlen - off, (size_t)1 << 20));
+	ok = ok && write_chunk(fp, "IEND", NULL, 0);
+	xfree(z);
+	if (fclose(fp) != 0 || !ok) {
+		fprintf(stderr, "error writing file %s\n", outfile);
+		return -1;
+	}
+	fprintf(stderr, "PNG 已经写入到 %s 文件\n", outfile);
+	return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef H_MESH_TO_RASTER_H
+#define H_MESH_TO_RASTER_H
+
+#include "mesh.h"
+
+#define RASTER_TILE 64	/* tiles are RASTER_TILE x RASTER_TILE pixels */
+
+/* an RGB image, rows from top to bottom, 3 bytes per pixel */
+struct raster {
+	int width;
+	int height;
+	unsigned char *rgb;
+};
+
+struct raster *mesh_to_raster(struct mesh *mesh, int size,
+		const double *node_field, const double *element_field,
+		int draw_edges);
+int raster_write_ppm(const struct raster *r, char *outfile);
+int raster_write_png(const struct raster *r, char *outfile);
+void free_raster(struct raster *r);
+
+#endif /* H_MESH_TO_RASTER_H */
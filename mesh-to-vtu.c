@@ -0,0 +1,416 @@
+/*
+Write a mesh, and optionally data on it, as a VTK unstructured grid (.vtu)
+for ParaView, VisIt and the like.
+
+All arrays go into a single raw <AppendedData> block, each one preceded
+by its UInt64 byte count, so the XML part is a few hundred bytes and the
+arrays are written at their native size:
+
+	point data	bc (Int32), user fields (Float64)
+	cell data	area (Float64), user fields (Float64)
+	Points		x y z (Float64)
+	connectivity	three node numbers per triangle (Int32)
+	offsets		3, 6, 9, ... (Int32, Int64 for more than 2^31 entries)
+	types		5 = VTK_TRIANGLE (UInt8)
+
+Every array has a fixed size, so the position of every byte of the file
+is known before anything is written.  mesh_to_vtu() cuts each array into
+chunks of about VTU_CHUNK_BYTES, and the threads of parallel_for() each
+convert a chunk from struct mesh into a private buffer and pwrite() it
+to its place.  mesh_to_vtu_stream() writes the same bytes in order to a
+FILE*, one chunk at a time, for pipes and other unseekable outputs.
+Neither keeps more than one chunk per thread in memory.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "parallel.h"
+#include "mesh-to-vtu.h"
+
+#define VTU_CHUNK_BYTES	(1 << 20)
+#define VTU_MAX_ARRAYS	64
+#define VTK_TRIANGLE	5
+#define VTU_FOOTER	"\n  </AppendedData>\n</VTKFile>\n"
+
+struct vtu_array;
+typedef void (*vtu_fill_fn)(const struct mesh *mesh, const struct vtu_array *a,
+		long begin, long end, unsigned char *out);
+
+/* one array of the appended block; items are nodes or elements */
+struct vtu_array {
+	const char *name;
+	const char *type;
+	int components;
+	int item_size;		/* bytes per item */
+	long n;			/* number of items */
+	const double *data;	/* user fields only */
+	vtu_fill_fn fill;
+	uint64_t offset;	/* of the byte count, from the start of the block */
+};
+
+struct vtu_layout {
+	struct vtu_array arrays[VTU_MAX_ARRAYS];
+	int array_num;
+	int point_data_num, cell_data_num;	/* then Points, connectivity, offsets, types */
+	char *header;			/* from open_memstream, so libc free() */
+	size_t header_len;
+	uint64_t file_size;
+};
+
+static void fill_node_bc(const struct mesh *mesh, const struct vtu_array *a,
+		long begin, long end, unsigned char *out)
+{
+	int32_t *p = (int32_t *)out;
+	(void)a;
+	for (long i = begin; i < end; i++)
+		*p++ = mesh->nodes[i].bc;
+}
+
+static void fill_element_area(const struct mesh *mesh, const struct vtu_array *a,
+		long begin, long end, unsigned char *out)
+{
+	double *p = (double *)out;
+	(void)a;
+	for (long i = begin; i < end; i++)
+		*p++ = mesh->elements[i].area;
+}
+
+static void fill_field(const struct mesh *mesh, const struct vtu_array *a,
+		long begin, long end, unsigned char *out)
+{
+	(void)mesh;
+	memcpy(out, a->data + begin * a->components,
+			(end - begin) * a->item_size);
+}
+
+static void fill_points(const struct mesh *mesh, const struct vtu_array *a,
+		long begin, long end, unsigned char *out)
+{
+	double *p = (double *)out;
+	(void)a;
+	for (long i = begin; i < end; i++) {
+		*p++ = mesh->nodes[i].x;
+		*p++ = mesh->nodes[i].y;
+		*p++ = mesh->nodes[i].z;
+	}
+}
+
+static void fill_connectivity(const struct mesh *mesh, const struct vtu_array *a,
+		long begin, long end, unsigned char *out)
+{
+	int32_t *p = (int32_t *)out;
+	(void)a;
+	for (long i = begin; i < end; i++) {
+		*p++ = mesh->elements[i].node[0]->node_id;
+		*p++ = mesh->elements[i].node[1]->node_id;
+		*p++ = mesh->elements[i].node[2]->node_id;
+	}
+}
+
+static void fill_offsets(const struct mesh *mesh, const struct vtu_array *a,
+		long begin, long end, unsigned char *out)
+{
+	(void)mesh;
+	if (a->item_size == 4) {
+		int32_t *p = (int32_t *)out;
+		for (long i = begin; i < end; i++)
+			*p++ = 3 * (i + 1);
+	} else {
+		int64_t *p = (int64_t *)out;
+		for (long i = begin; i < end; i++)
+			*p++ = 3 * (i + 1);
+	}
+}
+
+static void fill_types(const struct mesh *mesh, const struct vtu_array *a,
+		long begin, long end, unsigned char *out)
+{
+	(void)mesh;
+	(void)a;
+	memset(out, VTK_TRIANGLE, end - begin);
+}
+
+static int host_is_little_endian(void)
+{
+	unsigned int one = 1;
+	return *(unsigned char *)&one == 1;
+}
+
+static void add_array(struct vtu_layout *L, const char *name, const char *type,
+		int components, int item_size, long n, const double *data, vtu_fill_fn fill)
+{
+	struct vtu_array *a = &L->arrays[L->array_num++];
+
+	a->name = name;
+	a->type = type;
+	a->components = components;
+	a->item_size = item_size;
+	a->n = n;
+	a->data = data;
+	a->fill = fill;
+}
+
+static void xml_array(FILE *fp, const struct vtu_array *a)
+{
+	fprintf(fp, "        <DataArray type=\"%s\" Name=\"%s\"", a->type, a->name);
+	if (a->components != 1)
+		fprintf(fp, " NumberOfComponents=\"%d\"", a->components);
+	fprintf(fp, " format=\"appended\" offset=\"%llu\"/>\n",
+			(unsigned long long)a->offset);
+}
+
+/* collect the arrays, place them and build the XML that precedes them */
+static int make_layout(struct vtu_layout *L, struct mesh *mesh, int flags,
+		const struct vtu_field *fields, int field_num)
+{
+	long offset_num = 3L * mesh->element_num;
+	uint64_t pos = 0;
+	size_t len;
+	FILE *fp;
+	int i;
+
+	if (field_num + 6 > VTU_MAX_ARRAYS) {
+		fprintf(stderr, "too many fields for a vtu file\n");
+		return -1;
+	}
+	for (i = 0; i < field_num; i++) {
+		if (fields[i].components < 1 || 8 * fields[i].components > VTU_CHUNK_BYTES) {
+			fprintf(stderr, "bad number of components for field %s\n", fields[i].name);
+			return -1;
+		}
+	}
+	L->array_num = 0;
+	if (flags & VTU_NODE_BC)
+		add_array(L, "bc", "Int32", 1, 4, mesh->node_num, NULL, fill_node_bc);
+	for (i = 0; i < field_num; i++)
+		if (fields[i].location == VTU_POINT_DATA)
+			add_array(L, fields[i].name, "Float64", fields[i].components,
+					8 * fields[i].components, mesh->node_num,
+					fields[i].data, fill_field);
+	L->point_data_num = L->array_num;
+	if (flags & VTU_ELEMENT_AREA)
+		add_array(L, "area", "Float64", 1, 8, mesh->element_num, NULL, fill_element_area);
+	for (i = 0; i < field_num; i++)
+		if (fields[i].location == VTU_CELL_DATA)
+			add_array(L, fields[i].name, "Float64", fields[i].components,
+					8 * fields[i].components, mesh->element_num,
+					fields[i].data, fill_field);
+	L->cell_data_num = L->array_num - L->point_data_num;
+	add_array(L, "Points", "Float64", 3, 24, mesh->node_num, NULL, fill_points);
+	add_array(L, "connectivity", "Int32", 1, 12, mesh->element_num, NULL, fill_connectivity);
+	if (offset_num > INT32_MAX)
+		add_array(L, "offsets", "Int64", 1, 8, mesh->element_num, NULL, fill_offsets);
+	else
+		add_array(L, "offsets", "Int32", 1, 4, mesh->element_num, NULL, fill_offsets);
+	add_array(L, "types", "UInt8", 1, 1, mesh->element_num, NULL, fill_types);
+
+	for (i = 0; i < L->array_num; i++) {
+		L->arrays[i].offset = pos;
+		pos += 8 + (uint64_t)L->arrays[i].n * L->arrays[i].item_size;
+	}
+
+	if ((fp = open_memstream(&L->header, &len)) == NULL)
+		return -1;
+	fprintf(fp, "<?xml version=\"1.0\"?>\n");
+	fprintf(fp, "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" "
+			"byte_order=\"%s\" header_type=\"UInt64\">\n",
+			host_is_little_endian() ? "LittleEndian" : "BigEndian");
+	fprintf(fp, "  <UnstructuredGrid>\n");
+	fprintf(fp, "    <Piece NumberOfPoints=\"%d\" NumberOfCells=\"%d\">\n",
+			mesh->node_num, mesh->element_num);
+	fprintf(fp, "      <PointData>\n");
+	for (i = 0; i < L->point_data_num; i++)
+		xml_array(fp, &L->arrays[i]);
+	fprintf(fp, "      </PointData>\n");
+	fprintf(fp, "      <CellData>\n");
+	for (; i < L->point_data_num + L->cell_data_num; i++)
+		xml_array(fp, &L->arrays[i]);
+	fprintf(fp, "      </CellData>\n");
+	fprintf(fp, "      <Points>\n");
+	xml_array(fp, &L->arrays[i++]);
+	fprintf(fp, "      </Points>\n");
+	fprintf(fp, "      <Cells>\n");
+	for (; i < L->array_num; i++)
+		xml_array(fp, &L->arrays[i]);
+	fprintf(fp, "      </Cells>\n");
+	fprintf(fp, "    </Piece>\n");
+	fprintf(fp, "  </UnstructuredGrid>\n");
+	fprintf(fp, "  <AppendedData encoding=\"raw\">\n   _");
+	fclose(fp);
+	L->header_len = len;
+	L->file_size = len + pos + strlen(VTU_FOOTER);
+	return 0;
+}
+
+/* ---------------- parallel pwrite ---------------- */
+
+struct vtu_job {
+	int array;
+	long begin, end;
+};
+
+struct vtu_writer {
+	const struct mesh *mesh;
+	const struct vtu_layout *L;
+	struct vtu_job *jobs;
+	int fd;
+	atomic_int err;
+};
+
+static int pwrite_all(int fd, const void *buf, size_t n, uint64_t off)
+{
+	const char *p = buf;
+
+	while (n > 0) {
+		ssize_t w = pwrite(fd, p, n, off);
+		if (w <= 0)
+			return -1;
+		p += w;
+		n -= w;
+		off += w;
+	}
+	return 0;
+}
+
+/* chunks of VTU_CHUNK_BYTES or less, never splitting an item */
+static struct vtu_job *make_jobs(const struct vtu_layout *L, int *job_num)
+{
+	struct vtu_job *jobs;
+	int n = 0;
+
+	for (int pass = 0; pass < 2; pass++) {
+		n = 0;
+		for (int i = 0; i < L->array_num; i++) {
+			const struct vtu_array *a = &L->arrays[i];
+			long step = VTU_CHUNK_BYTES / a->item_size;
+			for (long b = 0; b < a->n; b += step) {
+				if (pass == 1) {
+					jobs[n].array = i;
+					jobs[n].begin = b;
+					jobs[n].end = b + step < a->n ? b + step : a->n;
+				}
+				n++;
+			}
+		}
+		if (pass == 0)
+			make_vector(jobs, n > 0 ? n : 1);
+	}
+	*job_num = n;
+	return jobs;
+}
+
+static void write_chunks(void *arg, int begin, int end)
+{
+	struct vtu_writer *w = arg;
+	unsigned char *buf = xmalloc(VTU_CHUNK_BYTES);
+
+	for (int j = begin; j < end && !atomic_load(&w->err); j++) {
+		const struct vtu_job *job = &w->jobs[j];
+		const struct vtu_array *a = &w->L->arrays[job->array];
+		size_t n = (size_t)(job->end - job->begin) * a->item_size;
+		uint64_t off = w->L->header_len + a->offset + 8
+			+ (uint64_t)job->begin * a->item_size;
+		a->fill(w->mesh, a, job->begin, job->end, buf);
+		if (pwrite_all(w->fd, buf, n, off) != 0)
+			atomic_store(&w->err, 1);
+	}
+	xfree(buf);
+}
+
+/**
+ * @name mesh_to_vtu - 把网格和网格上的数据写成 VTK 非结构网格(.vtu)文件
+ * @param 1.mesh 网格 2.outfile 文件名 3.flags VTU_NODE_BC, VTU_ELEMENT_AREA 的组合
+ * 	4.fields 节点或单元上的数据 5.field_num 数据个数
+ * @return 成功返回 0, 失败返回 -1
+ * @note 各数组分块后由多个线程转换并用 pwrite 写到各自的位置
+*/
+int mesh_to_vtu(struct mesh *mesh, char *outfile, int flags,
+		const struct vtu_field *fields, int field_num)
+{
+	struct vtu_layout L;
+	struct vtu_writer w;
+	int job_num, err = 0;
+
+	if (make_layout(&L, mesh, flags, fields, field_num) != 0)
+		return -1;
+	if ((w.fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		fprintf(stderr, "cannot open file %s for writing\n", outfile);
+		free(L.header);
+		return -1;
+	}
+	if (ftruncate(w.fd, L.file_size) != 0)
+		err = 1;
+
+	err |= pwrite_all(w.fd, L.header, L.header_len, 0) != 0;
+	for (int i = 0; i < L.array_num; i++) {
+		uint64_t bytes = (uint64_t)L.arrays[i].n * L.arrays[i].item_size;
+		err |= pwrite_all(w.fd, &bytes, 8, L.header_len + L.arrays[i].offset) != 0;
+	}
+	err |= pwrite_all(w.fd, VTU_FOOTER, strlen(VTU_FOOTER),
+			L.file_size - strlen(VTU_FOOTER)) != 0;
+
+	w.mesh = mesh;
+	w.L = &L;
+	w.jobs = make_jobs(&L, &job_num);
+	atomic_init(&w.err, err);
+	if (!err)
+		parallel_for(job_num, 1, write_chunks, &w);
+	err = atomic_load(&w.err);
+
+	free_vector(w.jobs);
+	free(L.header);
+	if (close(w.fd) != 0 || err) {
+		fprintf(stderr, "error writing file %s\n", outfile);
+		return -1;
+	}
+	fprintf(stderr, "VTU 已经写入到 %s 文件\n", outfile);
+	return 0;
+}
+
+/**
+ * @name mesh_to_vtu_stream - 把 .vtu 文件按顺序写到流中
+ * @param 1.fp 输出流, 可以是管道 2-5.同 mesh_to_vtu
+ * @return 成功返回 0, 失败返回 -1
+ * @note 单线程, 同一时刻只保留一个分块
+*/
+int mesh_to_vtu_stream(FILE *fp, struct mesh *mesh, int flags,
+		const struct vtu_field *fields, int field_num)
+{
+	struct vtu_layout L;
+	unsigned char *buf;
+	int err = 0;
+
+	if (make_layout(&L, mesh, flags, fields, field_num) != 0)
+		return -1;
+	buf = xmalloc(VTU_CHUNK_BYTES);
+
+	err |= fwrite(L.header, 1, L.header_len, fp) != L.header_len;
+	for (int i = 0; i < L.array_num && !err; i++) {
+		const struct vtu_array *a = &L.arrays[i];
+		uint64_t bytes = (uint64_t)a->n * a->item_size;
+		long step = VTU_CHUNK_BYTES / a->item_size;
+		err |= fwrite(&bytes, 8, 1, fp) != 1;
+		for (long b = 0; b < a->n && !err; b += step) {
+			long e = b + step < a->n ? b + step : a->n;
+			size_t n = (size_t)(e - b) * a->item_size;
+			a->fill(mesh, a, b, e, buf);
+			err |= fwrite(buf, 1, n, fp) != n;
+		}
+	}
+	err |= fputs(VTU_FOOTER, fp) == EOF;
+
+	xfree(buf);
+	free(L.header);
+	if (err || ferror(fp)) {
+		fprintf(stderr, "error writing vtu stream\n");
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef H_MESH_TO_VTU_H
+#define H_MESH_TO_VTU_H
+
+#include <stdio.h>
+#include "mesh.h"
+
+#define VTU_NODE_BC		0x1	/* flags: write node bc as point data */
+#define VTU_ELEMENT_AREA	0x2	/* flags: write element areas as cell data */
+
+#define VTU_POINT_DATA	0
+#define VTU_CELL_DATA	1
+
+/* a Float64 array given per node (VTU_POINT_DATA) or per element (VTU_CELL_DATA) */
+struct vtu_field {
+	const char *name;
+	int location;
+	int components;		/* values per node or element, 1 for a scalar */
+	const double *data;
+};
+
+int mesh_to_vtu(struct mesh *mesh, char *outfile, int flags,
+		const struct vtu_field *fields, int field_num);
+int mesh_to_vtu_stream(FILE *fp, struct mesh *mesh, int flags,
+		const struct vtu_field *fields, int field_num);
+
+#endif /* H_MESH_TO_VTU_H */
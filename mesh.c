@@ -1,9 +1,14 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "triangle.h"
 #include "xmalloc.h"
 #include "myarray.h"
 #include "mesh.h"
 #include "problem-spec.h"
+#include "timer.h"
+#include "trace.h"
 
 static struct triangulateio *problem_spec_to_triangle(struct problem_spec *spec)
 {
@@ -47,16 +52,104 @@ static struct triangulateio *problem_spec_to_triangle(struct problem_spec *spec)
 	} else
 		in->holelist = NULL;
 
+	/* process regions: x, y, attribute, area constraint */
+	in->numberofregions = spec->num_regions;
+	if (in->numberofregions != 0) {
+		make_vector(in->regionlist, 4 * in->numberofregions);
+		for (i = 0; i < in->numberofregions; i++) {
+			in->regionlist[4*i]   = spec->regions[i].x;
+			in->regionlist[4*i+1] = spec->regions[i].y;
+			in->regionlist[4*i+2] = spec->regions[i].attribute;
+			in->regionlist[4*i+3] = spec->regions[i].max_area;
+		}
+	} else
+		in->regionlist = NULL;
+
+	/* no input triangles: Triangle builds them from the PSLG */
+	in->trianglelist = NULL;
+	in->trianglearealist = NULL;
+
+	return in;
+}
+
+/*
+ * 把已有网格转换为 Triangle 的输入, 用于 -r 加密
+ *  边界边(bc != 0)作为线段保留, area[i] 是第 i 个单元的面积上限(<= 0 表示不限制)
+ */
+static struct triangulateio *mesh_to_triangle(struct mesh *mesh, const double *area)
+{
+	int i, k;
+	struct triangulateio *in = xmalloc(sizeof *in);
+
+	in->numberofpoints = mesh->node_num;
+	in->numberofpointattributes = 0;
+	in->pointattributelist = NULL;
+	make_vector(in->pointlist, 2 * in->numberofpoints);
+	make_vector(in->pointmarkerlist, in->numberofpoints);
+	for (i = 0; i < in->numberofpoints; i++) {
+		in->pointlist[2*i]   = mesh->nodes[i].x;
+		in->pointlist[2*i+1] = mesh->nodes[i].y;
+		in->pointmarkerlist[i] = mesh->nodes[i].bc;
+	}
+
+	in->numberoftriangles = mesh->element_num;
+	in->numberofcorners = 3;
+	in->numberoftriangleattributes = 0;
+	in->triangleattributelist = NULL;
+	make_vector(in->trianglelist, 3 * in->numberoftriangles);
+	make_vector(in->trianglearealist, in->numberoftriangles);
+	for (i = 0; i < in->numberoftriangles; i++) {
+		for (k = 0; k < 3; k++)
+			in->trianglelist[3*i+k] = mesh->elements[i].node[k]->node_id;
+		in->trianglearealist[i] = area[i];
+	}
+
+	in->numberofsegments = 0;
+	for (i = 0; i < mesh->edge_num; i++)
+		if (mesh->edges[i].bc != 0)
+			in->numberofsegments++;
+	make_vector(in->segmentlist, 2 * in->numberofsegments);
+	make_vector(in->segmentmarkerlist, in->numberofsegments);
+	for (i = k = 0; i < mesh->edge_num; i++) {
+		if (mesh->edges[i].bc == 0)
+			continue;
+		in->segmentlist[2*k]   = mesh->edges[i].node[0]->node_id;
+		in->segmentlist[2*k+1] = mesh->edges[i].node[1]->node_id;
+		in->segmentmarkerlist[k++] = mesh->edges[i].bc;
+	}
+
+	/* the triangles already exclude the holes */
+	in->numberofholes = 0;
+	in->holelist = NULL;
 	in->numberofregions = 0;
+	in->regionlist = NULL;
 
 	return in;
 }
 
-static struct triangulateio *do_triangulate(struct triangulateio *in, double a)
+/*
+ * sinks 不为 NULL 时, 其中的回调和 ctx 交给 triangulatestream,
+ * 对应的输出数组留为 NULL; 此时不能再有 budget, 两者共用 ctx
+ */
+static struct triangulateio *do_triangulate(struct triangulateio *in, char *opts,
+		struct tritimings *timings, struct tristats *stats,
+		struct mesh_budget *budget, struct tristream *sinks)
 {
-	char *opts_string = "Qzpeq30a%f";
-	char opts[64];
 	struct triangulateio *out = xmalloc(sizeof *out);
+	struct tristream stream = { .timings = timings, .stats = stats };
+
+	if (budget != NULL) {
+		stream.progress = budget->progress;
+		stream.ctx = budget->ctx;
+		stream.timelimit = budget->seconds > 0 ? budget->seconds : 0.0;
+	}
+	if (sinks != NULL) {
+		stream.begin = sinks->begin;
+		stream.nodes = sinks->nodes;
+		stream.triangles = sinks->triangles;
+		stream.edges = sinks->edges;
+		stream.ctx = sinks->ctx;
+	}
 
 	out->pointlist = NULL;
 	out->pointmarkerlist = NULL;
@@ -65,34 +158,67 @@ static struct triangulateio *do_triangulate(struct triangulateio *in, double a)
 	out->trianglelist = NULL;
 	out->segmentlist = NULL;
         out->segmentmarkerlist = NULL;
-	sprintf(opts, opts_string, a);
-	triangulate(opts, in, out, NULL);
+	/* Triangle 已经打印了错误并释放了自己的内存, 剩下的交给调用者的恢复点 */
+	if (triangulatestream(opts, in, out, NULL, &stream) != 0)
+		fail_or_exit(EXIT_FAILURE);
+	if (budget != NULL)
+		budget->truncated = stream.stopped;
 
 	return out;
 }
 
-/* This is ugly; there ought to be a better way but I don't see it */
+/*
+ * Attach to every element its three edges.  Edges are bucketed by their
+ * smaller endpoint, so each lookup only scans the few edges that leave
+ * one node instead of the whole edge list.
+ */
 static void assign_elem_edges(
 		struct element *elements, int element_num,
-		struct edge *edges, int edge_num)
+		struct edge *edges, int edge_num, int node_num)
 {
+	int *start, *list;
+
+	make_vector(start, node_num + 1);
+	make_vector(list, edge_num);
+	for (int i = 0; i <= node_num; i++)
+		start[i] = 0;
+	for (int s = 0; s < edge_num; s++) {
+		int m1 = edges[s].node[0]->node_id;
+		int m2 = edges[s].node[1]->node_id;
+		start[(m1 < m2 ? m1 : m2) + 1]++;
+	}
+	for (int i = 0; i < node_num; i++)
+		start[i+1] += start[i];
+	for (int s = 0; s < edge_num; s++) {
+		int m1 = edges[s].node[0]->node_id;
+		int m2 = edges[s].node[1]->node_id;
+		list[start[m1 < m2 ? m1 : m2]++] = s;
+	}
+	for (int i = node_num; i > 0; i--)	/* undo the shift from filling */
+		start[i] = start[i-1];
+	start[0] = 0;
+
 	for (int r = 0; r < element_num; r++) {
 		for (int i = 0; i < 3; i++) {	/* i: vertex index */
 			int j = (i+1)%3;
 			int k = (i+2)%3;
 			int n1 = elements[r].node[j]->node_id;
 			int n2 = elements[r].node[k]->node_id;
-			for (int s = 0; s < edge_num; s++) {
-				int m1 = edges[s].node[0]->node_id;
-				int m2 = edges[s].node[1]->node_id;
-				if ((m1 == n1 && m2 == n2)
-						|| (m1 == n2 && m2 == n1)) {
-					elements[r].edge[i] = &edges[s];
+			int lo = n1 < n2 ? n1 : n2;
+			int hi = n1 < n2 ? n2 : n1;
+			for (int p = start[lo]; p < start[lo+1]; p++) {
+				struct edge *e = &edges[list[p]];
+				if (e->node[0]->node_id == hi
+						|| e->node[1]->node_id == hi) {
+					elements[r].edge[i] = e;
 					break;
 				}
 			}
 		}
 	}
+
+	free_vector(start);
+	free_vector(list);
 }
 
 static void set_element_edge_vectors(struct element *ep)
@@ -101,13 +227,13 @@ static void set_element_edge_vectors(struct element *ep)
 		int j = (i+1)%3;
 		int k = (i+2)%3;
 		ep->edge_vector_x[i] = ep->node[k]->x - ep->node[j]->x;
-		ep->edge_vector_x[i] = ep->node[k]->y - ep->node[j]->y;
+		ep->edge_vector_y[i] = ep->node[k]->y - ep->node[j]->y;
 	}
 }
 
 static void set_element_area(struct element *ep)
 {
-	ep->area = (ep->edge_vector_x[0]*ep->edge_vector_x[1] - ep->edge_vector_x[1]*ep->edge_vector_x[0])/2.0;
+	ep->area = (ep->edge_vector_x[0]*ep->edge_vector_y[1] - ep->edge_vector_y[0]*ep->edge_vector_x[1])/2.0;
 }
 
 static void set_edge_vectors_and_areas(struct element *elements, int element_num)
@@ -119,44 +245,76 @@ static void set_edge_vectors_and_areas(struct element *elements, int element_num
 	}
 }
 
-static struct mesh *triangle_to_mesh(struct triangulateio *out)
+/**
+ * @name mesh_from_arrays - 由下标数组构造网格
+ * @param 1.node_num 节点个数 2.xy 节点坐标(x0,y0,x1,y1,...) 3.node_bc 节点边界条件
+ * 	4.edge_num 边个数 5.edge_node 每条边的两个节点下标 6.edge_bc 边的边界条件
+ * 	7.element_num 单元个数 8.element_node 每个单元的三个节点下标
+ * 	9.element_edge 每个单元的三条边下标(第 i 条边与第 i 个节点相对), 为 NULL 时重新计算
+ * @return 网格
+ * @note 数组只被读取, 网格中的数据都是复制出来的
+*/
+static struct mesh *build_mesh(int node_num, const double *xy, const int *node_bc,
+		int edge_num, const int *edge_node, const int *edge_bc,
+		int element_num, const int *element_node, const int *element_edge,
+		struct mesh_timings *timings)
 {
 	struct node *nodes;
 	struct edge *edges;
 	struct element *elements;
-	int i, node_num, edge_num, element_num;
+	int i;
 	struct mesh *mesh = xmalloc(sizeof *mesh);
+	double t0 = timings != NULL ? wall_time() : 0.0, t1 = t0, t2 = t0;
 
-	node_num = out->numberofpoints;
+	TRACE_BEGIN("triangle_to_mesh");
 	make_vector(nodes, node_num);
-	for (i = 0; i < out->numberofpoints; i++) {
+	for (i = 0; i < node_num; i++) {
 		nodes[i].node_id = i;
-		nodes[i].x = out->pointlist[2*i];
-		nodes[i].y = out->pointlist[2*i+1];
+		nodes[i].x = xy[2*i];
+		nodes[i].y = xy[2*i+1];
 		nodes[i].z = 0.0;
-		nodes[i].bc = out->pointmarkerlist[i];
+		nodes[i].bc = node_bc[i];
 	}
 
-	edge_num = out->numberofedges;
 	make_vector(edges, edge_num);
 	for (i = 0; i < edge_num; i++) {
 		edges[i].edge_id = i;
-		edges[i].node[0] = &nodes[out->edgelist[2*i]];
-		edges[i].node[1] = &nodes[out->edgelist[2*i+1]];
-		edges[i].bc = out->edgemarkerlist[i];
+		edges[i].node[0] = &nodes[edge_node[2*i]];
+		edges[i].node[1] = &nodes[edge_node[2*i+1]];
+		edges[i].bc = edge_bc[i];
 	}
 
-	element_num = out->numberoftriangles;
 	make_vector(elements, element_num);
 	for (i = 0; i < element_num; i++) {
 		elements[i].element_id = i;
-		elements[i].node[0] = &nodes[out->trianglelist[3*i]];
-		elements[i].node[1] = &nodes[out->trianglelist[3*i+1]];
-		elements[i].node[2] = &nodes[out->trianglelist[3*i+2]];
+		elements[i].node[0] = &nodes[element_node[3*i]];
+		elements[i].node[1] = &nodes[element_node[3*i+1]];
+		elements[i].node[2] = &nodes[element_node[3*i+2]];
 	}
 
-	assign_elem_edges(elements, element_num, edges, edge_num);
+	TRACE_END("triangle_to_mesh");
+	if (timings != NULL)
+		t1 = wall_time();
+	TRACE_BEGIN("assign_elem_edges");
+	if (element_edge != NULL) {
+		for (i = 0; i < element_num; i++) {
+			elements[i].edge[0] = &edges[element_edge[3*i]];
+			elements[i].edge[1] = &edges[element_edge[3*i+1]];
+			elements[i].edge[2] = &edges[element_edge[3*i+2]];
+		}
+	} else
+		assign_elem_edges(elements, element_num, edges, edge_num, node_num);
+	TRACE_END("assign_elem_edges");
+	if (timings != NULL)
+		t2 = wall_time();
+	TRACE_BEGIN("geometry");
 	set_edge_vectors_and_areas(elements, element_num);
+	TRACE_END("geometry");
+	if (timings != NULL) {
+		timings->triangle_to_mesh = t1 - t0;
+		timings->assign_elem_edges = t2 - t1;
+		timings->geometry = wall_time() - t2;
+	}
 
 	mesh->node_num = node_num;
 	mesh->edge_num = edge_num;
@@ -168,6 +326,22 @@ static struct mesh *triangle_to_mesh(struct triangulateio *out)
 	return mesh;
 }
 
+struct mesh *mesh_from_arrays(int node_num, const double *xy, const int *node_bc,
+		int edge_num, const int *edge_node, const int *edge_bc,
+		int element_num, const int *element_node, const int *element_edge)
+{
+	return build_mesh(node_num, xy, node_bc, edge_num, edge_node, edge_bc,
+			element_num, element_node, element_edge, NULL);
+}
+
+static struct mesh *triangle_to_mesh(struct triangulateio *out,
+		struct mesh_timings *timings)
+{
+	return build_mesh(out->numberofpoints, out->pointlist, out->pointmarkerlist,
+			out->numberofedges, out->edgelist, out->edgemarkerlist,
+			out->numberoftriangles, out->trianglelist, NULL, timings);
+}
+
 static void free_triangle_in_structure(struct triangulateio *in)
 {
 	free_vector(in->pointlist);
@@ -175,26 +349,29 @@ static void free_triangle_in_structure(struct triangulateio *in)
 	free_vector(in->segmentlist);
 	free_vector(in->segmentmarkerlist);
 	free_vector(in->holelist);
-	free(in);
+	free_vector(in->trianglelist);
+	free_vector(in->trianglearealist);
+	free_vector(in->regionlist);
+	xfree(in);
 }
 
 static void free_triangle_out_structure(struct triangulateio *out)
 {
 
-	free(out->pointlist);
-	free(out->pointmarkerlist);
-	free(out->edgelist);
-	free(out->edgemarkerlist);
-	free(out->trianglelist);
-	free(out->segmentlist);
-	free(out->segmentmarkerlist);
-	free(out);
+	xfree(out->pointlist);
+	xfree(out->pointmarkerlist);
+	xfree(out->edgelist);
+	xfree(out->edgemarkerlist);
+	xfree(out->trianglelist);
+	xfree(out->segmentlist);
+	xfree(out->segmentmarkerlist);
+	xfree(out);
 }
 
 /**
  * @name make_mesh - 生成网格
  * @param 1.spec 问题规格 2.a 内圆半径
- * @return 网格
+ * @return 网格; 出错(输入有误, Triangle 内部错误或内存不足)时返回 NULL
  * @note
  * 	生成网格的步骤
  * 	1.将问题描述(problem_spec)转换为三角形(triangulateio)结构
@@ -202,18 +379,380 @@ static void free_triangle_out_structure(struct triangulateio *out)
  * 	3.将三角形(triangulateio)结构转换为网格(mesh)结构
 */
 struct mesh *make_mesh(struct problem_spec *spec, double a)
+{
+	return make_mesh_profiled(spec, a, NULL, NULL);
+}
+
+static void copy_stats(struct mesh_stats *stats, const struct tristats *ts)
+{
+	stats->incircle_tests = ts->incircle;
+	stats->orient2d_tests = ts->counterclockwise;
+	stats->orient3d_tests = ts->orient3d;
+	stats->hyperbola_tests = ts->hyperbola;
+	stats->circumcenters = ts->circumcenter;
+	stats->circle_tops = ts->circletop;
+	stats->incircle_exact = ts->incircleexact;
+	stats->orient2d_exact = ts->counterclockwiseexact;
+	stats->orient3d_exact = ts->orient3dexact;
+	stats->locate_calls = ts->locates;
+	stats->locate_steps = ts->locatesteps;
+	stats->locate_max_steps = ts->maxlocatesteps;
+	stats->steiner_points = ts->steinerpoints;
+	stats->vertex_bytes = ts->vertexbytes;
+	stats->triangle_bytes = ts->trianglebytes;
+	stats->subseg_bytes = ts->subsegbytes;
+	stats->virus_bytes = ts->virusbytes;
+	stats->badsubseg_bytes = ts->badsubsegbytes;
+	stats->badtriangle_bytes = ts->badtrianglebytes;
+	stats->flipstacker_bytes = ts->flipstackerbytes;
+	stats->splaynode_bytes = ts->splaynodebytes;
+}
+
+/**
+ * @name mesh_switches - make_mesh 交给 Triangle 的开关
+ * @param 1.spec 问题规格 2.a 最大面积 3.opts 输出的开关字符串 4.size opts 的长度
+ * @note 同样的问题规格和开关总是得到同样的网格, mesh-cache.c 用它作为键的一部分
+*/
+void mesh_switches(struct problem_spec *spec, double a, char *opts, size_t size)
+{
+	int region_area = 0;
+
+	for (int i = 0; i < spec->num_regions; i++)
+		if (spec->regions[i].max_area > 0)
+			region_area = 1;
+	/* a second bare 'a' makes Triangle also apply the region area constraints */
+	snprintf(opts, size, "Qzpeq30a%f%s", a, region_area ? "a" : "");
+}
+
+static struct mesh *make_mesh_with(struct problem_spec *spec, double a,
+		struct mesh_timings *timings, struct mesh_stats *stats,
+		struct mesh_budget *budget)
 {
 	struct triangulateio *in, *out;
+	struct tritimings tt;
+	struct tristats ts;
 	struct mesh *mesh;
+	char opts[96];
+	double t0 = timings != NULL ? wall_time() : 0.0;
+	jmp_buf jump;
+	TRACE_SCOPE("make_mesh");
 
+	if (setjmp(jump) != 0) {
+		recovery_abort();
+		return NULL;
+	}
+	if (recovery_push(&jump) != 0)
+		return NULL;
+	mesh_switches(spec, a, opts, sizeof opts);
+	/* -S 限制 Steiner 点个数, Triangle 在 enforcequality 中检查 */
+	if (budget != NULL && budget->steiner_points > 0)
+		snprintf(opts + strlen(opts), sizeof opts - strlen(opts), "S%ld",
+				budget->steiner_points);
+	TRACE_BEGIN("spec_to_triangle");
 	in = problem_spec_to_triangle(spec);
-	out = do_triangulate(in, a);
-	mesh = triangle_to_mesh(out);
+	TRACE_END("spec_to_triangle");
+	if (timings != NULL)
+		timings->spec_to_triangle = wall_time() - t0;
+	TRACE_BEGIN("triangulate");
+	out = do_triangulate(in, opts, timings != NULL ? &tt : NULL,
+			stats != NULL ? &ts : NULL, budget, NULL);
+	TRACE_END("triangulate");
+	mesh = triangle_to_mesh(out, timings);
 	free_triangle_in_structure(in);
 	free_triangle_out_structure(out);
+	if (timings != NULL) {
+		timings->delaunay = tt.delaunay;
+		timings->segments = tt.segments;
+		timings->holes = tt.holes;
+		timings->quality = tt.quality;
+		timings->write_nodes = tt.writenodes;
+		timings->write_elements = tt.writeelements;
+		timings->write_segments = tt.writepoly;
+		timings->write_edges = tt.writeedges;
+		timings->total = wall_time() - t0;
+	}
+	if (stats != NULL)
+		copy_stats(stats, &ts);
+	recovery_pop();
 	return mesh;
 }
 
+/**
+ * @name make_mesh_profiled - 生成网格并记录各阶段的耗时和 Triangle 的统计量
+ * @param 1.spec 问题规格 2.a 最大面积 3.timings 各阶段耗时 4.stats 运算次数和内存用量
+ * @return 网格, 出错时打印错误并返回 NULL, 这次分配的内存都已释放
+ * @note timings 和 stats 都可以为 NULL; 除了错误不向标准输出打印任何内容
+*/
+struct mesh *make_mesh_profiled(struct problem_spec *spec, double a,
+		struct mesh_timings *timings, struct mesh_stats *stats)
+{
+	return make_mesh_with(spec, a, timings, stats, NULL);
+}
+
+/**
+ * @name make_mesh_budgeted - 在给定的时间或 Steiner 点预算内生成网格
+ * @param 1.spec 问题规格 2.a 最大面积 3.budget 预算, 返回时设置 truncated
+ * @return 网格, 出错时返回 NULL; 预算用完时是加密到一半的有效网格
+*/
+struct mesh *make_mesh_budgeted(struct problem_spec *spec, double a,
+		struct mesh_budget *budget)
+{
+	return make_mesh_with(spec, a, NULL, NULL, budget);
+}
+
+_Static_assert(MESH_STREAM_CHUNK == TRISTREAMCHUNK, "mesh.h and triangle.h disagree on the chunk size");
+
+/* Triangle 的回调, ctx 是 make_mesh_streamed 的 struct mesh_stream */
+static void stream_begin(void *ctx, int vertices, int triangles, int edges)
+{
+	struct mesh_stream *stream = ctx;
+
+	stream->begin(stream->ctx, vertices, triangles, edges);
+}
+
+static void stream_nodes(void *ctx, int first, int count, REAL *xy,
+		REAL *attribs, int *markers)
+{
+	struct mesh_stream *stream = ctx;
+
+	(void)attribs;
+	stream->nodes(stream->ctx, first, count, xy, markers);
+}
+
+static void stream_triangles(void *ctx, int first, int count, int *corners,
+		REAL *attribs)
+{
+	struct mesh_stream *stream = ctx;
+
+	(void)attribs;
+	stream->elements(stream->ctx, first, count, corners);
+}
+
+static void stream_edges(void *ctx, int first, int count, int *endpoints,
+		int *markers)
+{
+	struct mesh_stream *stream = ctx;
+
+	stream->edges(stream->ctx, first, count, endpoints, markers);
+}
+
+/**
+ * @name make_mesh_streamed - 生成网格, 结果分块交给回调而不建立网格
+ * @param 1.spec 问题规格 2.a 最大面积 3.stream 回调, 见 mesh.h
+ * @return 成功返回 0, 出错时打印错误并返回 -1
+ * @note 开关与 make_mesh 相同, 回调依次收到的节点, 单元和边与 make_mesh 得到的
+ * 	网格一一相同. Triangle 只用 MESH_STREAM_CHUNK 大小的缓冲区交出结果,
+ * 	不分配整份的 pointlist, trianglelist 和 edgelist
+*/
+int make_mesh_streamed(struct problem_spec *spec, double a,
+		struct mesh_stream *stream)
+{
+	struct triangulateio *in, *out;
+	struct tristream sinks = {
+		.begin = stream_begin,
+		.nodes = stream_nodes,
+		.triangles = stream_triangles,
+		.edges = stream_edges,
+		.ctx = stream,
+	};
+	char opts[96];
+	jmp_buf jump;
+	TRACE_SCOPE("make_mesh_streamed");
+
+	if (setjmp(jump) != 0) {
+		recovery_abort();
+		return -1;
+	}
+	if (recovery_push(&jump) != 0)
+		return -1;
+	mesh_switches(spec, a, opts, sizeof opts);
+	in = problem_spec_to_triangle(spec);
+	out = do_triangulate(in, opts, NULL, NULL, NULL, &sinks);
+	free_triangle_in_structure(in);
+	free_triangle_out_structure(out);
+	recovery_pop();
+	return 0;
+}
+
+/*
+ * make_mesh 内存峰值的模型, 系数按 memstat 对内置区域和合成用例的实测标定.
+ *  峰值出现在 build_mesh 中: Triangle 的输入和输出数组, 网格本身和
+ *  assign_elem_edges 的临时数组同时存在. 内部加密出的每个单元约带来 1.5 条边
+ *  和 0.5 个节点.
+ */
+#define MESH_AREA_RATIO	0.63		/* q30 加密后单元平均面积 / 面积约束 */
+#define MESH_PEAK_FIXED	(700 * 1024)	/* Triangle 各内存池的首块等固定开销 */
+
+/* mesh_predict_peak 估计的各种对象个数 */
+struct mesh_counts{
+	double elements, edges, nodes, segments;
+};
+
+/*
+ * 不加面积约束剖分一次, 得到区域面积和边界附近必需的对象个数, 再加上面积约束 a
+ * 要求的单元. 在调用者的恢复点里执行, 出错时 longjmp 回去.
+ */
+static void predict_counts(struct problem_spec *spec, double a,
+		struct mesh_counts *c)
+{
+	struct triangulateio *in, *out;
+	double area = 0.0, n;
+	char buf[64];
+
+	/* make_mesh 把 a 按 %f 写进选项, 这里用同样舍入后的值 */
+	snprintf(buf, sizeof buf, "%f", a);
+	if (strtod(buf, NULL) > 0.0)
+		a = strtod(buf, NULL);
+	for (int i = 0; i < spec->num_regions; i++)
+		if (spec->regions[i].max_area > 0 && spec->regions[i].max_area < a)
+			a = spec->regions[i].max_area;
+	in = problem_spec_to_triangle(spec);
+	out = do_triangulate(in, "Qzpeq30", NULL, NULL, NULL, NULL);
+	for (int t = 0; t < out->numberoftriangles; t++) {
+		const double *p = &out->pointlist[2*out->trianglelist[3*t]];
+		const double *q = &out->pointlist[2*out->trianglelist[3*t+1]];
+		const double *r = &out->pointlist[2*out->trianglelist[3*t+2]];
+		area += 0.5 * fabs((q[0]-p[0])*(r[1]-p[1]) - (q[1]-p[1])*(r[0]-p[0]));
+	}
+	n = ceil(area / (MESH_AREA_RATIO * a));
+	c->nodes = out->numberofpoints + 0.5*n;
+	c->edges = out->numberofedges + 1.5*n;
+	c->elements = n + out->numberoftriangles;
+	c->segments = spec->num_segments + out->numberofsegments;
+	free_triangle_in_structure(in);
+	free_triangle_out_structure(out);
+}
+
+/**
+ * @name mesh_predict_peak - 估计 make_mesh(spec, a) 经过 xmalloc 的内存峰值
+ * @param 1.spec 问题规格 2.a 面积约束 3.element_num 不为 NULL 时写入估计的单元数
+ * @return 估计的峰值字节数, 剖分出错时返回 0
+ * @note 先不加面积约束剖分一次(代价只与边界点数有关), 得到区域面积和边界附近
+ * 	必需的单元, 边, 节点数, 再加上面积约束要求的 面积/(MESH_AREA_RATIO*a)
+ * 	个单元, 偏向高估. 区域上更小的面积约束按最小的那个计算.
+*/
+size_t mesh_predict_peak(struct problem_spec *spec, double a, int *element_num)
+{
+	struct mesh_counts c;
+	double bytes;
+	jmp_buf jump;
+
+	if (setjmp(jump) != 0) {
+		recovery_abort();
+		return 0;
+	}
+	if (recovery_push(&jump) != 0)
+		return 0;
+	predict_counts(spec, a, &c);
+	recovery_pop();
+
+	bytes = c.elements * (sizeof(struct element) + 3*sizeof(int))	/* trianglelist */
+		+ c.edges * (sizeof(struct edge) + 3*sizeof(int)	/* edgelist, edgemarkerlist */
+			+ sizeof(int))				/* assign_elem_edges */
+		+ c.nodes * (sizeof(struct node) + 2*sizeof(double)	/* pointlist */
+			+ 2*sizeof(int))			/* pointmarkerlist, assign_elem_edges */
+		+ spec->num_points * (2*sizeof(double) + sizeof(int))	/* 输入的点 */
+		+ c.segments * 3*sizeof(int);		/* 输入和输出的 segmentlist */
+	if (element_num != NULL)
+		*element_num = (int)c.elements;
+	return MESH_PEAK_FIXED + (size_t)bytes;
+}
+
+/**
+ * @name refine_mesh - 在已有网格上按单元面积约束加密
+ * @param 1.mesh 已有网格(不会被修改) 2.area 每个单元的面积上限, <= 0 表示不限制
+ * @return 新网格, 出错时返回 NULL
+ * @note
+ * 	以 Triangle 的 -r -a 开关在原网格上加密, 而不是从问题规格重新剖分;
+ * 	原网格的边界边作为线段保留, 所以边界条件标记会传给新节点和新边
+*/
+struct mesh *refine_mesh(struct mesh *mesh, const double *area)
+{
+	struct triangulateio *in, *out;
+	struct mesh *refined;
+	jmp_buf jump;
+
+	if (setjmp(jump) != 0) {
+		recovery_abort();
+		return NULL;
+	}
+	if (recovery_push(&jump) != 0)
+		return NULL;
+	in = mesh_to_triangle(mesh, area);
+	out = do_triangulate(in, "Qzrpeq30a", NULL, NULL, NULL, NULL);
+	refined = triangle_to_mesh(out, NULL);
+	free_triangle_in_structure(in);
+	free_triangle_out_structure(out);
+	recovery_pop();
+	return refined;
+}
+
+/**
+ * @name mesh_check - 检查网格的节点, 边和单元是否一致
+ * @param 1.mesh 网格 2.holes 区域中洞的个数, < 0 表示不检查欧拉公式
+ * @return 一致返回 0, 否则向标准错误打印第一处问题并返回 -1
+ * @note 检查的内容: 边和单元引用的节点, 单元引用的边都在数组内; 单元的第 i 条边
+ * 	连接另外两个顶点; 单元面积为正; 每条边属于一个或两个单元;
+ * 	区域连通时 节点数 - 边数 + 单元数 = 1 - holes
+*/
+int mesh_check(const struct mesh *mesh, int holes)
+{
+	const struct node *nodes = mesh->nodes;
+	const struct edge *edges = mesh->edges;
+	int *uses, err = 0;
+
+	for (int s = 0; s < mesh->edge_num && !err; s++)
+		for (int k = 0; k < 2; k++)
+			if (edges[s].node[k] < nodes
+					|| edges[s].node[k] >= nodes + mesh->node_num) {
+				fprintf(stderr, "mesh_check: edge %d: node %d out of range\n", s, k);
+				err = 1;
+			}
+	if (err)
+		return -1;
+
+	make_vector(uses, mesh->edge_num);
+	memset(uses, 0, mesh->edge_num * sizeof *uses);
+	for (int r = 0; r < mesh->element_num && !err; r++) {
+		const struct element *ep = &mesh->elements[r];
+		for (int i = 0; i < 3 && !err; i++) {
+			const struct node *p = ep->node[(i+1)%3], *q = ep->node[(i+2)%3];
+			const struct edge *e = ep->edge[i];
+			if (ep->node[i] < nodes || ep->node[i] >= nodes + mesh->node_num) {
+				fprintf(stderr, "mesh_check: element %d: node %d out of range\n", r, i);
+				err = 1;
+			} else if (e < edges || e >= edges + mesh->edge_num) {
+				fprintf(stderr, "mesh_check: element %d: edge %d out of range\n", r, i);
+				err = 1;
+			} else if (!((e->node[0] == p && e->node[1] == q)
+					|| (e->node[0] == q && e->node[1] == p))) {
+				fprintf(stderr, "mesh_check: element %d: edge %d does not join "
+						"the other two vertices\n", r, i);
+				err = 1;
+			} else {
+				uses[e - edges]++;
+			}
+		}
+		if (!err && !(ep->area > 0.0)) {
+			fprintf(stderr, "mesh_check: element %d: area %g\n", r, ep->area);
+			err = 1;
+		}
+	}
+	for (int s = 0; s < mesh->edge_num && !err; s++)
+		if (uses[s] < 1 || uses[s] > 2) {
+			fprintf(stderr, "mesh_check: edge %d belongs to %d elements\n", s, uses[s]);
+			err = 1;
+		}
+	free_vector(uses);
+	if (!err && holes >= 0
+			&& mesh->node_num - mesh->edge_num + mesh->element_num != 1 - holes) {
+		fprintf(stderr, "mesh_check: %d nodes - %d edges + %d elements != 1 - %d holes\n",
+				mesh->node_num, mesh->edge_num, mesh->element_num, holes);
+		err = 1;
+	}
+	return err ? -1 : 0;
+}
+
 void free_mesh(struct mesh *mesh)
 {
 	if (mesh == NULL)
@@ -222,5 +761,5 @@ void free_mesh(struct mesh *mesh)
 	free_vector(mesh->nodes);
 	free_vector(mesh->edges);
 	free_vector(mesh->elements);
-	free(mesh);
+	xfree(mesh);
 }
@@ -45,6 +45,97 @@ struct mesh{
     int element_num;          // 单元个数
 };
 
+/*
+ * make_mesh_profiled 各阶段所用的时间(秒, 单调时钟)
+ *  delaunay 到 write_edges 由 Triangle 给出, 其余在 mesh.c 中测量
+ */
+struct mesh_timings{
+    double spec_to_triangle;    // 问题规格转换为 triangulateio
+    double delaunay;            // delaunay()
+    double segments;            // formskeleton()
+    double holes;               // carveholes()
+    double quality;             // enforcequality()
+    double write_nodes;         // writenodes()
+    double write_elements;      // writeelements()
+    double write_segments;      // writepoly()
+    double write_edges;         // writeedges()
+    double triangle_to_mesh;    // 建立节点, 边, 单元数组
+    double assign_elem_edges;   // 单元和边的对应关系
+    double geometry;            // 边向量和单元面积
+    double total;               // 整个 make_mesh_profiled
+};
+
+/*
+ * make_mesh_profiled 中 Triangle 的运算次数和内存用量
+ *  *_exact 是浮点误差过滤失败, 改用精确算术(adapt)的谓词调用次数
+ */
+struct mesh_stats{
+    long incircle_tests;        // incircle 测试次数
+    long orient2d_tests;        // 二维定向测试次数
+    long orient3d_tests;        // 三维定向测试次数(加权 Delaunay)
+    long hyperbola_tests;       // 扫描线算法的双曲线测试次数
+    long circumcenters;         // 外心计算次数
+    long circle_tops;           // 扫描线算法的圆顶计算次数
+    long incircle_exact;
+    long orient2d_exact;
+    long orient3d_exact;
+    long locate_calls;          // 点定位次数
+    long locate_steps;          // 点定位走过的三角形总数
+    long locate_max_steps;      // 一次点定位走过的最多三角形数
+    long steiner_points;        // 插入的 Steiner 点个数
+    long vertex_bytes;          // 各内存池的峰值字节数
+    long triangle_bytes;
+    long subseg_bytes;
+    long virus_bytes;
+    long badsubseg_bytes;
+    long badtriangle_bytes;
+    long flipstacker_bytes;
+    long splaynode_bytes;
+};
+
+/*
+ * make_mesh_budgeted 的加密预算
+ *  时间从调用开始算起. 预算用完或 progress 返回非零时停止加密,
+ *  返回的网格是有效的, 只是还有单元不满足面积或角度的要求
+ */
+struct mesh_budget{
+    double seconds;             // 可用的时间(秒), <= 0 表示不限制
+    long steiner_points;        // 最多插入的 Steiner 点个数, <= 0 表示不限制
+    // 每加密若干步调用一次, 参数是已插入的 Steiner 点个数和剩下的坏单元个数; 可为 NULL
+    int (*progress)(void *ctx, long steiner_points, long bad_triangles);
+    void *ctx;
+    int truncated;              // 输出: 是否因为预算而没有加密完
+};
+
+/*
+ * make_mesh_streamed 的输出回调
+ *  begin 先收到节点, 单元和边的个数, 然后 nodes, elements, edges 依次收到全部节点,
+ *  全部单元和全部边, 每次至多 MESH_STREAM_CHUNK 个, first 是这一块第一个的下标.
+ *  下标和内容与 make_mesh 得到的网格相同; 数组在回调返回后会被重用
+ */
+#define MESH_STREAM_CHUNK 4096      // 与 triangle.h 的 TRISTREAMCHUNK 相同
+
+struct mesh_stream{
+    void (*begin)(void *ctx, int node_num, int element_num, int edge_num);
+    void (*nodes)(void *ctx, int first, int count, const double *xy, const int *bc);
+    void (*elements)(void *ctx, int first, int count, const int *node);
+    void (*edges)(void *ctx, int first, int count, const int *node, const int *bc);
+    void *ctx;
+};
+
 struct mesh *make_mesh(struct problem_spec *spec, double a);
+int make_mesh_streamed(struct problem_spec *spec, double a,
+        struct mesh_stream *stream);
+struct mesh *make_mesh_budgeted(struct problem_spec *spec, double a,
+        struct mesh_budget *budget);
+struct mesh *make_mesh_profiled(struct problem_spec *spec, double a,
+        struct mesh_timings *timings, struct mesh_stats *stats);
+void mesh_switches(struct problem_spec *spec, double a, char *opts, size_t size);
+size_t mesh_predict_peak(struct problem_spec *spec, double a, int *element_num);
+struct mesh *refine_mesh(struct mesh *mesh, const double *area);
+struct mesh *mesh_from_arrays(int node_num, const double *xy, const int *node_bc,
+        int edge_num, const int *edge_node, const int *edge_bc,
+        int element_num, const int *element_node, const int *element_edge);
+int mesh_check(const struct mesh *mesh, int holes);
 void free_mesh(struct mesh *mesh);
 #endif
\ No newline at end of file
@@ -13,7 +13,7 @@
  *     print_vector(fmt, v, n);
  */
 #define make_vector(v, n) ((v) = xmalloc((n) * sizeof *(v))) 
-#define free_vector(v)  do { free(v); v = NULL; } while (0)
+#define free_vector(v)  do { xfree(v); v = NULL; } while (0)
 #define print_vactor(fmt, v, n) do {                    \
     size_t print_vactor_loop_counter;                   \
     for (print_vactor_loop_counter = 0;                 \
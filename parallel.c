@@ -0,0 +1,150 @@
+/**
+ * @file parallel.c
+ * @brief 基于 pthread 的并行循环
+ * @details
+ *  每次调用 parallel_for() 都会创建 nthreads-1 个工作线程, 调用者本身也参与计算.
+ *  分块通过原子计数器动态分配, 因此各块耗时不均时负载也能自动平衡.
+ *  工作线程沿用调用者的分配器(见 xmalloc.h).
+ *  调用者设置了恢复点时, 每个线程的分块都在自己的恢复点里执行: 一个线程出错后
+ *  其余线程不再领取新的分块, 全部结束后错误交给调用者的恢复点; 各线程留下的
+ *  内存也转归调用者的恢复点.
+*/
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "parallel.h"
+#include "trace.h"
+
+struct parallel_job{
+	int n;
+	int chunk;
+	atomic_int next;	/* 下一个待领取分块的起点 */
+	void (*fn)(void *ctx, int begin, int end);
+	void *ctx;
+	struct allocator *allocator;	/* 调用者的分配器 */
+	int recover;			/* 调用者设置了恢复点 */
+	atomic_int status;		/* 最先出错的线程传给 fail_or_exit 的状态 */
+};
+
+struct parallel_thread{
+	pthread_t thread;
+	struct parallel_job *job;
+	struct recovery_block *blocks;	/* 恢复点里留下的内存, 交给调用者 */
+	size_t block_num;
+};
+
+int parallel_num_threads(void)
+{
+	char *s = getenv("TRI_NUM_THREADS");
+	long n;
+
+	if (s != NULL && (n = strtol(s, NULL, 10)) > 0)
+		return (int)n;
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+}
+
+static void run_chunks(struct parallel_job *job)
+{
+	int begin;
+
+	while ((begin = atomic_fetch_add(&job->next, job->chunk)) < job->n) {
+		int end = begin + job->chunk;
+		if (end > job->n)
+			end = job->n;
+		TRACE_BEGIN("parallel_for.chunk");
+		job->fn(job->ctx, begin, end);
+		TRACE_END("parallel_for.chunk");
+	}
+}
+
+static void *parallel_worker(void *arg)
+{
+	struct parallel_thread *self = arg;
+	struct parallel_job *job = self->job;
+	struct allocator *old = set_allocator(job->allocator);
+	jmp_buf jump;
+
+	if (!job->recover) {
+		run_chunks(job);
+	} else if (setjmp(jump) != 0) {
+		int status = recovery_abort(), expected = 0;
+		atomic_compare_exchange_strong(&job->status, &expected, status);
+		atomic_store(&job->next, job->n);
+	} else if (recovery_push(&jump) != 0) {
+		int expected = 0;
+		atomic_compare_exchange_strong(&job->status, &expected, EXIT_FAILURE);
+		atomic_store(&job->next, job->n);
+	} else {
+		run_chunks(job);
+		self->blocks = recovery_export(&self->block_num);
+	}
+	set_allocator(old);
+	return NULL;
+}
+
+/**
+ * @name parallel_for - 并行执行 fn 于 [0, n) 的各个分块
+ * @param 1.n 迭代总数 2.chunk 每块大小(<=0 时自动选择)
+ * 	3.fn 处理 [begin, end) 的回调 4.ctx 传给 fn 的上下文
+ * @note 返回时所有分块都已处理完毕; 有线程出错时对调用者 fail_or_exit
+*/
+void parallel_for(int n, int chunk,
+		void (*fn)(void *ctx, int begin, int end), void *ctx)
+{
+	struct parallel_job job;
+	struct parallel_thread *threads;
+	int nthreads = parallel_num_threads();
+	int started = 1, status;
+	TRACE_SCOPE("parallel_for");
+
+	if (n <= 0)
+		return;
+	if (chunk <= 0)
+		chunk = (n + 4*nthreads - 1) / (4*nthreads);
+	if (nthreads > (n + chunk - 1) / chunk)
+		nthreads = (n + chunk - 1) / chunk;
+
+	job.n = n;
+	job.chunk = chunk;
+	atomic_init(&job.next, 0);
+	job.fn = fn;
+	job.ctx = ctx;
+	job.allocator = get_allocator();
+	job.recover = recovery_depth() > 0;
+	atomic_init(&job.status, 0);
+
+	if (nthreads <= 1) {
+		TRACE_BEGIN("parallel_for.chunk");
+		fn(ctx, 0, n);
+		TRACE_END("parallel_for.chunk");
+		return;
+	}
+
+	make_vector(threads, nthreads);
+	for (int t = 0; t < nthreads; t++) {
+		threads[t].job = &job;
+		threads[t].blocks = NULL;
+		threads[t].block_num = 0;
+	}
+	for (int t = 1; t < nthreads; t++)
+		if (pthread_create(&threads[t].thread, NULL,
+				parallel_worker, &threads[t]) == 0)
+			started++;
+		else
+			break;
+	parallel_worker(&threads[0]);
+	for (int t = 1; t < started; t++)
+		pthread_join(threads[t].thread, NULL);
+	for (int t = 0; t < started; t++) {
+		for (size_t i = 0; i < threads[t].block_num; i++)
+			recovery_adopt(&threads[t].blocks[i]);
+		free(threads[t].blocks);
+	}
+	free_vector(threads);
+	if ((status = atomic_load(&job.status)) != 0)
+		fail_or_exit(status);
+}
@@ -0,0 +1,15 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/*
+ * 简单的 pthread 并行循环
+ *  parallel_for(n, chunk, fn, ctx) 把 [0, n) 按 chunk 大小分块,
+ *  各线程动态领取分块并调用 fn(ctx, begin, end)
+ *
+ *  线程数由环境变量 TRI_NUM_THREADS 指定, 缺省为在线 CPU 个数
+ */
+int parallel_num_threads(void);
+void parallel_for(int n, int chunk,
+        void (*fn)(void *ctx, int begin, int end), void *ctx);
+
+#endif
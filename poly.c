@@ -0,0 +1,474 @@
+/*
+Read Triangle .poly and .node files into a problem_spec.
+
+The file is mapped with mmap() and cut into chunks at line boundaries.
+Since a '#' comment always ends at the end of its line, every chunk can
+be scanned on its own: parallel_for() first counts the numbers in each
+chunk, then converts them into one array of doubles, each chunk writing
+its own slice.  The file structure (counts, vertices, segments, holes,
+regions) is then read off that array in order, which is cheap.
+
+Numbers are converted by scan_number().  The digits are gathered into a
+64-bit integer, eight at a time with SWAR arithmetic on little-endian
+hosts, and the value is formed with one multiplication or division by
+an exact power of ten when both the digits (at most 2^53) and the
+decimal exponent (at most 22 in magnitude) allow it, which gives the
+correctly rounded result.  Other numbers, such as those with more than
+15 or 16 significant digits, go through strtod().
+
+As in Triangle, the vertices may be numbered from 0 or 1, a .poly file
+with no vertices takes them from the .node file of the same name, and
+the region section is optional.  A .node file alone gives a spec with
+points only.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "parallel.h"
+#include "problem-spec.h"
+
+#define POLY_CHUNKS_PER_THREAD	4
+#define POLY_MIN_CHUNK		(1 << 16)
+#define POLY_MAX_TOKEN		64
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define POLY_SWAR 1
+#else
+#define POLY_SWAR 0
+#endif
+
+static const double pow10_exact[23] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int is_space(char c)
+{
+	return (unsigned char)c <= ' ';
+}
+
+static int is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+#if POLY_SWAR
+/* all eight bytes of w are ASCII digits */
+static int eight_digits(uint64_t w)
+{
+	return ((w & 0xF0F0F0F0F0F0F0F0ULL)
+		| (((w + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+		== 0x3333333333333333ULL;
+}
+
+/* the value of eight ASCII digits, the first one in the lowest byte */
+static uint32_t parse_eight(uint64_t w)
+{
+	w -= 0x3030303030303030ULL;
+	w = w * 10 + (w >> 8);
+	w = ((w & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))
+		+ ((w >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32))) >> 32;
+	return (uint32_t)w;
+}
+#endif
+
+/*
+ * Append the digits at p to m; *digits counts the digits kept in m, the
+ * ones that would overflow 19 are dropped and reported through *lost.
+ */
+static const char *scan_digits(const char *p, const char *end,
+		uint64_t *m, int *digits, int *lost)
+{
+	const char *start = p;
+
+#if POLY_SWAR
+	while (end - p >= 8 && *digits <= 11) {
+		uint64_t w;
+		memcpy(&w, p, 8);
+		if (!eight_digits(w))
+			break;
+		*m = *m * 100000000 + parse_eight(w);
+		*digits += 8;
+		p += 8;
+	}
+#endif
+	for (; p < end && is_digit(*p); p++) {
+		if (*digits < 19) {
+			*m = *m * 10 + (*p - '0');
+			if (*m != 0)
+				(*digits)++;
+		} else
+			(*lost)++;
+	}
+	return p == start ? NULL : p;
+}
+
+/* one number at p; returns the end of the token or NULL if it is not a number */
+static const char *scan_number(const char *p, const char *end, double *out)
+{
+	const char *start = p, *q;
+	uint64_t m = 0;
+	int neg = 0, digits = 0, lost = 0, frac_lost = 0, exp10 = 0, any = 0;
+	double v;
+
+	if (p < end && (*p == '-' || *p == '+'))
+		neg = *p++ == '-';
+	if ((q = scan_digits(p, end, &m, &digits, &lost)) != NULL) {
+		p = q;
+		any = 1;
+	}
+	exp10 = lost;
+	if (p < end && *p == '.') {
+		p++;
+		if ((q = scan_digits(p, end, &m, &digits, &frac_lost)) != NULL) {
+			/* digits that were kept, counting leading zeros of the fraction */
+			int kept = (int)(q - p) - frac_lost;
+			exp10 -= kept;
+			p = q;
+			any = 1;
+		}
+	}
+	if (!any)
+		return NULL;
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		int eneg = 0, e = 0;
+		p++;
+		if (p < end && (*p == '-' || *p == '+'))
+			eneg = *p++ == '-';
+		if (p == end || !is_digit(*p))
+			return NULL;
+		for (; p < end && is_digit(*p); p++)
+			if (e < 100000)
+				e = e * 10 + (*p - '0');
+		exp10 += eneg ? -e : e;
+	}
+	if (p < end && !is_space(*p) && *p != '#')
+		return NULL;
+
+	if (lost == 0 && frac_lost == 0 && m <= (1ULL << 53)
+			&& exp10 >= -22 && exp10 <= 22) {
+		v = (double)m;
+		v = exp10 < 0 ? v / pow10_exact[-exp10] : v * pow10_exact[exp10];
+		*out = neg ? -v : v;
+	} else {
+		char buf[POLY_MAX_TOKEN];
+		if (p - start >= POLY_MAX_TOKEN)
+			return NULL;
+		memcpy(buf, start, p - start);
+		buf[p - start] = '\0';
+		*out = strtod(buf, NULL);
+	}
+	return p;
+}
+
+/* ---------------- parallel tokenizer ---------------- */
+
+struct poly_chunk {
+	const char *begin, *end;
+	long count;	/* numbers in the chunk */
+	long first;	/* index of its first number */
+	int err;
+};
+
+struct poly_scan {
+	struct poly_chunk *chunks;
+	double *v;
+	int pass;
+};
+
+static void scan_chunks(void *arg, int begin, int end)
+{
+	struct poly_scan *s = arg;
+
+	for (int k = begin; k < end; k++) {
+		struct poly_chunk *c = &s->chunks[k];
+		const char *p = c->begin, *e = c->end;
+		long n = 0;
+		while (p < e) {
+			if (is_space(*p)) {
+				p++;
+			} else if (*p == '#') {
+				const char *nl = memchr(p, '\n', e - p);
+				p = nl != NULL ? nl + 1 : e;
+			} else if (s->pass == 0) {
+				while (p < e && !is_space(*p) && *p != '#')
+					p++;
+				n++;
+			} else {
+				const char *q = scan_number(p, e, &s->v[c->first + n]);
+				if (q == NULL) {
+					c->err = 1;
+					break;
+				}
+				p = q;
+				n++;
+			}
+		}
+		c->count = n;
+	}
+}
+
+/* all numbers in the file, in order */
+static double *read_numbers(char *path, long *count)
+{
+	struct poly_scan s;
+	struct stat st;
+	const char *base;
+	size_t size, step;
+	int fd, chunk_num, err = 0;
+	long n = 0;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		fprintf(stderr, "cannot open file %s for reading\n", path);
+		return NULL;
+	}
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return NULL;
+	}
+	size = st.st_size;
+	base = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : "";
+	close(fd);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, "cannot map file %s\n", path);
+		return NULL;
+	}
+
+	chunk_num = parallel_num_threads() * POLY_CHUNKS_PER_THREAD;
+	step = size / chunk_num > POLY_MIN_CHUNK ? size / chunk_num : POLY_MIN_CHUNK;
+	make_vector(s.chunks, chunk_num);
+	{
+		const char *p = base, *e = base + size;
+		int k = 0;
+		while (k < chunk_num && p < e) {
+			const char *q = (size_t)(e - p) > step ? p + step : e;
+			const char *nl = q < e ? memchr(q, '\n', e - q) : NULL;
+			q = nl != NULL ? nl + 1 : e;
+			s.chunks[k].begin = p;
+			s.chunks[k].end = q;
+			s.chunks[k].err = 0;
+			p = q;
+			k++;
+		}
+		if (p < e)	/* can only happen with chunk_num < 1 */
+			s.chunks[k-1].end = e;
+		chunk_num = k;
+	}
+
+	s.pass = 0;
+	parallel_for(chunk_num, 1, scan_chunks, &s);
+	for (int k = 0; k < chunk_num; k++) {
+		s.chunks[k].first = n;
+		n += s.chunks[k].count;
+	}
+	make_vector(s.v, n > 0 ? n : 1);
+	s.pass = 1;
+	parallel_for(chunk_num, 1, scan_chunks, &s);
+	for (int k = 0; k < chunk_num; k++)
+		err |= s.chunks[k].err;
+
+	free_vector(s.chunks);
+	if (size > 0)
+		munmap((void *)base, size);
+	if (err) {
+		fprintf(stderr, "%s: malformed number\n", path);
+		free_vector(s.v);
+		return NULL;
+	}
+	*count = n;
+	return s.v;
+}
+
+/* ---------------- file structure ---------------- */
+
+struct poly_reader {
+	const double *v;
+	long n, pos;
+	int err;
+};
+
+static double next_number(struct poly_reader *r)
+{
+	if (r->pos >= r->n) {
+		r->err = 1;
+		return 0.0;
+	}
+	return r->v[r->pos++];
+}
+
+static long next_int(struct poly_reader *r)
+{
+	double x = next_number(r);
+	long i = (long)x;
+
+	if (i != x)
+		r->err = 1;
+	return i;
+}
+
+/* a node section: header and vertices; returns the first vertex number */
+static int read_points(struct poly_reader *r, struct problem_spec *spec, int *base)
+{
+	long n = next_int(r), dim = next_int(r);
+	long attr_num = next_int(r), marker_num = next_int(r);
+
+	if (r->err || n < 0 || n > r->n || dim != 2 || attr_num < 0 || marker_num < 0)
+		return -1;
+	make_vector(spec->points, n > 0 ? n : 1);
+	spec->num_points = n;
+	for (long i = 0; i < n && !r->err; i++) {
+		long id = next_int(r);
+		if (i == 0)
+			*base = id;
+		if (id != i + *base)
+			return -1;
+		spec->points[i].point_id = i;
+		spec->points[i].x = next_number(r);
+		spec->points[i].y = next_number(r);
+		r->pos += attr_num;
+		spec->points[i].bc = marker_num > 0 ? next_int(r) : 0;
+	}
+	return r->err ? -1 : 0;
+}
+
+static int read_segments(struct poly_reader *r, struct problem_spec *spec, int base)
+{
+	long n = next_int(r), marker_num = next_int(r);
+
+	if (r->err || n < 0 || n > r->n || marker_num < 0)
+		return -1;
+	make_vector(spec->segments, n > 0 ? n : 1);
+	spec->num_segments = n;
+	for (long i = 0; i < n && !r->err; i++) {
+		long a, b;
+		next_int(r);
+		a = next_int(r) - base;
+		b = next_int(r) - base;
+		if (a < 0 || a >= spec->num_points || b < 0 || b >= spec->num_points)
+			return -1;
+		spec->segments[i].segment_id = i;
+		spec->segments[i].point_id1 = a;
+		spec->segments[i].point_id2 = b;
+		spec->segments[i].bc = marker_num > 0 ? next_int(r) : 0;
+	}
+	return r->err ? -1 : 0;
+}
+
+static int read_holes(struct poly_reader *r, struct problem_spec *spec)
+{
+	long n = next_int(r);
+
+	if (r->err || n < 0 || n > r->n)
+		return -1;
+	if (n > 0)
+		make_vector(spec->holes, n);
+	spec->num_holes = n;
+	for (long i = 0; i < n && !r->err; i++) {
+		next_int(r);
+		spec->holes[i].x = next_number(r);
+		spec->holes[i].y = next_number(r);
+	}
+	return r->err ? -1 : 0;
+}
+
+static int read_regions(struct poly_reader *r, struct problem_spec *spec)
+{
+	long n;
+
+	if (r->pos == r->n)	/* the section is optional */
+		return 0;
+	n = next_int(r);
+	if (r->err || n < 0 || n > r->n)
+		return -1;
+	if (n > 0)
+		make_vector(spec->regions, n);
+	spec->num_regions = n;
+	for (long i = 0; i < n && !r->err; i++) {
+		next_int(r);
+		spec->regions[i].x = next_number(r);
+		spec->regions[i].y = next_number(r);
+		spec->regions[i].attribute = next_number(r);
+		spec->regions[i].max_area = next_number(r);
+	}
+	return r->err ? -1 : 0;
+}
+
+static int has_suffix(const char *s, const char *suffix)
+{
+	size_t n = strlen(s), m = strlen(suffix);
+	return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+/* the vertices of a .poly file that has none, from its .node file */
+static int read_node_file(char *poly_path, struct problem_spec *spec, int *base)
+{
+	struct poly_reader r;
+	size_t n = strlen(poly_path);
+	char *path = xmalloc(n + 1);
+	int status;
+
+	memcpy(path, poly_path, n + 1);
+	memcpy(path + n - 5, ".node", 5);
+	r.v = read_numbers(path, &r.n);
+	r.pos = 0;
+	r.err = 0;
+	free_vector(spec->points);
+	status = r.v != NULL ? read_points(&r, spec, base) : -1;
+	if (r.v != NULL && status != 0)
+		fprintf(stderr, "%s: bad vertex section\n", path);
+	xfree((void *)r.v);
+	xfree(path);
+	return status;
+}
+
+/**
+ * @name problem_spec_from_poly - 从 Triangle 的 .poly 或 .node 文件读入问题规格
+ * @param 1.path 文件名, 以 .poly 或 .node 结尾
+ * @return 问题规格(用 free_problem_spec 释放), 失败返回 NULL
+ * @note 点和线段的边界标记作为 bc; 系数函数 f, g, h, eta 等都为 NULL, 由调用者设置
+*/
+struct problem_spec *problem_spec_from_poly(char *path)
+{
+	struct problem_spec *spec;
+	struct poly_reader r;
+	const char *what = NULL;
+	int base = 0, poly = has_suffix(path, ".poly");
+
+	if (!poly && !has_suffix(path, ".node")) {
+		fprintf(stderr, "%s: expected a .poly or .node file\n", path);
+		return NULL;
+	}
+	if ((r.v = read_numbers(path, &r.n)) == NULL)
+		return NULL;
+	r.pos = 0;
+	r.err = 0;
+
+	spec = xmalloc(sizeof *spec);
+	memset(spec, 0, sizeof *spec);
+	if (read_points(&r, spec, &base) != 0)
+		what = "bad vertex section";
+	else if (poly && spec->num_points == 0 && read_node_file(path, spec, &base) != 0)
+		what = "bad .node file";
+	else if (poly && read_segments(&r, spec, base) != 0)
+		what = "bad segment section";
+	else if (poly && read_holes(&r, spec) != 0)
+		what = "bad hole section";
+	else if (poly && read_regions(&r, spec) != 0)
+		what = "bad region section";
+	xfree((void *)r.v);
+
+	if (what != NULL) {
+		fprintf(stderr, "%s: %s\n", path, what);
+		free_problem_spec(spec);
+		return NULL;
+	}
+	return spec;
+}
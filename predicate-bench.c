@@ -0,0 +1,220 @@
+/**
+ * @file predicate-bench.c
+ * @brief 几何谓词的微基准测试: 每次调用的耗时和各精度阶段所占的比例
+ * @details
+ *  用法:
+ *      predicate-bench.bin [csv-file] [calls] [reps]
+ *  对 Triangle 的 counterclockwise, incircle, orient3d 三个谓词,
+ *  在退化程度不同的点集上各做 calls 次调用(缺省 100000), 重复 reps 次
+ *  (缺省 5), 给出每次调用耗时(纳秒)的最小值和中位数, 以及由浮点过滤器
+ *  直接判定, 在自适应阶段 B, C, D 判定的调用所占的比例.
+ *  点集:
+ *      random          单位正方形中的随机点, 高度也随机
+ *      near-collinear  直线 y = 0.3x + 0.2 上的点, 只有舍入误差;
+ *                      高度取平面 0.7x - 0.4y + 0.1, 同样只有舍入误差
+ *      cocircular      annulus 那样的圆上的随机点, 高度取抬升 x²+y²
+ *      grid            8×8 网格上的点(坐标精确), 经常恰好共线或共圆
+ *  随机输入用固定的种子生成, 多次运行的输入完全相同.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "timer.h"
+#include "triangle.h"
+
+#define BENCH_SEED	20240601ULL
+#define GRID_N		8	/* 网格每边的点数 */
+
+struct predicate{
+	const char *name;
+	int kind;		/* TRIORIENT2D, TRIINCIRCLE 或 TRIORIENT3D */
+	int points;		/* 每次调用的点数 */
+	int dim;		/* 每个点的坐标个数, orient3d 多一个高度 */
+};
+
+static const struct predicate predicates[] = {
+	{ "orient2d", TRIORIENT2D, 3, 2 },
+	{ "incircle", TRIINCIRCLE, 4, 2 },
+	{ "orient3d", TRIORIENT3D, 4, 3 },
+};
+#define PREDICATE_NUM	((int)(sizeof predicates / sizeof predicates[0]))
+
+/* xorshift64*, 各平台结果一致 */
+static double next_random(unsigned long long *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return ((*state * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void random_point(unsigned long long *state, double *x, double *y, double *h)
+{
+	*x = next_random(state);
+	*y = next_random(state);
+	*h = next_random(state);
+}
+
+static void collinear_point(unsigned long long *state, double *x, double *y, double *h)
+{
+	*x = next_random(state);
+	*y = 0.3 * *x + 0.2;
+	*h = 0.7 * *x - 0.4 * *y + 0.1;
+}
+
+static void cocircular_point(unsigned long long *state, double *x, double *y, double *h)
+{
+	double t = 8*atan(1.0) * next_random(state);
+
+	*x = 0.5 + 0.325*cos(t);
+	*y = 0.5 + 0.325*sin(t);
+	*h = *x * *x + *y * *y;
+}
+
+static void grid_point(unsigned long long *state, double *x, double *y, double *h)
+{
+	*x = floor(GRID_N * next_random(state)) / GRID_N;
+	*y = floor(GRID_N * next_random(state)) / GRID_N;
+	*h = *x * *x + *y * *y;
+}
+
+struct point_set{
+	const char *name;
+	void (*point)(unsigned long long *state, double *x, double *y, double *h);
+};
+
+static const struct point_set sets[] = {
+	{ "random", random_point },
+	{ "near-collinear", collinear_point },
+	{ "cocircular", cocircular_point },
+	{ "grid", grid_point },
+};
+#define SET_NUM	((int)(sizeof sets / sizeof sets[0]))
+
+// 一个谓词在一个点集上的结果
+struct bench_result{
+	const char *predicate, *set;
+	double ns_min, ns_median;
+	double stage[TRISTAGES];	/* 各阶段判定的调用比例 */
+	double zeros;			/* 结果恰好为 0 的比例 */
+};
+
+static void fill_points(const struct predicate *pr, const struct point_set *ps,
+		double *points, int calls)
+{
+	unsigned long long state = BENCH_SEED;
+	double x, y, h;
+	double *p = points;
+
+	for (int i = 0; i < calls * pr->points; i++) {
+		ps->point(&state, &x, &y, &h);
+		*p++ = x;
+		*p++ = y;
+		if (pr->dim == 3)
+			*p++ = h;
+	}
+}
+
+static int compare_double(const void *p, const void *q)
+{
+	double x = *(const double *)p, y = *(const double *)q;
+	return (x > y) - (x < y);
+}
+
+static void run_case(struct bench_result *res, const struct predicate *pr,
+		double *points, double *results, int calls, int reps)
+{
+	long stages[TRISTAGES] = { 0 };
+	double *samples;
+	long zeros = 0;
+
+	/* 第一遍统计阶段, 同时作为预热 */
+	tripredicates(pr->kind, calls, points, results, stages);
+	for (int i = 0; i < calls; i++)
+		zeros += results[i] == 0.0;
+	for (int s = 0; s < TRISTAGES; s++)
+		res->stage[s] = (double)stages[s] / calls;
+	res->zeros = (double)zeros / calls;
+
+	make_vector(samples, reps);
+	for (int r = 0; r < reps; r++) {
+		double t0 = wall_time();
+		tripredicates(pr->kind, calls, points, results, NULL);
+		samples[r] = (wall_time() - t0) * 1e9 / calls;
+	}
+	qsort(samples, reps, sizeof *samples, compare_double);
+	res->ns_min = samples[0];
+	res->ns_median = reps % 2 ? samples[reps/2] : 0.5 * (samples[reps/2-1] + samples[reps/2]);
+	free_vector(samples);
+}
+
+static void write_csv(FILE *fp, const struct bench_result *res, int count, int calls)
+{
+	fprintf(fp, "predicate,set,calls,ns_min,ns_median,filter,stage_b,stage_c,"
+			"stage_d,zeros\n");
+	for (int k = 0; k < count; k++)
+		fprintf(fp, "%s,%s,%d,%.3f,%.3f,%.6f,%.6f,%.6f,%.6f,%.6f\n",
+				res[k].predicate, res[k].set, calls,
+				res[k].ns_min, res[k].ns_median, res[k].stage[0],
+				res[k].stage[1], res[k].stage[2], res[k].stage[3],
+				res[k].zeros);
+}
+
+static void show_usage(char *progname)
+{
+	printf("Usage: %s [csv-file] [calls] [reps]\n", progname);
+	printf("  calls: 每组的调用次数(缺省 100000), reps: 计时的重复次数(缺省 5)\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_result res[PREDICATE_NUM * SET_NUM];
+	int calls = 100000, reps = 5, count = 0;
+	double *points, *results;
+	FILE *fp;
+
+	if (argc > 4)
+		show_usage(argv[0]);
+	if (argc > 2)
+		calls = atoi(argv[2]);
+	if (argc > 3)
+		reps = atoi(argv[3]);
+	if (calls <= 0 || reps <= 0)
+		show_usage(argv[0]);
+
+	make_vector(points, (size_t)calls * 12);
+	make_vector(results, calls);
+	printf("%-9s %-15s %9s %9s %8s %8s %8s %8s %8s\n", "predicate", "set",
+			"min(ns)", "med(ns)", "filter", "B", "C", "D", "zero");
+
+	for (int k = 0; k < PREDICATE_NUM; k++) {
+		for (int s = 0; s < SET_NUM; s++) {
+			struct bench_result *r = &res[count++];
+			r->predicate = predicates[k].name;
+			r->set = sets[s].name;
+			fill_points(&predicates[k], &sets[s], points, calls);
+			run_case(r, &predicates[k], points, results, calls, reps);
+			printf("%-9s %-15s %9.2f %9.2f %7.3f%% %7.3f%% %7.3f%% %7.3f%% %7.3f%%\n",
+					r->predicate, r->set, r->ns_min, r->ns_median,
+					100*r->stage[0], 100*r->stage[1], 100*r->stage[2],
+					100*r->stage[3], 100*r->zeros);
+			fflush(stdout);
+		}
+	}
+	free_vector(points);
+	free_vector(results);
+
+	if (argc > 1) {
+		if ((fp = fopen(argv[1], "w")) == NULL) {
+			fprintf(stderr, "cannot open file %s for writing\n", argv[1]);
+			return 1;
+		}
+		write_csv(fp, res, count, calls);
+		fclose(fp);
+		fprintf(stderr, "结果已经写入到 %s 文件\n", argv[1]);
+	}
+	return 0;
+}
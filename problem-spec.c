@@ -134,7 +134,12 @@ struct problem_spec *annulus(int n)
     spec->num_points = 2*n;
     spec->num_segments = 2*n;
     spec->num_holes = 1;
+    spec->regions = NULL;
+    spec->num_regions = 0;
     spec->f = spec->u_exact = spec->g = spec->h = spec->eta = NULL;
+    spec->f_batch = spec->u_exact_batch = spec->g_batch = NULL;
+    spec->h_batch = spec->eta_batch = NULL;
+    spec->ctx = NULL;
     printf("环形区域(%d角形), 内部半径%g, 外部半径%g\n", n, a, b);
     return spec;
 }
@@ -145,7 +150,7 @@ void free_annulus(struct problem_spec *spec)
         free_vector(spec->points);
         free_vector(spec->segments);
         free_vector(spec->holes);
-        free(spec);
+        xfree(spec);
     }
 }
 
@@ -208,6 +213,71 @@ void free_three_holes(struct problem_spec *spec)
         free_vector(spec->points);
         free_vector(spec->segments);
         free_vector(spec->holes);
-        free(spec);
+        xfree(spec);
     }
 }
+
+/*
+ * 释放从文件读入的问题规格
+ *  points, segments, holes, regions 都由 make_vector 分配, 后两者可以为 NULL
+ */
+void free_problem_spec(struct problem_spec *spec)
+{
+    if(spec != NULL){
+        free_vector(spec->points);
+        free_vector(spec->segments);
+        free_vector(spec->holes);
+        free_vector(spec->regions);
+        xfree(spec);
+    }
+}
+
+/*
+ * 批量计算的公共部分
+ *  batch 非空时直接调用批量回调；否则 scalar 非空时逐点计算；
+ *  两者都为空时整个输出填充为默认值 dflt
+ */
+static void eval_batch(
+        void (*batch)(const double *, const double *, double *, int, void *),
+        double (*scalar)(double, double), double dflt, void *ctx,
+        const double *x, const double *y, double *out, int n)
+{
+    if (batch != NULL)
+        batch(x, y, out, n, ctx);
+    else if (scalar != NULL)
+        for (int i = 0; i < n; i++)
+            out[i] = scalar(x[i], y[i]);
+    else
+        for (int i = 0; i < n; i++)
+            out[i] = dflt;
+}
+
+void problem_spec_eval_f(const struct problem_spec *spec,
+        const double *x, const double *y, double *out, int n)
+{
+    eval_batch(spec->f_batch, spec->f, 0.0, spec->ctx, x, y, out, n);
+}
+
+void problem_spec_eval_u_exact(const struct problem_spec *spec,
+        const double *x, const double *y, double *out, int n)
+{
+    eval_batch(spec->u_exact_batch, spec->u_exact, 0.0, spec->ctx, x, y, out, n);
+}
+
+void problem_spec_eval_g(const struct problem_spec *spec,
+        const double *x, const double *y, double *out, int n)
+{
+    eval_batch(spec->g_batch, spec->g, 0.0, spec->ctx, x, y, out, n);
+}
+
+void problem_spec_eval_h(const struct problem_spec *spec,
+        const double *x, const double *y, double *out, int n)
+{
+    eval_batch(spec->h_batch, spec->h, 0.0, spec->ctx, x, y, out, n);
+}
+
+void problem_spec_eval_eta(const struct problem_spec *spec,
+        const double *x, const double *y, double *out, int n)
+{
+    eval_batch(spec->eta_batch, spec->eta, 1.0, spec->ctx, x, y, out, n);
+}
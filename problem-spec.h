@@ -49,6 +49,18 @@ struct problem_spec_hole
     double y; // 洞中点y坐标
 };
 
+/*
+ * 问题规格区域
+ *  通过区域中任意一个点的坐标来标识区域, 同 Triangle 的 .poly 文件
+ */
+struct problem_spec_region
+{
+    double x;         // 区域中点x坐标
+    double y;         // 区域中点y坐标
+    double attribute; // 区域属性
+    double max_area;  // 区域中单元面积上限(<= 0 表示不限制)
+};
+
 // 问题规格
 struct problem_spec
 {
@@ -58,12 +70,27 @@ struct problem_spec
     int num_points;                        // 点的数量
     int num_segments;                      // 线段的数量
     int num_holes;                         // 洞的数量(如果没有洞 num_holes = 0)
+    struct problem_spec_region *regions;   // 区域 (如果没有区域 regions = NULL)
+    int num_regions;                       // 区域的数量
 
     double (*f)(double x, double y);       // 二阶PDE右端项
     double (*u_exact)(double x, double y); // 精确解
     double (*g)(double x, double y);       // 狄利克雷边界条件的右端项
     double (*h)(double x, double y);       // 纽曼边界条件的右端项
     double (*eta)(double x, double y);     // 纽曼边界条件的函数
+
+    /*
+     * 批量回调(可选)
+     *  一次计算 n 个点 (x[i], y[i]) 上的函数值，结果写入 out[i]
+     *  ctx 为用户上下文指针，原样传给批量回调
+     *  若某个批量回调为 NULL，则自动退回到对应的单点回调
+     */
+    void (*f_batch)(const double *x, const double *y, double *out, int n, void *ctx);
+    void (*u_exact_batch)(const double *x, const double *y, double *out, int n, void *ctx);
+    void (*g_batch)(const double *x, const double *y, double *out, int n, void *ctx);
+    void (*h_batch)(const double *x, const double *y, double *out, int n, void *ctx);
+    void (*eta_batch)(const double *x, const double *y, double *out, int n, void *ctx);
+    void *ctx;                             // 批量回调的用户上下文
 };
 
 struct problem_spec *triangle_with_hole(void);
@@ -73,5 +100,23 @@ struct problem_spec *square(void);
 void free_square(struct problem_spec *spec);
 struct problem_spec *three_holes(int n);
 void free_three_holes(struct problem_spec *spec);
+void free_problem_spec(struct problem_spec *spec);
+struct problem_spec *problem_spec_from_poly(char *path);
+
+/*
+ * 在 n 个点上批量计算系数函数
+ *  优先调用批量回调，否则逐点调用单点回调
+ *  两者都为 NULL 时取默认值: f, g, h, u_exact 为 0, eta 为 1
+ */
+void problem_spec_eval_f(const struct problem_spec *spec,
+        const double *x, const double *y, double *out, int n);
+void problem_spec_eval_u_exact(const struct problem_spec *spec,
+        const double *x, const double *y, double *out, int n);
+void problem_spec_eval_g(const struct problem_spec *spec,
+        const double *x, const double *y, double *out, int n);
+void problem_spec_eval_h(const struct problem_spec *spec,
+        const double *x, const double *y, double *out, int n);
+void problem_spec_eval_eta(const struct problem_spec *spec,
+        const double *x, const double *y, double *out, int n);
 
 #endif
\ No newline at end of file
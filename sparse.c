@@ -0,0 +1,60 @@
+/**
+ * @file sparse.c
+ * @brief 压缩行存储(CSR)稀疏矩阵的基本操作
+*/
+#include <stdlib.h>
+#include "xmalloc.h"
+#include "myarray.h"
+#include "sparse.h"
+
+/**
+ * @name make_csr_matrix - 分配 CSR 矩阵
+ * @param 1.n 行数 2.nnz 非零元个数
+ * @return 矩阵, rowptr/colind/val 已分配但未初始化
+*/
+struct csr_matrix *make_csr_matrix(int n, int nnz)
+{
+	struct csr_matrix *A = xmalloc(sizeof *A);
+
+	A->n = n;
+	A->nnz = nnz;
+	make_vector(A->rowptr, n + 1);
+	make_vector(A->colind, nnz);
+	make_vector(A->val, nnz);
+	return A;
+}
+
+void free_csr_matrix(struct csr_matrix *A)
+{
+	if (A == NULL)
+		return;
+
+	free_vector(A->rowptr);
+	free_vector(A->colind);
+	free_vector(A->val);
+	xfree(A);
+}
+
+/**
+ * @name csr_find - 查找 (i,j) 元在 colind/val 中的位置
+ * @return 位置下标, 若 (i,j) 不在稀疏结构中则返回 -1
+ * @note 每行只有几个非零元, 所以直接顺序查找
+*/
+int csr_find(const struct csr_matrix *A, int i, int j)
+{
+	for (int p = A->rowptr[i]; p < A->rowptr[i+1]; p++)
+		if (A->colind[p] == j)
+			return p;
+	return -1;
+}
+
+/* y = A x */
+void csr_matvec(const struct csr_matrix *A, const double *x, double *y)
+{
+	for (int i = 0; i < A->n; i++) {
+		double s = 0.0;
+		for (int p = A->rowptr[i]; p < A->rowptr[i+1]; p++)
+			s += A->val[p] * x[A->colind[p]];
+		y[i] = s;
+	}
+}
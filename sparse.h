@@ -0,0 +1,22 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+/*
+ * 压缩行存储(CSR)的稀疏方阵
+ *  第 i 行的非零元位于 colind/val 的 [rowptr[i], rowptr[i+1]) 区间,
+ *  每一行内列号按升序排列
+ */
+struct csr_matrix{
+    int n;          // 行数(也是列数)
+    int nnz;        // 非零元个数
+    int *rowptr;    // 行起始位置, 长度 n+1
+    int *colind;    // 列号, 长度 nnz
+    double *val;    // 非零元的值, 长度 nnz
+};
+
+struct csr_matrix *make_csr_matrix(int n, int nnz);
+void free_csr_matrix(struct csr_matrix *A);
+int csr_find(const struct csr_matrix *A, int i, int j);
+void csr_matvec(const struct csr_matrix *A, const double *x, double *y);
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+// 单调时钟的当前时间(秒), 用于计算时间间隔
+double wall_time(void);
+
+#endif
@@ -0,0 +1,206 @@
+/**
+ * @file trace.c
+ * @brief Chrome/Perfetto 格式的时间线跟踪, 见 trace.h
+ * @details
+ *  每个线程第一次记录事件时领取一个环形缓冲区, 之后只有它自己写这个缓冲区,
+ *  写完一个事件再用 release 语义推进 head, 记录事件不需要加锁.
+ *  缓冲区挂在一个只增不减的全局链表上; 线程退出时(pthread 键的析构函数)
+ *  只把缓冲区标记为空闲, 留给以后的线程(比如下一次 parallel_for 的工作线程)
+ *  继续使用, 已记录的事件保留到写出为止. 缓冲区的编号就是时间线上的 tid.
+ *
+ *  trace_flush 读取 head 之后逐个复制事件, 复制完再检查 head:
+ *  如果写入者在此期间已经绕回覆盖了这个位置, 就丢弃这个事件.
+ *  不用 -DMESH_TRACE 编译时本文件为空.
+*/
+#include "trace.h"
+
+#ifdef MESH_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "timer.h"
+
+#define TRACE_CAPACITY	16384	/* 每个缓冲区的事件数, 必须是 2 的幂 */
+
+struct trace_event{
+	const char *name;
+	double ts;		/* wall_time(), 秒 */
+	double dur;		/* 只用于 'X' 事件 */
+	char ph;		/* 'B', 'E' 或 'X' */
+};
+
+struct trace_buffer{
+	struct trace_buffer *next;
+	int id;
+	atomic_int busy;		/* 是否有线程正在使用 */
+	atomic_ulong head;		/* 写入过的事件总数 */
+	unsigned long tail;		/* 已经写出的事件总数, 只由 trace_flush 修改 */
+	struct trace_event events[TRACE_CAPACITY];
+};
+
+static struct trace_buffer *_Atomic buffers;
+static atomic_int buffer_num;
+static _Thread_local struct trace_buffer *local;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t key;
+static char *trace_path;	/* NULL 表示不记录 */
+static double epoch;
+
+static void release_buffer(void *p)
+{
+	struct trace_buffer *buf = p;
+
+	atomic_store(&buf->busy, 0);
+}
+
+static void flush_at_exit(void)
+{
+	trace_flush(trace_path);
+}
+
+static void trace_init(void)
+{
+	char *s = getenv("TRI_TRACE");
+
+	if (s == NULL || *s == '\0')
+		return;
+	if (pthread_key_create(&key, release_buffer) != 0)
+		return;
+	epoch = wall_time();
+	trace_path = s;
+	atexit(flush_at_exit);
+}
+
+int trace_enabled(void)
+{
+	pthread_once(&once, trace_init);
+	return trace_path != NULL;
+}
+
+static struct trace_buffer *get_buffer(void)
+{
+	struct trace_buffer *buf;
+
+	if (local != NULL)
+		return local;
+	for (buf = atomic_load(&buffers); buf != NULL; buf = buf->next)
+		if (atomic_exchange(&buf->busy, 1) == 0)
+			break;
+	if (buf == NULL) {
+		/* 不经过 xmalloc: 缓冲区的寿命比调用者安装的分配器长 */
+		if ((buf = malloc(sizeof *buf)) == NULL) {
+			fprintf(stderr, "%s:%d: malloc(%zu) failed\n",
+					__FILE__, __LINE__, sizeof *buf);
+			exit(EXIT_FAILURE);
+		}
+		buf->id = atomic_fetch_add(&buffer_num, 1);
+		atomic_init(&buf->busy, 1);
+		atomic_init(&buf->head, 0);
+		buf->tail = 0;
+		buf->next = atomic_load(&buffers);
+		while (!atomic_compare_exchange_weak(&buffers, &buf->next, buf))
+			;
+	}
+	pthread_setspecific(key, buf);
+	local = buf;
+	return buf;
+}
+
+static void record(const char *name, char ph, double ts, double dur)
+{
+	struct trace_buffer *buf = get_buffer();
+	unsigned long h = atomic_load_explicit(&buf->head, memory_order_relaxed);
+	struct trace_event *e = &buf->events[h & (TRACE_CAPACITY - 1)];
+
+	e->name = name;
+	e->ts = ts;
+	e->dur = dur;
+	e->ph = ph;
+	atomic_store_explicit(&buf->head, h + 1, memory_order_release);
+}
+
+void trace_begin(const char *name)
+{
+	if (trace_enabled())
+		record(name, 'B', wall_time(), 0.0);
+}
+
+void trace_end(const char *name)
+{
+	if (trace_enabled())
+		record(name, 'E', wall_time(), 0.0);
+}
+
+void trace_complete(const char *name, double begin, double end)
+{
+	if (trace_enabled())
+		record(name, 'X', begin, end - begin);
+}
+
+static void write_events(FILE *fp, struct trace_buffer *buf, int pid, int *first)
+{
+	unsigned long h = atomic_load_explicit(&buf->head, memory_order_acquire);
+	unsigned long i = buf->tail;
+
+	/* 写者在发布 head + 1 之前就写下标 head 的槽, 它与下标 head - TRACE_CAPACITY
+	   是同一个槽, 所以只有 head - i < TRACE_CAPACITY 的事件是完整的 */
+	if (h - i >= TRACE_CAPACITY)
+		i = h - TRACE_CAPACITY + 1;	/* 更早的已经被覆盖或正在被覆盖 */
+	for (; i < h; i++) {
+		struct trace_event e = buf->events[i & (TRACE_CAPACITY - 1)];
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&buf->head, memory_order_relaxed) - i >= TRACE_CAPACITY)
+			continue;	/* 复制的时候被覆盖了 */
+		fprintf(fp, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,"
+				"\"ts\":%.3f", *first ? "" : ",", e.name, e.ph, pid, buf->id,
+				(e.ts - epoch) * 1e6);
+		if (e.ph == 'X')
+			fprintf(fp, ",\"dur\":%.3f", e.dur * 1e6);
+		fprintf(fp, "}");
+		*first = 0;
+	}
+	buf->tail = h;
+}
+
+/**
+ * @name trace_flush - 把还没有写出的事件写到文件
+ * @param 1.path 输出文件名, NULL 时用 TRI_TRACE
+ * @return 成功返回 0, 不能写文件返回 -1; 没有开启跟踪时什么也不做
+ * @note 写出的事件从缓冲区中清除, 再次调用只写出之后的事件
+*/
+int trace_flush(const char *path)
+{
+	struct trace_buffer *buf;
+	FILE *fp;
+	int pid = (int)getpid(), first = 1;
+
+	if (!trace_enabled())
+		return 0;
+	if (path == NULL)
+		path = trace_path;
+	pthread_mutex_lock(&flush_lock);
+	if ((fp = fopen(path, "w")) == NULL) {
+		pthread_mutex_unlock(&flush_lock);
+		fprintf(stderr, "cannot open file %s for writing\n", path);
+		return -1;
+	}
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	for (buf = atomic_load(&buffers); buf != NULL; buf = buf->next) {
+		fprintf(fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+				"\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+				first ? "" : ",", pid, buf->id, buf->id);
+		first = 0;
+		write_events(fp, buf, pid, &first);
+	}
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+	pthread_mutex_unlock(&flush_lock);
+	fprintf(stderr, "跟踪结果已经写入到 %s 文件\n", path);
+	return 0;
+}
+
+#endif /* MESH_TRACE */
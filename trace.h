@@ -0,0 +1,59 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Chrome/Perfetto 格式的时间线跟踪
+ *  用 -DMESH_TRACE 编译才会记录, 否则下面的宏全部展开为空, 不产生任何代码.
+ *  运行时还需要设置环境变量 TRI_TRACE=<文件名>: 每个线程把事件写入自己的
+ *  环形缓冲区(满了覆盖最旧的事件), 程序退出时写到该文件, 也可以随时用
+ *  TRACE_FLUSH(path) 写出. 生成的 JSON 可以用 chrome://tracing 或
+ *  ui.perfetto.dev 打开.
+ *
+ *  TRACE_BEGIN(name) / TRACE_END(name)   开始 / 结束一个区间, 必须成对
+ *  TRACE_SCOPE(name)                     到所在的代码块结束为止的区间
+ *  TRACE_COMPLETE(name, begin, end)      已经结束的区间, 时间取 wall_time()
+ *  name 必须是字符串常量(只保存指针)
+ */
+#ifdef MESH_TRACE
+
+int trace_enabled(void);
+void trace_begin(const char *name);
+void trace_end(const char *name);
+void trace_complete(const char *name, double begin, double end);
+int trace_flush(const char *path);
+
+static inline const char *trace_scope_begin(const char *name)
+{
+	trace_begin(name);
+	return name;
+}
+
+static inline void trace_scope_end(const char **name)
+{
+	trace_end(*name);
+}
+
+#define TRACE_CONCAT_(a, b)	a##b
+#define TRACE_CONCAT(a, b)	TRACE_CONCAT_(a, b)
+
+#define TRACE_ENABLED()		trace_enabled()
+#define TRACE_BEGIN(name)	trace_begin(name)
+#define TRACE_END(name)		trace_end(name)
+#define TRACE_COMPLETE(name, begin, end)	trace_complete(name, begin, end)
+#define TRACE_FLUSH(path)	trace_flush(path)
+#define TRACE_SCOPE(name) \
+	const char *TRACE_CONCAT(trace_scope_, __LINE__) \
+		__attribute__((cleanup(trace_scope_end))) = trace_scope_begin(name)
+
+#else
+
+#define TRACE_ENABLED()		0
+#define TRACE_BEGIN(name)	((void)0)
+#define TRACE_END(name)		((void)0)
+#define TRACE_COMPLETE(name, begin, end)	((void)0)
+#define TRACE_FLUSH(path)	0
+#define TRACE_SCOPE(name)	((void)0)
+
+#endif /* MESH_TRACE */
+
+#endif
@@ -355,6 +355,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
+#include <pthread.h>
 #ifndef NO_TIMER
 #include <sys/time.h>
 #endif /* not NO_TIMER */
@@ -366,6 +368,8 @@
 #endif /* LINUX */
 #ifdef TRILIBRARY
 #include "triangle.h"
+#include "trace.h"
+#include "xmalloc.h"
 #endif /* TRILIBRARY */
 
 /* A few forward declarations.                                               */
@@ -659,9 +663,17 @@ REAL ccwerrboundA, ccwerrboundB, ccwerrboundC;
 REAL iccerrboundA, iccerrboundB, iccerrboundC;
 REAL o3derrboundA, o3derrboundB, o3derrboundC;
 
-/* Random number seed is not constant, but I've made it global anyway.       */
+/* Random number seed is not constant, but I've made it global anyway.  It  */
+/*   is thread-local so that concurrent calls to triangulate() (one mesh per */
+/*   thread) do not race on it.                                              */
 
-unsigned long randomseed;                     /* Current random number seed. */
+_Thread_local unsigned long randomseed;       /* Current random number seed. */
+
+/* The stage at which the last call to an adaptive predicate on this thread */
+/*   was decided:  1, 2, or 3 for Shewchuk's stages B, C, and D.  Read only */
+/*   by tripredicates(); the meshing code never looks at it.                */
+
+_Thread_local int adaptstage;
 
 
 /* Mesh data structure.  Triangle operates on only one mesh, but the mesh    */
@@ -726,6 +738,12 @@ struct mesh {
   long hyperbolacount;      /* Number of right-of-hyperbola tests performed. */
   long circumcentercount;  /* Number of circumcenter calculations performed. */
   long circletopcount;       /* Number of circle top calculations performed. */
+  long counterclockexactcount;            /* Orientation tests done exactly. */
+  long incircleexactcount;       /* Incircle tests done in exact arithmetic. */
+  long orient3dexactcount;             /* 3D orientation tests done exactly. */
+  long locatecount;                   /* Number of calls to preciselocate(). */
+  long locatesteps;                 /* Triangles visited by preciselocate(). */
+  long maxlocatesteps;               /* Longest walk of one preciselocate(). */
 
 /* Triangular bounding box vertices.                                         */
 
@@ -823,6 +841,29 @@ struct behavior {
   char offfilename[FILENAMESIZE];
 #endif /* not TRILIBRARY */
 
+/* Streaming output sinks, from triangulatestream(); NULL for triangulate(). */
+
+#ifdef TRILIBRARY
+  struct tristream *stream;
+#endif /* TRILIBRARY */
+
+/* Phase timings, from `stream'; NULL when not wanted.                       */
+/*   laststamp: monotonic time of the previous call to tristamp().           */
+
+#ifdef TRILIBRARY
+  struct tritimings *timings;
+  REAL laststamp;
+#endif /* TRILIBRARY */
+
+/* Refinement budget, from `stream'.                                         */
+/*   deadline: monotonic time at which refinement stops, if timelimit > 0.   */
+/*   budgetcount: refinement steps taken, for checkbudget().                 */
+
+#ifdef TRILIBRARY
+  REAL deadline;
+  long budgetcount;
+#endif /* TRILIBRARY */
+
 };                                              /* End of `struct behavior'. */
 
 
@@ -1418,6 +1459,11 @@ REAL area;                                      /* The area of the triangle. */
 /**                                                                         **/
 /**                                                                         **/
 
+/*  When Triangle is compiled as a library, triexit() returns control to the */
+/*  innermost recovery point (see xmalloc.h) if there is one.  The one set   */
+/*  by triangulatestream() frees everything Triangle allocated and returns   */
+/*  `status' to the caller, instead of ending the process.                   */
+
 #ifdef ANSI_DECLARATORS
 void triexit(int status)
 #else /* not ANSI_DECLARATORS */
@@ -1426,20 +1472,35 @@ int status;
 #endif /* not ANSI_DECLARATORS */
 
 {
+#ifdef TRILIBRARY
+  fail_or_exit(status);
+#else /* not TRILIBRARY */
   exit(status);
+#endif /* not TRILIBRARY */
 }
 
+/*  trimallocsite() allocates through the calling thread's allocator (see   */
+/*  xmalloc.h) when Triangle is compiled as a library, passing on the source */
+/*  line of the call for memory accounting.  Below, trimalloc() becomes a    */
+/*  macro that supplies that line.                                           */
+
 #ifdef ANSI_DECLARATORS
-VOID *trimalloc(int size)
+VOID *trimallocsite(int size, char *file, int line)
 #else /* not ANSI_DECLARATORS */
-VOID *trimalloc(size)
+VOID *trimallocsite(size, file, line)
 int size;
+char *file;
+int line;
 #endif /* not ANSI_DECLARATORS */
 
 {
   VOID *memptr;
 
+#ifdef TRILIBRARY
+  memptr = (VOID *) malloc_or_null((unsigned int) size, file, line);
+#else /* not TRILIBRARY */
   memptr = (VOID *) malloc((unsigned int) size);
+#endif /* not TRILIBRARY */
   if (memptr == (VOID *) NULL) {
     printf("Error:  Out of memory.\n");
     triexit(1);
@@ -1447,6 +1508,19 @@ int size;
   return(memptr);
 }
 
+#ifdef ANSI_DECLARATORS
+VOID *trimalloc(int size)
+#else /* not ANSI_DECLARATORS */
+VOID *trimalloc(size)
+int size;
+#endif /* not ANSI_DECLARATORS */
+
+{
+  return trimallocsite(size, __FILE__, __LINE__);
+}
+
+#define trimalloc(size) trimallocsite(size, __FILE__, __LINE__)
+
 #ifdef ANSI_DECLARATORS
 void trifree(VOID *memptr)
 #else /* not ANSI_DECLARATORS */
@@ -1455,9 +1529,60 @@ VOID *memptr;
 #endif /* not ANSI_DECLARATORS */
 
 {
+#ifdef TRILIBRARY
+  xfree(memptr);
+#else /* not TRILIBRARY */
   free(memptr);
+#endif /* not TRILIBRARY */
 }
 
+#ifdef TRILIBRARY
+
+/* The address of one phase of the timings, or NULL without timings.         */
+
+#define triphase(b, phase)                                                    \
+  ((b)->timings == (struct tritimings *) NULL ? (REAL *) NULL :               \
+   &(b)->timings->phase)
+
+/*****************************************************************************/
+/*                                                                           */
+/*  tristamp()   Add the time since the previous stamp to `phase' (unless    */
+/*               `phase' is NULL), reading the monotonic clock, and record   */
+/*               the interval as a trace span called `name' (unless `name'   */
+/*               is NULL) when built with MESH_TRACE.  Does nothing if       */
+/*               neither phase timings nor tracing were asked for.           */
+/*                                                                           */
+/*****************************************************************************/
+
+#ifdef ANSI_DECLARATORS
+void tristamp(struct behavior *b, REAL *phase, char *name)
+#else /* not ANSI_DECLARATORS */
+void tristamp(b, phase, name)
+struct behavior *b;
+REAL *phase;
+char *name;
+#endif /* not ANSI_DECLARATORS */
+
+{
+  struct timespec now;
+  REAL t;
+
+  if ((b->timings == (struct tritimings *) NULL) && !TRACE_ENABLED()) {
+    return;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  t = (REAL) now.tv_sec + 1e-9 * (REAL) now.tv_nsec;
+  if (phase != (REAL *) NULL) {
+    *phase += t - b->laststamp;
+  }
+  if (name != (char *) NULL) {
+    TRACE_COMPLETE(name, b->laststamp, t);
+  }
+  b->laststamp = t;
+}
+
+#endif /* TRILIBRARY */
+
 /**                                                                         **/
 /**                                                                         **/
 /********* Memory allocation and program exit wrappers end here      *********/
@@ -4892,34 +5017,20 @@ struct osub *newsubseg;
 /*                                                                           */
 /*  Don't change this routine unless you fully understand it.                */
 /*                                                                           */
+/*  The constants are computed only once, through pthread_once(), so that    */
+/*  concurrent calls to triangulate() do not all write the same globals.     */
+/*  The FPU control word belongs to the calling thread, so it is still set   */
+/*  on every call.                                                           */
+/*                                                                           */
 /*****************************************************************************/
 
-void exactinit()
+static pthread_once_t exactonce = PTHREAD_ONCE_INIT;
+
+static void exactconstants(void)
 {
   REAL half;
   REAL check, lastcheck;
   int every_other;
-#ifdef LINUX
-  int cword;
-#endif /* LINUX */
-
-#ifdef CPU86
-#ifdef SINGLE
-  _control87(_PC_24, _MCW_PC); /* Set FPU control word for single precision. */
-#else /* not SINGLE */
-  _control87(_PC_53, _MCW_PC); /* Set FPU control word for double precision. */
-#endif /* not SINGLE */
-#endif /* CPU86 */
-#ifdef LINUX
-#ifdef SINGLE
-  /*  cword = 4223; */
-  cword = 4210;                 /* set FPU control word for single precision */
-#else /* not SINGLE */
-  /*  cword = 4735; */
-  cword = 4722;                 /* set FPU control word for double precision */
-#endif /* not SINGLE */
-  _FPU_SETCW(cword);
-#endif /* LINUX */
 
   every_other = 1;
   half = 0.5;
@@ -4953,6 +5064,33 @@ void exactinit()
   o3derrboundC = (26.0 + 288.0 * epsilon) * epsilon * epsilon;
 }
 
+void exactinit()
+{
+#ifdef LINUX
+  int cword;
+#endif /* LINUX */
+
+#ifdef CPU86
+#ifdef SINGLE
+  _control87(_PC_24, _MCW_PC); /* Set FPU control word for single precision. */
+#else /* not SINGLE */
+  _control87(_PC_53, _MCW_PC); /* Set FPU control word for double precision. */
+#endif /* not SINGLE */
+#endif /* CPU86 */
+#ifdef LINUX
+#ifdef SINGLE
+  /*  cword = 4223; */
+  cword = 4210;                 /* set FPU control word for single precision */
+#else /* not SINGLE */
+  /*  cword = 4735; */
+  cword = 4722;                 /* set FPU control word for double precision */
+#endif /* not SINGLE */
+  _FPU_SETCW(cword);
+#endif /* LINUX */
+
+  pthread_once(&exactonce, exactconstants);
+}
+
 /*****************************************************************************/
 /*                                                                           */
 /*  fast_expansion_sum_zeroelim()   Sum two expansions, eliminating zero     */
@@ -5204,6 +5342,7 @@ REAL detsum;
   det = estimate(4, B);
   errbound = ccwerrboundB * detsum;
   if ((det >= errbound) || (-det >= errbound)) {
+    adaptstage = 1;
     return det;
   }
 
@@ -5214,6 +5353,7 @@ REAL detsum;
 
   if ((acxtail == 0.0) && (acytail == 0.0)
       && (bcxtail == 0.0) && (bcytail == 0.0)) {
+    adaptstage = 1;
     return det;
   }
 
@@ -5221,6 +5361,7 @@ REAL detsum;
   det += (acx * bcytail + bcy * acxtail)
        - (acy * bcxtail + bcx * acytail);
   if ((det >= errbound) || (-det >= errbound)) {
+    adaptstage = 2;
     return det;
   }
 
@@ -5242,6 +5383,7 @@ REAL detsum;
   u[3] = u3;
   Dlength = fast_expansion_sum_zeroelim(C2length, C2, 4, u, D);
 
+  adaptstage = 3;
   return(D[Dlength - 1]);
 }
 
@@ -5292,6 +5434,7 @@ vertex pc;
     return det;
   }
 
+  m->counterclockexactcount++;
   return counterclockwiseadapt(pa, pb, pc, detsum);
 }
 
@@ -5430,6 +5573,7 @@ REAL permanent;
   det = estimate(finlength, fin1);
   errbound = iccerrboundB * permanent;
   if ((det >= errbound) || (-det >= errbound)) {
+    adaptstage = 1;
     return det;
   }
 
@@ -5441,6 +5585,7 @@ REAL permanent;
   Two_Diff_Tail(pc[1], pd[1], cdy, cdytail);
   if ((adxtail == 0.0) && (bdxtail == 0.0) && (cdxtail == 0.0)
       && (adytail == 0.0) && (bdytail == 0.0) && (cdytail == 0.0)) {
+    adaptstage = 1;
     return det;
   }
 
@@ -5455,6 +5600,7 @@ REAL permanent;
                                      - (ady * bdxtail + bdx * adytail))
           + 2.0 * (cdx * cdxtail + cdy * cdytail) * (adx * bdy - ady * bdx));
   if ((det >= errbound) || (-det >= errbound)) {
+    adaptstage = 2;
     return det;
   }
 
@@ -5890,6 +6036,7 @@ REAL permanent;
     }
   }
 
+  adaptstage = 3;
   return finnow[finlength - 1];
 }
 
@@ -5950,6 +6097,7 @@ vertex pd;
     return det;
   }
 
+  m->incircleexactcount++;
   return incircleadapt(pa, pb, pc, pd, permanent);
 }
 
@@ -6079,6 +6227,7 @@ REAL permanent;
   det = estimate(finlength, fin1);
   errbound = o3derrboundB * permanent;
   if ((det >= errbound) || (-det >= errbound)) {
+    adaptstage = 1;
     return det;
   }
 
@@ -6097,6 +6246,7 @@ REAL permanent;
       (adheighttail == 0.0) &&
       (bdheighttail == 0.0) &&
       (cdheighttail == 0.0)) {
+    adaptstage = 1;
     return det;
   }
 
@@ -6111,6 +6261,7 @@ REAL permanent;
                       (ady * bdxtail + bdx * adytail)) +
           cdheighttail * (adx * bdy - ady * bdx));
   if ((det >= errbound) || (-det >= errbound)) {
+    adaptstage = 2;
     return det;
   }
 
@@ -6397,6 +6548,7 @@ REAL permanent;
     finswap = finnow; finnow = finother; finother = finswap;
   }
 
+  adaptstage = 3;
   return finnow[finlength - 1];
 }
 
@@ -6461,6 +6613,7 @@ REAL dheight;
     return det;
   }
 
+  m->orient3dexactcount++;
   return orient3dadapt(pa, pb, pc, pd, aheight, bheight, cheight, dheight,
                        permanent);
 }
@@ -6510,6 +6663,74 @@ vertex pd;
   }
 }
 
+#ifdef TRILIBRARY
+
+/*****************************************************************************/
+/*                                                                           */
+/*  tripredicates()   Evaluate one of the geometric predicates on a batch    */
+/*                    of point sets, for testing and benchmarking.           */
+/*                                                                           */
+/*  `kind' is TRIORIENT2D, TRIINCIRCLE, or TRIORIENT3D.  Each of the `count' */
+/*  calls reads its points from `points':  three (x, y) pairs for            */
+/*  counterclockwise(), four (x, y) pairs for incircle(), and four           */
+/*  (x, y, height) triples for orient3d().  The determinants are written to  */
+/*  `results' if it is not NULL.  If `stages' is not NULL, stages[i] is      */
+/*  incremented for each call decided at stage i:  0 for the floating-point  */
+/*  filter, and 1, 2, 3 for the adaptive stages B, C, and D.  `stages' must  */
+/*  have TRISTAGES entries.                                                  */
+/*                                                                           */
+/*****************************************************************************/
+
+#ifdef ANSI_DECLARATORS
+void tripredicates(int kind, int count, REAL *points, REAL *results,
+                   long *stages)
+#else /* not ANSI_DECLARATORS */
+void tripredicates(kind, count, points, results, stages)
+int kind;
+int count;
+REAL *points;
+REAL *results;
+long *stages;
+#endif /* not ANSI_DECLARATORS */
+
+{
+  struct mesh m;
+  struct behavior b;
+  REAL *p;
+  REAL det;
+  int i;
+
+  exactinit();
+  m.counterclockcount = m.counterclockexactcount = 0l;
+  m.incirclecount = m.incircleexactcount = 0l;
+  m.orient3dcount = m.orient3dexactcount = 0l;
+  b.noexact = 0;
+
+  p = points;
+  for (i = 0; i < count; i++) {
+    adaptstage = 0;
+    if (kind == TRIORIENT2D) {
+      det = counterclockwise(&m, &b, p, &p[2], &p[4]);
+      p += 6;
+    } else if (kind == TRIINCIRCLE) {
+      det = incircle(&m, &b, p, &p[2], &p[4], &p[6]);
+      p += 8;
+    } else {
+      det = orient3d(&m, &b, p, &p[3], &p[6], &p[9],
+                     p[2], p[5], p[8], p[11]);
+      p += 12;
+    }
+    if (results != (REAL *) NULL) {
+      results[i] = det;
+    }
+    if (stages != (long *) NULL) {
+      stages[adaptstage]++;
+    }
+  }
+}
+
+#endif /* TRILIBRARY */
+
 /*****************************************************************************/
 /*                                                                           */
 /*  findcircumcenter()   Find the circumcenter of a triangle.                */
@@ -6662,6 +6883,9 @@ struct mesh *m;
   m->checkquality = 0;     /* The quality triangulation stage has not begun. */
   m->incirclecount = m->counterclockcount = m->orient3dcount = 0;
   m->hyperbolacount = m->circletopcount = m->circumcentercount = 0;
+  m->counterclockexactcount = m->incircleexactcount = 0;
+  m->orient3dexactcount = 0;
+  m->locatecount = m->locatesteps = m->maxlocatesteps = 0;
   randomseed = 1;
 
   exactinit();                     /* Initialize exact arithmetic constants. */
@@ -7519,6 +7743,7 @@ int stopatsubsegment;
   vertex forg, fdest, fapex;
   REAL orgorient, destorient;
   int moveleft;
+  long steps;
   triangle ptr;                         /* Temporary variable used by sym(). */
   subseg sptr;                      /* Temporary variable used by tspivot(). */
 
@@ -7526,11 +7751,17 @@ int stopatsubsegment;
     printf("  Searching for point (%.12g, %.12g).\n",
            searchpoint[0], searchpoint[1]);
   }
+  m->locatecount++;
+  steps = 0;
   /* Where are we? */
   org(*searchtri, forg);
   dest(*searchtri, fdest);
   apex(*searchtri, fapex);
   while (1) {
+    m->locatesteps++;
+    if (++steps > m->maxlocatesteps) {
+      m->maxlocatesteps = steps;
+    }
     if (b->verbose > 2) {
       printf("    At (%.12g, %.12g) (%.12g, %.12g) (%.12g, %.12g)\n",
              forg[0], forg[1], fdest[0], fdest[1], fapex[0], fapex[1]);
@@ -13227,6 +13458,53 @@ void precisionerror()
 
 #endif /* not CDT_ONLY */
 
+/*****************************************************************************/
+/*                                                                           */
+/*  checkbudget()   Called after each step of refinement.  Every             */
+/*                  TRIBUDGETSTEP steps, consult the progress callback and   */
+/*                  the clock.  If either says stop, use up the Steiner      */
+/*                  points, so that splitencsegs() and enforcequality()      */
+/*                  finish with the mesh as it is.                           */
+/*                                                                           */
+/*****************************************************************************/
+
+#ifdef TRILIBRARY
+#ifndef CDT_ONLY
+
+#ifdef ANSI_DECLARATORS
+void checkbudget(struct mesh *m, struct behavior *b)
+#else /* not ANSI_DECLARATORS */
+void checkbudget(m, b)
+struct mesh *m;
+struct behavior *b;
+#endif /* not ANSI_DECLARATORS */
+
+{
+  struct tristream *stream;
+  struct timespec now;
+
+  stream = b->stream;
+  if ((stream == (struct tristream *) NULL) ||
+      (++b->budgetcount % TRIBUDGETSTEP != 0)) {
+    return;
+  }
+  if ((stream->progress != NULL) &&
+      (stream->progress(stream->ctx, m->vertices.items - m->invertices,
+                        m->checkquality ? m->badtriangles.items : 0l) != 0)) {
+    m->steinerleft = 0;
+    return;
+  }
+  if (stream->timelimit > 0.0) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((REAL) now.tv_sec + 1e-9 * (REAL) now.tv_nsec >= b->deadline) {
+      m->steinerleft = 0;
+    }
+  }
+}
+
+#endif /* not CDT_ONLY */
+#endif /* TRILIBRARY */
+
 /*****************************************************************************/
 /*                                                                           */
 /*  splitencsegs()   Split all the encroached subsegments.                   */
@@ -13433,6 +13711,9 @@ int triflaws;
         if (m->steinerleft > 0) {
           m->steinerleft--;
         }
+#ifdef TRILIBRARY
+        checkbudget(m, b);
+#endif /* TRILIBRARY */
         /* Check the two new subsegments to see if they're encroached. */
         dummy = checkseg4encroach(m, b, &currentenc);
         snextself(currentenc);
@@ -13684,8 +13965,19 @@ struct behavior *b;
         /* Return the bad triangle to the pool. */
         pooldealloc(&m->badtriangles, (VOID *) badtri);
       }
+#ifdef TRILIBRARY
+      checkbudget(m, b);
+#endif /* TRILIBRARY */
     }
   }
+#ifdef TRILIBRARY
+  /* Note whether the budget or the -S switch cut the refinement short. */
+  if ((b->stream != (struct tristream *) NULL) && (m->steinerleft == 0) &&
+      ((m->badsubsegs.items > 0) ||
+       (m->checkquality && (m->badtriangles.items > 0)))) {
+    b->stream->stopped = 1;
+  }
+#endif /* TRILIBRARY */
   /* At this point, if the "-D" switch was selected and we haven't run out  */
   /*   of Steiner points, the triangulation should be (conforming) Delaunay */
   /*   and have no low-quality triangles.                                   */
@@ -14365,6 +14657,8 @@ char **argv;
   int *pmlist;
   int coordindex;
   int attribindex;
+  int streaming;
+  int chunkfirst;
 #else /* not TRILIBRARY */
   FILE *outfile;
 #endif /* not TRILIBRARY */
@@ -14383,24 +14677,43 @@ char **argv;
   if (!b->quiet) {
     printf("Writing vertices.\n");
   }
-  /* Allocate memory for output vertices if necessary. */
-  if (*pointlist == (REAL *) NULL) {
-    *pointlist = (REAL *) trimalloc((int) (outvertices * 2 * sizeof(REAL)));
-  }
-  /* Allocate memory for output vertex attributes if necessary. */
-  if ((m->nextras > 0) && (*pointattriblist == (REAL *) NULL)) {
-    *pointattriblist = (REAL *) trimalloc((int) (outvertices * m->nextras *
-                                                 sizeof(REAL)));
-  }
-  /* Allocate memory for output vertex markers if necessary. */
-  if (!b->nobound && (*pointmarkerlist == (int *) NULL)) {
-    *pointmarkerlist = (int *) trimalloc((int) (outvertices * sizeof(int)));
+  /* When streaming, private arrays hold one chunk and are handed to the  */
+  /*   sink whenever they fill up; the caller's arrays are not touched.    */
+  streaming = (b->stream != (struct tristream *) NULL) &&
+              (b->stream->nodes != NULL);
+  if (streaming) {
+    outvertices = outvertices < TRISTREAMCHUNK ? outvertices : TRISTREAMCHUNK;
+    plist = (REAL *) trimalloc((int) (outvertices * 2 * sizeof(REAL)));
+    palist = (REAL *) NULL;
+    if (m->nextras > 0) {
+      palist = (REAL *) trimalloc((int) (outvertices * m->nextras *
+                                         sizeof(REAL)));
+    }
+    pmlist = (int *) NULL;
+    if (!b->nobound) {
+      pmlist = (int *) trimalloc((int) (outvertices * sizeof(int)));
+    }
+  } else {
+    /* Allocate memory for output vertices if necessary. */
+    if (*pointlist == (REAL *) NULL) {
+      *pointlist = (REAL *) trimalloc((int) (outvertices * 2 * sizeof(REAL)));
+    }
+    /* Allocate memory for output vertex attributes if necessary. */
+    if ((m->nextras > 0) && (*pointattriblist == (REAL *) NULL)) {
+      *pointattriblist = (REAL *) trimalloc((int) (outvertices * m->nextras *
+                                                   sizeof(REAL)));
+    }
+    /* Allocate memory for output vertex markers if necessary. */
+    if (!b->nobound && (*pointmarkerlist == (int *) NULL)) {
+      *pointmarkerlist = (int *) trimalloc((int) (outvertices * sizeof(int)));
+    }
+    plist = *pointlist;
+    palist = *pointattriblist;
+    pmlist = *pointmarkerlist;
   }
-  plist = *pointlist;
-  palist = *pointattriblist;
-  pmlist = *pointmarkerlist;
   coordindex = 0;
   attribindex = 0;
+  chunkfirst = 0;
 #else /* not TRILIBRARY */
   if (!b->quiet) {
     printf("Writing %s.\n", nodefilename);
@@ -14431,7 +14744,8 @@ char **argv;
       }
       if (!b->nobound) {
         /* Copy the boundary marker. */
-        pmlist[vertexnumber - b->firstnumber] = vertexmark(vertexloop);
+        pmlist[vertexnumber - b->firstnumber - chunkfirst] =
+          vertexmark(vertexloop);
       }
 #else /* not TRILIBRARY */
       /* Vertex number, x and y coordinates. */
@@ -14451,11 +14765,36 @@ char **argv;
 
       setvertexmark(vertexloop, vertexnumber);
       vertexnumber++;
+#ifdef TRILIBRARY
+      if (streaming &&
+          (vertexnumber - b->firstnumber - chunkfirst == TRISTREAMCHUNK)) {
+        b->stream->nodes(b->stream->ctx, chunkfirst, TRISTREAMCHUNK,
+                         plist, palist, pmlist);
+        chunkfirst += TRISTREAMCHUNK;
+        coordindex = 0;
+        attribindex = 0;
+      }
+#endif /* TRILIBRARY */
     }
     vertexloop = vertextraverse(m);
   }
 
-#ifndef TRILIBRARY
+#ifdef TRILIBRARY
+  if (streaming) {
+    if (vertexnumber - b->firstnumber > chunkfirst) {
+      b->stream->nodes(b->stream->ctx, chunkfirst,
+                       vertexnumber - b->firstnumber - chunkfirst,
+                       plist, palist, pmlist);
+    }
+    trifree((VOID *) plist);
+    if (palist != (REAL *) NULL) {
+      trifree((VOID *) palist);
+    }
+    if (pmlist != (int *) NULL) {
+      trifree((VOID *) pmlist);
+    }
+  }
+#else /* not TRILIBRARY */
   finishfile(outfile, argc, argv);
 #endif /* not TRILIBRARY */
 }
@@ -14535,6 +14874,9 @@ char **argv;
   REAL *talist;
   int vertexindex;
   int attribindex;
+  int streaming;
+  long outtriangles;
+  long chunkfirst;
 #else /* not TRILIBRARY */
   FILE *outfile;
 #endif /* not TRILIBRARY */
@@ -14548,22 +14890,42 @@ char **argv;
   if (!b->quiet) {
     printf("Writing triangles.\n");
   }
-  /* Allocate memory for output triangles if necessary. */
-  if (*trianglelist == (int *) NULL) {
-    *trianglelist = (int *) trimalloc((int) (m->triangles.items *
-                                             ((b->order + 1) * (b->order + 2) /
-                                              2) * sizeof(int)));
-  }
-  /* Allocate memory for output triangle attributes if necessary. */
-  if ((m->eextras > 0) && (*triangleattriblist == (REAL *) NULL)) {
-    *triangleattriblist = (REAL *) trimalloc((int) (m->triangles.items *
-                                                    m->eextras *
-                                                    sizeof(REAL)));
+  /* When streaming, private arrays hold one chunk of triangles; the */
+  /*   caller's arrays are not touched.                               */
+  streaming = (b->stream != (struct tristream *) NULL) &&
+              (b->stream->triangles != NULL);
+  outtriangles = m->triangles.items;
+  if (streaming) {
+    outtriangles = outtriangles < TRISTREAMCHUNK ? outtriangles :
+                   TRISTREAMCHUNK;
+    tlist = (int *) trimalloc((int) (outtriangles *
+                                     ((b->order + 1) * (b->order + 2) / 2) *
+                                     sizeof(int)));
+    talist = (REAL *) NULL;
+    if (m->eextras > 0) {
+      talist = (REAL *) trimalloc((int) (outtriangles * m->eextras *
+                                         sizeof(REAL)));
+    }
+  } else {
+    /* Allocate memory for output triangles if necessary. */
+    if (*trianglelist == (int *) NULL) {
+      *trianglelist = (int *) trimalloc((int) (outtriangles *
+                                               ((b->order + 1) *
+                                                (b->order + 2) / 2) *
+                                               sizeof(int)));
+    }
+    /* Allocate memory for output triangle attributes if necessary. */
+    if ((m->eextras > 0) && (*triangleattriblist == (REAL *) NULL)) {
+      *triangleattriblist = (REAL *) trimalloc((int) (outtriangles *
+                                                      m->eextras *
+                                                      sizeof(REAL)));
+    }
+    tlist = *trianglelist;
+    talist = *triangleattriblist;
   }
-  tlist = *trianglelist;
-  talist = *triangleattriblist;
   vertexindex = 0;
   attribindex = 0;
+  chunkfirst = 0;
 #else /* not TRILIBRARY */
   if (!b->quiet) {
     printf("Writing %s.\n", elefilename);
@@ -14628,9 +14990,31 @@ char **argv;
 
     triangleloop.tri = triangletraverse(m);
     elementnumber++;
+#ifdef TRILIBRARY
+    if (streaming &&
+        (elementnumber - b->firstnumber - chunkfirst == TRISTREAMCHUNK)) {
+      b->stream->triangles(b->stream->ctx, (int) chunkfirst, TRISTREAMCHUNK,
+                           tlist, talist);
+      chunkfirst += TRISTREAMCHUNK;
+      vertexindex = 0;
+      attribindex = 0;
+    }
+#endif /* TRILIBRARY */
   }
 
-#ifndef TRILIBRARY
+#ifdef TRILIBRARY
+  if (streaming) {
+    if (elementnumber - b->firstnumber > chunkfirst) {
+      b->stream->triangles(b->stream->ctx, (int) chunkfirst,
+                           (int) (elementnumber - b->firstnumber - chunkfirst),
+                           tlist, talist);
+    }
+    trifree((VOID *) tlist);
+    if (talist != (REAL *) NULL) {
+      trifree((VOID *) talist);
+    }
+  }
+#else /* not TRILIBRARY */
   finishfile(outfile, argc, argv);
 #endif /* not TRILIBRARY */
 }
@@ -14821,6 +15205,9 @@ char **argv;
   int *elist;
   int *emlist;
   int index;
+  int streaming;
+  long outedges;
+  long chunkfirst;
 #else /* not TRILIBRARY */
   FILE *outfile;
 #endif /* not TRILIBRARY */
@@ -14835,17 +15222,32 @@ char **argv;
   if (!b->quiet) {
     printf("Writing edges.\n");
   }
-  /* Allocate memory for edges if necessary. */
-  if (*edgelist == (int *) NULL) {
-    *edgelist = (int *) trimalloc((int) (m->edges * 2 * sizeof(int)));
-  }
-  /* Allocate memory for edge markers if necessary. */
-  if (!b->nobound && (*edgemarkerlist == (int *) NULL)) {
-    *edgemarkerlist = (int *) trimalloc((int) (m->edges * sizeof(int)));
+  /* When streaming, private arrays hold one chunk of edges; the caller's */
+  /*   arrays are not touched.                                             */
+  streaming = (b->stream != (struct tristream *) NULL) &&
+              (b->stream->edges != NULL);
+  outedges = m->edges;
+  if (streaming) {
+    outedges = outedges < TRISTREAMCHUNK ? outedges : TRISTREAMCHUNK;
+    elist = (int *) trimalloc((int) (outedges * 2 * sizeof(int)));
+    emlist = (int *) NULL;
+    if (!b->nobound) {
+      emlist = (int *) trimalloc((int) (outedges * sizeof(int)));
+    }
+  } else {
+    /* Allocate memory for edges if necessary. */
+    if (*edgelist == (int *) NULL) {
+      *edgelist = (int *) trimalloc((int) (outedges * 2 * sizeof(int)));
+    }
+    /* Allocate memory for edge markers if necessary. */
+    if (!b->nobound && (*edgemarkerlist == (int *) NULL)) {
+      *edgemarkerlist = (int *) trimalloc((int) (outedges * sizeof(int)));
+    }
+    elist = *edgelist;
+    emlist = *edgemarkerlist;
   }
-  elist = *edgelist;
-  emlist = *edgemarkerlist;
   index = 0;
+  chunkfirst = 0;
 #else /* not TRILIBRARY */
   if (!b->quiet) {
     printf("Writing %s.\n", edgefilename);
@@ -14866,13 +15268,19 @@ char **argv;
   /*   the three edges of each triangle.  If there isn't another triangle  */
   /*   adjacent to the edge, operate on the edge.  If there is another     */
   /*   adjacent triangle, operate on the edge only if the current triangle */
-  /*   has a smaller pointer than its neighbor.  This way, each edge is    */
-  /*   considered only once.                                               */
+  /*   has an apex with a smaller vertex number than its neighbor's apex.  */
+  /*   This way, each edge is considered only once, and (unlike comparing  */
+  /*   triangle pointers) the order of the edges does not depend on where */
+  /*   the memory blocks of the triangle pool happen to lie.               */
   while (triangleloop.tri != (triangle *) NULL) {
     for (triangleloop.orient = 0; triangleloop.orient < 3;
          triangleloop.orient++) {
       sym(triangleloop, trisym);
-      if ((triangleloop.tri < trisym.tri) || (trisym.tri == m->dummytri)) {
+      if (trisym.tri != m->dummytri) {
+        apex(triangleloop, p1);
+        apex(trisym, p2);
+      }
+      if ((trisym.tri == m->dummytri) || (vertexmark(p1) < vertexmark(p2))) {
         org(triangleloop, p1);
         dest(triangleloop, p2);
 #ifdef TRILIBRARY
@@ -14892,14 +15300,15 @@ char **argv;
             tspivot(triangleloop, checkmark);
             if (checkmark.ss == m->dummysub) {
 #ifdef TRILIBRARY
-              emlist[edgenumber - b->firstnumber] = 0;
+              emlist[edgenumber - b->firstnumber - chunkfirst] = 0;
 #else /* not TRILIBRARY */
               fprintf(outfile, "%4ld   %d  %d  %d\n", edgenumber,
                       vertexmark(p1), vertexmark(p2), 0);
 #endif /* not TRILIBRARY */
             } else {
 #ifdef TRILIBRARY
-              emlist[edgenumber - b->firstnumber] = mark(checkmark);
+              emlist[edgenumber - b->firstnumber - chunkfirst] =
+                mark(checkmark);
 #else /* not TRILIBRARY */
               fprintf(outfile, "%4ld   %d  %d  %d\n", edgenumber,
                       vertexmark(p1), vertexmark(p2), mark(checkmark));
@@ -14907,7 +15316,8 @@ char **argv;
             }
           } else {
 #ifdef TRILIBRARY
-            emlist[edgenumber - b->firstnumber] = trisym.tri == m->dummytri;
+            emlist[edgenumber - b->firstnumber - chunkfirst] =
+              trisym.tri == m->dummytri;
 #else /* not TRILIBRARY */
             fprintf(outfile, "%4ld   %d  %d  %d\n", edgenumber,
                     vertexmark(p1), vertexmark(p2), trisym.tri == m->dummytri);
@@ -14915,12 +15325,33 @@ char **argv;
           }
         }
         edgenumber++;
+#ifdef TRILIBRARY
+        if (streaming &&
+            (edgenumber - b->firstnumber - chunkfirst == TRISTREAMCHUNK)) {
+          b->stream->edges(b->stream->ctx, (int) chunkfirst, TRISTREAMCHUNK,
+                           elist, emlist);
+          chunkfirst += TRISTREAMCHUNK;
+          index = 0;
+        }
+#endif /* TRILIBRARY */
       }
     }
     triangleloop.tri = triangletraverse(m);
   }
 
-#ifndef TRILIBRARY
+#ifdef TRILIBRARY
+  if (streaming) {
+    if (edgenumber - b->firstnumber > chunkfirst) {
+      b->stream->edges(b->stream->ctx, (int) chunkfirst,
+                       (int) (edgenumber - b->firstnumber - chunkfirst),
+                       elist, emlist);
+    }
+    trifree((VOID *) elist);
+    if (emlist != (int *) NULL) {
+      trifree((VOID *) emlist);
+    }
+  }
+#else /* not TRILIBRARY */
   finishfile(outfile, argc, argv);
 #endif /* not TRILIBRARY */
 }
@@ -15649,6 +16080,55 @@ struct behavior *b;
   }
 }
 
+#ifdef TRILIBRARY
+
+/*****************************************************************************/
+/*                                                                           */
+/*  getstatistics()   Copy the operation counts and memory use into a       */
+/*                    tristats structure, without printing anything.        */
+/*                                                                           */
+/*  Pool bytes are the high-water mark of items times the item size, the     */
+/*  same estimate statistics() prints as heap memory use.                    */
+/*                                                                           */
+/*****************************************************************************/
+
+#ifdef ANSI_DECLARATORS
+void getstatistics(struct mesh *m, struct tristats *stats)
+#else /* not ANSI_DECLARATORS */
+void getstatistics(m, stats)
+struct mesh *m;
+struct tristats *stats;
+#endif /* not ANSI_DECLARATORS */
+
+{
+  stats->incircle = m->incirclecount;
+  stats->counterclockwise = m->counterclockcount;
+  stats->orient3d = m->orient3dcount;
+  stats->hyperbola = m->hyperbolacount;
+  stats->circumcenter = m->circumcentercount;
+  stats->circletop = m->circletopcount;
+  stats->incircleexact = m->incircleexactcount;
+  stats->counterclockwiseexact = m->counterclockexactcount;
+  stats->orient3dexact = m->orient3dexactcount;
+  stats->locates = m->locatecount;
+  stats->locatesteps = m->locatesteps;
+  stats->maxlocatesteps = m->maxlocatesteps;
+  /* Every vertex beyond the input ones was inserted by Triangle. */
+  stats->steinerpoints = m->vertices.items - m->invertices;
+  stats->vertexbytes = m->vertices.maxitems * m->vertices.itembytes;
+  stats->trianglebytes = m->triangles.maxitems * m->triangles.itembytes;
+  stats->subsegbytes = m->subsegs.maxitems * m->subsegs.itembytes;
+  stats->virusbytes = m->viri.maxitems * m->viri.itembytes;
+  stats->badsubsegbytes = m->badsubsegs.maxitems * m->badsubsegs.itembytes;
+  stats->badtrianglebytes = m->badtriangles.maxitems *
+                            m->badtriangles.itembytes;
+  stats->flipstackerbytes = m->flipstackers.maxitems *
+                            m->flipstackers.itembytes;
+  stats->splaynodebytes = m->splaynodes.maxitems * m->splaynodes.itembytes;
+}
+
+#endif /* TRILIBRARY */
+
 /*****************************************************************************/
 /*                                                                           */
 /*  main() or triangulate()   Gosh, do everything.                           */
@@ -15676,15 +16156,47 @@ struct behavior *b;
 
 #ifdef TRILIBRARY
 
+/*  triangulate() is triangulatestream() without streaming sinks.            */
+
+#ifdef ANSI_DECLARATORS
+int triangulate(char *triswitches, struct triangulateio *in,
+                struct triangulateio *out, struct triangulateio *vorout)
+#else /* not ANSI_DECLARATORS */
+int triangulate(triswitches, in, out, vorout)
+char *triswitches;
+struct triangulateio *in;
+struct triangulateio *out;
+struct triangulateio *vorout;
+#endif /* not ANSI_DECLARATORS */
+
+{
+  return triangulatestream(triswitches, in, out, vorout,
+                           (struct tristream *) NULL);
+}
+
+/*  triangulatestream() hands the vertices, triangles, and edges to the      */
+/*  non-NULL sinks in `stream', TRISTREAMCHUNK at a time, instead of         */
+/*  returning them in `out'.  The corresponding `out' arrays are neither     */
+/*  read nor written, so they keep whatever the caller put there (normally   */
+/*  NULL; preallocated arrays stay the caller's to free).  The counts in     */
+/*  `out' are set as usual, and handed to `begin' first.                     */
+/*                                                                           */
+/*  Returns zero on success.  On an error (bad input, an internal error, or  */
+/*  running out of memory) it returns the nonzero status Triangle would have */
+/*  exited with, after freeing all its memory (including any output arrays   */
+/*  it allocated) and restoring `out' and `vorout' to their values on entry. */
+
 #ifdef ANSI_DECLARATORS
-void triangulate(char *triswitches, struct triangulateio *in,
-                 struct triangulateio *out, struct triangulateio *vorout)
+int triangulatestream(char *triswitches, struct triangulateio *in,
+                      struct triangulateio *out, struct triangulateio *vorout,
+                      struct tristream *stream)
 #else /* not ANSI_DECLARATORS */
-void triangulate(triswitches, in, out, vorout)
+int triangulatestream(triswitches, in, out, vorout, stream)
 char *triswitches;
 struct triangulateio *in;
 struct triangulateio *out;
 struct triangulateio *vorout;
+struct tristream *stream;
 #endif /* not ANSI_DECLARATORS */
 
 #else /* not TRILIBRARY */
@@ -15704,7 +16216,12 @@ char **argv;
   struct behavior b;
   REAL *holearray;                                        /* Array of holes. */
   REAL *regionarray;   /* Array of regional attributes and area constraints. */
-#ifndef TRILIBRARY
+#ifdef TRILIBRARY
+  struct triangulateio outentry, voroutentry;      /* Restored on an error. */
+  jmp_buf recovery;
+  int status;
+  struct timespec now;
+#else /* not TRILIBRARY */
   FILE *polyfile;
 #endif /* not TRILIBRARY */
 #ifndef NO_TIMER
@@ -15718,9 +16235,44 @@ char **argv;
   gettimeofday(&tv0, &tz);
 #endif /* not NO_TIMER */
 
+#ifdef TRILIBRARY
+  outentry = *out;
+  if (vorout != (struct triangulateio *) NULL) {
+    voroutentry = *vorout;
+  }
+  if (setjmp(recovery) != 0) {
+    /* triexit() was called.  Free the memory pools and everything else. */
+    status = recovery_abort();
+    *out = outentry;
+    if (vorout != (struct triangulateio *) NULL) {
+      *vorout = voroutentry;
+    }
+    return status;
+  }
+  if (recovery_push(&recovery) != 0) {
+    return EXIT_FAILURE;          /* Nothing is allocated yet; `out' is intact. */
+  }
+#endif /* TRILIBRARY */
+
   triangleinit(&m);
 #ifdef TRILIBRARY
   parsecommandline(1, &triswitches, &b);
+  b.stream = stream;
+  b.timings = (struct tritimings *) NULL;
+  b.budgetcount = 0l;
+  if (stream != (struct tristream *) NULL) {
+    b.timings = stream->timings;
+    stream->stopped = 0;
+    if (stream->timelimit > 0.0) {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      b.deadline = (REAL) now.tv_sec + 1e-9 * (REAL) now.tv_nsec +
+                   stream->timelimit;
+    }
+  }
+  if (b.timings != (struct tritimings *) NULL) {
+    memset(b.timings, 0, sizeof(struct tritimings));
+  }
+  tristamp(&b, (REAL *) NULL, (char *) NULL);
 #else /* not TRILIBRARY */
   parsecommandline(argc, argv, &b);
 #endif /* not TRILIBRARY */
@@ -15730,6 +16282,7 @@ char **argv;
   transfernodes(&m, &b, in->pointlist, in->pointattributelist,
                 in->pointmarkerlist, in->numberofpoints,
                 in->numberofpointattributes);
+  tristamp(&b, triphase(&b, input), "triangle.input");
 #else /* not TRILIBRARY */
   readnodes(&m, &b, b.innodefilename, b.inpolyfilename, &polyfile);
 #endif /* not TRILIBRARY */
@@ -15760,6 +16313,9 @@ char **argv;
     m.hullsize = delaunay(&m, &b);              /* Triangulate the vertices. */
   }
 #endif /* not CDT_ONLY */
+#ifdef TRILIBRARY
+  tristamp(&b, triphase(&b, delaunay), "triangle.delaunay");
+#endif /* TRILIBRARY */
 
 #ifndef NO_TIMER
   if (!b.quiet) {
@@ -15792,6 +16348,9 @@ char **argv;
 #endif /* not TRILIBRARY */
     }
   }
+#ifdef TRILIBRARY
+  tristamp(&b, triphase(&b, segments), "triangle.segments");
+#endif /* TRILIBRARY */
 
 #ifndef NO_TIMER
   if (!b.quiet) {
@@ -15825,6 +16384,9 @@ char **argv;
     m.holes = 0;
     m.regions = 0;
   }
+#ifdef TRILIBRARY
+  tristamp(&b, triphase(&b, holes), "triangle.holes");
+#endif /* TRILIBRARY */
 
 #ifndef NO_TIMER
   if (!b.quiet) {
@@ -15841,6 +16403,9 @@ char **argv;
     enforcequality(&m, &b);           /* Enforce angle and area constraints. */
   }
 #endif /* not CDT_ONLY */
+#ifdef TRILIBRARY
+  tristamp(&b, triphase(&b, quality), "triangle.quality");
+#endif /* TRILIBRARY */
 
 #ifndef NO_TIMER
   if (!b.quiet) {
@@ -15864,6 +16429,9 @@ char **argv;
   if (!b.quiet) {
     printf("\n");
   }
+#ifdef TRILIBRARY
+  tristamp(&b, triphase(&b, other), "triangle.other");
+#endif /* TRILIBRARY */
 
 #ifdef TRILIBRARY
   if (b.jettison) {
@@ -15886,6 +16454,10 @@ char **argv;
     vorout->numberofpointattributes = m.nextras;
     vorout->numberofedges = m.edges;
   }
+  if ((stream != (struct tristream *) NULL) && (stream->begin != NULL)) {
+    stream->begin(stream->ctx, out->numberofpoints, out->numberoftriangles,
+                  out->numberofedges);
+  }
 #endif /* TRILIBRARY */
   /* If not using iteration numbers, don't write a .node file if one was */
   /*   read, because the original one would be overwritten!              */
@@ -15907,6 +16479,9 @@ char **argv;
     writenodes(&m, &b, b.outnodefilename, argc, argv);
 #endif /* TRILIBRARY */
   }
+#ifdef TRILIBRARY
+  tristamp(&b, triphase(&b, writenodes), "triangle.writenodes");
+#endif /* TRILIBRARY */
   if (b.noelewritten) {
     if (!b.quiet) {
 #ifdef TRILIBRARY
@@ -15922,6 +16497,9 @@ char **argv;
     writeelements(&m, &b, b.outelefilename, argc, argv);
 #endif /* not TRILIBRARY */
   }
+#ifdef TRILIBRARY
+  tristamp(&b, triphase(&b, writeelements), "triangle.writeelements");
+#endif /* TRILIBRARY */
   /* The -c switch (convex switch) causes a PSLG to be written */
   /*   even if none was read.                                  */
   if (b.poly || b.convex) {
@@ -15952,6 +16530,9 @@ char **argv;
 #endif /* not TRILIBRARY */
     }
   }
+#ifdef TRILIBRARY
+  tristamp(&b, triphase(&b, writepoly), "triangle.writepoly");
+#endif /* TRILIBRARY */
 #ifndef TRILIBRARY
 #ifndef CDT_ONLY
   if (m.regions > 0) {
@@ -15972,6 +16553,9 @@ char **argv;
     writeedges(&m, &b, b.edgefilename, argc, argv);
 #endif /* not TRILIBRARY */
   }
+#ifdef TRILIBRARY
+  tristamp(&b, triphase(&b, writeedges), "triangle.writeedges");
+#endif /* TRILIBRARY */
   if (b.voronoi) {
 #ifdef TRILIBRARY
     writevoronoi(&m, &b, &vorout->pointlist, &vorout->pointattributelist,
@@ -15988,6 +16572,9 @@ char **argv;
     writeneighbors(&m, &b, b.neighborfilename, argc, argv);
 #endif /* not TRILIBRARY */
   }
+#ifdef TRILIBRARY
+  tristamp(&b, triphase(&b, other), "triangle.other");
+#endif /* TRILIBRARY */
 
   if (!b.quiet) {
 #ifndef NO_TIMER
@@ -16010,8 +16597,16 @@ char **argv;
   }
 #endif /* not REDUCED */
 
+#ifdef TRILIBRARY
+  if ((stream != (struct tristream *) NULL) &&
+      (stream->stats != (struct tristats *) NULL)) {
+    getstatistics(&m, stream->stats);
+  }
+#endif /* TRILIBRARY */
   triangledeinit(&m, &b);
-#ifndef TRILIBRARY
+#ifdef TRILIBRARY
+  /* Whatever Triangle returns in `out' now belongs to the caller. */
+  recovery_pop();
+#endif /* TRILIBRARY */
   return 0;
-#endif /* not TRILIBRARY */
 }
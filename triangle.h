@@ -53,7 +53,7 @@
 /*                                                                           */
 /*  The calling convention for triangulate() follows.                        */
 /*                                                                           */
-/*      void triangulate(triswitches, in, out, vorout)                       */
+/*      int triangulate(triswitches, in, out, vorout)                        */
 /*      char *triswitches;                                                   */
 /*      struct triangulateio *in;                                            */
 /*      struct triangulateio *out;                                           */
@@ -85,6 +85,11 @@
 /*  and the Voronoi output.  If the `v' (Voronoi output) switch is not used, */
 /*  `vorout' may be NULL.  `in' and `out' may never be NULL.                 */
 /*                                                                           */
+/*  triangulate() returns zero on success.  On an error it prints a message, */
+/*  frees everything it allocated, leaves `out' and `vorout' as they were,   */
+/*  and returns the nonzero status that the standalone program would have    */
+/*  exited with.                                                             */
+/*                                                                           */
 /*  Certain fields of the input and output structures must be initialized,   */
 /*  as described below.                                                      */
 /*                                                                           */
@@ -173,10 +178,10 @@
 /*                                                                           */
 /*  Triangle will not free() any input or output arrays, including those it  */
 /*  allocates itself; that's up to you.  You should free arrays allocated by */
-/*  Triangle by calling the trifree() procedure defined below.  (By default, */
-/*  trifree() just calls the standard free() library procedure, but          */
-/*  applications that call triangulate() may replace trimalloc() and         */
-/*  trifree() in triangle.c to use specialized memory allocators.)           */
+/*  Triangle by calling the trifree() procedure defined below.  (trimalloc() */
+/*  and trifree() go through the calling thread's allocator, set with        */
+/*  set_allocator() in xmalloc.h; by default that is the standard malloc()   */
+/*  and free() library procedures.)                                          */
 /*                                                                           */
 /*  Here's a guide to help you decide which fields you must initialize       */
 /*  before you call triangulate().                                           */
@@ -299,12 +304,111 @@ struct triangulateio {
   int numberofedges;                                             /* Out only */
 };
 
+/* Streaming output for triangulatestream().  Each non-NULL sink receives   */
+/*   the vertices, triangles, or edges in output order, at most             */
+/*   TRISTREAMCHUNK items per call, so no array of the whole mesh is built. */
+/*   `first' is the index of the first item of the chunk, counting from 0;  */
+/*   the vertex numbers in `corners' and `endpoints' follow the -z switch.  */
+/*   `attribs' and `markers' are NULL when there are none.  The buffers are */
+/*   reused, so a sink must copy anything it keeps.  `begin', if not NULL,  */
+/*   is called once before any sink with the number of vertices, triangles, */
+/*   and edges that will follow, so the arrays can be sized up front.       */
+/*   The `out' arrays of a streamed kind are neither read nor written; a    */
+/*   preallocated array stays the caller's to free.                         */
+
+#define TRISTREAMCHUNK 4096
+
+/* Wall-clock seconds (monotonic clock) spent in each phase of one call to  */
+/*   triangulatestream(), filled in when `timings' in struct tristream is   */
+/*   not NULL.  Nothing is printed.                                         */
+
+struct tritimings {
+  REAL input;                                             /* transfernodes() */
+  REAL delaunay;                              /* delaunay() or reconstruct() */
+  REAL segments;                                           /* formskeleton() */
+  REAL holes;                                                /* carveholes() */
+  REAL quality;                                          /* enforcequality() */
+  REAL writenodes;
+  REAL writeelements;
+  REAL writepoly;
+  REAL writeedges;
+  REAL other;                /* Edge count, higher order, Voronoi, neighbors */
+};
+
+/* Operation counts and memory use of one call to triangulatestream(),      */
+/*   filled in when `stats' in struct tristream is not NULL.  The exact     */
+/*   counts are the predicate calls whose floating-point filter failed.     */
+
+struct tristats {
+  long incircle;                                    /* Operations performed. */
+  long counterclockwise;
+  long orient3d;
+  long hyperbola;
+  long circumcenter;
+  long circletop;
+  long incircleexact;                             /* Calls that fell back to */
+  long counterclockwiseexact;                           /* exact arithmetic. */
+  long orient3dexact;
+  long locates;                                    /* preciselocate() calls, */
+  long locatesteps;                                    /* triangles visited, */
+  long maxlocatesteps;                              /* and the longest walk. */
+  long steinerpoints;                        /* Vertices added to the input. */
+  long vertexbytes;                              /* Peak bytes of each pool. */
+  long trianglebytes;
+  long subsegbytes;
+  long virusbytes;
+  long badsubsegbytes;
+  long badtrianglebytes;
+  long flipstackerbytes;
+  long splaynodebytes;
+};
+
+/* Predicates and adaptive stages for tripredicates().                       */
+
+#define TRIORIENT2D 0                                  /* counterclockwise() */
+#define TRIINCIRCLE 1                                          /* incircle() */
+#define TRIORIENT3D 2                                          /* orient3d() */
+#define TRISTAGES 4               /* Floating-point filter, then stages B-D. */
+
+/* Refinement budget, in struct tristream.  Every TRIBUDGETSTEP steps of     */
+/*   refinement (a segment split or a bad triangle tried), `progress'        */
+/*   (unless NULL) is called with the number of Steiner points so far and    */
+/*   the number of bad triangles still queued; a nonzero return stops the    */
+/*   refinement, and so does passing `timelimit' seconds (if positive) since */
+/*   the call began.  The mesh is then valid but not fully refined, and      */
+/*   `stopped' is set, as it also is when the -S limit on Steiner points     */
+/*   runs out early.                                                         */
+
+#define TRIBUDGETSTEP 64
+
+struct tristream {
+  void (*begin)(void *ctx, int vertices, int triangles, int edges);
+  void (*nodes)(void *ctx, int first, int count, REAL *xy, REAL *attribs,
+                int *markers);
+  void (*triangles)(void *ctx, int first, int count, int *corners,
+                    REAL *attribs);
+  void (*edges)(void *ctx, int first, int count, int *endpoints,
+                int *markers);
+  void *ctx;                                    /* Passed to every callback. */
+  struct tritimings *timings;                                /* May be NULL. */
+  struct tristats *stats;                                    /* May be NULL. */
+  int (*progress)(void *ctx, long steinerpoints, long badtriangles);
+  REAL timelimit;                             /* Seconds; zero for no limit. */
+  int stopped;                                                  /* Out only. */
+};
+
 #ifdef ANSI_DECLARATORS
-void triangulate(char *, struct triangulateio *, struct triangulateio *,
-                 struct triangulateio *);
+int triangulate(char *, struct triangulateio *, struct triangulateio *,
+                struct triangulateio *);
+int triangulatestream(char *, struct triangulateio *, struct triangulateio *,
+                      struct triangulateio *, struct tristream *);
+void tripredicates(int kind, int count, REAL *points, REAL *results,
+                   long *stages);
 void trifree(VOID *memptr);
 #else /* not ANSI_DECLARATORS */
-void triangulate();
+int triangulate();
+int triangulatestream();
+void tripredicates();
 void trifree();
 #endif /* not ANSI_DECLARATORS */
 
@@ -1,12 +1,366 @@
 #include "xmalloc.h"
 #include <stdio.h>
+#include <stdint.h>
+
+#define RECOVERY_DEPTH 8    // 恢复点最多嵌套的层数
+
+static void *libc_alloc(void *ctx, size_t size) {
+    (void)ctx;
+    return malloc(size);
+}
+
+static void *libc_realloc(void *ctx, void *ptr, size_t size) {
+    (void)ctx;
+    return realloc(ptr, size);
+}
+
+static void libc_free(void *ctx, void *ptr) {
+    (void)ctx;
+    free(ptr);
+}
+
+static struct allocator libc_allocator = {
+    libc_alloc, libc_realloc, libc_free, NULL
+};
+
+static _Thread_local struct allocator *current = &libc_allocator;
+static _Thread_local const char *site_file;
+static _Thread_local int site_line;
+
+/*
+ * 恢复点的栈
+ *  nodes 是按分配的先后串起来的双向循环链表, nodes[0] 是表头, 记下最外层恢复点
+ *  设置以来分配而还没有释放的内存; 每个恢复点在链表里有一个 ptr 为 NULL 的标记
+ *  结点 marks[i], 第 i 层恢复点拥有它后面的结点.
+ *  slots 是以内存地址为键, 线性探测的哈希表, 存结点的下标(0 表示空), 释放时
+ *  找到并摘下一块只要 O(1). 这些表用 libc 分配, 不经过当前的分配器.
+ *  每块还记下分配它的分配器, recovery_abort 用它释放, 与那时的当前分配器无关.
+ */
+struct block{
+    void *ptr;
+    struct allocator *allocator;
+    size_t prev, next;
+};
+
+static _Thread_local jmp_buf *jumps[RECOVERY_DEPTH];
+static _Thread_local size_t marks[RECOVERY_DEPTH];
+static _Thread_local int depth;
+static _Thread_local int fail_status;
+static _Thread_local struct block *nodes;
+static _Thread_local size_t node_num, node_max;    // 用过的结点数(含表头)
+static _Thread_local size_t free_node;             // 空闲结点链, 0 表示没有
+static _Thread_local size_t *slots;
+static _Thread_local size_t slot_num, slot_max;    // slot_max 是 2 的幂
+
+struct allocator *get_allocator(void) {
+    return current;
+}
+
+struct allocator *set_allocator(struct allocator *allocator) {
+    struct allocator *old = current;
+    current = allocator != NULL ? allocator : &libc_allocator;
+    return old;
+}
+
+// 当前线程正在进行的分配的调用点
+void alloc_site(const char **file, int *line) {
+    *file = site_file;
+    *line = site_line;
+}
+
+static size_t slot_of(void *ptr) {
+    uint64_t h = (uint64_t)(uintptr_t)ptr;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdu;      // MurmurHash3 的 fmix64
+    h ^= h >> 33;
+    return (size_t)h & (slot_max - 1);
+}
+
+// ptr 所在的槽, 不在表中时是它该放的空槽
+static size_t find_slot(void *ptr) {
+    size_t i = slot_of(ptr);
+
+    while (slots[i] != 0 && nodes[slots[i]].ptr != ptr)
+        i = (i + 1) & (slot_max - 1);
+    return i;
+}
+
+// 清空槽 i, 把后面探测链上的项往前移, 保持线性探测的不变式
+static void clear_slot(size_t i) {
+    size_t j = i, k;
+
+    slots[i] = 0;
+    slot_num--;
+    for (;;) {
+        j = (j + 1) & (slot_max - 1);
+        if (slots[j] == 0)
+            return;
+        k = slot_of(nodes[slots[j]].ptr);
+        if (i < j ? (k <= i || k > j) : (k <= i && k > j)) {
+            slots[i] = slots[j];
+            slots[j] = 0;
+            i = j;
+        }
+    }
+}
+
+// 保证还能再记下一块: 有空闲结点, 哈希表的负载不超过一半
+static int reserve_block(void) {
+    if (free_node == 0 && node_num == node_max) {
+        size_t max = node_max > 0 ? 2 * node_max : 256;
+        struct block *p = realloc(nodes, max * sizeof *p);
+        if (p == NULL)
+            return 0;
+        nodes = p;
+        node_max = max;
+    }
+    if (2 * (slot_num + 1) > slot_max) {
+        size_t max = slot_max > 0 ? 2 * slot_max : 512;
+        size_t *old = slots, old_max = slot_max;
+        if ((slots = calloc(max, sizeof *slots)) == NULL) {
+            slots = old;
+            return 0;
+        }
+        slot_max = max;
+        for (size_t i = 0; i < old_max; i++)
+            if (old[i] != 0)
+                slots[find_slot(nodes[old[i]].ptr)] = old[i];
+        free(old);
+    }
+    return 1;
+}
+
+// 在链表尾部加一个结点, 事先要 reserve_block
+static size_t append_node(void *ptr, struct allocator *allocator) {
+    size_t n;
+
+    if (free_node != 0) {
+        n = free_node;
+        free_node = nodes[n].next;
+    }else{
+        n = node_num++;
+    }
+    nodes[n].ptr = ptr;
+    nodes[n].allocator = allocator;
+    nodes[n].prev = nodes[0].prev;
+    nodes[n].next = 0;
+    nodes[nodes[0].prev].next = n;
+    nodes[0].prev = n;
+    return n;
+}
+
+static void remove_node(size_t n) {
+    nodes[nodes[n].prev].next = nodes[n].next;
+    nodes[nodes[n].next].prev = nodes[n].prev;
+    nodes[n].next = free_node;
+    free_node = n;
+}
+
+// 记下由 allocator 分配的 ptr, 它归最内层的恢复点所有
+static void track_block(void *ptr, struct allocator *allocator) {
+    slots[find_slot(ptr)] = append_node(ptr, allocator);
+    slot_num++;
+}
+
+// 块从 ptr 搬到了 p, 仍归原来的恢复点所有; ptr 不在表中时什么也不做
+static void move_block(void *ptr, void *p) {
+    size_t i = find_slot(ptr), n = slots[i];
+
+    if (n == 0)
+        return;
+    clear_slot(i);
+    nodes[n].ptr = p;
+    slots[find_slot(p)] = n;
+    slot_num++;
+}
+
+// 不再记下 ptr; ptr 不在表中(在最外层恢复点之前或别的线程分配的)时返回 0
+static int forget_block(void *ptr) {
+    size_t i = find_slot(ptr);
+
+    if (slots[i] == 0)
+        return 0;
+    remove_node(slots[i]);
+    clear_slot(i);
+    return 1;
+}
+
+void *malloc_or_null(size_t size, const char *file, int line) {
+    void *ptr;
+
+    if (depth > 0 && !reserve_block())
+        return NULL;
+    site_file = file;
+    site_line = line;
+    ptr = current->alloc(current->ctx, size);
+    if (ptr != NULL && depth > 0)
+        track_block(ptr, current);
+    return ptr;
+}
 
 void *malloc_or_exit(size_t size, const char *file, int line) {
-    void *ptr = malloc(size);
+    void *ptr = malloc_or_null(size, file, line);
     if (!ptr) {
         fprintf(stderr, "%s:%d: malloc(%zu) failed\n", file, line, size);
-        exit(EXIT_FAILURE);
+        fail_or_exit(EXIT_FAILURE);
     }else{
         return ptr;
     }
-}
\ No newline at end of file
+}
+
+void *realloc_or_exit(void *ptr, size_t size, const char *file, int line) {
+    void *p = NULL;
+
+    site_file = file;
+    site_line = line;
+    if (depth == 0 || reserve_block())
+        p = current->realloc(current->ctx, ptr, size);
+    if (!p) {
+        fprintf(stderr, "%s:%d: realloc(%zu) failed\n", file, line, size);
+        fail_or_exit(EXIT_FAILURE);
+    }
+    // 在恢复点之前分配的内存仍归调用者所有, 换了地址也不记下
+    if (depth > 0) {
+        if (ptr == NULL)
+            track_block(p, current);
+        else
+            move_block(ptr, p);
+    }
+    return p;
+}
+
+void xfree(void *ptr) {
+    if (ptr != NULL) {
+        if (depth > 0)
+            forget_block(ptr);
+        current->free(current->ctx, ptr);
+    }
+}
+
+// 没有恢复点了, 释放记录用的表
+static void recovery_reset(void) {
+    free(nodes);
+    free(slots);
+    nodes = NULL;
+    slots = NULL;
+    node_num = node_max = free_node = 0;
+    slot_num = slot_max = 0;
+}
+
+/**
+ * @name recovery_push - 设置当前线程的恢复点
+ * @param 1.jump 已经 setjmp 的位置, 在 recovery_pop 或 recovery_abort 之前要一直有效
+ * @return 成功返回 0; 嵌套超过 RECOVERY_DEPTH 层或记录用的表分配失败时打印错误,
+ * 	返回 -1, 这时没有设置恢复点, 不能再调用 recovery_pop 或 recovery_abort
+*/
+int recovery_push(jmp_buf *jump) {
+    if (depth == RECOVERY_DEPTH) {
+        fprintf(stderr, "%s:%d: too many recovery points\n", __FILE__, __LINE__);
+        return -1;
+    }
+    if (node_num == 0) {
+        if (!reserve_block()) {
+            fprintf(stderr, "%s:%d: malloc failed\n", __FILE__, __LINE__);
+            return -1;
+        }
+        nodes[0].prev = nodes[0].next = 0;
+        node_num = 1;
+    }
+    if (!reserve_block()) {
+        fprintf(stderr, "%s:%d: malloc failed\n", __FILE__, __LINE__);
+        if (depth == 0)
+            recovery_reset();
+        return -1;
+    }
+    jumps[depth] = jump;
+    marks[depth] = append_node(NULL, NULL);
+    depth++;
+    return 0;
+}
+
+// 正常结束: 去掉最内层的恢复点, 它记下的内存交给外层
+void recovery_pop(void) {
+    remove_node(marks[--depth]);
+    if (depth == 0)
+        recovery_reset();
+}
+
+/**
+ * @name recovery_abort - 出错后释放最内层恢复点记下的内存并去掉这个恢复点
+ * @return 传给 fail_or_exit 的状态
+ * @note 只能在 longjmp 回来之后调用; 后分配的先释放, 每块都交给分配它的分配器
+*/
+int recovery_abort(void) {
+    size_t n;
+
+    while ((n = nodes[0].prev) != marks[depth - 1]) {
+        void *ptr = nodes[n].ptr;
+        struct allocator *allocator = nodes[n].allocator;
+        forget_block(ptr);
+        allocator->free(allocator->ctx, ptr);
+    }
+    recovery_pop();
+    return fail_status;
+}
+
+/**
+ * @name recovery_export - 正常结束时去掉最内层的恢复点, 把它记下的内存交给调用者
+ * @param 1.num 返回块数
+ * @return 这些块的地址和分配器, 用 libc 的 free 释放; 没有块或分配失败时为 NULL
+ * @note 用于把工作线程的内存交给另一个线程的恢复点(见 recovery_adopt)
+*/
+struct recovery_block *recovery_export(size_t *num) {
+    struct recovery_block *blocks = NULL;
+    size_t k = 0, n;
+
+    for (n = nodes[marks[depth - 1]].next; n != 0; n = nodes[n].next)
+        k++;
+    if (k > 0 && (blocks = malloc(k * sizeof *blocks)) != NULL) {
+        k = 0;
+        for (n = nodes[marks[depth - 1]].next; n != 0; n = nodes[n].next) {
+            blocks[k].ptr = nodes[n].ptr;
+            blocks[k++].allocator = nodes[n].allocator;
+        }
+    }
+    *num = blocks != NULL ? k : 0;
+    while (nodes[0].prev != marks[depth - 1])
+        forget_block(nodes[nodes[0].prev].ptr);
+    recovery_pop();
+    return blocks;
+}
+
+// 由最内层的恢复点接管别的线程分配的块; 没有恢复点时什么也不做
+void recovery_adopt(const struct recovery_block *block) {
+    if (depth > 0 && block->ptr != NULL) {
+        if (!reserve_block()) {
+            fprintf(stderr, "%s:%d: malloc failed\n", __FILE__, __LINE__);
+            fail_or_exit(EXIT_FAILURE);
+        }
+        track_block(block->ptr, block->allocator);
+    }
+}
+
+// ptr 不再归任何恢复点所有, 出错时也不释放
+void recovery_detach(void *ptr) {
+    if (depth > 0 && ptr != NULL)
+        forget_block(ptr);
+}
+
+// 当前线程恢复点的层数, 0 表示出错时直接退出进程
+int recovery_depth(void) {
+    return depth;
+}
+
+/**
+ * @name fail_or_exit - 报告错误
+ * @param 1.status 退出状态
+ * @note 有恢复点时 longjmp 到最内层的恢复点(状态 0 按 EXIT_FAILURE 处理), 否则退出进程
+*/
+_Noreturn void fail_or_exit(int status) {
+    if (depth > 0) {
+        fail_status = status != 0 ? status : EXIT_FAILURE;
+        longjmp(*jumps[depth - 1], 1);
+    }
+    exit(status);
+}
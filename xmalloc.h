@@ -2,9 +2,77 @@
 #define XMALLOC_H
 
 #include <stdlib.h>
-// 本文件依赖 malloc 函数
+#include <setjmp.h>
+
+/*
+ * 可替换的内存分配器
+ *  xmalloc, xrealloc, xfree 以及 Triangle 的 trimalloc, trifree 都经过当前线程
+ *  的分配器; 缺省是 libc 的 malloc/realloc/free.
+ *  分配失败时 alloc 和 realloc 返回 NULL. free(ctx, NULL) 不会被调用.
+ *  parallel_for 的工作线程沿用调用者的分配器, 因此分配器要能被多个线程同时调用.
+ *  同一块内存必须在同一个分配器下分配和释放.
+ *  分配器可以用 alloc_site 得到这次分配的调用点(__FILE__, __LINE__).
+ */
+struct allocator{
+    void *(*alloc)(void *ctx, size_t size);
+    void *(*realloc)(void *ctx, void *ptr, size_t size);
+    void (*free)(void *ctx, void *ptr);
+    void *ctx;
+};
+
+struct allocator *get_allocator(void);
+// 设置当前线程的分配器, NULL 表示恢复 libc; 返回原来的分配器
+struct allocator *set_allocator(struct allocator *allocator);
+
+void alloc_site(const char **file, int *line);
+
 void *malloc_or_exit(size_t size, const char *file, int line);
+void *malloc_or_null(size_t size, const char *file, int line);
+void *realloc_or_exit(void *ptr, size_t size, const char *file, int line);
+void xfree(void *ptr);
+
+/*
+ * 可恢复的错误
+ *  recovery_push 设置当前线程的恢复点之后, malloc_or_exit, realloc_or_exit
+ *  失败以及 Triangle 出错(triexit)时不再退出进程, 而是由 fail_or_exit longjmp
+ *  回最内层的恢复点; 调用者在那里用 recovery_abort 释放这个恢复点设置以来
+ *  经过 xmalloc, xrealloc, trimalloc 分配而还没有释放的内存, 然后返回错误.
+ *  正常结束时调用 recovery_pop, 这些内存改归外层的恢复点.
+ *  要比恢复点活得长的内存(比如放进缓存的)用 recovery_detach 摘出来.
+ *  每个线程只记录自己的分配, 因此恢复点里的内存要在分配它的线程释放.
+ *  parallel_for 在调用者有恢复点时给每个工作线程也设置恢复点, 工作线程出错后
+ *  等所有线程结束, 再把错误交给调用者的恢复点; 工作线程留下的内存由
+ *  recovery_export, recovery_adopt 转给调用者的恢复点.
+ *  出错时每块内存由分配它的分配器释放, 所以恢复点里可以切换分配器.
+ *  recovery_push 失败(嵌套太深或内存不足)时返回 -1, 调用者直接返回错误.
+ *
+ * 用法:
+ *     jmp_buf jump;
+ *     if (setjmp(jump) != 0) {
+ *         recovery_abort();
+ *         return NULL;
+ *     }
+ *     if (recovery_push(&jump) != 0)
+ *         return NULL;
+ *     ...
+ *     recovery_pop();
+ */
+// recovery_export 交出的一块内存和分配它的分配器
+struct recovery_block{
+    void *ptr;
+    struct allocator *allocator;
+};
+
+int recovery_push(jmp_buf *jump);
+void recovery_pop(void);
+int recovery_abort(void);
+void recovery_detach(void *ptr);
+struct recovery_block *recovery_export(size_t *num);
+void recovery_adopt(const struct recovery_block *block);
+int recovery_depth(void);
+_Noreturn void fail_or_exit(int status);
 
 #define xmalloc(size) malloc_or_exit((size), __FILE__, __LINE__)
+#define xrealloc(ptr, size) realloc_or_exit((ptr), (size), __FILE__, __LINE__)
 
 #endif
\ No newline at end of file